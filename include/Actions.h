@@ -0,0 +1,110 @@
+#ifndef ACTIONS_H
+#define ACTIONS_H
+
+#include <ArduinoJson.h>
+#include "ReplyOutput.h"
+
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+
+// Change the seed if the static_assert in Actions.cpp reports a collision
+#define ACTION_HASH_SEED 14u
+#define ACTION_SLOTS 32
+
+#define ACTION_SCHEMA_NONE "null"
+#define ACTION_FIELD_TRANSITION "\"transition\":{\"type\":\"integer\",\"value\":\"[0,60000]\",\"optional\":true}"
+#define ACTION_FIELD_ZONES \
+    "\"zone\":{\"type\":\"integer\",\"value\":\"[0,5]\",\"optional\":true}," \
+    "\"zones\":{\"type\":\"integer\",\"value\":\"[1,255]\",\"optional\":true}"
+// Controller time in ms, see ClockSync.h
+#define ACTION_FIELD_APPLY_AT "\"applyAt\":{\"type\":\"integer\",\"optional\":true}"
+#define ACTION_FIELDS_LIGHT ACTION_FIELD_ZONES "," ACTION_FIELD_APPLY_AT
+#define ACTION_SCHEMA_PING \
+    "{\"t\":{\"type\":\"integer\",\"optional\":true}," \
+    "\"rtt\":{\"type\":\"integer\",\"optional\":true}}"
+#define ACTION_SCHEMA_TRANSITION "{" ACTION_FIELD_TRANSITION "," ACTION_FIELDS_LIGHT "}"
+// red, green and blue, or kelvin, or hue and saturation, brightness scales the last two
+#define ACTION_SCHEMA_COLOR \
+    "{\"red\":{\"type\":\"integer\",\"value\":\"[0,255]\",\"optional\":true}," \
+    "\"green\":{\"type\":\"integer\",\"value\":\"[0,255]\",\"optional\":true}," \
+    "\"blue\":{\"type\":\"integer\",\"value\":\"[0,255]\",\"optional\":true}," \
+    "\"kelvin\":{\"type\":\"integer\",\"value\":\"[1000,10000]\",\"optional\":true}," \
+    "\"hue\":{\"type\":\"integer\",\"value\":\"[0,359]\",\"optional\":true}," \
+    "\"saturation\":{\"type\":\"integer\",\"value\":\"[0,255]\",\"optional\":true}," \
+    "\"brightness\":{\"type\":\"integer\",\"value\":\"[0,255]\",\"optional\":true}," \
+    ACTION_FIELD_TRANSITION "," ACTION_FIELDS_LIGHT "}"
+
+#define ACTION_SCHEMA_EFFECT \
+    "{\"effect\":{\"type\":\"string\",\"value\":\"[breathe,rainbow,strobe,candle]\"}," \
+    "\"red\":{\"type\":\"integer\",\"value\":\"[0,255]\",\"optional\":true}," \
+    "\"green\":{\"type\":\"integer\",\"value\":\"[0,255]\",\"optional\":true}," \
+    "\"blue\":{\"type\":\"integer\",\"value\":\"[0,255]\",\"optional\":true}," \
+    "\"period\":{\"type\":\"integer\",\"value\":\"[100,600000]\",\"optional\":true}," \
+    ACTION_FIELDS_LIGHT "}"
+
+// Light actions as in the messages, applied on the same frame
+#define ACTION_FIELD_COMMANDS \
+    "\"commands\":{\"type\":\"array\",\"value\":\"[1,8]\"," \
+    "\"items\":{\"action\":\"[lightOn,lightOff,changeColor,startEffect,stopEffect]\",\"payload\":\"object\"}}"
+#define ACTION_FIELD_SCENE_NAME "\"name\":{\"type\":\"string\",\"value\":\"[1,15]\"}"
+#define ACTION_SCHEMA_BATCH "{" ACTION_FIELD_COMMANDS "," ACTION_FIELD_APPLY_AT "}"
+#define ACTION_SCHEMA_SAVE_SCENE "{" ACTION_FIELD_SCENE_NAME "," ACTION_FIELD_COMMANDS "}"
+#define ACTION_SCHEMA_SCENE "{" ACTION_FIELD_SCENE_NAME "," ACTION_FIELD_APPLY_AT "}"
+#define ACTION_SCHEMA_DELETE_SCENE "{" ACTION_FIELD_SCENE_NAME "}"
+
+#define ACTION_SCHEMA_RESPONSE \
+    "{\"code\":{\"type\":\"integer\",\"value\":\"[200,500]\",\"definition\":{\"200\":\"ok\",\"500\":\"error\"}}," \
+    "\"actionCalled\":{\"type\":\"string\"},\"payload\":{\"type\":\"string\"}}"
+
+// Registry of the mqtt actions : X(name, handler, payload schema)
+// Adding an action is one line here and its handler, dispatch and configure manifest follow.
+#define MQTT_ACTIONS(X) \
+    X(ping, actionPing, ACTION_SCHEMA_PING) \
+    X(status, actionStatus, ACTION_SCHEMA_NONE) \
+    X(configure, actionConfigure, ACTION_SCHEMA_NONE) \
+    X(restart, actionRestart, ACTION_SCHEMA_NONE) \
+    X(reset, actionReset, ACTION_SCHEMA_NONE) \
+    X(lightOn, actionLightOn, ACTION_SCHEMA_TRANSITION) \
+    X(lightOff, actionLightOff, ACTION_SCHEMA_TRANSITION) \
+    X(changeColor, actionChangeColor, ACTION_SCHEMA_COLOR) \
+    X(startEffect, actionStartEffect, ACTION_SCHEMA_EFFECT) \
+    X(stopEffect, actionStopEffect, ACTION_SCHEMA_TRANSITION) \
+    X(batch, actionBatch, ACTION_SCHEMA_BATCH) \
+    X(saveScene, actionSaveScene, ACTION_SCHEMA_SAVE_SCENE) \
+    X(scene, actionScene, ACTION_SCHEMA_SCENE) \
+    X(deleteScene, actionDeleteScene, ACTION_SCHEMA_DELETE_SCENE) \
+    X(stats, actionStats, ACTION_SCHEMA_NONE) \
+    X(metrics, actionMetrics, ACTION_SCHEMA_NONE)
+
+struct ActionReply {
+    int code = 200;
+    // Plain text payload of the reply
+    char message[128] = "";
+    // Payload is the configure manifest instead of the message
+    bool manifest = false;
+    // Payload string written by this function instead of the message
+    ReplyWriter body = nullptr;
+    // Not published by the callback, acknowledged later with the others of its batch
+    bool deferred = false;
+};
+
+typedef void (*ActionHandler)(JsonVariant payload, ActionReply &reply);
+
+struct Action {
+    const char *name;
+    ActionHandler handler;
+};
+
+#define ACTION_DECLARE(name, handler, schema) void handler(JsonVariant payload, ActionReply &reply);
+MQTT_ACTIONS(ACTION_DECLARE)
+#undef ACTION_DECLARE
+
+// Find an action by name with one hash and one string compare, nullptr if unknown
+const Action *actionFind(const char *name);
+
+// "actions" array of the configure reply, without its opening bracket
+extern const char *const actionManifest;
+extern const size_t actionManifestLength;
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef BINARY_COMMAND_H
+#define BINARY_COMMAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "LightZone.h"
+#include "LightCommand.h"
+
+// Suffix of the binary topics, appended to the subscribe and publish channels
+#define BINARY_TOPIC_SUFFIX "/bin"
+
+// Color frame, also sent by the websocket clients (see WebControl.h) :
+//   byte 0    flags (BINARY_FLAG_*), the other bits must be 0
+//   byte 1-3  red, green, blue
+//   1 byte    effect (EffectType), when BINARY_FLAG_EFFECT. EFFECT_NONE stops the running
+//             effect, the others start it with the color
+//   2 bytes   transition in ms, big endian, when BINARY_FLAG_TRANSITION. Period of a started
+//             effect (EFFECT_PERIOD_DEFAULT_MS without it)
+//   2 bytes   sequence number, big endian, when BINARY_FLAG_SEQUENCE
+//   1 byte    zone mask, when BINARY_FLAG_ZONES (every zone otherwise)
+#define BINARY_FLAG_TRANSITION 0x01
+#define BINARY_FLAG_SEQUENCE 0x02
+#define BINARY_FLAG_REPLY 0x04
+#define BINARY_FLAG_ZONES 0x08
+#define BINARY_FLAG_EFFECT 0x10
+#define BINARY_FLAGS_MASK 0x1F
+#define BINARY_COLOR_MAX_LENGTH 10
+
+// Ack frame : status, sequence (big endian, 0 when the command had none)
+#define BINARY_ACK_LENGTH 3
+
+enum BinaryStatus : uint8_t {
+    BINARY_STATUS_OK,
+    BINARY_STATUS_QUEUE_FULL,
+    BINARY_STATUS_MALFORMED
+};
+
+struct BinaryColor {
+    uint8_t flags = 0;
+    uint8_t color[3] = { 0, 0, 0 };
+    uint16_t transitionMs = 0;
+    uint16_t sequence = 0;
+    uint8_t zones = LIGHT_ZONES_ALL;
+    EffectType effect = EFFECT_NONE;
+};
+
+// False when the length does not match the flags, unknown flags are set or the effect is unknown
+bool binaryColorDecode(const uint8_t *payload, size_t length, BinaryColor &command);
+
+// The light command of a decoded frame
+void binaryColorCommand(const BinaryColor &frame, LightCommand &command);
+
+size_t binaryColorEncode(const BinaryColor &command, uint8_t *buffer);
+
+size_t binaryAckEncode(BinaryStatus status, uint16_t sequence, uint8_t buffer[BINARY_ACK_LENGTH]);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef BUTTONS_H
+#define BUTTONS_H
+
+#include <stdint.h>
+
+// Push buttons (src/Buttons.cpp, device only). An edge raises an interrupt which restarts the
+// debounce timer of the button, the level is read once the contact has settled.
+
+#define BUTTONS_MAX 2
+#define BUTTON_DEBOUNCE_MS 30
+#define BUTTON_LONG_PRESS_MS 5000
+#define BUTTON_EVENTS_MAX 8
+
+enum ButtonEventType : uint8_t {
+    BUTTON_PRESSED,
+    BUTTON_RELEASED,
+    // Still pressed BUTTON_LONG_PRESS_MS after the press, the release follows
+    BUTTON_LONG_PRESS
+};
+
+struct ButtonEvent {
+    // Index in the pins given to buttonsBegin
+    uint8_t button = 0;
+    ButtonEventType type = BUTTON_PRESSED;
+    uint32_t atMs = 0;
+};
+
+// Active high buttons, the pins get a pull down. wake is called from the timer task once an
+// event is queued.
+void buttonsBegin(const int pins[], uint8_t count, void (*wake)());
+
+// Never blocks, false when no event is queued
+bool buttonsPoll(ButtonEvent &event);
+
+#endif
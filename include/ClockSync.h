@@ -0,0 +1,35 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+
+// Offset between the clock of the controller and halMicros(), from the ping action :
+// {"t": controller time in ms when sent, "rtt": round trip of the previous ping in ms}.
+// The controller only sends rtt when the pong of the previous ping came back. Each round
+// trip completes the sample of its ping, the controller time plus half the round trip
+// against the local arrival time, and of the recent samples the fastest one is kept (NTP).
+#define CLOCK_SYNC_WINDOW 8
+// A scheduled command further in the future is refused
+#define CLOCK_SYNC_AHEAD_MAX_MS 60000
+// And one further in the past, it went stale on its way. Under the 2^31 us the render task
+// compares the times in, so a late one never reads as ahead.
+#define CLOCK_SYNC_BEHIND_MAX_MS 10000
+
+struct ClockSyncStats {
+    uint32_t samples = 0;
+    // Controller clock minus the local one
+    int64_t offsetUs = 0;
+    // Round trip of the sample in use
+    uint32_t rttMs = 0;
+    bool synced = false;
+};
+
+// previousRttMs is negative without rtt
+void clockSyncPing(uint64_t controllerMs, int32_t previousRttMs);
+
+// Local time (halMicros) of a controller time, false before the first complete sample
+bool clockSyncToLocal(uint64_t controllerMs, int64_t &localUs);
+
+ClockSyncStats clockSyncStats();
+
+#endif
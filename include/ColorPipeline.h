@@ -0,0 +1,42 @@
+#ifndef COLOR_PIPELINE_H
+#define COLOR_PIPELINE_H
+
+#include <stdint.h>
+#include "Hal.h"
+#include "LightEngine.h"
+#include "LightZone.h"
+
+// From a level of the commands to the duty of a PWM channel, in integers only :
+//   level (0 to 255)   -> linear light (16 bits), the level is a CIE 1976 lightness so the
+//                         steps look even down to the lowest ones
+//   linear             -> scaled by the white balance of the channel
+//   linear             -> duty of LIGHT_PWM_RESOLUTION bits and HAL_PWM_FRACTION_BITS under
+//                         them, dithered by the PWM peripheral (a step is over 1.5 % of the
+//                         light below a duty of 64)
+// The tables are built by the compiler and stay in flash.
+#define COLOR_LEVELS 256
+#define COLOR_LINEAR_BITS 16
+// Duty of a channel full on
+#define COLOR_DUTY_MAX (1u << (LIGHT_PWM_RESOLUTION + HAL_PWM_FRACTION_BITS))
+
+#define COLOR_HUE_MAX 359
+// Range of the color temperature table, 500 K per entry
+#define COLOR_KELVIN_MIN 1000
+#define COLOR_KELVIN_MAX 10000
+
+// Linear light of a level, 0 to 65535
+uint16_t colorLinear(uint8_t level);
+
+// Linear light scaled by a white balance of 0 to 255, LIGHT_BALANCE_NONE keeps it
+uint16_t colorBalance(uint16_t linear, uint8_t balance);
+
+// Duty of a channel for halPwmWrite, 0 to COLOR_DUTY_MAX
+uint32_t colorDuty(uint16_t linear);
+
+// Hue in degrees, saturation and value (brightness) 0 to 255
+void colorFromHsv(uint16_t hue, uint8_t saturation, uint8_t value, uint8_t color[LIGHT_CHANNELS]);
+
+// Color of a black body, clamped to the range of the table, scaled by the brightness
+void colorFromKelvin(uint16_t kelvin, uint8_t brightness, uint8_t color[LIGHT_CHANNELS]);
+
+#endif
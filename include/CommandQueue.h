@@ -0,0 +1,142 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free ring for one producer task and one consumer task, N must be a power of two
+template <typename T, uint32_t N>
+class SpscRing {
+    static_assert((N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+  public:
+    // Producer side, false when full
+    bool push(const T &item) {
+        if (false == stage(item)) {
+            return false;
+        }
+
+        publish();
+
+        return true;
+    }
+
+    // Producer side : staged items are only seen by the consumer once published,
+    // so a batch is popped whole or not at all. False when full.
+    bool stage(const T &item) {
+        uint32_t head = this->head.load(std::memory_order_relaxed) + staged;
+
+        if (head - tail.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+
+        items[head & (N - 1)] = item;
+        staged++;
+
+        return true;
+    }
+
+    void publish() {
+        this->head.store(this->head.load(std::memory_order_relaxed) + staged, std::memory_order_release);
+        staged = 0;
+    }
+
+    void discard() {
+        staged = 0;
+    }
+
+    // Consumer side, false when empty
+    bool pop(T &item) {
+        uint32_t tail = this->tail.load(std::memory_order_relaxed);
+
+        if (head.load(std::memory_order_acquire) == tail) {
+            return false;
+        }
+
+        item = items[tail & (N - 1)];
+        this->tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    uint32_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+  private:
+    T items[N];
+    std::atomic<uint32_t> head { 0 };
+    std::atomic<uint32_t> tail { 0 };
+    // Producer only
+    uint32_t staged = 0;
+};
+
+// Lock-free ring for several producer tasks and one consumer task, N must be a power of two.
+// Producers claim a ticket on head, each slot has a sequence telling whether it is free
+// for that ticket or holds the item the consumer waits for (bounded queue of D. Vyukov).
+template <typename T, uint32_t N>
+class MpscRing {
+    static_assert((N & (N - 1)) == 0, "MpscRing size must be a power of two");
+
+  public:
+    MpscRing() {
+        for (uint32_t i = 0 ; i < N ; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Any producer, false when full
+    bool push(const T &item) {
+        uint32_t head = this->head.load(std::memory_order_relaxed);
+        Slot *slot;
+
+        for (;;) {
+            slot = &slots[head & (N - 1)];
+            int32_t distance = (int32_t) (slot->sequence.load(std::memory_order_acquire) - head);
+
+            if (distance == 0) {
+                // On failure head is reloaded, another producer took this ticket
+                if (this->head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (distance < 0) {
+                return false;
+            } else {
+                head = this->head.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->item = item;
+        slot->sequence.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Consumer side, false when empty or when the oldest item is still being written
+    bool pop(T &item) {
+        uint32_t tail = this->tail.load(std::memory_order_relaxed);
+        Slot &slot = slots[tail & (N - 1)];
+
+        if (slot.sequence.load(std::memory_order_acquire) != tail + 1) {
+            return false;
+        }
+
+        item = slot.item;
+        slot.sequence.store(tail + N, std::memory_order_release);
+        this->tail.store(tail + 1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+  private:
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        T item;
+    };
+
+    Slot slots[N];
+    std::atomic<uint32_t> head { 0 };
+    std::atomic<uint32_t> tail { 0 };
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+#include "LightZone.h"
+#include "Settings.h"
+
+// Larger config files are rejected
+#define CONFIG_FILE_MAX 1024
+
+struct Config {
+  char wifiSsid[32] = "";
+  char wifiPassword[64] = "";
+  #if MQTT_ENABLE == true
+  bool mqttEnable = true;
+  char mqttHost[128] = "";
+  int  mqttPort = 1883;
+  char mqttUsername[32] = "";
+  char mqttPassword[64] = "";
+  char mqttPublishChannel[128] = "device/to/marvin";
+  char mqttSubscribeChannel[128] = "marvin/to/device";
+  #endif
+  char uuid[64] = "";
+  // One RGB strip on the pins of the original board
+  LightZoneConfig zones[LIGHT_ZONES_MAX] = {
+      { 3, { 19, 18, 5, -1 }, { LIGHT_BALANCE_NONE, LIGHT_BALANCE_NONE, LIGHT_BALANCE_NONE, LIGHT_BALANCE_NONE } }
+  };
+  PixelStripConfig pixels = { -1, 0, 3 };
+};
+
+// Json is only used to import a config file and to export the config,
+// the device keeps it in the binary store (see ConfigStore.h)
+
+// Parse a json config in place (the buffer is modified), false when a key is missing
+bool configParse(char *json, size_t length, Config &config);
+
+// Return the length written, or the length needed when the buffer is too small
+size_t configSerialize(const Config &config, char *buffer, size_t size);
+
+bool configImport(const char *path, Config &config);
+
+#endif
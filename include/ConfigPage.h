@@ -0,0 +1,14 @@
+#ifndef CONFIG_PAGE_H
+#define CONFIG_PAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Config.h"
+
+// Values of the configuration pages are read from these until the next bind
+void configPageBind(const Config *config, const char *appName, const char *errorMessage);
+
+// TemplateValueFn of the pages (see include/generated/Templates.h)
+size_t configPageValue(uint8_t var, char *buffer, size_t size);
+
+#endif
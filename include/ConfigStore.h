@@ -0,0 +1,31 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <stdint.h>
+#include "Config.h"
+
+// Bump when the layout of Config changes, older records are then ignored
+#define CONFIG_STORE_VERSION 3
+#define CONFIG_STORE_MAGIC 0x53434647
+
+// Two slots written in turn, a torn write only loses the record being written
+#define CONFIG_STORE_SLOTS 2
+
+struct ConfigRecord {
+    uint32_t magic = CONFIG_STORE_MAGIC;
+    uint16_t version = CONFIG_STORE_VERSION;
+    uint16_t size = sizeof(Config);
+    // Incremented on each save, the highest valid one is loaded
+    uint32_t sequence = 0;
+    // CRC-32 of the sequence and the config
+    uint32_t crc = 0;
+    Config config;
+};
+
+// Load the newest valid slot, false when none is
+bool configStoreLoad(Config &config);
+
+// Write the slot not holding the newest record, a random uuid is given to a config without one
+bool configStoreSave(Config &config);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef CONNECTION_MANAGER_H
+#define CONNECTION_MANAGER_H
+
+#include <stdint.h>
+
+enum ConnectionState : uint8_t {
+    CONNECTION_IDLE,
+    CONNECTION_WIFI_CONNECTING,
+    CONNECTION_WIFI_WAIT,
+    CONNECTION_MQTT_WAIT,
+    CONNECTION_READY
+};
+
+// Exponential backoff with jitter, so devices rebooted together do not retry in lockstep
+struct Backoff {
+    uint32_t baseMs;
+    uint32_t maxMs;
+    uint32_t currentMs;
+
+    Backoff(uint32_t baseMs, uint32_t maxMs);
+
+    // Delay before the next attempt, between half and the whole current step
+    uint32_t next();
+    void reset();
+};
+
+struct ConnectionHandlers {
+    // One connection attempt, nullptr when mqtt is disabled
+    bool (*mqttConnect)();
+    bool (*mqttConnected)();
+};
+
+struct ConnectionStats {
+    uint32_t wifiAttempts = 0;
+    uint32_t wifiDisconnects = 0;
+    uint32_t directedAttempts = 0;
+    uint32_t directedFailures = 0;
+    uint32_t mqttAttempts = 0;
+    uint32_t mqttFailures = 0;
+};
+
+// Start connecting, wifi events and timers then drive everything from connectionLoop().
+// The access point, address and broker address of the last connection are cached in
+// retained memory and in the store, they are reused while ssid and brokerHost do not change.
+// The address is only reused until half of its DHCP lease, after that the station asks DHCP
+// again, even while connected.
+void connectionBegin(const char *ssid, const char *password, const char *brokerHost, const ConnectionHandlers &handlers);
+
+// Never blocks longer than one mqtt connection attempt
+ConnectionState connectionLoop();
+
+// Time before connectionLoop has something to do on its own (a retry or the end of the lease
+// of the cached address), UINT32_MAX when only a WiFi event or the mqtt socket can give it some
+uint32_t connectionIdleMs();
+
+void connectionStop();
+bool connectionWifiUp();
+const ConnectionStats &connectionStats();
+
+// Cached broker address (IPAddress order), 0 when the host name must be resolved
+uint32_t connectionBrokerIp();
+// Address the broker was reached at, 0 when the cached one did not answer
+void connectionBrokerResolved(uint32_t ip);
+
+#endif
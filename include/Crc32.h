@@ -0,0 +1,10 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (IEEE) of the stored records, crc is the value of the previous chunk or 0
+uint32_t crc32(uint32_t crc, const void *data, size_t length);
+
+#endif
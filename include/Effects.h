@@ -0,0 +1,43 @@
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include <stdint.h>
+#include "LightEngine.h"
+
+#define EFFECT_PERIOD_MIN_MS 100
+#define EFFECT_PERIOD_MAX_MS 600000
+#define EFFECT_PERIOD_DEFAULT_MS 4000
+
+enum EffectType : uint8_t {
+    EFFECT_NONE,
+    EFFECT_BREATHE,
+    EFFECT_RAINBOW,
+    EFFECT_STROBE,
+    EFFECT_CANDLE,
+    EFFECT_COUNT
+};
+
+struct Effect {
+    EffectType type = EFFECT_NONE;
+    uint8_t color[LIGHT_CHANNELS] = { 255, 255, 255 };
+    // Frames in one cycle of the effect
+    uint32_t periodFrames = 0;
+    uint32_t frame = 0;
+    // State of the candle flicker
+    uint32_t seed = 1;
+    uint8_t level = 0;
+};
+
+// Fill the sine and hue lookup tables, once before the first frame
+void effectsBegin();
+
+EffectType effectFind(const char *name);
+const char *effectName(EffectType type);
+
+// The candle flickers at random, its period is not used
+void effectStart(Effect &effect, EffectType type, const uint8_t color[LIGHT_CHANNELS], uint32_t periodMs);
+
+// Render the next frame, return false when no effect runs
+bool effectFrame(Effect &effect, uint8_t output[LIGHT_CHANNELS]);
+
+#endif
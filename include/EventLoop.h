@@ -0,0 +1,39 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+
+// The loop task blocks between two passes instead of spinning (src/EventLoop.cpp, device only).
+// It wakes up on data from the mqtt socket, on eventLoopWake from another task, or once the
+// earliest deadline of the modules has passed.
+
+#define EVENT_LOOP_CORES 2
+
+struct IdleStats {
+    // Ticks that found the idle task running, a tickless sleep counts as idle
+    uint32_t cpuIdleMs[EVENT_LOOP_CORES] = { 0, 0 };
+    // The idle task ran again, roughly one per interrupt that woke the core up
+    uint32_t cpuWakeups[EVENT_LOOP_CORES] = { 0, 0 };
+    uint32_t loopWakeups = 0;
+    // Time the loop task spent between two waits
+    uint64_t loopBusyUs = 0;
+    // Automatic light sleep is configured, it depends on the sdkconfig of the framework
+    bool lightSleep = false;
+};
+
+// Wake socket, idle counters and power management
+void eventLoopBegin();
+
+// Block until the socket fd (-1 for none) is readable, eventLoopWake is called or timeoutMs has
+// passed, UINT32_MAX waits for an event
+void eventLoopWait(int fd, uint32_t timeoutMs);
+
+// From any task, not from an interrupt. Wakes coming before the wait are not lost.
+void eventLoopWake();
+
+// Render task. Light sleep stops the PWM timers, it is held off while a zone is lit.
+void eventLoopKeepAwake(bool awake);
+
+IdleStats eventLoopStats();
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Thin hardware layer of the portable modules.
+// Implemented by src/HalEsp32.cpp on the device and by in-memory fakes in src/native/ on the host.
+
+// Clock
+uint32_t halMillis();
+int64_t halMicros();
+// Cycle counter for the handling stats (nanoseconds on the host)
+uint32_t halCycles();
+uint32_t halRandom();
+// Stack high water mark of the calling task, in bytes
+uint32_t halStackFree();
+uint32_t halHeapFree();
+uint32_t halHeapMinFree();
+
+// PWM sink. Written duties are only latched by halPwmCommit, all together at the end of a period.
+// A duty has HAL_PWM_FRACTION_BITS bits under the resolution : the peripheral adds one step on
+// that many periods out of 16, the bits under a step are dithered at the PWM rate.
+#define HAL_PWM_FRACTION_BITS 4
+void halPwmSetup(uint8_t channel, int pin, uint32_t frequency, uint8_t resolution);
+void halPwmWrite(uint8_t channel, uint32_t duty);
+void halPwmCommit();
+// Restart the timers of every channel together once they are set up, so their periods line up
+void halPwmSync();
+
+// Addressable pixel sink (WS2812 timing), frames of bytes in wire order
+bool halPixelsSetup(int pin);
+// Start clocking a frame out and return at once, the frame must not change until the sink is idle.
+// False while the previous frame is still clocked out, the latch time after it is left to the caller.
+bool halPixelsSend(const uint8_t *frame, size_t length);
+
+// Filesystem, small files read and written at once
+// Return the file size or -1 when it can not be opened, at most size bytes are copied
+int32_t halFileRead(const char *path, char *buffer, size_t size);
+bool halFileWrite(const char *path, const char *data, size_t length);
+
+// Key-value store of small binary records (NVS on the device), a write replaces the whole record
+// Read fails unless the stored record has exactly this size
+bool halStoreRead(const char *key, void *data, size_t size);
+bool halStoreWrite(const char *key, const void *data, size_t size);
+
+// Journal partition, erased one sector at a time, a write only turns erased (0xFF) bits to 0
+#define HAL_JOURNAL_SECTOR_SIZE 4096
+// Size in bytes, 0 when the partition table has no journal
+uint32_t halJournalSize();
+bool halJournalRead(uint32_t offset, void *data, size_t size);
+bool halJournalWrite(uint32_t offset, const void *data, size_t size);
+// The sector starting at offset
+bool halJournalErase(uint32_t offset);
+
+// MQTT transport, a reply is either published at once or streamed between begin and end.
+// The broker keeps the last retained message of a topic for the next subscribers.
+bool halMqttPublish(const char *topic, const uint8_t *payload, size_t length, bool retained = false);
+bool halMqttBeginPublish(const char *topic, size_t length, bool retained = false);
+size_t halMqttWrite(const uint8_t *buffer, size_t size);
+bool halMqttEndPublish();
+
+// Addresses announced by the configure action
+void halNetworkAddress(char ip[16], char mac[18]);
+
+// Access point and addresses of a WiFi station, IPv4 addresses as IPAddress stores them
+struct WifiLink {
+    uint8_t bssid[6] = { 0, 0, 0, 0, 0, 0 };
+    uint8_t channel = 0;
+    // 0 asks for a DHCP lease
+    uint32_t ip = 0;
+    uint32_t gateway = 0;
+    uint32_t subnet = 0;
+    uint32_t dns = 0;
+    // Lease of a DHCP address in seconds, 0 for a static one
+    uint32_t leaseS = 0;
+};
+
+// WiFi station, nullptr link scans every channel, otherwise the association goes straight
+// to the access point of link and its address is applied as a static one when ip is set
+void halWifiBegin(const char *ssid, const char *password, const WifiLink *link);
+// Drop the static address and ask DHCP for one, the station stays associated but is not up
+// until it gets the lease
+void halWifiDhcp();
+void halWifiDisconnect();
+// Associated and with an address
+bool halWifiUp();
+void halWifiLink(WifiLink &link);
+
+// Memory kept across restarts and crashes but lost on power loss (RTC memory on the device),
+// at most HAL_RETAINED_SIZE bytes. The content is undefined after a power loss, callers check it
+#define HAL_RETAINED_SIZE 64
+void halRetainedRead(void *data, size_t size);
+void halRetainedWrite(const void *data, size_t size);
+// Seconds counted across restarts and crashes, back from 0 after a power loss like the
+// retained memory (RTC timer on the device)
+uint32_t halRetainedSeconds();
+
+#endif
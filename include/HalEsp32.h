@@ -0,0 +1,14 @@
+#ifndef HAL_ESP32_H
+#define HAL_ESP32_H
+
+#include "Settings.h"
+#include "Hal.h"
+
+#if MQTT_ENABLE == true
+#include <PubSubClient.h>
+
+// Client behind the mqtt transport
+void halMqttAttach(PubSubClient &client);
+#endif
+
+#endif
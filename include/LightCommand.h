@@ -0,0 +1,90 @@
+#ifndef LIGHT_COMMAND_H
+#define LIGHT_COMMAND_H
+
+#include <stdint.h>
+#include "CommandQueue.h"
+#include "Effects.h"
+#include "LightZone.h"
+
+#define LIGHT_COMMAND_QUEUE_SIZE 32
+// Commands of a batch or a scene, all applied on the same frame
+#define LIGHT_BATCH_MAX 8
+// Scheduled commands waiting for their time in the render task
+#define LIGHT_SCHEDULE_MAX 8
+// A scheduled command applied later than this is counted late
+#define LIGHT_SCHEDULE_LATE_US 1000
+
+enum LightCommandType : uint8_t {
+    LIGHT_COMMAND_COLOR,
+    LIGHT_COMMAND_EFFECT_START,
+    LIGHT_COMMAND_EFFECT_STOP
+};
+
+struct LightCommand {
+    LightCommandType type = LIGHT_COMMAND_COLOR;
+    EffectType effect = EFFECT_NONE;
+    // Zones the command applies to, one bit per zone
+    uint8_t zones = LIGHT_ZONES_ALL;
+    // Applied at applyAtUs (halMicros) rather than on the next frame
+    bool scheduled = false;
+    uint8_t color[LIGHT_CHANNELS] = { 0, 0, 0 };
+    // Transition of a color or of an effect stop, period of an effect
+    uint32_t durationMs = 0;
+    // halMicros() when queued, for the apply latency
+    uint32_t queuedUs = 0;
+    uint32_t applyAtUs = 0;
+};
+
+// Each counter has a single writer : enqueued and dropped the producer, the others the consumer
+struct CommandStats {
+    uint32_t enqueued = 0;
+    uint32_t dropped = 0;
+    uint32_t coalesced = 0;
+    uint32_t applied = 0;
+    uint32_t scheduled = 0;
+    // Scheduled commands applied more than LIGHT_SCHEDULE_LATE_US after their time, or before it
+    // when the schedule is full
+    uint32_t late = 0;
+};
+
+typedef SpscRing<LightCommand, LIGHT_COMMAND_QUEUE_SIZE> LightCommandQueue;
+
+// Apply every queued command in order, a run of colors only applies the latest one
+// unless it leaves a zone of the earlier one out. Scheduled commands are never coalesced.
+template <typename Apply>
+void lightCommandsDrain(LightCommandQueue &queue, CommandStats &stats, Apply apply) {
+    LightCommand command;
+    LightCommand pending;
+    bool hasPending = false;
+
+    while (queue.pop(command)) {
+        if (command.type == LIGHT_COMMAND_COLOR && false == command.scheduled) {
+            if (true == hasPending && (pending.zones & ~command.zones) == 0) {
+                stats.coalesced++;
+            } else if (true == hasPending) {
+                apply(pending);
+                stats.applied++;
+            }
+
+            pending = command;
+            hasPending = true;
+            continue;
+        }
+
+        if (true == hasPending) {
+            apply(pending);
+            stats.applied++;
+            hasPending = false;
+        }
+
+        apply(command);
+        stats.applied++;
+    }
+
+    if (true == hasPending) {
+        apply(pending);
+        stats.applied++;
+    }
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef LIGHT_ENGINE_H
+#define LIGHT_ENGINE_H
+
+#include <stdint.h>
+
+#define LIGHT_CHANNELS 3
+#define LIGHT_FRAME_RATE 100
+#define LIGHT_FRAME_US (1000000 / LIGHT_FRAME_RATE)
+#define LIGHT_TRANSITION_MAX_MS 60000
+
+// Interpolation between two colors in 16.16 fixed point, one step per frame
+struct LightEngine {
+    int32_t current[LIGHT_CHANNELS] = { 0, 0, 0 };
+    int32_t step[LIGHT_CHANNELS] = { 0, 0, 0 };
+    uint8_t target[LIGHT_CHANNELS] = { 0, 0, 0 };
+    uint32_t framesLeft = 0;
+};
+
+// Start a transition from the current output, transitionMs = 0 applies the color on the next frame
+void lightEngineSetTarget(LightEngine &engine, const uint8_t color[LIGHT_CHANNELS], uint32_t transitionMs);
+
+// Jump to a color without transition, used when an effect hands the output back
+void lightEngineSetCurrent(LightEngine &engine, const uint8_t color[LIGHT_CHANNELS]);
+
+// Advance one frame and write the output, return false when nothing is left to do
+bool lightEngineFrame(LightEngine &engine, uint8_t output[LIGHT_CHANNELS]);
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef LIGHT_OUTPUT_H
+#define LIGHT_OUTPUT_H
+
+#include <stdint.h>
+#include "LightEngine.h"
+#include "LightZone.h"
+#include "Effects.h"
+#include "LightCommand.h"
+
+// Core not used by the WiFi and lwIP tasks (they run on PRO_CPU)
+#define RENDER_TASK_CORE 1
+#define RENDER_TASK_PRIORITY 5
+
+struct RenderStats {
+    uint32_t frames = 0;
+    // Distance between two timer frames and the frame period
+    uint32_t jitterMaxUs = 0;
+    uint64_t jitterTotalUs = 0;
+    uint32_t jitterSamples = 0;
+    // Time spent computing and writing a frame
+    uint32_t renderMaxUs = 0;
+    uint32_t overruns = 0;
+};
+
+// What was last requested, enough to bring the output back after a restart
+struct LightZoneState {
+    uint8_t color[LIGHT_CHANNELS] = { 0, 0, 0 };
+    EffectType effect = EFFECT_NONE;
+    uint32_t periodMs = 0;
+    // Fade of the last color change or effect stop
+    uint32_t transitionMs = 0;
+};
+
+struct LightState {
+    LightZoneState zones[LIGHT_ZONES_MAX];
+};
+
+// Attach the pins of the zones (see LightZone.h) to the PWM channels, set the addressable strip up
+// as the last zone and start the render scheduler
+void lightOutputBegin(const LightZoneConfig zones[LIGHT_ZONES_MAX], const PixelStripConfig &pixels);
+
+// Number of zones and mask of all of them
+uint8_t lightOutputZoneCount();
+uint8_t lightOutputZoneMask();
+
+// The commands below are queued for the render task, which applies them on its next frame,
+// to every zone of the mask at once. They must all be called from the same task and return false
+// when the queue is full.
+
+// Fade to a color, stops any running effect
+bool lightOutputSet(uint8_t zones, uint8_t red, uint8_t green, uint8_t blue, uint32_t transitionMs);
+
+bool lightOutputStartEffect(uint8_t zones, EffectType type, const uint8_t color[LIGHT_CHANNELS], uint32_t periodMs);
+
+// Fade from the current effect frame to the effect color
+bool lightOutputStopEffect(uint8_t zones, uint32_t transitionMs);
+
+// Any of the commands above
+bool lightOutputQueue(LightCommand command);
+
+// Commands queued between the two calls are seen by the render task together, so they
+// are applied on the same frame. On a full queue none of them is applied and
+// lightOutputBatchEnd returns false.
+void lightOutputBatchBegin();
+bool lightOutputBatchEnd();
+
+// Last requested color and effect of a zone
+void lightOutputTarget(uint8_t zone, uint8_t color[LIGHT_CHANNELS]);
+EffectType lightOutputEffect(uint8_t zone);
+void lightOutputState(LightState &state);
+
+CommandStats lightOutputCommandStats();
+
+// Copy of the stats, jitter counters are reset
+RenderStats lightOutputStats(bool reset = false);
+
+// The scheduler (src/RenderTask.cpp on the device, the native simulator on the host)
+// implements lightOutputBegin, lightOutputStats and lightOutputWake, and renders with
+// the functions below.
+
+void lightOutputSetup(const LightZoneConfig zones[LIGHT_ZONES_MAX], const PixelStripConfig &pixels);
+
+// Apply the queued commands and write one frame, false once the output does not change anymore
+bool lightOutputRender();
+
+// Scheduled commands (LightCommand::scheduled) wait in the render task for their time. The
+// scheduler wakes up at the earliest one, which lightOutputRenderDue applies and writes
+// between two frames. False when no command waits.
+bool lightOutputNextDue(uint32_t &atUs);
+bool lightOutputRenderDue();
+
+// Render task, a PWM zone is not black. The pixel strips keep their frame without a clock.
+bool lightOutputLit();
+
+// A command was queued
+void lightOutputWake();
+
+#endif
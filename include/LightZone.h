@@ -0,0 +1,42 @@
+#ifndef LIGHT_ZONE_H
+#define LIGHT_ZONE_H
+
+#include <stdint.h>
+
+// LEDC channels : 8 high speed and 8 low speed, each pair of channels shares a timer
+#define LIGHT_PWM_CHANNELS 16
+#define LIGHT_PWM_FREQUENCY 12000
+// 12 bits is the most the 80 MHz LEDC clock allows at 12 kHz, the LEDC dithers the bits under
+// it (see ColorPipeline.h)
+#define LIGHT_PWM_RESOLUTION 12
+
+// 5 RGB strips or 4 RGBW ones fill the PWM channels, the addressable strip comes after them
+#define LIGHT_ZONES_MAX 6
+#define LIGHT_ZONE_PINS_MAX 4
+// Zone mask of a command, bit n for zone n
+#define LIGHT_ZONES_ALL 0xFF
+// White balance of a channel that is not calibrated
+#define LIGHT_BALANCE_NONE 255
+
+// Pins in the order red, green, blue and white. 3 channels for an RGB strip, 4 for an RGBW one,
+// 0 ends the table. Zones take the PWM channels one after the other from channel 0.
+// The balance of each channel (0 to 255) evens out strips of different batches.
+struct LightZoneConfig {
+    uint8_t channels;
+    int8_t pins[LIGHT_ZONE_PINS_MAX];
+    uint8_t balance[LIGHT_ZONE_PINS_MAX];
+};
+
+// Addressable strip (WS2812, SK6812) clocked out by the RMT peripheral, one more zone
+// after the PWM ones. Every pixel shows the color of the zone.
+#define PIXELS_MAX 1000
+
+struct PixelStripConfig {
+    // -1 without a strip
+    int8_t pin;
+    uint16_t count;
+    // 3 for GRB pixels, 4 for GRBW ones (SK6812 RGBW)
+    uint8_t channels;
+};
+
+#endif
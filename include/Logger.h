@@ -0,0 +1,80 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Levels, the macros above LOG_LEVEL (build flag) are compiled out with their arguments
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Longer lines are cut
+#define LOG_LINE_MAX 112
+#define LOG_QUEUE_SLOTS 32
+// Recent output kept for the /log endpoint
+#define LOG_HISTORY_SIZE 2048
+
+struct LogLine {
+    uint32_t ms;
+    uint8_t level;
+    char text[LOG_LINE_MAX];
+};
+
+struct LogStats {
+    uint32_t lines = 0;
+    // Queue full, the drain task is behind
+    uint32_t dropped = 0;
+    // Slowest logWrite call, formatting included
+    uint32_t writeMaxCycles = 0;
+};
+
+// Start the task printing the lines to the serial port (device only)
+void logBegin();
+
+// Format and queue a line, safe from any task, never blocks
+void logWrite(uint8_t level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+// Consumer side (src/LogTask.cpp on the device) : print the queued lines through sink
+// and keep them in the history, returns the number of lines
+uint32_t logDrain(void (*sink)(const char *text, size_t length));
+
+// Implemented by the consumer, a line was queued
+void logWake();
+
+// Last complete lines of the history, returns the length
+size_t logTail(char *buffer, size_t size);
+
+LogStats logStats();
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ReplyOutput.h"
+#include "ClockSync.h"
+#include "ConnectionManager.h"
+#include "EventLoop.h"
+#include "LightCommand.h"
+#include "LightOutput.h"
+#include "PixelOutput.h"
+#include "StateJournal.h"
+#include "Logger.h"
+#include "WebControl.h"
+#include "MqttOutbox.h"
+
+// Upper bounds of the histogram buckets in us, the last bucket is +Inf
+#define METRICS_BUCKETS 14
+
+// Hot path histograms : X(id, prometheus name, help)
+#define METRICS_HISTOGRAMS(X) \
+    X(METRIC_MQTT_PARSE, "mqtt_parse", "Json parse of an mqtt message") \
+    X(METRIC_MQTT_DISPATCH, "mqtt_dispatch", "Action handler of an mqtt message") \
+    X(METRIC_MQTT_PUBLISH, "mqtt_publish", "Reply or acknowledgement publish") \
+    X(METRIC_MQTT_OUTBOX, "mqtt_outbox", "Outbound mqtt message from queued to written") \
+    X(METRIC_LIGHT_APPLY, "light_apply", "Light command from queued to written to the PWM") \
+    X(METRIC_WEB_CONTROL, "web_control", "Websocket light frame from received to queued")
+
+#define METRIC_ENUM(id, name, help) id,
+enum MetricHistogram : uint8_t {
+    METRICS_HISTOGRAMS(METRIC_ENUM)
+    METRIC_HISTOGRAM_COUNT
+};
+#undef METRIC_ENUM
+
+// Boot phases, in the order they complete : X(id, prometheus label)
+#define METRICS_BOOT_PHASES(X) \
+    X(BOOT_PHASE_CONFIG, "config") \
+    X(BOOT_PHASE_SPIFFS, "spiffs") \
+    X(BOOT_PHASE_WIFI, "wifi") \
+    X(BOOT_PHASE_MQTT, "mqtt")
+
+#define BOOT_PHASE_ENUM(id, name) id,
+enum BootPhase : uint8_t {
+    METRICS_BOOT_PHASES(BOOT_PHASE_ENUM)
+    BOOT_PHASE_COUNT
+};
+#undef BOOT_PHASE_ENUM
+
+struct Histogram {
+    uint32_t buckets[METRICS_BUCKETS] = {};
+    uint64_t sumUs = 0;
+};
+
+// Copy of everything exported, so a reply measured then streamed writes the same bytes twice
+struct MetricsSnapshot {
+    Histogram histograms[METRIC_HISTOGRAM_COUNT];
+    uint32_t heapFree = 0;
+    uint32_t heapMinFree = 0;
+    ConnectionStats connection;
+    CommandStats commands;
+    RenderStats render;
+    PixelStats pixels;
+    ClockSyncStats clock;
+    JournalStats journal;
+    LogStats log;
+    IdleStats idle;
+    WebControlStats web;
+    uint32_t jsonMessages = 0;
+    uint32_t binaryMessages = 0;
+    uint32_t stateChanges = 0;
+    uint32_t statePublished = 0;
+    #if MQTT_ENABLE == true
+    MqttOutboxStats outbox;
+    #endif
+    uint32_t bootPhasesUs[BOOT_PHASE_COUNT] = {};
+};
+
+// Connection counters and idle stats of the device, nullptr on the host
+void metricsBegin(const ConnectionStats *connection, IdleStats (*idle)() = nullptr);
+
+// Each histogram must have a single writer task, readers may see it one sample behind
+void metricsObserve(MetricHistogram id, uint32_t us);
+
+// Time since boot when the phase completes, only the first completion counts
+void metricsBootPhase(BootPhase phase);
+// Forget the phases, for the boots of the host simulator
+void metricsBootReset();
+// "config 12 ms, wifi 350 ms" of the phases completed, returns the length
+size_t metricsBootSummary(char *buffer, size_t size);
+
+void metricsCapture(MetricsSnapshot &snapshot);
+
+// Prometheus text exposition format
+void metricsWrite(ReplyOutput &out, const MetricsSnapshot &snapshot);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef MQTT_HANDLER_H
+#define MQTT_HANDLER_H
+
+#include "Settings.h"
+
+#if MQTT_ENABLE == true
+#include <stdint.h>
+
+struct MqttPathStats {
+    uint32_t messages = 0;
+    uint32_t lastCycles = 0;
+    uint32_t maxCycles = 0;
+    uint64_t totalCycles = 0;
+};
+
+struct MqttStats {
+    MqttPathStats json;
+    MqttPathStats binary;
+    // Stack high water mark of the loop task, in bytes
+    uint32_t stackFree = 0;
+};
+
+// Set by the restart and reset actions (halMillis), 0 when nothing was requested
+extern unsigned long restartRequested;
+extern unsigned long resetRequested;
+
+// The channels are kept, the binary topics are derived from them
+void mqttHandlerBegin(const char *publishChannel, const char *subscribeChannel);
+
+const char *mqttHandlerBinaryTopic();
+
+// Callback of the mqtt client, the payload is parsed in place
+void mqttHandleMessage(char *topic, uint8_t *payload, unsigned int length);
+
+// Publish the batched acknowledgements, returns the time before the next one is due,
+// UINT32_MAX when none is pending
+uint32_t mqttHandlerLoop();
+
+const MqttStats &mqttHandlerStats();
+#endif
+
+#endif
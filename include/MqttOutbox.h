@@ -0,0 +1,78 @@
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include "Settings.h"
+
+#if MQTT_ENABLE == true
+#include <stddef.h>
+#include <stdint.h>
+#include "Actions.h"
+
+// Outbound messages of the loop task : replies, acks and the state are queued instead of being
+// published from the mqtt callback, and written by mqttOutboxLoop once the callback returned.
+// A publish that fails is tried again with a growing delay, the messages behind it wait so the
+// order is kept. A message not written after MQTT_OUTBOX_EXPIRE_MS is dropped, its sender
+// has given up.
+#define MQTT_OUTBOX_SIZE 16
+// A json reply with a full message is about 200 bytes
+#define MQTT_OUTBOX_PAYLOAD_MAX 256
+// Larger replies (configure manifest, metrics) are written from the reply when their turn comes
+#define MQTT_OUTBOX_STREAMED_MAX 2
+// Over this depth the inbound messages wait in the socket, the broker sees the backpressure
+#define MQTT_OUTBOX_HIGH_WATER 12
+// Messages written back to back in one pass, they leave in as few TCP segments as possible
+#define MQTT_OUTBOX_BATCH_MAX 8
+#define MQTT_OUTBOX_RETRIES 4
+// First retry delay, doubled on each retry
+#define MQTT_OUTBOX_RETRY_MS 20
+#define MQTT_OUTBOX_EXPIRE_MS 5000
+
+enum OutboxPolicy : uint8_t {
+    // Dropped when the queue is full, the sender times out (replies, acks)
+    OUTBOX_DROP_NEWEST,
+    // Replaces the queued message of the same topic, only the latest one matters (retained
+    // state). Takes the place of the oldest message when the queue is full.
+    OUTBOX_LATEST
+};
+
+struct MqttOutboxStats {
+    uint32_t queued = 0;
+    uint32_t published = 0;
+    // Passes that wrote at least one message
+    uint32_t batches = 0;
+    uint32_t replaced = 0;
+    // Queue full
+    uint32_t dropped = 0;
+    uint32_t expired = 0;
+    uint32_t retries = 0;
+    // Still failing after MQTT_OUTBOX_RETRIES retries
+    uint32_t failed = 0;
+    uint8_t depth = 0;
+    uint8_t depthMax = 0;
+};
+
+// The topic is kept until the message is written, it must outlive it. False when the message
+// is dropped.
+bool mqttOutboxPush(const char *topic, const uint8_t *payload, size_t length, bool retained, OutboxPolicy policy);
+
+// Reply of an action, written in the queue or streamed from a copy of the reply when too large
+bool mqttOutboxPushReply(const char *topic, const char *actionName, const ActionReply &reply);
+
+// Payload written by body, in the queue or streamed by body when its turn comes when too large
+// (state of many zones). Until then body must write the latest payload of the topic.
+bool mqttOutboxPushWriter(const char *topic, ReplyWriter body, bool retained, OutboxPolicy policy);
+
+// Over the high water mark, the mqtt client should not read more messages
+bool mqttOutboxBusy();
+
+// Write the queued messages, called from the loop once connected. Returns the time before the
+// next retry, 0 when messages are left after a full batch, UINT32_MAX when the queue is empty.
+uint32_t mqttOutboxLoop();
+
+// One attempt for every message, before a restart
+void mqttOutboxFlush();
+
+MqttOutboxStats mqttOutboxStats();
+#endif
+
+#endif
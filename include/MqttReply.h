@@ -0,0 +1,38 @@
+#ifndef MQTT_REPLY_H
+#define MQTT_REPLY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Actions.h"
+#include "ReplyOutput.h"
+
+#define MQTT_REPLY_CHUNK 64
+
+// Streams a payload to the mqtt transport by small chunks after halMqttBeginPublish,
+// the payload is never built in full in memory.
+class MqttReplyWriter : public ReplyOutput {
+  public:
+    bool begin(const char *topic, size_t length, bool retained = false);
+    bool end();
+
+    size_t write(const uint8_t *buffer, size_t size) override;
+
+  private:
+    uint8_t chunk[MQTT_REPLY_CHUNK];
+    size_t used = 0;
+    bool failed = false;
+
+    void flushChunk();
+};
+
+// Write the reply of an action, actionName is omitted when nullptr
+void mqttWriteReply(ReplyOutput &out, const char *actionName, const ActionReply &reply);
+
+// Measure then stream the reply, nothing received from the transport may be used after this call
+// as its buffer is reused for the outgoing packet.
+bool mqttPublishReply(const char *topic, const char *actionName, const ActionReply &reply);
+
+// Measure then stream the payload written by body
+bool mqttPublishWriter(const char *topic, ReplyWriter body, bool retained);
+
+#endif
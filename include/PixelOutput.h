@@ -0,0 +1,35 @@
+#ifndef PIXEL_OUTPUT_H
+#define PIXEL_OUTPUT_H
+
+#include <stdint.h>
+#include "LightZone.h"
+
+// WS2812 timing : 8 bits of 1.25 us per byte, then the line is held low to latch the frame
+#define PIXEL_BYTE_NS 10000
+#define PIXEL_LATCH_US 300
+
+struct PixelStats {
+    uint16_t count = 0;
+    // Frames clocked out, and frames replaced by a newer one before they could be
+    uint32_t frames = 0;
+    uint32_t dropped = 0;
+    // Wire time of one frame, latch included, and the frame rate it allows
+    uint32_t frameUs = 0;
+    uint32_t maxFps = 0;
+};
+
+// Two frames : the render task fills one while the other is clocked out.
+// False when the config has no strip.
+bool pixelOutputBegin(const PixelStripConfig &config);
+
+// Fill the next frame with one color (red, green, blue and white), the pixels take it in GRB(W) order
+void pixelOutputFill(const uint8_t color[LIGHT_ZONE_PINS_MAX]);
+
+// Send the filled frame once the previous one is out, true while a frame waits
+bool pixelOutputPresent();
+
+PixelStats pixelOutputStats();
+
+uint32_t pixelFrameUs(uint16_t count, uint8_t channels);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef REPLY_OUTPUT_H
+#define REPLY_OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte sink a reply is written to
+class ReplyOutput {
+  public:
+    virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+
+    size_t put(char c);
+    size_t print(const char *text);
+    size_t print(int value);
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+// Writes the body of a reply, called once per pass so it must write the same bytes each time
+typedef void (*ReplyWriter)(ReplyOutput &out);
+
+// Only counts the bytes, used to announce the length to the transport
+class CountingOutput : public ReplyOutput {
+  public:
+    size_t count = 0;
+
+    size_t write(const uint8_t *buffer, size_t size) override;
+};
+
+// Escapes what is written as the content of a json string
+class JsonStringOutput : public ReplyOutput {
+  public:
+    explicit JsonStringOutput(ReplyOutput &out);
+
+    size_t write(const uint8_t *buffer, size_t size) override;
+
+  private:
+    ReplyOutput &out;
+};
+
+#endif
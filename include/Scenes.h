@@ -0,0 +1,53 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include <stdint.h>
+#include "LightCommand.h"
+
+// Named scenes : a batch of light commands stored once and recalled by name, every
+// command of the scene applied on the same frame. One store record per scene, kept
+// in RAM too so a recall does not read the flash.
+#define SCENES_MAX 8
+// Terminator included
+#define SCENE_NAME_MAX 16
+#define SCENE_STEPS_MAX LIGHT_BATCH_MAX
+
+// A light command without its queue time
+struct SceneStep {
+    uint8_t type = LIGHT_COMMAND_COLOR;
+    uint8_t zones = LIGHT_ZONES_ALL;
+    uint8_t effect = EFFECT_NONE;
+    uint8_t color[LIGHT_CHANNELS] = { 0, 0, 0 };
+    uint32_t durationMs = 0;
+};
+
+struct SceneRecord {
+    // Empty for a free record
+    char name[SCENE_NAME_MAX] = "";
+    uint8_t count = 0;
+    SceneStep steps[SCENE_STEPS_MAX];
+};
+
+enum SceneStatus : uint8_t {
+    SCENE_OK,
+    SCENE_NOT_FOUND,
+    // Every record is used by another scene
+    SCENE_STORE_FULL,
+    SCENE_STORE_FAILED,
+    SCENE_QUEUE_FULL
+};
+
+// Load the stored scenes
+void scenesBegin();
+
+uint8_t scenesCount();
+
+// Replaces a scene with the same name
+SceneStatus sceneSave(const char *name, const LightCommand commands[], uint8_t count);
+
+// Queue the commands of the scene as one batch, at applyAtUs (halMicros) when scheduled
+SceneStatus sceneRecall(const char *name, bool scheduled = false, uint32_t applyAtUs = 0);
+
+SceneStatus sceneDelete(const char *name);
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#define MQTT_ENABLE true
+#define OTA_ENABLE false
+
+#endif
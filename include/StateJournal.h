@@ -0,0 +1,53 @@
+#ifndef STATE_JOURNAL_H
+#define STATE_JOURNAL_H
+
+#include <stdint.h>
+#include "LightOutput.h"
+
+// Light state kept across power cuts, in the journal partition (see partitions.csv).
+// Records are appended one after the other over the sectors and the oldest sector is erased
+// when the ring comes back to it, so each sector is erased once every
+// HAL_JOURNAL_SECTOR_SIZE / sizeof(JournalRecord) writes. The end of a sector too short for
+// a record is left unused.
+
+// A change is written once the light has not changed for this long
+#define STATE_JOURNAL_QUIET_MS 5000
+
+struct JournalZone {
+    uint8_t color[LIGHT_CHANNELS] = { 0, 0, 0 };
+    uint8_t effect = 0;
+    uint32_t periodMs = 0;
+};
+
+struct JournalRecord {
+    // Incremented on each write, an erased slot reads 0xFFFFFFFF
+    uint32_t sequence = 0;
+    JournalZone zones[LIGHT_ZONES_MAX];
+    // CRC-32 of the fields above
+    uint32_t crc = 0;
+};
+
+struct JournalStats {
+    // Light commands seen, each one changes the state
+    uint32_t updates = 0;
+    uint32_t writes = 0;
+    // Updates coalesced into a later write or equal to the written state
+    uint32_t writesAvoided = 0;
+    uint32_t erases = 0;
+    uint32_t restoreUs = 0;
+};
+
+// Find the newest valid record and queue it to the light output, which must be started.
+// False when the journal is empty or there is no journal partition.
+bool stateJournalBegin();
+
+// Called from the loop, writes the state once it has been quiet. Returns the time before the
+// next write, UINT32_MAX when nothing is pending.
+uint32_t stateJournalLoop();
+
+// Write a pending change now, before a restart
+void stateJournalFlush();
+
+const JournalStats &stateJournalStats();
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef STATE_PUBLISHER_H
+#define STATE_PUBLISHER_H
+
+#include "Settings.h"
+
+#if MQTT_ENABLE == true
+#include <stdint.h>
+
+// Light state published by the device itself, so controllers subscribe once instead of
+// polling the status action. Both topics are retained by the broker :
+//   <publishChannel>/state         {"on":true,"zones":[{"red":255,"green":0,"blue":0,"effect":"none",
+//                                  "period":0,"transition":250},...]}, the requested state of every
+//                                  zone (the target of a fade, not its current frame)
+//   <publishChannel>/availability  "online" once connected, "offline" as the will of the
+//                                  connection or before a restart
+#define STATE_TOPIC_SUFFIX "/state"
+#define STATE_AVAILABILITY_SUFFIX "/availability"
+#define STATE_ONLINE "online"
+#define STATE_OFFLINE "offline"
+
+// A change is published once the state has not changed for this long, and at most this late
+// while a slider keeps changing it
+#define STATE_DEBOUNCE_MS 250
+#define STATE_DEBOUNCE_MAX_MS 1000
+
+struct StatePublisherStats {
+    // State changes seen by the loop, several per publish during a burst
+    uint32_t changes = 0;
+    // Queued to the mqtt outbox
+    uint32_t published = 0;
+    // Debounced back to the published state, nothing sent
+    uint32_t unchanged = 0;
+    // Refused by the outbox
+    uint32_t failed = 0;
+};
+
+// The topics are derived from the publish channel, which is kept
+void statePublisherBegin(const char *publishChannel);
+
+// Will topic of the mqtt connection, its message is STATE_OFFLINE
+const char *statePublisherAvailabilityTopic();
+
+// After each connection : "online" and the current state, a state changed while offline is
+// not retained yet
+void statePublisherOnline();
+
+// Before a restart, the will is only sent on a lost connection
+void statePublisherOffline();
+
+// Called from the loop after the light commands, publishes a debounced change. Returns the time
+// before the next publish, UINT32_MAX when nothing is pending.
+uint32_t statePublisherLoop();
+
+const StatePublisherStats &statePublisherStats();
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef TEMPLATE_RENDERER_H
+#define TEMPLATE_RENDERER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+
+#define TPL_VAR_NONE 0xFF
+// Largest value a placeholder can be replaced with (mqttHost and channels are 128)
+#define TPL_VALUE_MAX 128
+
+struct TemplateSegment {
+    const char *text;
+    uint16_t length;
+    uint8_t var;
+};
+
+struct Template {
+    const TemplateSegment *segments;
+    size_t count;
+};
+
+// Write the value of a placeholder, return its length (without the trailing \0)
+typedef size_t (*TemplateValueFn)(uint8_t var, char *buffer, size_t size);
+
+// Render up to maxLen bytes of the page starting at byte index, return the written length (0 at the end).
+// Nothing is kept between calls, values are html escaped.
+size_t templateRender(const Template &page, TemplateValueFn value, size_t index, uint8_t *buffer, size_t maxLen);
+
+// Total length of the rendered page
+size_t templateLength(const Template &page, TemplateValueFn value);
+
+// Copy a string value, clamped to the buffer size
+size_t templateCopy(char *buffer, size_t size, const char *value);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <ESPAsyncWebServer.h>
+#include "TemplateRenderer.h"
+#include "ReplyOutput.h"
+
+#define WEB_ASSETS_MAX 8
+#define WEB_ROUTES_MAX 8
+
+struct WebAsset {
+    char path[32] = "";
+    char etag[20] = "";
+    size_t size = 0;
+};
+
+struct WebTemplate {
+    const Template *page;
+    TemplateValueFn value;
+    int routeId;
+};
+
+struct WebRouteStats {
+    const char *path = nullptr;
+    uint32_t requests = 0;
+    uint32_t notModified = 0;
+    uint64_t bytes = 0;
+    uint32_t ttlbLastUs = 0;
+    uint32_t ttlbMaxUs = 0;
+    uint64_t ttlbTotalUs = 0;
+};
+
+// Load the manifest written by scripts/build_data.py
+bool webAssetsBegin(fs::FS &fs);
+
+// Register a route for the stats, return its id
+int webRouteRegister(const char *path);
+
+// Count the request and measure time to last byte (until the client is released)
+void webRouteTrack(AsyncWebServerRequest *request, int routeId, size_t bytes);
+
+// Send a static asset, gzipped with ETag and Cache-Control when present in the manifest
+void webSendAsset(AsyncWebServerRequest *request, int routeId, const char *path, const char *contentType);
+
+// Stream a compiled template as a chunked response, the descriptor must outlive the request
+void webSendTemplate(AsyncWebServerRequest *request, const WebTemplate *webTemplate);
+
+// Send the per route stats as json
+void webSendStats(AsyncWebServerRequest *request);
+
+// Send what the writer outputs as one buffered response
+void webSendWriter(AsyncWebServerRequest *request, int routeId, const char *contentType, ReplyWriter body);
+
+#endif
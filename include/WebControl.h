@@ -0,0 +1,64 @@
+#ifndef WEB_CONTROL_H
+#define WEB_CONTROL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "BinaryCommand.h"
+#include "CommandQueue.h"
+
+// Light control from the websocket clients of the web server, a local UI does not go through
+// the broker. Frames are the binary color frames of BinaryCommand.h, acknowledged with the
+// same ack frame when they ask for it.
+//
+// The websocket task decodes the frames and queues them for the loop task, which applies them
+// through the light command queue like the mqtt messages. Each client may send up to
+// WEB_CONTROL_RATE frames per second (bursts of WEB_CONTROL_BURST), the frames over the rate are
+// held and a newer frame covering the same zones replaces a held one.
+//
+// Every ack is sent by the loop task, AsyncWebSocket does not lock its clients against two
+// tasks sending : the acks of the frames the websocket task refuses (malformed, queue full) wait
+// in the slot of the client. A client takes a slot with its first frame, its disconnect marks
+// the slot and the loop task frees it, so a disconnect is never lost to a full queue.
+
+// AsyncWebSocket keeps at most 8 clients on the ESP32
+#define WEB_CONTROL_CLIENTS_MAX 8
+#define WEB_CONTROL_QUEUE_SIZE 32
+#define WEB_CONTROL_HELD_MAX 4
+// Acks waiting for the loop task in the slot of a client, more are lost and the client times out
+#define WEB_CONTROL_REFUSED_MAX 4
+#define WEB_CONTROL_RATE 100
+#define WEB_CONTROL_BURST 10
+
+// Each counter has a single writer : frames, malformed and overflow the websocket task,
+// the others the loop task
+struct WebControlStats {
+    uint32_t frames = 0;
+    uint32_t malformed = 0;
+    // Queue to the loop task full, or more clients than slots (not acknowledged)
+    uint32_t overflow = 0;
+    uint32_t applied = 0;
+    // Replaced while held by a newer frame of the same client
+    uint32_t coalesced = 0;
+    // Held because the client was over its rate
+    uint32_t limited = 0;
+    // Held frames full or light queue full
+    uint32_t dropped = 0;
+};
+
+// Ack frame to a client, called from the loop task
+typedef void (*WebControlReply)(uint32_t client, const uint8_t *frame, size_t length);
+
+// wake is called once a frame is queued, so the loop task runs webControlLoop
+void webControlBegin(void (*wake)(), WebControlReply reply);
+
+// Websocket task, one whole binary frame of the client
+void webControlReceive(uint32_t client, const uint8_t *data, size_t length);
+void webControlDisconnect(uint32_t client);
+
+// Loop task, applies the queued frames the rates allow. Returns the time before a held frame
+// may go, UINT32_MAX when none is held.
+uint32_t webControlLoop();
+
+WebControlStats webControlStats();
+
+#endif
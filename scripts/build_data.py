@@ -0,0 +1,68 @@
+"""
+PlatformIO pre-script : prepare the SPIFFS image content.
+
+Static assets (css, js, ...) of the `data` directory are gzipped, html
+templates are skipped as they are compiled into the firmware (see
+scripts/compile_templates.py) and other files (json config) are copied as
+is. An `assets.idx` manifest is written next to them, one line per
+compressed asset :
+
+    <path> <etag> <gzip size>
+
+The firmware reads this manifest once to answer with a strong ETag and 304
+on revalidation (see src/WebAssets.cpp).
+"""
+
+import gzip
+import hashlib
+import os
+import shutil
+
+Import("env")
+
+GZIP_EXTENSIONS = (".css", ".js", ".svg", ".ico", ".woff", ".woff2")
+SKIP_EXTENSIONS = (".html",)
+MANIFEST_NAME = "assets.idx"
+FS_TARGETS = ("buildfs", "uploadfs", "uploadfsota")
+
+
+def build_data(source_dir, output_dir):
+    if os.path.isdir(output_dir):
+        shutil.rmtree(output_dir)
+
+    os.makedirs(output_dir)
+    manifest = []
+
+    for name in sorted(os.listdir(source_dir)):
+        source_path = os.path.join(source_dir, name)
+
+        if not os.path.isfile(source_path) or name.endswith(SKIP_EXTENSIONS):
+            continue
+
+        if not name.endswith(GZIP_EXTENSIONS):
+            shutil.copyfile(source_path, os.path.join(output_dir, name))
+            continue
+
+        with open(source_path, "rb") as source_file:
+            content = source_file.read()
+
+        # mtime=0 keeps the archive (and so the ETag) stable between builds
+        compressed = gzip.compress(content, compresslevel=9, mtime=0)
+        etag = hashlib.sha1(compressed).hexdigest()[:16]
+
+        with open(os.path.join(output_dir, name + ".gz"), "wb") as output_file:
+            output_file.write(compressed)
+
+        manifest.append("/%s \"%s\" %d" % (name, etag, len(compressed)))
+        print("Gzip data/%s : %d -> %d bytes" % (name, len(content), len(compressed)))
+
+    with open(os.path.join(output_dir, MANIFEST_NAME), "w") as manifest_file:
+        manifest_file.write("\n".join(manifest) + "\n")
+
+
+if any(target in COMMAND_LINE_TARGETS for target in FS_TARGETS):
+    data_dir = env.subst("$PROJECT_DATA_DIR")
+    build_dir = os.path.join(env.subst("$BUILD_DIR"), "data")
+
+    build_data(data_dir, build_dir)
+    env.Replace(PROJECT_DATA_DIR=build_dir)
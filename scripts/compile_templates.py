@@ -0,0 +1,108 @@
+"""
+PlatformIO pre-script : compile the html templates of `data` into firmware.
+
+Each page is split on its `%VAR%` placeholders and written to
+include/generated/Templates.h as PROGMEM literal chunks plus a segment
+table, the placeholders being replaced by ids of the `TemplateVar` enum.
+The pages are then streamed by src/TemplateRenderer.cpp, the values being
+filled from the config by id (see src/ConfigPage.cpp).
+"""
+
+import os
+import re
+
+Import("env")
+
+TEMPLATES = ("index.html", "index_cc.html", "404.html", "restart.html")
+PLACEHOLDER = re.compile(r"%([A-Z][A-Z0-9_]*)%")
+
+
+def symbol_name(file_name):
+    base = os.path.splitext(file_name)[0]
+    return "template" + "".join(part.capitalize() for part in re.split(r"[^A-Za-z0-9]", base))
+
+
+def c_literal(text):
+    escaped = text.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n\"\n    \"")
+    return "\"" + escaped + "\""
+
+
+def split_template(content):
+    segments = []
+    position = 0
+
+    for match in PLACEHOLDER.finditer(content):
+        if match.start() > position:
+            segments.append((content[position:match.start()], None))
+
+        segments.append((None, match.group(1)))
+        position = match.end()
+
+    if position < len(content):
+        segments.append((content[position:], None))
+
+    return segments
+
+
+def compile_templates(data_dir, output_path):
+    pages = []
+    variables = set()
+
+    for file_name in TEMPLATES:
+        with open(os.path.join(data_dir, file_name), "r") as template_file:
+            segments = split_template(template_file.read())
+
+        variables.update(name for text, name in segments if name is not None)
+        pages.append((symbol_name(file_name), segments))
+
+    variables = sorted(variables)
+    lines = [
+        "// Generated by scripts/compile_templates.py, do not edit",
+        "#ifndef GENERATED_TEMPLATES_H",
+        "#define GENERATED_TEMPLATES_H",
+        "",
+        "#include \"TemplateRenderer.h\"",
+        "",
+        "enum TemplateVar : uint8_t {",
+    ]
+    lines += ["    TPL_VAR_%s," % name for name in variables]
+    lines += ["    TPL_VAR_COUNT", "};", ""]
+
+    for symbol, segments in pages:
+        for index, (text, name) in enumerate(segments):
+            if text is not None:
+                lines.append("static const char %sChunk%d[] PROGMEM = %s;" % (symbol, index, c_literal(text)))
+
+        lines.append("static const TemplateSegment %sSegments[] PROGMEM = {" % symbol)
+
+        for index, (text, name) in enumerate(segments):
+            if text is not None:
+                lines.append("    { %sChunk%d, %d, TPL_VAR_NONE }," % (symbol, index, len(text.encode("utf-8"))))
+            else:
+                lines.append("    { nullptr, 0, TPL_VAR_%s }," % name)
+
+        lines.append("};")
+        lines.append("static const Template %s = { %sSegments, %d };" % (symbol, symbol, len(segments)))
+        lines.append("")
+
+    lines.append("#endif")
+
+    output = "\n".join(lines) + "\n"
+
+    if os.path.isfile(output_path):
+        with open(output_path, "r") as current_file:
+            if current_file.read() == output:
+                return
+
+    os.makedirs(os.path.dirname(output_path), exist_ok=True)
+
+    with open(output_path, "w") as output_file:
+        output_file.write(output)
+
+    print("Templates compiled to %s" % output_path)
+
+
+compile_templates(
+    env.subst("$PROJECT_DATA_DIR"),
+    os.path.join(env.subst("$PROJECT_INCLUDE_DIR"), "generated", "Templates.h")
+)
@@ -0,0 +1,175 @@
+"""
+Local MQTT broker, a stand-in for Mosquitto on a machine without it.
+
+    python3 scripts/mqtt_broker.py [--port 1883] [--kick-every 300]
+
+QoS 0 publish and subscribe with the + and # wildcards, retained messages,
+last will and keep alive. Any username and password is accepted, like
+Mosquitto with allow_anonymous. --kick-every drops every client on a period
+so a soak run (scripts/mqtt_load.py) goes through reconnections.
+"""
+
+import argparse
+import asyncio
+import struct
+import sys
+import time
+
+import mqtt_wire as wire
+
+
+class Session:
+    def __init__(self, writer):
+        self.writer = writer
+        self.client_id = ""
+        self.subscriptions = set()
+        self.will = None
+
+    def send(self, data):
+        if not self.writer.is_closing():
+            self.writer.write(data)
+
+
+class Broker:
+    def __init__(self, verbose):
+        self.sessions = set()
+        self.retained = {}
+        self.verbose = verbose
+        self.published = 0
+
+    def log(self, text):
+        if self.verbose:
+            print("%.3f %s" % (time.time(), text), flush=True)
+
+    def route(self, topic, payload, retain):
+        self.published += 1
+
+        if retain:
+            # An empty retained payload clears the topic
+            if payload:
+                self.retained[topic] = payload
+            else:
+                self.retained.pop(topic, None)
+
+        data = wire.publish_packet(topic, payload)
+
+        for session in list(self.sessions):
+            if any(wire.topic_matches(pattern, topic) for pattern in session.subscriptions):
+                session.send(data)
+
+    async def handle(self, reader, writer):
+        session = Session(writer)
+        keep_alive = 0
+        clean = False
+
+        try:
+            header, body = await asyncio.wait_for(wire.read_packet(reader), 10)
+
+            if header & 0xF0 != wire.CONNECT:
+                return
+
+            _, offset = wire.decode_string(body, 0)
+            flags = body[offset + 1]
+            keep_alive = struct.unpack_from("!H", body, offset + 2)[0]
+            session.client_id, offset = wire.decode_string(body, offset + 4)
+
+            if flags & 0x04:
+                will_topic, offset = wire.decode_string(body, offset)
+                will_length = struct.unpack_from("!H", body, offset)[0]
+                session.will = (will_topic, body[offset + 2:offset + 2 + will_length], bool(flags & 0x20))
+
+            # A client id already connected takes the session over, as the spec asks
+            for other in [other for other in self.sessions if other.client_id == session.client_id]:
+                other.writer.close()
+
+            self.sessions.add(session)
+            session.send(wire.packet(wire.CONNACK, b"\x00\x00"))
+            self.log("%s connected" % session.client_id)
+
+            while True:
+                # 1.5 times the keep alive, then the client is lost
+                timeout = keep_alive * 1.5 if keep_alive else None
+                header, body = await asyncio.wait_for(wire.read_packet(reader), timeout)
+                packet_type = header & 0xF0
+
+                if packet_type == wire.PUBLISH:
+                    topic, payload, retain = wire.parse_publish(header, body)
+
+                    if header & 0x06:
+                        session.send(wire.packet(wire.PUBACK, body[len(topic.encode("utf-8")) + 2:][:2]))
+
+                    self.route(topic, payload, retain)
+                elif packet_type == wire.SUBSCRIBE:
+                    packet_id = body[:2]
+                    offset = 2
+                    granted = b""
+
+                    while offset < len(body):
+                        pattern, offset = wire.decode_string(body, offset)
+                        offset += 1
+                        session.subscriptions.add(pattern)
+                        granted += b"\x00"
+
+                        for topic, payload in self.retained.items():
+                            if wire.topic_matches(pattern, topic):
+                                session.send(wire.publish_packet(topic, payload, True))
+
+                    session.send(wire.packet(wire.SUBACK, packet_id + granted))
+                elif packet_type == wire.UNSUBSCRIBE:
+                    offset = 2
+
+                    while offset < len(body):
+                        pattern, offset = wire.decode_string(body, offset)
+                        session.subscriptions.discard(pattern)
+
+                    session.send(wire.packet(wire.UNSUBACK, body[:2]))
+                elif packet_type == wire.PINGREQ:
+                    session.send(wire.packet(wire.PINGRESP))
+                elif packet_type == wire.DISCONNECT:
+                    clean = True
+                    return
+        except (asyncio.IncompleteReadError, asyncio.TimeoutError, ConnectionError, OSError, IndexError, struct.error):
+            pass
+        finally:
+            self.sessions.discard(session)
+            writer.close()
+
+            if session.client_id:
+                self.log("%s disconnected%s" % (session.client_id, "" if clean else " (lost)"))
+
+            if session.will and not clean:
+                self.route(*session.will)
+
+    async def kick(self, period):
+        while True:
+            await asyncio.sleep(period)
+            self.log("Dropping %d clients" % len(self.sessions))
+
+            for session in list(self.sessions):
+                session.writer.close()
+
+
+async def main(arguments):
+    broker = Broker(arguments.verbose)
+    server = await asyncio.start_server(broker.handle, arguments.host, arguments.port)
+
+    print("Broker listening on %s:%d" % (arguments.host, arguments.port), flush=True)
+
+    if arguments.kick_every > 0:
+        asyncio.ensure_future(broker.kick(arguments.kick_every))
+
+    async with server:
+        await server.serve_forever()
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Local QoS 0 MQTT broker")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--kick-every", type=float, default=0, help="drop every client each N seconds")
+    parser.add_argument("-v", "--verbose", action="store_true")
+
+    try:
+        asyncio.run(main(parser.parse_args()))
+    except KeyboardInterrupt:
+        sys.exit(0)
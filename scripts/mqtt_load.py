@@ -0,0 +1,343 @@
+"""
+MQTT load generator and soak test of the firmware, end to end through a broker.
+
+    python3 scripts/mqtt_broker.py &                # or a Mosquitto
+    .pio/build/native/program mqtt 127.0.0.1 1883 & # or a device on the bench
+    python3 scripts/mqtt_load.py --rate 50 --mix changeColor=8,status=1,ping=1 --duration 3600
+
+Messages go to the mqttSubscribeChannel of the config and the replies are
+read on its mqttPublishChannel, the topics the device uses. Replies carry
+no request id, so they are matched in order per action. changeColor
+acknowledgements are batched by the firmware, "(N commands)" acknowledges
+the N oldest ones; their latency includes the 100 ms batching.
+
+Every --report seconds, and at the end, it prints the latency percentiles,
+the replies lost (not back within --timeout), the error replies, the
+reconnections of this client and the stalls (replies missing for more than a
+second while requests are pending, a device reconnecting shows up there).
+"""
+
+import argparse
+import asyncio
+import json
+import math
+import os
+import random
+import re
+import time
+
+import mqtt_wire as wire
+
+ACTIONS = ("changeColor", "status", "ping")
+ACK_COUNT = re.compile(r"\((\d+) commands\)$")
+STALL_SECONDS = 1.0
+# Latency histogram : 5 % wide buckets from 50 us to about 2 minutes
+BUCKET_BASE = 0.00005
+BUCKET_GROWTH = 1.05
+BUCKET_COUNT = 300
+
+
+class Histogram:
+    def __init__(self):
+        self.buckets = [0] * BUCKET_COUNT
+        self.count = 0
+        self.maximum = 0.0
+
+    def add(self, seconds):
+        index = 0 if seconds <= BUCKET_BASE else int(math.log(seconds / BUCKET_BASE, BUCKET_GROWTH)) + 1
+        self.buckets[min(index, BUCKET_COUNT - 1)] += 1
+        self.count += 1
+        self.maximum = max(self.maximum, seconds)
+
+    def merge(self, other):
+        for index, count in enumerate(other.buckets):
+            self.buckets[index] += count
+
+        self.count += other.count
+        self.maximum = max(self.maximum, other.maximum)
+
+    def percentile(self, fraction):
+        """Upper bound of the bucket, so never under the real value by more than 5 %."""
+        if not self.count:
+            return 0.0
+
+        rank = math.ceil(self.count * fraction)
+        seen = 0
+
+        for index, count in enumerate(self.buckets):
+            seen += count
+
+            if seen >= rank:
+                return min(BUCKET_BASE * BUCKET_GROWTH ** index, self.maximum)
+
+        return self.maximum
+
+
+class Counters:
+    def __init__(self):
+        self.sent = {action: 0 for action in ACTIONS}
+        self.replied = {action: 0 for action in ACTIONS}
+        self.lost = {action: 0 for action in ACTIONS}
+        self.errors = {action: 0 for action in ACTIONS}
+        self.latency = {action: Histogram() for action in ACTIONS}
+        self.reconnects = 0
+        self.stalls = []
+
+    def merge(self, other):
+        for action in ACTIONS:
+            self.sent[action] += other.sent[action]
+            self.replied[action] += other.replied[action]
+            self.lost[action] += other.lost[action]
+            self.errors[action] += other.errors[action]
+            self.latency[action].merge(other.latency[action])
+
+        self.reconnects += other.reconnects
+        self.stalls += other.stalls
+
+
+def parse_mix(text):
+    mix = []
+
+    for part in text.split(","):
+        action, _, weight = part.partition("=")
+
+        if action not in ACTIONS:
+            raise argparse.ArgumentTypeError("Unknown action %s, one of %s" % (action, ", ".join(ACTIONS)))
+
+        mix.append((action, float(weight or 1)))
+
+    return mix
+
+
+def milliseconds(seconds):
+    return "%.1f" % (seconds * 1000)
+
+
+class LoadTest:
+    def __init__(self, arguments, config):
+        self.arguments = arguments
+        self.listen_topic = config["mqttSubscribeChannel"]
+        self.reply_topic = config["mqttPublishChannel"]
+        self.random = random.Random(arguments.seed)
+        self.actions = [action for action, _ in arguments.mix]
+        self.weights = [weight for _, weight in arguments.mix]
+        # Send times of the requests waiting for a reply, oldest first
+        self.pending = {action: [] for action in ACTIONS}
+        self.interval = Counters()
+        self.total = Counters()
+        self.last_reply = time.monotonic()
+        self.stall_start = None
+        self.client = None
+
+    def payload(self, action):
+        if action == "changeColor":
+            color = [self.random.randrange(256) for _ in range(3)]
+            body = {"red": color[0], "green": color[1], "blue": color[2]}
+            return json.dumps({"action": action, "payload": body}).encode()
+
+        return json.dumps({"action": action}).encode()
+
+    def on_message(self, topic, payload, retain):
+        if topic != self.reply_topic or retain:
+            return
+
+        try:
+            reply = json.loads(payload)
+        except ValueError:
+            return
+
+        action = reply.get("actionCalled")
+
+        if action not in self.pending:
+            return
+
+        now = time.monotonic()
+        count = 1
+        match = ACK_COUNT.search(str(reply.get("payload", "")))
+
+        if action == "changeColor" and match:
+            count = int(match.group(1))
+
+        if str(reply.get("code")) != "200":
+            self.interval.errors[action] += 1
+
+        for _ in range(min(count, len(self.pending[action]))):
+            self.interval.latency[action].add(now - self.pending[action].pop(0))
+            self.interval.replied[action] += 1
+
+        self.last_reply = now
+
+    def sweep(self, now):
+        """Requests past the timeout are lost, a long silence with requests pending is a stall."""
+        for action in ACTIONS:
+            waiting = self.pending[action]
+
+            while waiting and now - waiting[0] > self.arguments.timeout:
+                waiting.pop(0)
+                self.interval.lost[action] += 1
+
+        outstanding = any(self.pending[action] for action in ACTIONS)
+
+        if outstanding and now - self.last_reply > STALL_SECONDS and self.stall_start is None:
+            self.stall_start = self.last_reply
+        elif self.stall_start is not None and (not outstanding or now - self.last_reply <= STALL_SECONDS):
+            self.interval.stalls.append(self.last_reply - self.stall_start)
+            self.stall_start = None
+
+    async def connect(self):
+        delay = 1.0
+
+        while True:
+            self.client = wire.Client(self.on_message)
+
+            try:
+                await self.client.connect(
+                    self.arguments.host,
+                    self.arguments.port,
+                    "mqtt-load-%d" % os.getpid(),
+                    self.arguments.username,
+                    self.arguments.password,
+                )
+                self.client.subscribe(self.reply_topic)
+                return
+            except (OSError, ConnectionError, asyncio.TimeoutError) as error:
+                print("Connection to %s:%d failed (%s), retry in %.0f s" % (
+                    self.arguments.host, self.arguments.port, error, delay), flush=True)
+                await asyncio.sleep(delay)
+                delay = min(delay * 2, 30)
+
+    def report(self, elapsed, counters, title):
+        sent = sum(counters.sent.values())
+        replied = sum(counters.replied.values())
+        lost = sum(counters.lost.values())
+        stall_time = sum(counters.stalls)
+
+        print("%s %6.0f s  sent %d  replied %d  lost %d  errors %d  reconnects %d  stalls %d (%.1f s)" % (
+            title, elapsed, sent, replied, lost, sum(counters.errors.values()),
+            counters.reconnects, len(counters.stalls), stall_time), flush=True)
+
+        for action in ACTIONS:
+            histogram = counters.latency[action]
+
+            if not counters.sent[action] and not histogram.count:
+                continue
+
+            print("    %-12s %7d sent  p50 %7s  p90 %7s  p99 %7s  p99.9 %7s  max %7s ms  lost %d  errors %d" % (
+                action,
+                counters.sent[action],
+                milliseconds(histogram.percentile(0.5)),
+                milliseconds(histogram.percentile(0.9)),
+                milliseconds(histogram.percentile(0.99)),
+                milliseconds(histogram.percentile(0.999)),
+                milliseconds(histogram.maximum),
+                counters.lost[action],
+                counters.errors[action],
+            ), flush=True)
+
+    def summary(self):
+        summary = {"reconnects": self.total.reconnects, "stalls": self.total.stalls, "actions": {}}
+
+        for action in ACTIONS:
+            histogram = self.total.latency[action]
+            summary["actions"][action] = {
+                "sent": self.total.sent[action],
+                "replied": self.total.replied[action],
+                "lost": self.total.lost[action],
+                "errors": self.total.errors[action],
+                "p50_ms": histogram.percentile(0.5) * 1000,
+                "p90_ms": histogram.percentile(0.9) * 1000,
+                "p99_ms": histogram.percentile(0.99) * 1000,
+                "p999_ms": histogram.percentile(0.999) * 1000,
+                "max_ms": histogram.maximum * 1000,
+            }
+
+        return summary
+
+    async def run(self):
+        arguments = self.arguments
+        period = arguments.burst / arguments.rate
+        start = time.monotonic()
+        next_send = start
+        next_report = start + arguments.report
+
+        await self.connect()
+        print("Sending %.1f messages/s in bursts of %d to %s, replies on %s" % (
+            arguments.rate, arguments.burst, self.listen_topic, self.reply_topic), flush=True)
+
+        while arguments.duration <= 0 or time.monotonic() - start < arguments.duration:
+            now = time.monotonic()
+
+            if self.client.closed.is_set():
+                self.interval.reconnects += 1
+                await self.connect()
+                continue
+
+            if now >= next_send:
+                for _ in range(arguments.burst):
+                    action = self.random.choices(self.actions, self.weights)[0]
+                    self.client.publish(self.listen_topic, self.payload(action))
+                    self.pending[action].append(time.monotonic())
+                    self.interval.sent[action] += 1
+
+                # Behind schedule after a reconnection, the missed sends are skipped
+                next_send = max(next_send + period, now - period)
+
+            self.sweep(now)
+
+            if now >= next_report:
+                self.report(now - start, self.interval, "interval")
+                self.total.merge(self.interval)
+                self.interval = Counters()
+                next_report += arguments.report
+
+            await asyncio.sleep(max(0, min(next_send, next_report) - time.monotonic()))
+
+        # The replies in flight come back or time out
+        drain_end = time.monotonic() + arguments.timeout
+
+        while any(self.pending[action] for action in ACTIONS) and time.monotonic() < drain_end:
+            await asyncio.sleep(0.05)
+
+        self.sweep(time.monotonic() + arguments.timeout + 1)
+        self.total.merge(self.interval)
+        self.report(time.monotonic() - start, self.total, "total   ")
+        await self.client.disconnect()
+
+        if arguments.json:
+            with open(arguments.json, "w") as output:
+                json.dump(self.summary(), output, indent=2)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="End to end MQTT load and soak test of the firmware")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--config", default=os.path.join(os.path.dirname(__file__), "..", "data", "config.json"),
+                        help="config of the device, for its topics and mqtt credentials")
+    parser.add_argument("--username", help="default : mqttUsername of the config")
+    parser.add_argument("--password", help="default : mqttPassword of the config")
+    parser.add_argument("--rate", type=float, default=20, help="messages per second")
+    parser.add_argument("--burst", type=int, default=1, help="messages sent back to back each time")
+    parser.add_argument("--mix", type=parse_mix, default=parse_mix("changeColor=8,status=1,ping=1"),
+                        help="action=weight list of changeColor, status and ping")
+    parser.add_argument("--duration", type=float, default=60, help="seconds, 0 runs until interrupted")
+    parser.add_argument("--report", type=float, default=10, help="seconds between two reports")
+    parser.add_argument("--timeout", type=float, default=5, help="seconds before a reply is lost")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--json", help="write the total to this file")
+    arguments = parser.parse_args()
+
+    with open(arguments.config) as config_file:
+        config = json.load(config_file)
+
+    arguments.username = config.get("mqttUsername", "") if arguments.username is None else arguments.username
+    arguments.password = config.get("mqttPassword", "") if arguments.password is None else arguments.password
+
+    try:
+        asyncio.run(LoadTest(arguments, config).run())
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
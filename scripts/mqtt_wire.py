@@ -0,0 +1,191 @@
+"""
+MQTT 3.1.1 framing shared by scripts/mqtt_broker.py and scripts/mqtt_load.py.
+
+QoS 0 only, which is what the firmware uses (PubSubClient publishes and
+subscribes at QoS 0). Standard library only, so the tools run without
+installing anything next to PlatformIO.
+"""
+
+import asyncio
+import struct
+
+CONNECT = 0x10
+CONNACK = 0x20
+PUBLISH = 0x30
+PUBACK = 0x40
+SUBSCRIBE = 0x80
+SUBACK = 0x90
+UNSUBSCRIBE = 0xA0
+UNSUBACK = 0xB0
+PINGREQ = 0xC0
+PINGRESP = 0xD0
+DISCONNECT = 0xE0
+
+
+def encode_string(text):
+    data = text.encode("utf-8") if isinstance(text, str) else text
+    return struct.pack("!H", len(data)) + data
+
+
+def decode_string(body, offset):
+    length = struct.unpack_from("!H", body, offset)[0]
+    return body[offset + 2:offset + 2 + length].decode("utf-8"), offset + 2 + length
+
+
+def packet(header, body=b""):
+    """Fixed header, remaining length on 7 bits per byte, then the body."""
+    length = len(body)
+    encoded = bytearray([header])
+
+    while True:
+        digit = length & 0x7F
+        length >>= 7
+        encoded.append(digit | 0x80 if length else digit)
+
+        if not length:
+            break
+
+    return bytes(encoded) + body
+
+
+async def read_packet(reader):
+    """(header byte, body) of the next packet, IncompleteReadError on a closed connection."""
+    header = (await reader.readexactly(1))[0]
+    length = 0
+    shift = 0
+
+    while True:
+        digit = (await reader.readexactly(1))[0]
+        length |= (digit & 0x7F) << shift
+        shift += 7
+
+        if not digit & 0x80:
+            break
+
+    return header, await reader.readexactly(length)
+
+
+def connect_packet(client_id, username="", password="", keep_alive=15, will=None):
+    """will : (topic, payload bytes, retain) published by the broker when the client is lost."""
+    flags = 0x02
+    payload = encode_string(client_id)
+
+    if will:
+        flags |= 0x04 | (0x20 if will[2] else 0)
+        payload += encode_string(will[0]) + encode_string(will[1])
+
+    if username:
+        flags |= 0x80
+        payload += encode_string(username)
+
+        if password:
+            flags |= 0x40
+            payload += encode_string(password)
+
+    return packet(CONNECT, encode_string("MQTT") + bytes([4, flags]) + struct.pack("!H", keep_alive) + payload)
+
+
+def publish_packet(topic, payload, retain=False):
+    return packet(PUBLISH | (0x01 if retain else 0), encode_string(topic) + payload)
+
+
+def subscribe_packet(packet_id, topics):
+    body = struct.pack("!H", packet_id)
+
+    for topic in topics:
+        body += encode_string(topic) + b"\x00"
+
+    return packet(SUBSCRIBE | 0x02, body)
+
+
+def parse_publish(header, body):
+    """(topic, payload, retain) of a PUBLISH, the packet id of QoS 1 and 2 skipped."""
+    topic, offset = decode_string(body, 0)
+
+    if header & 0x06:
+        offset += 2
+
+    return topic, body[offset:], bool(header & 0x01)
+
+
+def topic_matches(pattern, topic):
+    """Subscription filter with the + and # wildcards."""
+    pattern_levels = pattern.split("/")
+    topic_levels = topic.split("/")
+
+    for index, level in enumerate(pattern_levels):
+        if level == "#":
+            return True
+
+        if index >= len(topic_levels) or (level != "+" and level != topic_levels[index]):
+            return False
+
+    return len(pattern_levels) == len(topic_levels)
+
+
+class Client:
+    """Asyncio QoS 0 client : connect, subscribe, publish, and a callback per message."""
+
+    def __init__(self, on_message):
+        self.on_message = on_message
+        self.reader = None
+        self.writer = None
+        self.packet_id = 0
+        self.tasks = []
+        self.closed = asyncio.Event()
+
+    async def connect(self, host, port, client_id, username="", password="", keep_alive=15, will=None):
+        self.reader, self.writer = await asyncio.open_connection(host, port)
+        self.closed.clear()
+        self.writer.write(connect_packet(client_id, username, password, keep_alive, will))
+        header, body = await asyncio.wait_for(read_packet(self.reader), 5)
+
+        if header & 0xF0 != CONNACK or len(body) < 2 or body[1] != 0:
+            self.writer.close()
+            raise ConnectionError("Connection refused (%s)" % (body[1] if len(body) > 1 else "no CONNACK"))
+
+        self.tasks = [
+            asyncio.ensure_future(self.read_loop()),
+            asyncio.ensure_future(self.ping_loop(keep_alive)),
+        ]
+
+    async def read_loop(self):
+        try:
+            while True:
+                header, body = await read_packet(self.reader)
+
+                if header & 0xF0 == PUBLISH:
+                    topic, payload, retain = parse_publish(header, body)
+                    self.on_message(topic, payload, retain)
+        except (asyncio.IncompleteReadError, ConnectionError, OSError):
+            pass
+        finally:
+            self.closed.set()
+
+    async def ping_loop(self, keep_alive):
+        while not self.closed.is_set():
+            await asyncio.sleep(keep_alive / 2)
+            self.send(packet(PINGREQ))
+
+    def subscribe(self, *topics):
+        self.packet_id = self.packet_id % 0xFFFF + 1
+        self.send(subscribe_packet(self.packet_id, topics))
+
+    def publish(self, topic, payload, retain=False):
+        self.send(publish_packet(topic, payload, retain))
+
+    def send(self, data):
+        if self.writer is not None and not self.closed.is_set():
+            self.writer.write(data)
+
+    async def disconnect(self):
+        for task in self.tasks:
+            task.cancel()
+
+        if self.writer is not None:
+            if not self.closed.is_set():
+                self.writer.write(packet(DISCONNECT))
+
+            self.writer.close()
+
+        self.closed.set()
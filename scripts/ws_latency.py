@@ -0,0 +1,258 @@
+"""
+Round trip latency of a color frame over the websocket control channel and
+over the MQTT binary topic, against the same device.
+
+    python3 scripts/mqtt_broker.py &                     # or a Mosquitto
+    .pio/build/native/program mqtt 127.0.0.1 1883 8080 &  # or a device on the bench
+    python3 scripts/ws_latency.py --ws-port 8080 --count 2000
+
+The same color frame (BinaryCommand.h) goes to /ws and to the
+mqttSubscribeChannel + "/bin" topic of the config, with a sequence number
+and the reply flag. The time is taken until its ack comes back, on the
+websocket or on mqttPublishChannel + "/bin". One frame is in flight at a
+time and the paths take turns, so both see the same device load; --rate
+stays under the per client rate of the firmware (100 frames per second)
+unless the rate limiting itself is measured.
+"""
+
+import argparse
+import asyncio
+import base64
+import hashlib
+import json
+import os
+import struct
+import time
+
+import mqtt_wire as wire
+from mqtt_load import Histogram, milliseconds
+
+BINARY_SUFFIX = "/bin"
+FLAG_SEQUENCE = 0x02
+FLAG_REPLY = 0x04
+HANDSHAKE_GUID = b"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+OPCODE_BINARY = 0x2
+OPCODE_CLOSE = 0x8
+OPCODE_PING = 0x9
+OPCODE_PONG = 0xA
+PATHS = ("websocket", "mqtt")
+
+
+def color_frame(sequence, step):
+    """A slow hue walk, each frame is a different color."""
+    red = (step * 7) & 0xFF
+    return struct.pack(">BBBBH", FLAG_SEQUENCE | FLAG_REPLY, red, 255 - red, 64, sequence)
+
+
+def parse_ack(payload):
+    if len(payload) != 3:
+        return None
+
+    status, sequence = struct.unpack(">BH", payload)
+    return status, sequence
+
+
+class WebSocket:
+    """Websocket client of the firmware : binary frames, masked as the protocol wants."""
+
+    def __init__(self, on_frame):
+        self.on_frame = on_frame
+        self.reader = None
+        self.writer = None
+        self.task = None
+
+    async def connect(self, host, port, path):
+        self.reader, self.writer = await asyncio.open_connection(host, port)
+        key = base64.b64encode(os.urandom(16))
+        self.writer.write(
+            b"GET %s HTTP/1.1\r\nHost: %s:%d\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            b"Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n"
+            % (path.encode(), host.encode(), port, key)
+        )
+        headers = await asyncio.wait_for(self.reader.readuntil(b"\r\n\r\n"), 5)
+        accept = base64.b64encode(hashlib.sha1(key + HANDSHAKE_GUID).digest())
+
+        if not headers.startswith(b"HTTP/1.1 101") or accept not in headers:
+            self.writer.close()
+            raise ConnectionError("Websocket upgrade refused : %s" % headers.split(b"\r\n")[0].decode())
+
+        self.task = asyncio.ensure_future(self.read_loop())
+
+    def send(self, opcode, payload):
+        mask = os.urandom(4)
+        masked = bytes(byte ^ mask[index % 4] for index, byte in enumerate(payload))
+        length = len(payload)
+
+        if length < 126:
+            header = struct.pack(">BB", 0x80 | opcode, 0x80 | length)
+        else:
+            header = struct.pack(">BBH", 0x80 | opcode, 0x80 | 126, length)
+
+        self.writer.write(header + mask + masked)
+
+    async def read_loop(self):
+        try:
+            while True:
+                first, second = await self.reader.readexactly(2)
+                length = second & 0x7F
+
+                if length == 126:
+                    length, = struct.unpack(">H", await self.reader.readexactly(2))
+                elif length == 127:
+                    length, = struct.unpack(">Q", await self.reader.readexactly(8))
+
+                payload = await self.reader.readexactly(length)
+                opcode = first & 0x0F
+
+                if opcode == OPCODE_PING:
+                    self.send(OPCODE_PONG, payload)
+                elif opcode == OPCODE_CLOSE:
+                    break
+                elif opcode == OPCODE_BINARY:
+                    self.on_frame(payload)
+        except (asyncio.IncompleteReadError, ConnectionError, OSError):
+            pass
+
+    async def close(self):
+        if self.task is not None:
+            self.task.cancel()
+
+        if self.writer is not None:
+            self.send(OPCODE_CLOSE, struct.pack(">H", 1000))
+            self.writer.close()
+
+
+class LatencyTest:
+    def __init__(self, arguments, config):
+        self.arguments = arguments
+        self.listen_topic = config["mqttSubscribeChannel"] + BINARY_SUFFIX
+        self.reply_topic = config["mqttPublishChannel"] + BINARY_SUFFIX
+        self.latency = {path: Histogram() for path in PATHS}
+        self.lost = {path: 0 for path in PATHS}
+        self.errors = {path: 0 for path in PATHS}
+        # Sequence number and future of the frame in flight of each path
+        self.waiting = {path: (None, None) for path in PATHS}
+        self.sequence = 0
+
+    def on_ack(self, path, payload):
+        ack = parse_ack(payload)
+        sequence, future = self.waiting[path]
+
+        if ack is None or future is None or future.done() or ack[1] != sequence:
+            return
+
+        future.set_result(ack[0])
+
+    def on_message(self, topic, payload, retain):
+        if topic == self.reply_topic:
+            self.on_ack("mqtt", payload)
+
+    async def round_trip(self, path, send, step):
+        self.sequence = self.sequence % 0xFFFF + 1
+        future = asyncio.get_event_loop().create_future()
+        self.waiting[path] = (self.sequence, future)
+        start = time.perf_counter()
+        send(color_frame(self.sequence, step))
+
+        try:
+            status = await asyncio.wait_for(future, self.arguments.timeout)
+        except asyncio.TimeoutError:
+            self.lost[path] += 1
+            return
+
+        if status != 0:
+            self.errors[path] += 1
+            return
+
+        self.latency[path].add(time.perf_counter() - start)
+
+    async def run(self):
+        arguments = self.arguments
+        mqtt = wire.Client(self.on_message)
+        socket = WebSocket(lambda payload: self.on_ack("websocket", payload))
+
+        await mqtt.connect(arguments.host, arguments.port, "ws-latency-%d" % os.getpid(),
+                           arguments.username, arguments.password)
+        mqtt.subscribe(self.reply_topic)
+        await socket.connect(arguments.ws_host or arguments.host, arguments.ws_port, arguments.path)
+        # The subscription is in place before the first frame
+        await asyncio.sleep(0.2)
+
+        senders = {
+            "websocket": lambda frame: socket.send(OPCODE_BINARY, frame),
+            "mqtt": lambda frame: mqtt.publish(self.listen_topic, frame),
+        }
+        interval = 1.0 / arguments.rate
+        next_send = time.monotonic()
+
+        for step in range(arguments.count):
+            for path in PATHS:
+                await self.round_trip(path, senders[path], step)
+
+            next_send += interval
+            await asyncio.sleep(max(0.0, next_send - time.monotonic()))
+
+        await socket.close()
+        await mqtt.disconnect()
+        self.report()
+
+    def report(self):
+        print("%-10s %7s %5s %6s %8s %8s %8s %8s %8s"
+              % ("path", "acked", "lost", "errors", "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms"))
+
+        for path in PATHS:
+            latency = self.latency[path]
+            print("%-10s %7d %5d %6d %8s %8s %8s %8s %8s" % (
+                path, latency.count, self.lost[path], self.errors[path],
+                milliseconds(latency.percentile(0.5)), milliseconds(latency.percentile(0.9)),
+                milliseconds(latency.percentile(0.99)), milliseconds(latency.percentile(0.999)),
+                milliseconds(latency.maximum),
+            ))
+
+        if self.arguments.json:
+            with open(self.arguments.json, "w") as output:
+                json.dump({
+                    path: {
+                        "acked": self.latency[path].count,
+                        "lost": self.lost[path],
+                        "errors": self.errors[path],
+                        "p50": self.latency[path].percentile(0.5),
+                        "p90": self.latency[path].percentile(0.9),
+                        "p99": self.latency[path].percentile(0.99),
+                        "p999": self.latency[path].percentile(0.999),
+                        "max": self.latency[path].maximum,
+                    } for path in PATHS
+                }, output, indent=2)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Websocket against MQTT round trip of a color frame")
+    parser.add_argument("--host", default="127.0.0.1", help="mqtt broker")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--ws-host", help="device, default : --host")
+    parser.add_argument("--ws-port", type=int, default=80)
+    parser.add_argument("--path", default="/ws")
+    parser.add_argument("--config", default=os.path.join(os.path.dirname(__file__), "..", "data", "config.json"),
+                        help="config of the device, for its topics and mqtt credentials")
+    parser.add_argument("--username", help="default : mqttUsername of the config")
+    parser.add_argument("--password", help="default : mqttPassword of the config")
+    parser.add_argument("--count", type=int, default=1000, help="frames per path")
+    parser.add_argument("--rate", type=float, default=50, help="frames per second and path")
+    parser.add_argument("--timeout", type=float, default=2, help="seconds before a frame is lost")
+    parser.add_argument("--json", help="write the percentiles (seconds) to this file")
+    arguments = parser.parse_args()
+
+    with open(arguments.config) as config_file:
+        config = json.load(config_file)
+
+    arguments.username = config.get("mqttUsername", "") if arguments.username is None else arguments.username
+    arguments.password = config.get("mqttPassword", "") if arguments.password is None else arguments.password
+
+    try:
+        asyncio.run(LatencyTest(arguments, config).run())
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,72 @@
+#include <string.h>
+#include "Settings.h"
+
+#if MQTT_ENABLE == true
+#include "Actions.h"
+
+#define ACTION_NAME(name, handler, schema) #name,
+#define ACTION_ENTRY(name, handler, schema) { #name, handler },
+#define ACTION_MANIFEST_ENTRY(name, handler, schema) \
+    ",{\"action\":\"" #name "\",\"payload\":" schema ",\"response\":" ACTION_SCHEMA_RESPONSE "}"
+
+static constexpr const char *actionNames[] = { MQTT_ACTIONS(ACTION_NAME) };
+static constexpr size_t actionCount = sizeof(actionNames) / sizeof(actionNames[0]);
+
+static const Action actions[] = { MQTT_ACTIONS(ACTION_ENTRY) };
+
+// Every entry starts with a comma, the first one is skipped
+static const char actionManifestEntries[] PROGMEM = MQTT_ACTIONS(ACTION_MANIFEST_ENTRY) "]";
+const char *const actionManifest = actionManifestEntries + 1;
+const size_t actionManifestLength = sizeof(actionManifestEntries) - 2;
+
+// FNV-1a, usable at compile time (C++11 constexpr) and at runtime
+static constexpr uint32_t actionHash(const char *name, uint32_t hash = 2166136261u ^ ACTION_HASH_SEED) {
+    return *name == '\0' ? hash : actionHash(name + 1, (hash ^ (uint8_t) *name) * 16777619u);
+}
+
+// The low bits of FNV-1a only depend on the low bits of the name, the high half is folded in
+static constexpr size_t actionFold(uint32_t hash) {
+    return (hash ^ (hash >> 16)) & (ACTION_SLOTS - 1);
+}
+
+static constexpr size_t actionSlot(const char *name) {
+    return actionFold(actionHash(name));
+}
+
+static constexpr bool actionSlotsUnique(size_t i = 0, size_t j = 1) {
+    return i >= actionCount ? true
+        : j >= actionCount ? actionSlotsUnique(i + 1, i + 2)
+        : actionSlot(actionNames[i]) != actionSlot(actionNames[j]) && actionSlotsUnique(i, j + 1);
+}
+
+static constexpr int8_t actionAt(size_t slot, size_t i = 0) {
+    return i >= actionCount ? -1
+        : actionSlot(actionNames[i]) == slot ? (int8_t) i
+        : actionAt(slot, i + 1);
+}
+
+static_assert(actionCount <= ACTION_SLOTS, "Too many mqtt actions, increase ACTION_SLOTS");
+static_assert(actionSlotsUnique(), "Mqtt action names collide, change ACTION_HASH_SEED");
+
+#define ACTION_SLOTS_4(slot) actionAt(slot), actionAt(slot + 1), actionAt(slot + 2), actionAt(slot + 3)
+
+// Perfect hash table : slot -> index in actions, -1 when empty
+static constexpr int8_t actionSlots[ACTION_SLOTS] = {
+    ACTION_SLOTS_4(0), ACTION_SLOTS_4(4), ACTION_SLOTS_4(8), ACTION_SLOTS_4(12),
+    ACTION_SLOTS_4(16), ACTION_SLOTS_4(20), ACTION_SLOTS_4(24), ACTION_SLOTS_4(28)
+};
+
+const Action *actionFind(const char *name) {
+    if (nullptr == name) {
+        return nullptr;
+    }
+
+    int8_t index = actionSlots[actionSlot(name)];
+
+    if (index < 0 || strcmp(actions[index].name, name) != 0) {
+        return nullptr;
+    }
+
+    return &actions[index];
+}
+#endif
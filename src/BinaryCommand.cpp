@@ -0,0 +1,107 @@
+#include <string.h>
+#include "BinaryCommand.h"
+
+static size_t binaryColorLength(uint8_t flags) {
+    return 4
+        + ((flags & BINARY_FLAG_EFFECT) != 0 ? 1 : 0)
+        + ((flags & BINARY_FLAG_TRANSITION) != 0 ? 2 : 0)
+        + ((flags & BINARY_FLAG_SEQUENCE) != 0 ? 2 : 0)
+        + ((flags & BINARY_FLAG_ZONES) != 0 ? 1 : 0);
+}
+
+bool binaryColorDecode(const uint8_t *payload, size_t length, BinaryColor &command) {
+    if (length < 4 || (payload[0] & ~BINARY_FLAGS_MASK) != 0 || length != binaryColorLength(payload[0])) {
+        return false;
+    }
+
+    size_t position = 4;
+
+    command.flags = payload[0];
+    command.color[0] = payload[1];
+    command.color[1] = payload[2];
+    command.color[2] = payload[3];
+    command.transitionMs = 0;
+    command.sequence = 0;
+    command.zones = LIGHT_ZONES_ALL;
+    command.effect = EFFECT_NONE;
+
+    if ((command.flags & BINARY_FLAG_EFFECT) != 0) {
+        if (payload[position] >= EFFECT_COUNT) {
+            return false;
+        }
+
+        command.effect = (EffectType) payload[position++];
+    }
+
+    if ((command.flags & BINARY_FLAG_TRANSITION) != 0) {
+        command.transitionMs = (uint16_t) (payload[position] << 8 | payload[position + 1]);
+        position += 2;
+    }
+
+    if ((command.flags & BINARY_FLAG_SEQUENCE) != 0) {
+        command.sequence = (uint16_t) (payload[position] << 8 | payload[position + 1]);
+        position += 2;
+    }
+
+    if ((command.flags & BINARY_FLAG_ZONES) != 0) {
+        command.zones = payload[position];
+    }
+
+    return true;
+}
+
+size_t binaryColorEncode(const BinaryColor &command, uint8_t *buffer) {
+    size_t position = 4;
+
+    buffer[0] = command.flags & BINARY_FLAGS_MASK;
+    buffer[1] = command.color[0];
+    buffer[2] = command.color[1];
+    buffer[3] = command.color[2];
+
+    if ((command.flags & BINARY_FLAG_EFFECT) != 0) {
+        buffer[position++] = command.effect;
+    }
+
+    if ((command.flags & BINARY_FLAG_TRANSITION) != 0) {
+        buffer[position++] = command.transitionMs >> 8;
+        buffer[position++] = command.transitionMs & 0xFF;
+    }
+
+    if ((command.flags & BINARY_FLAG_SEQUENCE) != 0) {
+        buffer[position++] = command.sequence >> 8;
+        buffer[position++] = command.sequence & 0xFF;
+    }
+
+    if ((command.flags & BINARY_FLAG_ZONES) != 0) {
+        buffer[position++] = command.zones;
+    }
+
+    return position;
+}
+
+void binaryColorCommand(const BinaryColor &frame, LightCommand &command) {
+    command.type = LIGHT_COMMAND_COLOR;
+    command.effect = frame.effect;
+    command.zones = frame.zones;
+    command.durationMs = frame.transitionMs;
+    memcpy(command.color, frame.color, sizeof(command.color));
+
+    if ((frame.flags & BINARY_FLAG_EFFECT) == 0) {
+        return;
+    }
+
+    if (frame.effect == EFFECT_NONE) {
+        command.type = LIGHT_COMMAND_EFFECT_STOP;
+    } else {
+        command.type = LIGHT_COMMAND_EFFECT_START;
+        command.durationMs = (frame.flags & BINARY_FLAG_TRANSITION) != 0 ? frame.transitionMs : EFFECT_PERIOD_DEFAULT_MS;
+    }
+}
+
+size_t binaryAckEncode(BinaryStatus status, uint16_t sequence, uint8_t buffer[BINARY_ACK_LENGTH]) {
+    buffer[0] = status;
+    buffer[1] = sequence >> 8;
+    buffer[2] = sequence & 0xFF;
+
+    return BINARY_ACK_LENGTH;
+}
@@ -0,0 +1,87 @@
+#include <Arduino.h>
+#include <freertos/timers.h>
+#include "Hal.h"
+#include "Buttons.h"
+
+struct Button {
+    int pin = -1;
+    // Debounced level, owned by the timer task
+    bool pressed = false;
+    TimerHandle_t debounceTimer = nullptr;
+    TimerHandle_t longPressTimer = nullptr;
+};
+
+static Button buttons[BUTTONS_MAX];
+static uint8_t buttonCount = 0;
+static QueueHandle_t events = nullptr;
+static void (*wakeLoop)() = nullptr;
+
+// Each bounce pushes the debounce timer back, it fires once the contact has settled
+static void IRAM_ATTR onEdge(void *arg) {
+    BaseType_t woken = pdFALSE;
+
+    xTimerResetFromISR(((Button *) arg)->debounceTimer, &woken);
+
+    if (pdFALSE != woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+// Timer task, a full queue drops the event
+static void post(uint8_t index, ButtonEventType type) {
+    ButtonEvent event;
+
+    event.button = index;
+    event.type = type;
+    event.atMs = halMillis();
+    xQueueSend(events, &event, 0);
+    wakeLoop();
+}
+
+static void onDebounced(TimerHandle_t timer) {
+    uint8_t index = (uint32_t) pvTimerGetTimerID(timer);
+    Button &button = buttons[index];
+    bool pressed = HIGH == digitalRead(button.pin);
+
+    // Bounced back to the level it had
+    if (pressed == button.pressed) {
+        return;
+    }
+
+    button.pressed = pressed;
+
+    if (true == pressed) {
+        xTimerStart(button.longPressTimer, 0);
+    } else {
+        xTimerStop(button.longPressTimer, 0);
+    }
+
+    post(index, true == pressed ? BUTTON_PRESSED : BUTTON_RELEASED);
+}
+
+static void onLongPress(TimerHandle_t timer) {
+    post((uint32_t) pvTimerGetTimerID(timer), BUTTON_LONG_PRESS);
+}
+
+void buttonsBegin(const int pins[], uint8_t count, void (*wake)()) {
+    events = xQueueCreate(BUTTON_EVENTS_MAX, sizeof(ButtonEvent));
+    wakeLoop = wake;
+    buttonCount = count < BUTTONS_MAX ? count : BUTTONS_MAX;
+
+    for (uint8_t i = 0 ; i < buttonCount ; i++) {
+        Button &button = buttons[i];
+
+        button.pin = pins[i];
+        button.debounceTimer = xTimerCreate("btnDebounce", pdMS_TO_TICKS(BUTTON_DEBOUNCE_MS), pdFALSE, (void *) (uint32_t) i, onDebounced);
+        button.longPressTimer = xTimerCreate("btnLong", pdMS_TO_TICKS(BUTTON_LONG_PRESS_MS), pdFALSE, (void *) (uint32_t) i, onLongPress);
+
+        pinMode(button.pin, INPUT_PULLDOWN);
+        // A button held at boot is seen as pressed after the debounce delay
+        xTimerStart(button.debounceTimer, 0);
+        attachInterruptArg(button.pin, onEdge, &button, CHANGE);
+    }
+}
+
+bool buttonsPoll(ButtonEvent &event) {
+    return nullptr != events && pdTRUE == xQueueReceive(events, &event, 0);
+}
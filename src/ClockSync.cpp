@@ -0,0 +1,57 @@
+#include "ClockSync.h"
+#include "Hal.h"
+
+struct ClockSample {
+    int64_t offsetUs = 0;
+    uint32_t rttMs = 0;
+};
+
+// Newest overwrites the oldest
+static ClockSample window[CLOCK_SYNC_WINDOW];
+static ClockSyncStats stats;
+// Last ping, waiting for its round trip
+static uint64_t pingMs = 0;
+static int64_t pingLocalUs = 0;
+static bool pingPending = false;
+
+void clockSyncPing(uint64_t controllerMs, int32_t previousRttMs) {
+    if (previousRttMs >= 0 && true == pingPending) {
+        ClockSample &sample = window[stats.samples % CLOCK_SYNC_WINDOW];
+
+        sample.offsetUs = (int64_t) pingMs * 1000 + (int64_t) previousRttMs * 500 - pingLocalUs;
+        sample.rttMs = previousRttMs;
+        stats.samples++;
+
+        // The newest of the fastest, the older ones drifted more
+        uint32_t newest = (stats.samples - 1) % CLOCK_SYNC_WINDOW;
+        const ClockSample *fastest = &window[newest];
+
+        for (uint32_t i = 0 ; i < CLOCK_SYNC_WINDOW && i < stats.samples ; i++) {
+            if (window[i].rttMs < fastest->rttMs) {
+                fastest = &window[i];
+            }
+        }
+
+        stats.offsetUs = fastest->offsetUs;
+        stats.rttMs = fastest->rttMs;
+        stats.synced = true;
+    }
+
+    pingMs = controllerMs;
+    pingLocalUs = halMicros();
+    pingPending = true;
+}
+
+bool clockSyncToLocal(uint64_t controllerMs, int64_t &localUs) {
+    if (false == stats.synced) {
+        return false;
+    }
+
+    localUs = (int64_t) controllerMs * 1000 - stats.offsetUs;
+
+    return true;
+}
+
+ClockSyncStats clockSyncStats() {
+    return stats;
+}
@@ -0,0 +1,98 @@
+#include "ColorPipeline.h"
+
+// The LEDC counter runs from the 80 MHz APB clock, a period is 1 << resolution ticks
+static_assert(((uint64_t) LIGHT_PWM_FREQUENCY << LIGHT_PWM_RESOLUTION) <= 80000000, "PWM frequency too high for its resolution");
+static_assert(LIGHT_PWM_RESOLUTION + HAL_PWM_FRACTION_BITS <= COLOR_LINEAR_BITS, "The duty has more bits than the linear light");
+
+static constexpr double cieCube(double value) {
+    return value * value * value;
+}
+
+// CIE 1976 : L* = 116 * Y^(1/3) - 16, and L* = 903.3 * Y on the linear part below 8
+static constexpr double cieLuminance(double lightness) {
+    return lightness <= 8.0 ? lightness / 903.3 : cieCube((lightness + 16.0) / 116.0);
+}
+
+static constexpr uint16_t cieLinear(int level) {
+    return (uint16_t) (cieLuminance(level * 100.0 / (COLOR_LEVELS - 1)) * 65535.0 + 0.5);
+}
+
+// The doubles only exist in the compiler, the device has no double precision unit
+#define CIE_LEVELS_4(i) cieLinear(i), cieLinear(i + 1), cieLinear(i + 2), cieLinear(i + 3)
+#define CIE_LEVELS_16(i) CIE_LEVELS_4(i), CIE_LEVELS_4(i + 4), CIE_LEVELS_4(i + 8), CIE_LEVELS_4(i + 12)
+#define CIE_LEVELS_64(i) CIE_LEVELS_16(i), CIE_LEVELS_16(i + 16), CIE_LEVELS_16(i + 32), CIE_LEVELS_16(i + 48)
+
+static constexpr uint16_t cieTable[COLOR_LEVELS] = {
+    CIE_LEVELS_64(0), CIE_LEVELS_64(64), CIE_LEVELS_64(128), CIE_LEVELS_64(192)
+};
+
+static constexpr bool cieIncreasing(int level = 1) {
+    return level >= COLOR_LEVELS || (cieTable[level] > cieTable[level - 1] && cieIncreasing(level + 1));
+}
+
+static_assert(0 == cieTable[0] && 65535 == cieTable[COLOR_LEVELS - 1], "CIE table does not span the linear range");
+static_assert(cieIncreasing(), "CIE table levels are not all distinct");
+
+// Black body colors every 500 K from COLOR_KELVIN_MIN (Mitchell Charity, CIE 1964 10 degrees)
+#define KELVIN_STEP 500
+#define KELVIN_ENTRIES ((COLOR_KELVIN_MAX - COLOR_KELVIN_MIN) / KELVIN_STEP + 1)
+
+static constexpr uint8_t kelvinTable[KELVIN_ENTRIES][LIGHT_CHANNELS] = {
+    { 255, 56, 0 }, { 255, 109, 0 }, { 255, 137, 18 }, { 255, 161, 72 }, { 255, 180, 107 },
+    { 255, 196, 137 }, { 255, 209, 163 }, { 255, 219, 186 }, { 255, 228, 206 }, { 255, 236, 224 },
+    { 255, 243, 239 }, { 255, 249, 253 }, { 245, 243, 255 }, { 235, 238, 255 }, { 227, 233, 255 },
+    { 220, 229, 255 }, { 214, 225, 255 }, { 208, 222, 255 }, { 204, 219, 255 }
+};
+
+static_assert(sizeof(kelvinTable) / sizeof(kelvinTable[0]) == KELVIN_ENTRIES, "Kelvin table does not cover its range");
+
+static uint8_t scale(uint8_t value, uint8_t level) {
+    return (uint8_t) (((uint16_t) value * (level + 1)) >> 8);
+}
+
+uint16_t colorLinear(uint8_t level) {
+    return cieTable[level];
+}
+
+uint16_t colorBalance(uint16_t linear, uint8_t balance) {
+    return (uint16_t) (((uint32_t) linear * (balance + 1)) >> 8);
+}
+
+// Rounded, so 65535 is full on and not one fraction under it
+uint32_t colorDuty(uint16_t linear) {
+    return ((uint32_t) linear * COLOR_DUTY_MAX + 32767) / 65535;
+}
+
+void colorFromHsv(uint16_t hue, uint8_t saturation, uint8_t value, uint8_t color[LIGHT_CHANNELS]) {
+    // 6 sectors of 256 steps around the circle, one channel ramps up or down in each
+    uint16_t position = (uint32_t) (hue % 360) * 6 * 256 / 360;
+    uint8_t sector = position >> 8;
+    uint8_t ramp = position & 0xFF;
+    uint8_t low = scale(value, 255 - saturation);
+    uint8_t up = scale(value, 255 - scale(saturation, 255 - ramp));
+    uint8_t down = scale(value, 255 - scale(saturation, ramp));
+    const uint8_t sectors[6][LIGHT_CHANNELS] = {
+        { value, up, low }, { down, value, low }, { low, value, up },
+        { low, down, value }, { up, low, value }, { value, low, down }
+    };
+
+    for (int i = 0 ; i < LIGHT_CHANNELS ; i++) {
+        color[i] = sectors[sector][i];
+    }
+}
+
+void colorFromKelvin(uint16_t kelvin, uint8_t brightness, uint8_t color[LIGHT_CHANNELS]) {
+    kelvin = kelvin < COLOR_KELVIN_MIN ? COLOR_KELVIN_MIN : kelvin > COLOR_KELVIN_MAX ? COLOR_KELVIN_MAX : kelvin;
+
+    uint16_t index = (kelvin - COLOR_KELVIN_MIN) / KELVIN_STEP;
+    // Weight of the next entry, 0 to 255
+    uint16_t weight = (kelvin - COLOR_KELVIN_MIN - index * KELVIN_STEP) * 256 / KELVIN_STEP;
+    const uint8_t *below = kelvinTable[index];
+    const uint8_t *above = kelvinTable[index + 1 < KELVIN_ENTRIES ? index + 1 : index];
+
+    for (int i = 0 ; i < LIGHT_CHANNELS ; i++) {
+        uint8_t value = (uint8_t) ((below[i] * (256 - weight) + above[i] * weight) >> 8);
+
+        color[i] = scale(value, brightness);
+    }
+}
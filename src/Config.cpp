@@ -0,0 +1,262 @@
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <string.h>
+#include "Config.h"
+#include "Hal.h"
+#include "Logger.h"
+
+#define CONFIG_JSON_CAPACITY ( \
+    JSON_OBJECT_SIZE(13) \
+    + 2 * JSON_ARRAY_SIZE(LIGHT_ZONES_MAX) \
+    + 2 * LIGHT_ZONES_MAX * JSON_ARRAY_SIZE(LIGHT_ZONE_PINS_MAX) \
+    + JSON_OBJECT_SIZE(3) \
+)
+
+// GPIO 34 to 39 are inputs only
+#define CONFIG_OUTPUT_PIN_MAX 33
+
+static void copyString(char *destination, JsonVariantConst value, size_t size) {
+    const char *text = value | "";
+
+    snprintf(destination, size, "%s", text);
+}
+
+// One array of pins per zone, 3 for an RGB strip and 4 for an RGBW one
+static bool parseZones(JsonVariantConst value, LightZoneConfig zones[LIGHT_ZONES_MAX]) {
+    LightZoneConfig parsed[LIGHT_ZONES_MAX] = {};
+    size_t channels = 0;
+
+    if (false == value.is<JsonArrayConst>() || value.size() == 0 || value.size() > LIGHT_ZONES_MAX) {
+        return false;
+    }
+
+    for (size_t i = 0 ; i < value.size() ; i++) {
+        JsonVariantConst pins = value[i];
+
+        if (false == pins.is<JsonArrayConst>() || pins.size() < 3 || pins.size() > LIGHT_ZONE_PINS_MAX) {
+            return false;
+        }
+
+        parsed[i].channels = pins.size();
+        memset(parsed[i].balance, LIGHT_BALANCE_NONE, sizeof(parsed[i].balance));
+        channels += pins.size();
+
+        for (size_t j = 0 ; j < LIGHT_ZONE_PINS_MAX ; j++) {
+            int pin = j < pins.size() ? pins[j].as<int>() : -1;
+
+            if (j < pins.size() && (pin < 0 || pin > CONFIG_OUTPUT_PIN_MAX)) {
+                return false;
+            }
+
+            parsed[i].pins[j] = pin;
+        }
+    }
+
+    if (channels > LIGHT_PWM_CHANNELS) {
+        return false;
+    }
+
+    memcpy(zones, parsed, sizeof(parsed));
+
+    return true;
+}
+
+// One array per zone in the order of the zones, a scale of 0 to 255 for each of its channels.
+// The zones left out keep theirs.
+static bool parseBalance(JsonVariantConst value, LightZoneConfig zones[LIGHT_ZONES_MAX]) {
+    uint8_t parsed[LIGHT_ZONES_MAX][LIGHT_ZONE_PINS_MAX];
+
+    if (false == value.is<JsonArrayConst>() || value.size() > LIGHT_ZONES_MAX) {
+        return false;
+    }
+
+    for (size_t i = 0 ; i < value.size() ; i++) {
+        JsonVariantConst scales = value[i];
+
+        if (0 == zones[i].channels || false == scales.is<JsonArrayConst>() || scales.size() != zones[i].channels) {
+            return false;
+        }
+
+        for (size_t j = 0 ; j < LIGHT_ZONE_PINS_MAX ; j++) {
+            int scale = j < scales.size() ? scales[j].as<int>() : LIGHT_BALANCE_NONE;
+
+            if (scale < 0 || scale > 255) {
+                return false;
+            }
+
+            parsed[i][j] = scale;
+        }
+    }
+
+    for (size_t i = 0 ; i < value.size() ; i++) {
+        memcpy(zones[i].balance, parsed[i], LIGHT_ZONE_PINS_MAX);
+    }
+
+    return true;
+}
+
+// {"pin": 13, "count": 300, "white": false}
+static bool parsePixels(JsonVariantConst value, PixelStripConfig &pixels) {
+    int pin = value["pin"] | -1;
+    unsigned int count = value["count"] | 0u;
+
+    if (pin < 0 || pin > CONFIG_OUTPUT_PIN_MAX || 0 == count || count > PIXELS_MAX) {
+        return false;
+    }
+
+    pixels.pin = pin;
+    pixels.count = count;
+    pixels.channels = true == (value["white"] | false) ? 4 : 3;
+
+    return true;
+}
+
+bool configParse(char *json, size_t length, Config &config) {
+    // Zero-copy : the strings of the document point into the buffer until they are copied
+    StaticJsonDocument<CONFIG_JSON_CAPACITY> document;
+    DeserializationError err = deserializeJson(document, json, length);
+
+    switch (err.code()) {
+        case DeserializationError::Ok:
+            break;
+        case DeserializationError::InvalidInput:
+            LOG_ERROR("Invalid input!");
+            return false;
+        case DeserializationError::NoMemory:
+            LOG_ERROR("Not enough memory");
+            return false;
+        default:
+            LOG_ERROR("Deserialization failed");
+            return false;
+    }
+
+    if (
+        !document.containsKey("wifiSsid") ||
+        !document.containsKey("wifiPassword") ||
+        #if MQTT_ENABLE == true
+        !document.containsKey("mqttEnable") ||
+        !document.containsKey("mqttHost") ||
+        !document.containsKey("mqttPort") ||
+        !document.containsKey("mqttUsername") ||
+        !document.containsKey("mqttPassword") ||
+        !document.containsKey("mqttPublishChannel") ||
+        !document.containsKey("mqttSubscribeChannel") ||
+        #endif
+        !document.containsKey("uuid")
+    ) {
+        LOG_ERROR("Key not found in json fille");
+        return false;
+    }
+
+    copyString(config.wifiSsid, document["wifiSsid"], sizeof(config.wifiSsid));
+    copyString(config.wifiPassword, document["wifiPassword"], sizeof(config.wifiPassword));
+    #if MQTT_ENABLE == true
+    config.mqttEnable = document["mqttEnable"] | true;
+    copyString(config.mqttHost, document["mqttHost"], sizeof(config.mqttHost));
+    config.mqttPort = document["mqttPort"] | 1883;
+    copyString(config.mqttUsername, document["mqttUsername"], sizeof(config.mqttUsername));
+    copyString(config.mqttPassword, document["mqttPassword"], sizeof(config.mqttPassword));
+    copyString(config.mqttPublishChannel, document["mqttPublishChannel"], sizeof(config.mqttPublishChannel));
+    copyString(config.mqttSubscribeChannel, document["mqttSubscribeChannel"], sizeof(config.mqttSubscribeChannel));
+    #endif
+    copyString(config.uuid, document["uuid"], sizeof(config.uuid));
+
+    // Optional, a config without zones keeps the single strip
+    if (document.containsKey("zones") && false == parseZones(document["zones"], config.zones)) {
+        LOG_ERROR("Invalid zones in json file");
+        return false;
+    }
+
+    if (document.containsKey("balance") && false == parseBalance(document["balance"], config.zones)) {
+        LOG_ERROR("Invalid balance in json file");
+        return false;
+    }
+
+    if (document.containsKey("pixels") && false == parsePixels(document["pixels"], config.pixels)) {
+        LOG_ERROR("Invalid pixels in json file");
+        return false;
+    }
+
+    return true;
+}
+
+size_t configSerialize(const Config &config, char *buffer, size_t size) {
+    StaticJsonDocument<CONFIG_JSON_CAPACITY> document;
+
+    // Strings are not copied, the document only lives in this call
+    document["wifiSsid"] = (const char *) config.wifiSsid;
+    document["wifiPassword"] = (const char *) config.wifiPassword;
+    #if MQTT_ENABLE == true
+    document["mqttEnable"] = config.mqttEnable;
+    document["mqttHost"] = (const char *) config.mqttHost;
+    document["mqttPort"] = config.mqttPort;
+    document["mqttUsername"] = (const char *) config.mqttUsername;
+    document["mqttPassword"] = (const char *) config.mqttPassword;
+    document["mqttPublishChannel"] = (const char *) config.mqttPublishChannel;
+    document["mqttSubscribeChannel"] = (const char *) config.mqttSubscribeChannel;
+    #endif
+    document["uuid"] = (const char *) config.uuid;
+
+    JsonArray zones = document.createNestedArray("zones");
+    bool balanced = false;
+
+    for (int i = 0 ; i < LIGHT_ZONES_MAX && config.zones[i].channels != 0 ; i++) {
+        JsonArray pins = zones.createNestedArray();
+
+        for (int j = 0 ; j < config.zones[i].channels ; j++) {
+            pins.add(config.zones[i].pins[j]);
+            balanced = true == balanced || config.zones[i].balance[j] != LIGHT_BALANCE_NONE;
+        }
+    }
+
+    // Only once a zone is calibrated
+    if (true == balanced) {
+        JsonArray balance = document.createNestedArray("balance");
+
+        for (int i = 0 ; i < LIGHT_ZONES_MAX && config.zones[i].channels != 0 ; i++) {
+            JsonArray scales = balance.createNestedArray();
+
+            for (int j = 0 ; j < config.zones[i].channels ; j++) {
+                scales.add(config.zones[i].balance[j]);
+            }
+        }
+    }
+
+    if (config.pixels.pin >= 0) {
+        JsonObject pixels = document.createNestedObject("pixels");
+
+        pixels["pin"] = config.pixels.pin;
+        pixels["count"] = config.pixels.count;
+        pixels["white"] = config.pixels.channels == 4;
+    }
+
+    size_t length = measureJson(document);
+
+    if (length >= size) {
+        return length;
+    }
+
+    return serializeJson(document, buffer, size);
+}
+
+bool configImport(const char *path, Config &config) {
+    char buffer[CONFIG_FILE_MAX];
+    int32_t length = halFileRead(path, buffer, sizeof(buffer));
+
+    if (length < 0) {
+        LOG_WARN("No config file to import");
+        return false;
+    }
+
+    if (length == 0) {
+        LOG_ERROR("Config file is empty !");
+        return false;
+    }
+
+    if (length > CONFIG_FILE_MAX) {
+        LOG_ERROR("Config file size is too large");
+        return false;
+    }
+
+    return configParse(buffer, length, config);
+}
@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include "ConfigPage.h"
+#include "TemplateRenderer.h"
+#include "generated/Templates.h"
+
+static const Config *pageConfig = nullptr;
+static const char *pageAppName = "";
+static const char *pageError = "";
+
+void configPageBind(const Config *config, const char *appName, const char *errorMessage) {
+    pageConfig = config;
+    pageAppName = appName;
+    pageError = errorMessage;
+}
+
+size_t configPageValue(uint8_t var, char *buffer, size_t size) {
+    const Config &config = *pageConfig;
+
+    switch (var) {
+        case TPL_VAR_TITLE:
+        case TPL_VAR_MODULE_NAME:
+            return templateCopy(buffer, size, pageAppName);
+        case TPL_VAR_WIFI_SSID:
+            return templateCopy(buffer, size, config.wifiSsid);
+        case TPL_VAR_WIFI_PASSWD:
+            return templateCopy(buffer, size, config.wifiPassword);
+        #if MQTT_ENABLE == true
+        case TPL_VAR_MQTT_ENABLE:
+            return templateCopy(buffer, size, true == config.mqttEnable ? "checked" : "");
+        case TPL_VAR_MQTT_HOST:
+            return templateCopy(buffer, size, config.mqttHost);
+        case TPL_VAR_MQTT_PORT:
+            return snprintf(buffer, size, "%d", config.mqttPort);
+        case TPL_VAR_MQTT_USERNAME:
+            return templateCopy(buffer, size, config.mqttUsername);
+        case TPL_VAR_MQTT_PASSWD:
+            return templateCopy(buffer, size, config.mqttPassword);
+        case TPL_VAR_MQTT_PUB_CHAN:
+            return templateCopy(buffer, size, config.mqttPublishChannel);
+        case TPL_VAR_MQTT_SUB_CHAN:
+            return templateCopy(buffer, size, config.mqttSubscribeChannel);
+        #endif
+        case TPL_VAR_ERROR_MESSAGE:
+            return templateCopy(buffer, size, pageError);
+        case TPL_VAR_ERROR_HIDDEN:
+            return templateCopy(buffer, size, pageError[0] == '\0' ? "d-none" : "");
+        default:
+            return 0;
+    }
+}
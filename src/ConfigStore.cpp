@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <string.h>
+#include "ConfigStore.h"
+#include "Crc32.h"
+#include "Hal.h"
+#include "Logger.h"
+
+static const char *const slotKeys[CONFIG_STORE_SLOTS] = { "configA", "configB" };
+
+// Slot of the newest record and its sequence, -1 until one is loaded or saved
+static int currentSlot = -1;
+static uint32_t currentSequence = 0;
+
+static uint32_t recordCrc(const ConfigRecord &record) {
+    uint32_t crc = crc32(0, &record.sequence, sizeof(record.sequence));
+
+    return crc32(crc, &record.config, sizeof(record.config));
+}
+
+static bool readSlot(int slot, ConfigRecord &record) {
+    return halStoreRead(slotKeys[slot], &record, sizeof(record))
+        && record.magic == CONFIG_STORE_MAGIC
+        && record.version == CONFIG_STORE_VERSION
+        && record.size == sizeof(Config)
+        && record.crc == recordCrc(record);
+}
+
+bool configStoreLoad(Config &config) {
+    ConfigRecord record;
+
+    currentSlot = -1;
+
+    for (int slot = 0 ; slot < CONFIG_STORE_SLOTS ; slot++) {
+        // Sequence distance, so the order survives the wrap around
+        if (readSlot(slot, record) && (currentSlot < 0 || (int32_t) (record.sequence - currentSequence) > 0)) {
+            currentSlot = slot;
+            currentSequence = record.sequence;
+            memcpy(&config, &record.config, sizeof(config));
+        }
+    }
+
+    return currentSlot >= 0;
+}
+
+bool configStoreSave(Config &config) {
+    ConfigRecord record;
+    int slot = (currentSlot + 1) % CONFIG_STORE_SLOTS;
+
+    if (strlen(config.uuid) == 0) {
+        snprintf(config.uuid, sizeof(config.uuid), "%u", halRandom());
+    }
+
+    record.sequence = currentSlot < 0 ? 1 : currentSequence + 1;
+    memcpy(&record.config, &config, sizeof(config));
+    record.crc = recordCrc(record);
+
+    if (!halStoreWrite(slotKeys[slot], &record, sizeof(record))) {
+        LOG_ERROR("Failed to write the config");
+        return false;
+    }
+
+    currentSlot = slot;
+    currentSequence = record.sequence;
+
+    return true;
+}
@@ -0,0 +1,334 @@
+#include <stddef.h>
+#include <string.h>
+#include "Hal.h"
+#include "ConnectionManager.h"
+#include "Logger.h"
+#include "Metrics.h"
+
+// Time given to one association before it is retried
+static const uint32_t wifiAttemptTimeoutMs = 10000;
+// A directed association takes a few hundred ms, past this the access point has moved
+static const uint32_t directedTimeoutMs = 3000;
+
+#define CONNECTION_CACHE_MAGIC 0x4e455443
+static const char *cacheStoreKey = "netcache";
+
+struct ConnectionCache {
+    uint32_t magic = 0;
+    // Hash of the ssid and broker host, a new config does not reuse the old network
+    uint32_t key = 0;
+    WifiLink link;
+    // halRetainedSeconds() at the middle of the lease of link.ip, when a DHCP client renews it
+    uint32_t leaseEndS = 0;
+    uint32_t brokerIp = 0;
+    uint32_t check = 0;
+};
+
+static_assert(sizeof(ConnectionCache) <= HAL_RETAINED_SIZE, "Connection cache larger than the retained memory");
+
+static const char *wifiSsid = nullptr;
+static const char *wifiPassword = nullptr;
+static ConnectionHandlers handlers = { nullptr, nullptr };
+static ConnectionState state = CONNECTION_IDLE;
+static ConnectionStats stats;
+static Backoff wifiBackoff(1000, 30000);
+static Backoff mqttBackoff(1000, 60000);
+static unsigned long nextAttempt = 0;
+static ConnectionCache cache;
+static uint32_t cacheKey = 0;
+static bool cacheValid = false;
+// The current attempt goes to the cached access point
+static bool directed = false;
+// The station runs on the cached address, not on a lease of its own
+static bool staticAddress = false;
+
+Backoff::Backoff(uint32_t baseMs, uint32_t maxMs) : baseMs(baseMs), maxMs(maxMs), currentMs(baseMs) {
+}
+
+uint32_t Backoff::next() {
+    uint32_t half = currentMs / 2;
+    uint32_t delayMs = half + halRandom() % (half + 1);
+
+    currentMs = currentMs >= maxMs / 2 ? maxMs : currentMs * 2;
+
+    return delayMs;
+}
+
+void Backoff::reset() {
+    currentMs = baseMs;
+}
+
+// FNV-1a
+static uint32_t hashBytes(const void *data, size_t size, uint32_t hash = 2166136261u) {
+    const uint8_t *bytes = (const uint8_t *) data;
+
+    for (size_t i = 0 ; i < size ; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t cacheCheck(const ConnectionCache &record) {
+    return hashBytes(&record, offsetof(ConnectionCache, check));
+}
+
+static bool cacheUsable(const ConnectionCache &record) {
+    return record.magic == CONNECTION_CACHE_MAGIC && record.key == cacheKey && record.check == cacheCheck(record);
+}
+
+static void cacheForgetAddress() {
+    cache.link.ip = 0;
+    cache.link.gateway = 0;
+    cache.link.subnet = 0;
+    cache.link.dns = 0;
+    cache.leaseEndS = 0;
+}
+
+// The server can give the address to another host once the lease is not renewed
+static bool cacheLeaseValid() {
+    return 0 != cache.link.ip && halRetainedSeconds() < cache.leaseEndS;
+}
+
+// The retained copy first, the store one after a power loss
+static void cacheLoad() {
+    halRetainedRead(&cache, sizeof(cache));
+    cacheValid = cacheUsable(cache);
+
+    if (true == cacheValid) {
+        LOG_INFO("Network cache restored from retained memory");
+        return;
+    }
+
+    cacheValid = halStoreRead(cacheStoreKey, &cache, sizeof(cache)) && cacheUsable(cache);
+
+    if (true == cacheValid) {
+        // The clock of the lease did not survive the power loss, only the access point is reused
+        cacheForgetAddress();
+        LOG_INFO("Network cache restored from the store");
+    } else {
+        cache = ConnectionCache();
+    }
+}
+
+// The store is only written when the access point or the broker changes, not on every lease
+static void cacheSave(bool persist) {
+    cache.magic = CONNECTION_CACHE_MAGIC;
+    cache.key = cacheKey;
+    cache.check = cacheCheck(cache);
+    halRetainedWrite(&cache, sizeof(cache));
+
+    if (true == persist) {
+        halStoreWrite(cacheStoreKey, &cache, sizeof(cache));
+    }
+}
+
+static void cacheUpdate() {
+    WifiLink link;
+
+    halWifiLink(link);
+
+    bool moved = false == cacheValid
+        || link.channel != cache.link.channel
+        || memcmp(link.bssid, cache.link.bssid, sizeof(link.bssid)) != 0;
+
+    // A static address was not renewed, its lease still ends where the last DHCP one put it
+    if (0 != link.leaseS) {
+        cache.leaseEndS = halRetainedSeconds() + link.leaseS / 2;
+    }
+
+    cache.link = link;
+    cacheValid = true;
+    cacheSave(moved);
+}
+
+static void wifiAttempt() {
+    stats.wifiAttempts++;
+    directed = cacheValid;
+
+    if (true == directed && false == cacheLeaseValid()) {
+        cacheForgetAddress();
+    }
+
+    staticAddress = true == directed && 0 != cache.link.ip;
+
+    if (true == directed) {
+        stats.directedAttempts++;
+        LOG_INFO("Try to connect to %s (cached access point, channel %u)", wifiSsid, cache.link.channel);
+    } else {
+        LOG_INFO("Try to connect to %s", wifiSsid);
+    }
+
+    halWifiBegin(wifiSsid, wifiPassword, true == directed ? &cache.link : nullptr);
+    nextAttempt = halMillis() + (true == directed ? directedTimeoutMs : wifiAttemptTimeoutMs);
+    state = CONNECTION_WIFI_CONNECTING;
+}
+
+static void wifiRetry() {
+    uint32_t delayMs = wifiBackoff.next();
+
+    halWifiDisconnect();
+    LOG_INFO("WiFi retry in %u ms", delayMs);
+    nextAttempt = halMillis() + delayMs;
+    state = CONNECTION_WIFI_WAIT;
+}
+
+static void mqttRetry() {
+    uint32_t delayMs = mqttBackoff.next();
+
+    LOG_INFO("Mqtt retry in %u ms", delayMs);
+    nextAttempt = halMillis() + delayMs;
+    state = CONNECTION_MQTT_WAIT;
+}
+
+// Past the lease of the cached address the station asks DHCP for its own, the mqtt
+// connection is made again once it is up
+static void wifiLeaseRenew() {
+    LOG_INFO("Lease of the cached address over, asking DHCP");
+    staticAddress = false;
+    directed = false;
+    cacheForgetAddress();
+    cacheSave(false);
+    halWifiDhcp();
+    nextAttempt = halMillis() + wifiAttemptTimeoutMs;
+    state = CONNECTION_WIFI_CONNECTING;
+}
+
+static void wifiConnected() {
+    cacheUpdate();
+    LOG_INFO(
+        "WiFi connected (IP : %u.%u.%u.%u)",
+        cache.link.ip & 0xFF,
+        (cache.link.ip >> 8) & 0xFF,
+        (cache.link.ip >> 16) & 0xFF,
+        cache.link.ip >> 24
+    );
+    metricsBootPhase(BOOT_PHASE_WIFI);
+}
+
+void connectionBegin(const char *ssid, const char *password, const char *brokerHost, const ConnectionHandlers &connectionHandlers) {
+    wifiSsid = ssid;
+    wifiPassword = password;
+    handlers = connectionHandlers;
+    wifiBackoff.reset();
+    mqttBackoff.reset();
+
+    cacheKey = hashBytes(ssid, strlen(ssid) + 1);
+    cacheKey = hashBytes(brokerHost, strlen(brokerHost) + 1, cacheKey);
+    cacheLoad();
+    wifiAttempt();
+}
+
+ConnectionState connectionLoop() {
+    unsigned long current = halMillis();
+
+    if ((state == CONNECTION_MQTT_WAIT || state == CONNECTION_READY) && false == halWifiUp()) {
+        stats.wifiDisconnects++;
+        LOG_WARN("WiFi connection lost");
+        wifiRetry();
+    }
+
+    if ((state == CONNECTION_MQTT_WAIT || state == CONNECTION_READY) && true == staticAddress && false == cacheLeaseValid()) {
+        wifiLeaseRenew();
+    }
+
+    switch (state) {
+        case CONNECTION_WIFI_CONNECTING:
+            if (true == halWifiUp()) {
+                wifiConnected();
+                wifiBackoff.reset();
+                nextAttempt = current;
+                state = nullptr != handlers.mqttConnect ? CONNECTION_MQTT_WAIT : CONNECTION_READY;
+            } else if ((long) (current - nextAttempt) >= 0 && true == directed) {
+                // Straight to a full scan, the backoff is for an unreachable network
+                stats.directedFailures++;
+                cacheValid = false;
+                LOG_WARN("Cached access point not found, scanning");
+                halWifiDisconnect();
+                wifiAttempt();
+            } else if ((long) (current - nextAttempt) >= 0) {
+                LOG_WARN("Error connection to %s", wifiSsid);
+                wifiRetry();
+            }
+            break;
+        case CONNECTION_WIFI_WAIT:
+            if ((long) (current - nextAttempt) >= 0) {
+                wifiAttempt();
+            }
+            break;
+        case CONNECTION_MQTT_WAIT:
+            if ((long) (current - nextAttempt) >= 0) {
+                stats.mqttAttempts++;
+
+                if (true == handlers.mqttConnect()) {
+                    mqttBackoff.reset();
+                    metricsBootPhase(BOOT_PHASE_MQTT);
+                    state = CONNECTION_READY;
+                } else {
+                    stats.mqttFailures++;
+                    mqttRetry();
+                }
+            }
+            break;
+        case CONNECTION_READY:
+            if (nullptr != handlers.mqttConnected && false == handlers.mqttConnected()) {
+                LOG_WARN("Mqtt connection lost");
+                mqttRetry();
+            }
+            break;
+        default:
+            break;
+    }
+
+    return state;
+}
+
+uint32_t connectionIdleMs() {
+    long leftMs = (long) (nextAttempt - halMillis());
+    uint32_t leaseMs = UINT32_MAX;
+
+    if (true == staticAddress) {
+        uint32_t leaseLeftS = true == cacheLeaseValid() ? cache.leaseEndS - halRetainedSeconds() : 0;
+
+        leaseMs = leaseLeftS < UINT32_MAX / 1000 ? leaseLeftS * 1000 : UINT32_MAX;
+    }
+
+    if (leftMs < 0) {
+        leftMs = 0;
+    }
+
+    switch (state) {
+        case CONNECTION_WIFI_CONNECTING:
+        case CONNECTION_WIFI_WAIT:
+            return leftMs;
+        case CONNECTION_MQTT_WAIT:
+            return (uint32_t) leftMs < leaseMs ? leftMs : leaseMs;
+        case CONNECTION_READY:
+            return leaseMs;
+        default:
+            return UINT32_MAX;
+    }
+}
+
+void connectionStop() {
+    state = CONNECTION_IDLE;
+}
+
+bool connectionWifiUp() {
+    return halWifiUp();
+}
+
+const ConnectionStats &connectionStats() {
+    return stats;
+}
+
+uint32_t connectionBrokerIp() {
+    return true == cacheValid ? cache.brokerIp : 0;
+}
+
+void connectionBrokerResolved(uint32_t ip) {
+    if (true == cacheValid && ip != cache.brokerIp) {
+        cache.brokerIp = ip;
+        cacheSave(true);
+    }
+}
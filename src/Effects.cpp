@@ -0,0 +1,117 @@
+#include <math.h>
+#include <string.h>
+#include "Effects.h"
+
+static const char *effectNames[EFFECT_COUNT] = { "none", "breathe", "rainbow", "strobe", "candle" };
+
+// One cycle of sine, 0 -> 255 -> 0, starting dark
+static uint8_t sineTable[256];
+// Fully saturated colors around the hue circle
+static uint8_t hueTable[256][LIGHT_CHANNELS];
+
+void effectsBegin() {
+    for (int i = 0 ; i < 256 ; i++) {
+        float angle = 2.0f * (float) M_PI * i / 256.0f - (float) M_PI / 2.0f;
+        sineTable[i] = (uint8_t) lroundf(127.5f + 127.5f * sinf(angle));
+
+        // 6 sectors, one channel ramps up or down in each
+        int sector = i * 6 / 256;
+        uint8_t up = (uint8_t) (i * 6 - sector * 256);
+        uint8_t down = 255 - up;
+        const uint8_t sectors[6][LIGHT_CHANNELS] = {
+            { 255, up, 0 }, { down, 255, 0 }, { 0, 255, up },
+            { 0, down, 255 }, { up, 0, 255 }, { 255, 0, down }
+        };
+
+        memcpy(hueTable[i], sectors[sector], LIGHT_CHANNELS);
+    }
+}
+
+EffectType effectFind(const char *name) {
+    if (nullptr == name) {
+        return EFFECT_COUNT;
+    }
+
+    for (int i = 0 ; i < EFFECT_COUNT ; i++) {
+        if (strcmp(effectNames[i], name) == 0) {
+            return (EffectType) i;
+        }
+    }
+
+    return EFFECT_COUNT;
+}
+
+const char *effectName(EffectType type) {
+    return type < EFFECT_COUNT ? effectNames[type] : "";
+}
+
+void effectStart(Effect &effect, EffectType type, const uint8_t color[LIGHT_CHANNELS], uint32_t periodMs) {
+    if (periodMs < EFFECT_PERIOD_MIN_MS) {
+        periodMs = EFFECT_PERIOD_MIN_MS;
+    } else if (periodMs > EFFECT_PERIOD_MAX_MS) {
+        periodMs = EFFECT_PERIOD_MAX_MS;
+    }
+
+    effect.type = type;
+    memcpy(effect.color, color, LIGHT_CHANNELS);
+    effect.periodFrames = periodMs * LIGHT_FRAME_RATE / 1000;
+    effect.frame = 0;
+    effect.level = 255;
+}
+
+static uint8_t scale(uint8_t value, uint8_t level) {
+    return (uint8_t) (((uint16_t) value * (level + 1)) >> 8);
+}
+
+static uint32_t xorshift(uint32_t &seed) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    return seed;
+}
+
+bool effectFrame(Effect &effect, uint8_t output[LIGHT_CHANNELS]) {
+    if (effect.type == EFFECT_NONE || effect.type >= EFFECT_COUNT) {
+        return false;
+    }
+
+    uint8_t phase = (uint8_t) ((effect.frame % effect.periodFrames) * 256 / effect.periodFrames);
+    uint8_t brightness = 0;
+
+    effect.frame++;
+
+    switch (effect.type) {
+        case EFFECT_BREATHE:
+            for (int i = 0 ; i < LIGHT_CHANNELS ; i++) {
+                output[i] = scale(effect.color[i], sineTable[phase]);
+            }
+            break;
+        case EFFECT_RAINBOW:
+            for (int i = 0 ; i < LIGHT_CHANNELS ; i++) {
+                brightness = effect.color[i] > brightness ? effect.color[i] : brightness;
+            }
+
+            for (int i = 0 ; i < LIGHT_CHANNELS ; i++) {
+                output[i] = scale(hueTable[phase][i], brightness);
+            }
+            break;
+        case EFFECT_STROBE:
+            for (int i = 0 ; i < LIGHT_CHANNELS ; i++) {
+                output[i] = phase < 32 ? effect.color[i] : 0;
+            }
+            break;
+        case EFFECT_CANDLE:
+            // Random level between 40% and 100%, smoothed over a few frames
+            effect.level = (uint8_t) ((effect.level * 3 + 100 + xorshift(effect.seed) % 156) / 4);
+
+            for (int i = 0 ; i < LIGHT_CHANNELS ; i++) {
+                output[i] = scale(effect.color[i], effect.level);
+            }
+            break;
+        default:
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,216 @@
+#include <Arduino.h>
+#include <atomic>
+#include <esp_freertos_hooks.h>
+#include <esp_timer.h>
+#include <tcpip_adapter.h>
+#include <lwip/sockets.h>
+#include "Logger.h"
+#include "EventLoop.h"
+
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+// Wakes from the other tasks are datagrams to a loopback socket, so one select covers
+// them and the mqtt socket
+static int wakeReceiver = -1;
+static int wakeSender = -1;
+static struct sockaddr_in wakeAddress;
+static SemaphoreHandle_t wakeMutex = nullptr;
+// One datagram is enough until the loop task has woken up
+static std::atomic<bool> wakePending(false);
+
+// Written by the loop task, read by the others
+static uint32_t loopWakeups = 0;
+static uint64_t loopBusyUs = 0;
+static int64_t lastWakeUs = 0;
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Written from the tick interrupt and the idle task of each core
+static volatile uint32_t idleTicks[EVENT_LOOP_CORES] = { 0, 0 };
+static volatile uint32_t ticks[EVENT_LOOP_CORES] = { 0, 0 };
+static volatile uint32_t idleWakeups[EVENT_LOOP_CORES] = { 0, 0 };
+// Tick count when the hooks were registered
+static uint32_t hookedTick = 0;
+
+static bool lightSleep = false;
+#if CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t awakeLock = nullptr;
+#endif
+static bool awake = false;
+
+// The tick interrupt samples what runs on its core
+static void IRAM_ATTR sampleTick(int core) {
+    ticks[core]++;
+
+    if (xTaskGetCurrentTaskHandleForCPU(core) == xTaskGetIdleTaskHandleForCPU(core)) {
+        idleTicks[core]++;
+    }
+}
+
+static void IRAM_ATTR onTick0() {
+    sampleTick(0);
+}
+
+static void IRAM_ATTR onTick1() {
+    sampleTick(1);
+}
+
+// True lets the idle task wait for the next interrupt
+static bool onIdle0() {
+    idleWakeups[0]++;
+    return true;
+}
+
+static bool onIdle1() {
+    idleWakeups[1]++;
+    return true;
+}
+
+static void powerBegin() {
+#if CONFIG_PM_ENABLE
+    esp_pm_config_esp32_t power = {};
+
+    // An 80 MHz floor keeps the APB clock of the PWM timers, their frequency does not move
+    power.max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+    power.min_freq_mhz = 80;
+    power.light_sleep_enable = true;
+    lightSleep = ESP_OK == esp_pm_configure(&power)
+        && ESP_OK == esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "lights", &awakeLock);
+#endif
+
+    if (true == lightSleep) {
+        LOG_INFO("Automatic light sleep enabled");
+    } else {
+        LOG_INFO("No automatic light sleep in this build, the loop still sleeps between events");
+    }
+}
+
+void eventLoopBegin() {
+    socklen_t length = sizeof(wakeAddress);
+
+    // The WiFi starts lwIP later, the loopback interface is needed now
+    tcpip_adapter_init();
+
+    memset(&wakeAddress, 0, sizeof(wakeAddress));
+    wakeAddress.sin_family = AF_INET;
+    wakeAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    wakeReceiver = socket(AF_INET, SOCK_DGRAM, 0);
+    wakeSender = socket(AF_INET, SOCK_DGRAM, 0);
+    wakeMutex = xSemaphoreCreateMutex();
+
+    // Port picked by the stack
+    if (
+        wakeReceiver < 0
+        || wakeSender < 0
+        || bind(wakeReceiver, (struct sockaddr *) &wakeAddress, sizeof(wakeAddress)) != 0
+        || getsockname(wakeReceiver, (struct sockaddr *) &wakeAddress, &length) != 0
+    ) {
+        LOG_ERROR("Event loop wake socket failed, the loop wakes up on its deadlines only");
+        wakeReceiver = -1;
+    }
+
+    hookedTick = xTaskGetTickCount();
+    esp_register_freertos_tick_hook_for_cpu(onTick0, 0);
+    esp_register_freertos_tick_hook_for_cpu(onTick1, 1);
+    esp_register_freertos_idle_hook_for_cpu(onIdle0, 0);
+    esp_register_freertos_idle_hook_for_cpu(onIdle1, 1);
+
+    powerBegin();
+    lastWakeUs = esp_timer_get_time();
+}
+
+void eventLoopWait(int fd, uint32_t timeoutMs) {
+    fd_set readable;
+    struct timeval timeout;
+    char drained[8];
+    int64_t start = esp_timer_get_time();
+
+    portENTER_CRITICAL(&statsMux);
+    loopBusyUs += start - lastWakeUs;
+    portEXIT_CRITICAL(&statsMux);
+
+    FD_ZERO(&readable);
+
+    if (wakeReceiver >= 0) {
+        FD_SET(wakeReceiver, &readable);
+    }
+
+    if (fd >= 0) {
+        FD_SET(fd, &readable);
+    }
+
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+
+    if (wakeReceiver >= 0 || fd >= 0) {
+        select((wakeReceiver > fd ? wakeReceiver : fd) + 1, &readable, nullptr, nullptr, UINT32_MAX == timeoutMs ? nullptr : &timeout);
+    } else {
+        vTaskDelay(pdMS_TO_TICKS(UINT32_MAX == timeoutMs ? 1000 : timeoutMs));
+    }
+
+    // Cleared first, a wake coming while draining sends a datagram for the next wait
+    wakePending.store(false);
+
+    if (wakeReceiver >= 0 && FD_ISSET(wakeReceiver, &readable)) {
+        while (recv(wakeReceiver, drained, sizeof(drained), MSG_DONTWAIT) > 0) {
+        }
+    }
+
+    lastWakeUs = esp_timer_get_time();
+
+    portENTER_CRITICAL(&statsMux);
+    loopWakeups++;
+    portEXIT_CRITICAL(&statsMux);
+}
+
+void eventLoopWake() {
+    if (wakeReceiver < 0 || true == wakePending.exchange(true)) {
+        return;
+    }
+
+    xSemaphoreTake(wakeMutex, portMAX_DELAY);
+    sendto(wakeSender, "", 1, 0, (struct sockaddr *) &wakeAddress, sizeof(wakeAddress));
+    xSemaphoreGive(wakeMutex);
+}
+
+void eventLoopKeepAwake(bool keep) {
+    if (keep == awake) {
+        return;
+    }
+
+    awake = keep;
+
+#if CONFIG_PM_ENABLE
+    if (nullptr != awakeLock) {
+        if (true == awake) {
+            esp_pm_lock_acquire(awakeLock);
+        } else {
+            esp_pm_lock_release(awakeLock);
+        }
+    }
+#endif
+}
+
+IdleStats eventLoopStats() {
+    IdleStats stats;
+    uint32_t elapsedTicks = xTaskGetTickCount() - hookedTick;
+
+    for (int core = 0 ; core < EVENT_LOOP_CORES ; core++) {
+        uint32_t sampled = ticks[core];
+        // Ticks suppressed while the core slept
+        uint32_t skipped = elapsedTicks > sampled ? elapsedTicks - sampled : 0;
+
+        stats.cpuIdleMs[core] = (idleTicks[core] + skipped) * portTICK_PERIOD_MS;
+        stats.cpuWakeups[core] = idleWakeups[core];
+    }
+
+    portENTER_CRITICAL(&statsMux);
+    stats.loopWakeups = loopWakeups;
+    stats.loopBusyUs = loopBusyUs;
+    portEXIT_CRITICAL(&statsMux);
+
+    stats.lightSleep = lightSleep;
+
+    return stats;
+}
@@ -0,0 +1,395 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include <SPIFFS.h>
+#include <WiFi.h>
+#include <driver/ledc.h>
+#include <driver/rmt.h>
+#include <soc/ledc_struct.h>
+#include <esp_clk.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <tcpip_adapter.h>
+#include <lwip/dhcp.h>
+#include "HalEsp32.h"
+
+uint32_t halMillis() {
+    return esp_timer_get_time() / 1000;
+}
+
+int64_t halMicros() {
+    return esp_timer_get_time();
+}
+
+uint32_t halCycles() {
+    return ESP.getCycleCount();
+}
+
+uint32_t halRandom() {
+    return esp_random();
+}
+
+uint32_t halStackFree() {
+    return uxTaskGetStackHighWaterMark(NULL);
+}
+
+uint32_t halHeapFree() {
+    return ESP.getFreeHeap();
+}
+
+uint32_t halHeapMinFree() {
+    return ESP.getMinFreeHeap();
+}
+
+// Arduino channel numbers : 0-7 high speed, 8-15 low speed, channels 2n and 2n + 1 share timer n % 4
+#define PWM_MODE(channel) ((ledc_mode_t) ((channel) / 8))
+#define PWM_CHANNEL(channel) ((ledc_channel_t) ((channel) % 8))
+#define PWM_TIMER(channel) (((channel) / 2) % 4)
+
+// Channels written and not latched yet
+static uint16_t pwmPending = 0;
+// Any channel tells where the period is once the timers are synchronized
+static int pwmReferenceChannel = -1;
+static uint32_t pwmPeriodTicks = 0;
+
+void halPwmSetup(uint8_t channel, int pin, uint32_t frequency, uint8_t resolution) {
+    ledcAttachPin(pin, channel);
+    // channels 0-15, resolution 1-16 bits, freq limits depend on resolution
+    ledcSetup(channel, frequency, resolution);
+
+    if (pwmReferenceChannel < 0) {
+        pwmReferenceChannel = channel;
+        pwmPeriodTicks = 1 << resolution;
+    }
+}
+
+// Only the duty register, ledcWrite would latch it at once. ledc_set_duty takes whole steps and
+// clears the 4 fraction bits of the register (LEDC_DUTY_CHn[3:0]), they are written after it.
+void halPwmWrite(uint8_t channel, uint32_t duty) {
+    ledc_set_duty(PWM_MODE(channel), PWM_CHANNEL(channel), duty >> HAL_PWM_FRACTION_BITS);
+    LEDC.channel_group[PWM_MODE(channel)].channel[PWM_CHANNEL(channel)].duty.duty = duty;
+    pwmPending |= 1 << channel;
+}
+
+void halPwmCommit() {
+    if (0 == pwmPending) {
+        return;
+    }
+
+    // The updates take a few us, they are not started in the last eighth of a period so none
+    // of them is latched one period after the others
+    if (pwmReferenceChannel >= 0) {
+        uint32_t guard = pwmPeriodTicks - pwmPeriodTicks / 8;
+
+        while (LEDC.timer_group[PWM_MODE(pwmReferenceChannel)].timer[PWM_TIMER(pwmReferenceChannel)].value.timer_cnt >= guard) {
+        }
+    }
+
+    for (uint8_t channel = 0 ; channel < 16 ; channel++) {
+        if ((pwmPending & (1 << channel)) != 0) {
+            ledc_update_duty(PWM_MODE(channel), PWM_CHANNEL(channel));
+        }
+    }
+
+    pwmPending = 0;
+}
+
+void halPwmSync() {
+    for (int mode = 0 ; mode < LEDC_SPEED_MODE_MAX ; mode++) {
+        for (int timer = 0 ; timer < LEDC_TIMER_MAX ; timer++) {
+            ledc_timer_pause((ledc_mode_t) mode, (ledc_timer_t) timer);
+            ledc_timer_rst((ledc_mode_t) mode, (ledc_timer_t) timer);
+        }
+    }
+
+    for (int mode = 0 ; mode < LEDC_SPEED_MODE_MAX ; mode++) {
+        for (int timer = 0 ; timer < LEDC_TIMER_MAX ; timer++) {
+            ledc_timer_resume((ledc_mode_t) mode, (ledc_timer_t) timer);
+        }
+    }
+}
+
+// RMT clocked at 40 MHz (APB / 2), 25 ns ticks. The ESP32 RMT has no DMA : the driver translates
+// the frame bytes into the two halves of the channel memory from its interrupt while the other
+// half is clocked out.
+#define PIXELS_RMT_CHANNEL RMT_CHANNEL_0
+#define PIXELS_RMT_BLOCKS 2
+#define PIXELS_T0H 16 // 0.4 us
+#define PIXELS_T0L 34 // 0.85 us
+#define PIXELS_T1H 32 // 0.8 us
+#define PIXELS_T1L 18 // 0.45 us
+
+static bool pixelsReady = false;
+
+static void IRAM_ATTR pixelsTranslate(const void *source, rmt_item32_t *destination, size_t sourceSize, size_t wanted, size_t *translatedSize, size_t *itemCount) {
+    static const rmt_item32_t bit0 = {{{ PIXELS_T0H, 1, PIXELS_T0L, 0 }}};
+    static const rmt_item32_t bit1 = {{{ PIXELS_T1H, 1, PIXELS_T1L, 0 }}};
+    const uint8_t *bytes = (const uint8_t *) source;
+    size_t size = 0;
+    size_t count = 0;
+
+    while (size < sourceSize && count + 8 <= wanted) {
+        for (int bit = 7 ; bit >= 0 ; bit--) {
+            destination[count++].val = (bytes[size] & (1 << bit)) != 0 ? bit1.val : bit0.val;
+        }
+
+        size++;
+    }
+
+    *translatedSize = size;
+    *itemCount = count;
+}
+
+// The refill interrupt runs on the core installing the driver, the app core from setup()
+bool halPixelsSetup(int pin) {
+    rmt_config_t config = {};
+
+    config.rmt_mode = RMT_MODE_TX;
+    config.channel = PIXELS_RMT_CHANNEL;
+    config.gpio_num = (gpio_num_t) pin;
+    config.mem_block_num = PIXELS_RMT_BLOCKS;
+    config.clk_div = 2;
+    config.tx_config.loop_en = false;
+    config.tx_config.carrier_en = false;
+    config.tx_config.idle_output_en = true;
+    config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+
+    pixelsReady = rmt_config(&config) == ESP_OK
+        && rmt_driver_install(PIXELS_RMT_CHANNEL, 0, 0) == ESP_OK
+        && rmt_translator_init(PIXELS_RMT_CHANNEL, pixelsTranslate) == ESP_OK;
+
+    return pixelsReady;
+}
+
+bool halPixelsSend(const uint8_t *frame, size_t length) {
+    if (false == pixelsReady || rmt_wait_tx_done(PIXELS_RMT_CHANNEL, 0) != ESP_OK) {
+        return false;
+    }
+
+    return rmt_write_sample(PIXELS_RMT_CHANNEL, frame, length, false) == ESP_OK;
+}
+
+int32_t halFileRead(const char *path, char *buffer, size_t size) {
+    File file = SPIFFS.open(path, FILE_READ);
+
+    if (!file) {
+        return -1;
+    }
+
+    int32_t length = file.size();
+
+    file.read((uint8_t *) buffer, (size_t) length < size ? length : size);
+    file.close();
+
+    return length;
+}
+
+bool halFileWrite(const char *path, const char *data, size_t length) {
+    File file = SPIFFS.open(path, FILE_WRITE);
+
+    if (!file) {
+        return false;
+    }
+
+    bool written = file.write((const uint8_t *) data, length) == length;
+
+    file.close();
+
+    return written;
+}
+
+static const char *storeNamespace = "stripled";
+
+bool halStoreRead(const char *key, void *data, size_t size) {
+    Preferences preferences;
+
+    if (!preferences.begin(storeNamespace, true)) {
+        return false;
+    }
+
+    bool read = preferences.getBytesLength(key) == size && preferences.getBytes(key, data, size) == size;
+
+    preferences.end();
+
+    return read;
+}
+
+bool halStoreWrite(const char *key, const void *data, size_t size) {
+    Preferences preferences;
+
+    if (!preferences.begin(storeNamespace, false)) {
+        return false;
+    }
+
+    bool written = preferences.putBytes(key, data, size) == size;
+
+    preferences.end();
+
+    return written;
+}
+
+// Data partition "journal" of partitions.csv
+#define JOURNAL_PARTITION_SUBTYPE 0x40
+
+static const esp_partition_t *journalPartition() {
+    static const esp_partition_t *partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA,
+        (esp_partition_subtype_t) JOURNAL_PARTITION_SUBTYPE,
+        "journal"
+    );
+
+    return partition;
+}
+
+uint32_t halJournalSize() {
+    return nullptr != journalPartition() ? journalPartition()->size : 0;
+}
+
+bool halJournalRead(uint32_t offset, void *data, size_t size) {
+    return nullptr != journalPartition() && esp_partition_read(journalPartition(), offset, data, size) == ESP_OK;
+}
+
+bool halJournalWrite(uint32_t offset, const void *data, size_t size) {
+    return nullptr != journalPartition() && esp_partition_write(journalPartition(), offset, data, size) == ESP_OK;
+}
+
+bool halJournalErase(uint32_t offset) {
+    return nullptr != journalPartition()
+        && esp_partition_erase_range(journalPartition(), offset, HAL_JOURNAL_SECTOR_SIZE) == ESP_OK;
+}
+
+#if MQTT_ENABLE == true
+static PubSubClient *mqttClient = nullptr;
+
+void halMqttAttach(PubSubClient &client) {
+    mqttClient = &client;
+}
+
+bool halMqttPublish(const char *topic, const uint8_t *payload, size_t length, bool retained) {
+    return nullptr != mqttClient && mqttClient->publish(topic, payload, length, retained);
+}
+
+bool halMqttBeginPublish(const char *topic, size_t length, bool retained) {
+    return nullptr != mqttClient && mqttClient->beginPublish(topic, length, retained);
+}
+
+size_t halMqttWrite(const uint8_t *buffer, size_t size) {
+    return mqttClient->write(buffer, size);
+}
+
+bool halMqttEndPublish() {
+    return mqttClient->endPublish() == 1;
+}
+#else
+bool halMqttPublish(const char *topic, const uint8_t *payload, size_t length, bool retained) {
+    return false;
+}
+
+bool halMqttBeginPublish(const char *topic, size_t length, bool retained) {
+    return false;
+}
+
+size_t halMqttWrite(const uint8_t *buffer, size_t size) {
+    return 0;
+}
+
+bool halMqttEndPublish() {
+    return false;
+}
+#endif
+
+void halNetworkAddress(char ip[16], char mac[18]) {
+    uint8_t address[6];
+
+    WiFi.macAddress(address);
+    snprintf(mac, 18, "%02X:%02X:%02X:%02X:%02X:%02X", address[0], address[1], address[2], address[3], address[4], address[5]);
+    strlcpy(ip, WiFi.localIP().toString().c_str(), 16);
+}
+
+// Written from the wifi event task, only this flag is touched there
+static volatile bool wifiUp = false;
+static bool wifiStarted = false;
+
+static void onWifiEvent(WiFiEvent_t event) {
+    switch (event) {
+        case SYSTEM_EVENT_STA_GOT_IP:
+            wifiUp = true;
+            break;
+        case SYSTEM_EVENT_STA_DISCONNECTED:
+            wifiUp = false;
+            break;
+        default:
+            break;
+    }
+}
+
+void halWifiBegin(const char *ssid, const char *password, const WifiLink *link) {
+    if (false == wifiStarted) {
+        WiFi.onEvent(onWifiEvent);
+        WiFi.setAutoReconnect(false);
+        WiFi.mode(WIFI_STA);
+        // Modem sleep, the radio wakes up for the DTIM beacons and the loop sleeps in between
+        WiFi.setSleep(true);
+        wifiStarted = true;
+    }
+
+    // A static address skips DHCP, INADDR_NONE goes back to it. The caller only sets one
+    // while the lease it came from is valid.
+    if (nullptr != link && 0 != link->ip) {
+        WiFi.config(IPAddress(link->ip), IPAddress(link->gateway), IPAddress(link->subnet), IPAddress(link->dns));
+    } else {
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    }
+
+    if (nullptr != link) {
+        WiFi.begin(ssid, password, link->channel, link->bssid);
+    } else {
+        WiFi.begin(ssid, password);
+    }
+}
+
+void halWifiDhcp() {
+    // No event says the address is gone, the DHCP client zeroes it until it binds again
+    wifiUp = false;
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+}
+
+void halWifiDisconnect() {
+    WiFi.disconnect();
+}
+
+bool halWifiUp() {
+    return wifiUp;
+}
+
+void halWifiLink(WifiLink &link) {
+    memcpy(link.bssid, WiFi.BSSID(), sizeof(link.bssid));
+    link.channel = WiFi.channel();
+    link.ip = (uint32_t) WiFi.localIP();
+    link.gateway = (uint32_t) WiFi.gatewayIP();
+    link.subnet = (uint32_t) WiFi.subnetMask();
+    link.dns = (uint32_t) WiFi.dnsIP();
+    link.leaseS = 0;
+
+    struct netif *netif = nullptr;
+
+    // Read from the lwIP task's state, the lease only changes when DHCP binds
+    if (ESP_OK == tcpip_adapter_get_netif(TCPIP_ADAPTER_IF_STA, (void **) &netif) && dhcp_supplied_address(netif)) {
+        link.leaseS = netif_dhcp_data(netif)->offered_t0_lease;
+    }
+}
+
+// Not initialized by the bootloader, so it survives ESP.restart(), panics and watchdog resets
+RTC_NOINIT_ATTR static uint8_t retained[HAL_RETAINED_SIZE];
+
+void halRetainedRead(void *data, size_t size) {
+    memcpy(data, retained, size < HAL_RETAINED_SIZE ? size : HAL_RETAINED_SIZE);
+}
+
+void halRetainedWrite(const void *data, size_t size) {
+    memcpy(retained, data, size < HAL_RETAINED_SIZE ? size : HAL_RETAINED_SIZE);
+}
+
+// The RTC timer is only reset with the RTC domain, like the retained memory
+uint32_t halRetainedSeconds() {
+    return esp_clk_rtc_time() / 1000000;
+}
@@ -0,0 +1,48 @@
+#include "LightEngine.h"
+
+void lightEngineSetTarget(LightEngine &engine, const uint8_t color[LIGHT_CHANNELS], uint32_t transitionMs) {
+    if (transitionMs > LIGHT_TRANSITION_MAX_MS) {
+        transitionMs = LIGHT_TRANSITION_MAX_MS;
+    }
+
+    uint32_t frames = transitionMs * LIGHT_FRAME_RATE / 1000;
+
+    if (frames == 0) {
+        frames = 1;
+    }
+
+    for (int i = 0 ; i < LIGHT_CHANNELS ; i++) {
+        engine.target[i] = color[i];
+        engine.step[i] = (((int32_t) color[i] << 16) - engine.current[i]) / (int32_t) frames;
+    }
+
+    engine.framesLeft = frames;
+}
+
+void lightEngineSetCurrent(LightEngine &engine, const uint8_t color[LIGHT_CHANNELS]) {
+    for (int i = 0 ; i < LIGHT_CHANNELS ; i++) {
+        engine.current[i] = (int32_t) color[i] << 16;
+    }
+}
+
+bool lightEngineFrame(LightEngine &engine, uint8_t output[LIGHT_CHANNELS]) {
+    if (engine.framesLeft == 0) {
+        return false;
+    }
+
+    engine.framesLeft--;
+
+    for (int i = 0 ; i < LIGHT_CHANNELS ; i++) {
+        if (engine.framesLeft == 0) {
+            // Snap on the last frame, the division of the step leaves a remainder
+            engine.current[i] = (int32_t) engine.target[i] << 16;
+        } else {
+            engine.current[i] += engine.step[i];
+        }
+
+        // Round to the nearest level
+        output[i] = (uint8_t) ((engine.current[i] + 0x8000) >> 16);
+    }
+
+    return true;
+}
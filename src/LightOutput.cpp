@@ -0,0 +1,417 @@
+#include <string.h>
+#include "Hal.h"
+#include "ColorPipeline.h"
+#include "LightOutput.h"
+#include "LightCommand.h"
+#include "Metrics.h"
+#include "PixelOutput.h"
+
+struct Zone {
+    // 3 or 4 PWM channels from firstChannel, the white one last, or the addressable strip
+    uint8_t channels = 0;
+    uint8_t firstChannel = 0;
+    bool pixels = false;
+    LightEngine engine;
+    Effect effect;
+    uint8_t lastOutput[LIGHT_CHANNELS] = { 0, 0, 0 };
+    uint8_t balance[LIGHT_ZONE_PINS_MAX] = { LIGHT_BALANCE_NONE, LIGHT_BALANCE_NONE, LIGHT_BALANCE_NONE, LIGHT_BALANCE_NONE };
+};
+
+// Set up before the render task starts, then owned by it
+static Zone zones[LIGHT_ZONES_MAX];
+static uint8_t zoneCount = 0;
+static uint8_t zoneMask = 0;
+
+// Owned by the producer (the loop task)
+static LightZoneState requested[LIGHT_ZONES_MAX];
+// Batch being staged, requested is restored when it does not fit in the queue
+static bool batching = false;
+static bool batchFull = false;
+static uint32_t batchSize = 0;
+static LightZoneState batchRequested[LIGHT_ZONES_MAX];
+
+static LightCommandQueue commands;
+static CommandStats commandStats;
+// Queue time of the last command applied and not written yet
+static uint32_t appliedQueuedUs = 0;
+static bool appliedPending = false;
+// Scheduled commands taken from the queue and not due yet, owned by the render task
+static LightCommand schedule[LIGHT_SCHEDULE_MAX];
+static uint8_t scheduledCount = 0;
+
+// The white channel of an RGBW strip takes the part common to the three colors. The PWM
+// channels go through the color pipeline, the pixels get the 8 bit levels as they are, without
+// the CIE table nor the white balance.
+static void writeOutput(Zone &zone, const uint8_t output[LIGHT_CHANNELS]) {
+    uint8_t values[LIGHT_ZONE_PINS_MAX];
+    uint8_t white = 0;
+
+    if (zone.channels > LIGHT_CHANNELS) {
+        white = output[0] < output[1] ? output[0] : output[1];
+        white = white < output[2] ? white : output[2];
+    }
+
+    for (int i = 0 ; i < LIGHT_CHANNELS ; i++) {
+        values[i] = output[i] - white;
+    }
+
+    values[LIGHT_CHANNELS] = white;
+
+    if (true == zone.pixels) {
+        pixelOutputFill(values);
+        return;
+    }
+
+    for (int i = 0 ; i < zone.channels ; i++) {
+        halPwmWrite(zone.firstChannel + i, colorDuty(colorBalance(colorLinear(values[i]), zone.balance[i])));
+    }
+}
+
+// Render task
+static void stopEffect(Zone &zone) {
+    if (zone.effect.type != EFFECT_NONE) {
+        zone.effect.type = EFFECT_NONE;
+        lightEngineSetCurrent(zone.engine, zone.lastOutput);
+    }
+}
+
+// Render task
+static void applyCommand(const LightCommand &command) {
+    // The apply latency of a scheduled command is its schedule
+    if (false == command.scheduled) {
+        appliedQueuedUs = command.queuedUs;
+        appliedPending = true;
+    }
+
+    for (int i = 0 ; i < zoneCount ; i++) {
+        Zone &zone = zones[i];
+
+        if ((command.zones & (1 << i)) == 0) {
+            continue;
+        }
+
+        switch (command.type) {
+            case LIGHT_COMMAND_COLOR:
+                stopEffect(zone);
+                lightEngineSetTarget(zone.engine, command.color, command.durationMs);
+                break;
+            case LIGHT_COMMAND_EFFECT_START:
+                effectStart(zone.effect, command.effect, command.color, command.durationMs);
+                break;
+            case LIGHT_COMMAND_EFFECT_STOP:
+                if (zone.effect.type != EFFECT_NONE) {
+                    stopEffect(zone);
+                    lightEngineSetTarget(zone.engine, zone.effect.color, command.durationMs);
+                }
+                break;
+        }
+    }
+}
+
+void lightOutputSetup(const LightZoneConfig config[LIGHT_ZONES_MAX], const PixelStripConfig &pixels) {
+    uint8_t channel = 0;
+
+    zoneCount = 0;
+
+    for (int i = 0 ; i < LIGHT_ZONES_MAX && config[i].channels != 0 ; i++) {
+        if (channel + config[i].channels > LIGHT_PWM_CHANNELS) {
+            break;
+        }
+
+        zones[i].channels = config[i].channels;
+        zones[i].firstChannel = channel;
+        memcpy(zones[i].balance, config[i].balance, LIGHT_ZONE_PINS_MAX);
+
+        for (int j = 0 ; j < config[i].channels ; j++) {
+            halPwmSetup(channel++, config[i].pins[j], LIGHT_PWM_FREQUENCY, LIGHT_PWM_RESOLUTION);
+        }
+
+        zoneCount++;
+    }
+
+    if (zoneCount < LIGHT_ZONES_MAX && true == pixelOutputBegin(pixels)) {
+        zones[zoneCount].channels = pixels.channels;
+        zones[zoneCount].pixels = true;
+        zoneCount++;
+    }
+
+    zoneMask = (1 << zoneCount) - 1;
+    halPwmSync();
+    effectsBegin();
+}
+
+// Render task. Every zone is written before the commit, so the PWM zones of a command change
+// in the same PWM period. The pixels follow once their previous frame is out.
+static bool renderZones(uint8_t mask) {
+    uint8_t output[LIGHT_CHANNELS];
+    bool changed = false;
+
+    for (int i = 0 ; i < zoneCount ; i++) {
+        Zone &zone = zones[i];
+
+        if ((mask & (1 << i)) == 0) {
+            continue;
+        }
+
+        bool zoneChanged = effectFrame(zone.effect, output);
+
+        if (false == zoneChanged) {
+            zoneChanged = lightEngineFrame(zone.engine, output);
+        }
+
+        if (true == zoneChanged) {
+            memcpy(zone.lastOutput, output, LIGHT_CHANNELS);
+            writeOutput(zone, output);
+            changed = true;
+        }
+    }
+
+    if (true == changed) {
+        halPwmCommit();
+    }
+
+    // Frames go on while a pixel frame waits, so it is not left behind when the output settles
+    changed |= pixelOutputPresent();
+
+    if (true == appliedPending) {
+        metricsObserve(METRIC_LIGHT_APPLY, (uint32_t) halMicros() - appliedQueuedUs);
+        appliedPending = false;
+    }
+
+    return changed;
+}
+
+// Render task
+static void applyOrSchedule(const LightCommand &command) {
+    int32_t dueInUs = (int32_t) (command.applyAtUs - (uint32_t) halMicros());
+
+    if (false == command.scheduled) {
+        applyCommand(command);
+        return;
+    }
+
+    commandStats.scheduled++;
+
+    // A full schedule applies at once, counted late
+    if (dueInUs > 0 && scheduledCount < LIGHT_SCHEDULE_MAX) {
+        schedule[scheduledCount++] = command;
+        return;
+    }
+
+    if (dueInUs < -LIGHT_SCHEDULE_LATE_US || dueInUs > 0) {
+        commandStats.late++;
+    }
+
+    applyCommand(command);
+}
+
+// Render task, in the order they were queued. Returns the zones of the commands applied.
+static uint8_t applyDue() {
+    uint32_t now = (uint32_t) halMicros();
+    uint8_t applied = 0;
+    uint8_t kept = 0;
+
+    for (uint8_t i = 0 ; i < scheduledCount ; i++) {
+        const LightCommand &command = schedule[i];
+
+        if ((int32_t) (command.applyAtUs - now) > 0) {
+            schedule[kept++] = command;
+            continue;
+        }
+
+        if ((int32_t) (now - command.applyAtUs) > LIGHT_SCHEDULE_LATE_US) {
+            commandStats.late++;
+        }
+
+        applyCommand(command);
+        applied |= command.zones;
+    }
+
+    scheduledCount = kept;
+
+    return applied;
+}
+
+bool lightOutputRender() {
+    lightCommandsDrain(commands, commandStats, applyOrSchedule);
+    applyDue();
+
+    return renderZones(zoneMask);
+}
+
+// The other zones keep their frame rate, a transition or an effect is not moved forward
+bool lightOutputRenderDue() {
+    uint8_t applied = applyDue();
+
+    return 0 != applied && true == renderZones(applied);
+}
+
+bool lightOutputNextDue(uint32_t &atUs) {
+    for (uint8_t i = 0 ; i < scheduledCount ; i++) {
+        if (0 == i || (int32_t) (schedule[i].applyAtUs - atUs) < 0) {
+            atUs = schedule[i].applyAtUs;
+        }
+    }
+
+    return scheduledCount > 0;
+}
+
+bool lightOutputLit() {
+    for (int i = 0 ; i < zoneCount ; i++) {
+        const Zone &zone = zones[i];
+
+        if (false == zone.pixels && (zone.lastOutput[0] != 0 || zone.lastOutput[1] != 0 || zone.lastOutput[2] != 0)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool enqueue(LightCommand &command) {
+    command.queuedUs = (uint32_t) halMicros();
+
+    if (true == batching) {
+        batchSize++;
+        batchFull = true == batchFull || !commands.stage(command);
+
+        return false == batchFull;
+    }
+
+    if (!commands.push(command)) {
+        commandStats.dropped++;
+        return false;
+    }
+
+    commandStats.enqueued++;
+    lightOutputWake();
+
+    return true;
+}
+
+uint8_t lightOutputZoneCount() {
+    return zoneCount;
+}
+
+uint8_t lightOutputZoneMask() {
+    return zoneMask;
+}
+
+bool lightOutputQueue(LightCommand command) {
+    command.zones &= zoneMask;
+
+    if (false == enqueue(command)) {
+        return false;
+    }
+
+    for (int i = 0 ; i < zoneCount ; i++) {
+        if ((command.zones & (1 << i)) == 0) {
+            continue;
+        }
+
+        switch (command.type) {
+            case LIGHT_COMMAND_COLOR:
+                memcpy(requested[i].color, command.color, LIGHT_CHANNELS);
+                requested[i].effect = EFFECT_NONE;
+                requested[i].transitionMs = command.durationMs;
+                break;
+            case LIGHT_COMMAND_EFFECT_START:
+                memcpy(requested[i].color, command.color, LIGHT_CHANNELS);
+                requested[i].effect = command.effect;
+                requested[i].periodMs = command.durationMs;
+                requested[i].transitionMs = 0;
+                break;
+            case LIGHT_COMMAND_EFFECT_STOP:
+                requested[i].effect = EFFECT_NONE;
+                requested[i].transitionMs = command.durationMs;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool lightOutputSet(uint8_t zones, uint8_t red, uint8_t green, uint8_t blue, uint32_t transitionMs) {
+    LightCommand command;
+
+    command.type = LIGHT_COMMAND_COLOR;
+    command.zones = zones;
+    command.color[0] = red;
+    command.color[1] = green;
+    command.color[2] = blue;
+    command.durationMs = transitionMs;
+
+    return lightOutputQueue(command);
+}
+
+void lightOutputTarget(uint8_t zone, uint8_t color[LIGHT_CHANNELS]) {
+    memcpy(color, requested[zone < LIGHT_ZONES_MAX ? zone : 0].color, LIGHT_CHANNELS);
+}
+
+bool lightOutputStartEffect(uint8_t zones, EffectType type, const uint8_t color[LIGHT_CHANNELS], uint32_t periodMs) {
+    LightCommand command;
+
+    command.type = LIGHT_COMMAND_EFFECT_START;
+    command.zones = zones;
+    command.effect = type;
+    memcpy(command.color, color, LIGHT_CHANNELS);
+    command.durationMs = periodMs;
+
+    return lightOutputQueue(command);
+}
+
+bool lightOutputStopEffect(uint8_t zones, uint32_t transitionMs) {
+    LightCommand command;
+
+    command.type = LIGHT_COMMAND_EFFECT_STOP;
+    command.zones = zones;
+    command.durationMs = transitionMs;
+
+    return lightOutputQueue(command);
+}
+
+void lightOutputBatchBegin() {
+    memcpy(batchRequested, requested, sizeof(requested));
+    batching = true;
+    batchFull = false;
+    batchSize = 0;
+}
+
+bool lightOutputBatchEnd() {
+    batching = false;
+
+    if (true == batchFull) {
+        commands.discard();
+        commandStats.dropped += batchSize;
+        memcpy(requested, batchRequested, sizeof(requested));
+        return false;
+    }
+
+    if (0 == batchSize) {
+        return true;
+    }
+
+    commands.publish();
+    commandStats.enqueued += batchSize;
+    lightOutputWake();
+
+    return true;
+}
+
+EffectType lightOutputEffect(uint8_t zone) {
+    return requested[zone < LIGHT_ZONES_MAX ? zone : 0].effect;
+}
+
+void lightOutputState(LightState &state) {
+    for (int i = 0 ; i < LIGHT_ZONES_MAX ; i++) {
+        state.zones[i] = requested[i];
+
+        if (state.zones[i].effect == EFFECT_NONE) {
+            state.zones[i].periodMs = 0;
+        }
+    }
+}
+
+CommandStats lightOutputCommandStats() {
+    return commandStats;
+}
@@ -0,0 +1,30 @@
+#include <Arduino.h>
+#include "Logger.h"
+
+// Below the loop task, logging never slows down the mqtt or render paths
+#define LOG_TASK_PRIORITY 1
+
+static TaskHandle_t logTaskHandle = nullptr;
+
+static void serialSink(const char *text, size_t length) {
+    Serial.write((const uint8_t *) text, length);
+}
+
+// Sleeps until a line is queued, the cpu is not woken up while nothing is logged
+static void logTask(void *arg) {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        logDrain(serialSink);
+    }
+}
+
+void logBegin() {
+    xTaskCreate(logTask, "log", 3072, nullptr, LOG_TASK_PRIORITY, &logTaskHandle);
+}
+
+void logWake() {
+    // Lines written before the task exists are drained with the first one after
+    if (nullptr != logTaskHandle) {
+        xTaskNotifyGive(logTaskHandle);
+    }
+}
@@ -0,0 +1,137 @@
+#include <atomic>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "CommandQueue.h"
+#include "Hal.h"
+#include "Logger.h"
+
+static const char levelLetters[] = { '-', 'E', 'W', 'I', 'D' };
+
+static MpscRing<LogLine, LOG_QUEUE_SLOTS> queue;
+static std::atomic<uint32_t> lines { 0 };
+static std::atomic<uint32_t> dropped { 0 };
+static std::atomic<uint32_t> writeMaxCycles { 0 };
+
+// Written by the drain task only. The version is odd while it writes, so a reader
+// that saw it change copies again (seqlock)
+static char history[LOG_HISTORY_SIZE];
+static uint32_t historyBytes = 0;
+static std::atomic<uint32_t> historyVersion { 0 };
+
+void logWrite(uint8_t level, const char *format, ...) {
+    uint32_t start = halCycles();
+    LogLine line;
+    va_list args;
+
+    line.ms = halMillis();
+    line.level = level;
+    va_start(args, format);
+    vsnprintf(line.text, sizeof(line.text), format, args);
+    va_end(args);
+
+    if (queue.push(line)) {
+        lines.fetch_add(1, std::memory_order_relaxed);
+        logWake();
+    } else {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint32_t cycles = halCycles() - start;
+    uint32_t max = writeMaxCycles.load(std::memory_order_relaxed);
+
+    while (cycles > max && false == writeMaxCycles.compare_exchange_weak(max, cycles, std::memory_order_relaxed)) {
+    }
+}
+
+static void historyAppend(const char *text, size_t length) {
+    historyVersion.fetch_add(1, std::memory_order_acq_rel);
+
+    for (size_t i = 0 ; i < length ; i++) {
+        history[(historyBytes + i) % LOG_HISTORY_SIZE] = text[i];
+    }
+
+    historyBytes += length;
+    historyVersion.fetch_add(1, std::memory_order_release);
+}
+
+uint32_t logDrain(void (*sink)(const char *text, size_t length)) {
+    LogLine line;
+    char text[LOG_LINE_MAX + 16];
+    uint32_t drained = 0;
+
+    while (queue.pop(line)) {
+        int length = snprintf(
+            text,
+            sizeof(text),
+            "%6u.%03u %c %s\n",
+            line.ms / 1000,
+            line.ms % 1000,
+            levelLetters[line.level < sizeof(levelLetters) ? line.level : 0],
+            line.text
+        );
+
+        length = length < (int) sizeof(text) ? length : sizeof(text) - 1;
+        historyAppend(text, length);
+
+        if (nullptr != sink) {
+            sink(text, length);
+        }
+
+        drained++;
+    }
+
+    return drained;
+}
+
+size_t logTail(char *buffer, size_t size) {
+    size_t length = 0;
+    uint32_t end = 0;
+
+    for (int attempt = 0 ; attempt < 4 ; attempt++) {
+        uint32_t version = historyVersion.load(std::memory_order_acquire);
+
+        if ((version & 1) != 0) {
+            continue;
+        }
+
+        end = historyBytes;
+        uint32_t available = end < LOG_HISTORY_SIZE ? end : LOG_HISTORY_SIZE;
+
+        length = available < size - 1 ? available : size - 1;
+
+        for (size_t i = 0 ; i < length ; i++) {
+            buffer[i] = history[(end - length + i) % LOG_HISTORY_SIZE];
+        }
+
+        if (historyVersion.load(std::memory_order_acquire) == version) {
+            break;
+        }
+
+        length = 0;
+    }
+
+    // The oldest line was cut by the ring, it starts after the first line break
+    size_t skip = 0;
+
+    if (length > 0 && end > length) {
+        const char *lineEnd = (const char *) memchr(buffer, '\n', length);
+
+        skip = nullptr != lineEnd ? lineEnd - buffer + 1 : length;
+    }
+
+    memmove(buffer, buffer + skip, length - skip);
+    buffer[length - skip] = '\0';
+
+    return length - skip;
+}
+
+LogStats logStats() {
+    LogStats stats;
+
+    stats.lines = lines.load(std::memory_order_relaxed);
+    stats.dropped = dropped.load(std::memory_order_relaxed);
+    stats.writeMaxCycles = writeMaxCycles.load(std::memory_order_relaxed);
+
+    return stats;
+}
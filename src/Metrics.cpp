@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include "Hal.h"
+#include "Metrics.h"
+#include "MqttHandler.h"
+#include "StatePublisher.h"
+
+#define METRICS_PREFIX "stripled_"
+
+static const uint32_t bucketBoundsUs[METRICS_BUCKETS - 1] = {
+    10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000
+};
+
+#define METRIC_NAME(id, name, help) name,
+static const char *const histogramNames[METRIC_HISTOGRAM_COUNT] = { METRICS_HISTOGRAMS(METRIC_NAME) };
+#undef METRIC_NAME
+
+#define METRIC_HELP(id, name, help) help,
+static const char *const histogramHelps[METRIC_HISTOGRAM_COUNT] = { METRICS_HISTOGRAMS(METRIC_HELP) };
+#undef METRIC_HELP
+
+#define BOOT_PHASE_NAME(id, name) name,
+static const char *const bootPhaseNames[BOOT_PHASE_COUNT] = { METRICS_BOOT_PHASES(BOOT_PHASE_NAME) };
+#undef BOOT_PHASE_NAME
+
+static Histogram histograms[METRIC_HISTOGRAM_COUNT];
+// 0 until the phase completes
+static uint32_t bootPhasesUs[BOOT_PHASE_COUNT];
+static const ConnectionStats *deviceConnection = nullptr;
+static IdleStats (*deviceIdle)() = nullptr;
+
+void metricsBegin(const ConnectionStats *connection, IdleStats (*idle)()) {
+    deviceConnection = connection;
+    deviceIdle = idle;
+}
+
+void metricsObserve(MetricHistogram id, uint32_t us) {
+    uint8_t bucket = 0;
+
+    while (bucket < METRICS_BUCKETS - 1 && us > bucketBoundsUs[bucket]) {
+        bucket++;
+    }
+
+    histograms[id].buckets[bucket]++;
+    histograms[id].sumUs += us;
+}
+
+void metricsBootPhase(BootPhase phase) {
+    if (0 == bootPhasesUs[phase]) {
+        uint32_t us = (uint32_t) halMicros();
+
+        bootPhasesUs[phase] = us > 0 ? us : 1;
+    }
+}
+
+void metricsBootReset() {
+    for (int i = 0 ; i < BOOT_PHASE_COUNT ; i++) {
+        bootPhasesUs[i] = 0;
+    }
+}
+
+size_t metricsBootSummary(char *buffer, size_t size) {
+    size_t length = 0;
+
+    buffer[0] = '\0';
+
+    for (int i = 0 ; i < BOOT_PHASE_COUNT && length < size ; i++) {
+        if (0 != bootPhasesUs[i]) {
+            int written = snprintf(
+                buffer + length,
+                size - length,
+                "%s%s %u ms",
+                length > 0 ? ", " : "",
+                bootPhaseNames[i],
+                bootPhasesUs[i] / 1000
+            );
+
+            length += written > 0 ? written : 0;
+        }
+    }
+
+    return length < size ? length : size - 1;
+}
+
+void metricsCapture(MetricsSnapshot &snapshot) {
+    for (int i = 0 ; i < METRIC_HISTOGRAM_COUNT ; i++) {
+        snapshot.histograms[i] = histograms[i];
+    }
+
+    for (int i = 0 ; i < BOOT_PHASE_COUNT ; i++) {
+        snapshot.bootPhasesUs[i] = bootPhasesUs[i];
+    }
+
+    snapshot.heapFree = halHeapFree();
+    snapshot.heapMinFree = halHeapMinFree();
+
+    if (nullptr != deviceConnection) {
+        snapshot.connection = *deviceConnection;
+    }
+
+    if (nullptr != deviceIdle) {
+        snapshot.idle = deviceIdle();
+    }
+
+    snapshot.commands = lightOutputCommandStats();
+    snapshot.render = lightOutputStats();
+    snapshot.pixels = pixelOutputStats();
+    snapshot.clock = clockSyncStats();
+    snapshot.journal = stateJournalStats();
+    snapshot.log = logStats();
+    snapshot.web = webControlStats();
+
+    #if MQTT_ENABLE == true
+    snapshot.jsonMessages = mqttHandlerStats().json.messages;
+    snapshot.binaryMessages = mqttHandlerStats().binary.messages;
+    snapshot.stateChanges = statePublisherStats().changes;
+    snapshot.statePublished = statePublisherStats().published;
+    snapshot.outbox = mqttOutboxStats();
+    #endif
+}
+
+static void writeHeader(ReplyOutput &out, const char *name, const char *unit, const char *type, const char *help) {
+    out.printf("# HELP " METRICS_PREFIX "%s%s %s\n", name, unit, help);
+    out.printf("# TYPE " METRICS_PREFIX "%s%s %s\n", name, unit, type);
+}
+
+static void writeCounter(ReplyOutput &out, const char *name, const char *help, uint32_t value) {
+    writeHeader(out, name, "", "counter", help);
+    out.printf(METRICS_PREFIX "%s %u\n", name, value);
+}
+
+static void writeGauge(ReplyOutput &out, const char *name, const char *help, uint32_t value) {
+    writeHeader(out, name, "", "gauge", help);
+    out.printf(METRICS_PREFIX "%s %u\n", name, value);
+}
+
+// Seconds are printed from the us with integers only
+static void writeSeconds(ReplyOutput &out, const char *name, const char *help, uint32_t us) {
+    writeHeader(out, name, "_seconds", "gauge", help);
+    out.printf(METRICS_PREFIX "%s_seconds %u.%06u\n", name, us / 1000000, us % 1000000);
+}
+
+static void writeHistogram(ReplyOutput &out, const char *name, const char *help, const Histogram &histogram) {
+    uint32_t cumulative = 0;
+
+    writeHeader(out, name, "_seconds", "histogram", help);
+
+    for (int i = 0 ; i < METRICS_BUCKETS - 1 ; i++) {
+        cumulative += histogram.buckets[i];
+        out.printf(
+            METRICS_PREFIX "%s_seconds_bucket{le=\"%u.%06u\"} %u\n",
+            name,
+            bucketBoundsUs[i] / 1000000,
+            bucketBoundsUs[i] % 1000000,
+            cumulative
+        );
+    }
+
+    cumulative += histogram.buckets[METRICS_BUCKETS - 1];
+    out.printf(METRICS_PREFIX "%s_seconds_bucket{le=\"+Inf\"} %u\n", name, cumulative);
+    out.printf(
+        METRICS_PREFIX "%s_seconds_sum %u.%06u\n",
+        name,
+        (uint32_t) (histogram.sumUs / 1000000),
+        (uint32_t) (histogram.sumUs % 1000000)
+    );
+    out.printf(METRICS_PREFIX "%s_seconds_count %u\n", name, cumulative);
+}
+
+void metricsWrite(ReplyOutput &out, const MetricsSnapshot &snapshot) {
+    for (int i = 0 ; i < METRIC_HISTOGRAM_COUNT ; i++) {
+        writeHistogram(out, histogramNames[i], histogramHelps[i], snapshot.histograms[i]);
+    }
+
+    writeGauge(out, "heap_free_bytes", "Free heap", snapshot.heapFree);
+    writeGauge(out, "heap_min_free_bytes", "Lowest free heap since boot", snapshot.heapMinFree);
+    writeCounter(out, "wifi_attempts_total", "WiFi connection attempts", snapshot.connection.wifiAttempts);
+    writeCounter(out, "wifi_disconnects_total", "WiFi connection losses", snapshot.connection.wifiDisconnects);
+    writeCounter(out, "wifi_directed_attempts_total", "WiFi attempts to the cached access point", snapshot.connection.directedAttempts);
+    writeCounter(out, "wifi_directed_failures_total", "Failed attempts to the cached access point, followed by a scan", snapshot.connection.directedFailures);
+    writeCounter(out, "mqtt_attempts_total", "Mqtt connection attempts", snapshot.connection.mqttAttempts);
+    writeCounter(out, "mqtt_failures_total", "Failed mqtt connection attempts", snapshot.connection.mqttFailures);
+    writeCounter(out, "mqtt_json_messages_total", "Json mqtt messages handled", snapshot.jsonMessages);
+    writeCounter(out, "mqtt_binary_messages_total", "Binary mqtt messages handled", snapshot.binaryMessages);
+    writeCounter(out, "state_changes_total", "Light state changes seen by the state publisher", snapshot.stateChanges);
+    writeCounter(out, "state_published_total", "Retained light states published", snapshot.statePublished);
+    #if MQTT_ENABLE == true
+    writeGauge(out, "mqtt_outbox_depth", "Outbound mqtt messages waiting", snapshot.outbox.depth);
+    writeGauge(out, "mqtt_outbox_depth_max", "Most outbound mqtt messages waiting at once", snapshot.outbox.depthMax);
+    writeCounter(out, "mqtt_outbox_published_total", "Outbound mqtt messages written", snapshot.outbox.published);
+    writeCounter(out, "mqtt_outbox_batches_total", "Loop passes that wrote outbound mqtt messages", snapshot.outbox.batches);
+    writeCounter(out, "mqtt_outbox_replaced_total", "Outbound mqtt messages replaced by a newer one of their topic", snapshot.outbox.replaced);
+    writeCounter(out, "mqtt_outbox_dropped_total", "Outbound mqtt messages dropped, queue full", snapshot.outbox.dropped);
+    writeCounter(out, "mqtt_outbox_expired_total", "Outbound mqtt messages dropped, not written in time", snapshot.outbox.expired);
+    writeCounter(out, "mqtt_outbox_retries_total", "Outbound mqtt publishes tried again", snapshot.outbox.retries);
+    writeCounter(out, "mqtt_outbox_failed_total", "Outbound mqtt messages dropped after their retries", snapshot.outbox.failed);
+    #endif
+    writeCounter(out, "light_commands_total", "Light commands queued", snapshot.commands.enqueued);
+    writeCounter(out, "light_commands_dropped_total", "Light commands dropped, queue full", snapshot.commands.dropped);
+    writeCounter(out, "light_commands_coalesced_total", "Light commands replaced before being applied", snapshot.commands.coalesced);
+    writeCounter(out, "light_commands_scheduled_total", "Light commands with an applyAt", snapshot.commands.scheduled);
+    writeCounter(out, "light_commands_late_total", "Scheduled light commands applied off their time", snapshot.commands.late);
+    writeCounter(out, "light_frames_total", "Frames written to the PWM", snapshot.render.frames);
+    writeCounter(out, "light_overruns_total", "Frames longer than the frame period", snapshot.render.overruns);
+    writeCounter(out, "pixel_frames_total", "Frames sent to the addressable strip", snapshot.pixels.frames);
+    writeCounter(out, "pixel_frames_dropped_total", "Pixel frames replaced while the previous one was sent", snapshot.pixels.dropped);
+    writeGauge(out, "pixel_count", "Pixels of the addressable strip", snapshot.pixels.count);
+    writeGauge(out, "pixel_max_fps", "Frame rate allowed by the wire time of the strip", snapshot.pixels.maxFps);
+    writeCounter(out, "clock_sync_samples_total", "Pings completed by their round trip", snapshot.clock.samples);
+    writeCounter(out, "journal_updates_total", "Light state changes seen by the journal", snapshot.journal.updates);
+    writeCounter(out, "journal_writes_total", "Journal records written to flash", snapshot.journal.writes);
+    writeCounter(out, "journal_writes_avoided_total", "Light state changes coalesced or unchanged, not written", snapshot.journal.writesAvoided);
+    writeCounter(out, "journal_erases_total", "Journal sectors erased", snapshot.journal.erases);
+    writeCounter(out, "log_lines_total", "Log lines queued", snapshot.log.lines);
+    writeCounter(out, "log_dropped_total", "Log lines dropped, queue full", snapshot.log.dropped);
+    writeGauge(out, "log_write_max_cycles", "Slowest log line format and queue", snapshot.log.writeMaxCycles);
+    writeSeconds(out, "pixel_frame", "Wire time of one pixel frame, latch included", snapshot.pixels.frameUs);
+    writeSeconds(out, "clock_sync_rtt", "Round trip of the clock sample in use", snapshot.clock.rttMs * 1000);
+    writeSeconds(out, "journal_restore", "Time to find and restore the last light state at boot", snapshot.journal.restoreUs);
+    writeCounter(out, "web_control_frames_total", "Websocket light frames received", snapshot.web.frames);
+    writeCounter(out, "web_control_applied_total", "Websocket light frames queued to the light output", snapshot.web.applied);
+    writeCounter(out, "web_control_coalesced_total", "Websocket light frames replaced while held", snapshot.web.coalesced);
+    writeCounter(out, "web_control_limited_total", "Websocket light frames held, client over its rate", snapshot.web.limited);
+    writeCounter(out, "web_control_dropped_total", "Websocket light frames dropped, queue or held frames full", snapshot.web.dropped + snapshot.web.overflow);
+    writeCounter(out, "web_control_malformed_total", "Websocket frames that are not light frames", snapshot.web.malformed);
+    writeCounter(out, "loop_wakeups_total", "Loop task woken up by an event or a deadline", snapshot.idle.loopWakeups);
+    writeGauge(out, "light_sleep_enabled", "Automatic light sleep between events", true == snapshot.idle.lightSleep ? 1 : 0);
+    writeHeader(out, "loop_busy", "_seconds_total", "counter", "Time the loop task spent out of its wait");
+    out.printf(
+        METRICS_PREFIX "loop_busy_seconds_total %u.%06u\n",
+        (uint32_t) (snapshot.idle.loopBusyUs / 1000000),
+        (uint32_t) (snapshot.idle.loopBusyUs % 1000000)
+    );
+    writeHeader(out, "cpu_idle", "_seconds_total", "counter", "Time the idle task of the core ran or the core slept");
+
+    for (int i = 0 ; i < EVENT_LOOP_CORES ; i++) {
+        out.printf(
+            METRICS_PREFIX "cpu_idle_seconds_total{core=\"%d\"} %u.%03u\n",
+            i,
+            snapshot.idle.cpuIdleMs[i] / 1000,
+            snapshot.idle.cpuIdleMs[i] % 1000
+        );
+    }
+
+    writeHeader(out, "cpu_wakeups", "_total", "counter", "Times the idle task of the core resumed, about one per interrupt");
+
+    for (int i = 0 ; i < EVENT_LOOP_CORES ; i++) {
+        out.printf(METRICS_PREFIX "cpu_wakeups_total{core=\"%d\"} %u\n", i, snapshot.idle.cpuWakeups[i]);
+    }
+
+    writeHeader(out, "boot_phase", "_seconds", "gauge", "Time after boot when the phase completed");
+
+    for (int i = 0 ; i < BOOT_PHASE_COUNT ; i++) {
+        if (0 != snapshot.bootPhasesUs[i]) {
+            out.printf(
+                METRICS_PREFIX "boot_phase_seconds{phase=\"%s\"} %u.%06u\n",
+                bootPhaseNames[i],
+                snapshot.bootPhasesUs[i] / 1000000,
+                snapshot.bootPhasesUs[i] % 1000000
+            );
+        }
+    }
+}
@@ -0,0 +1,675 @@
+#include "Settings.h"
+
+#if MQTT_ENABLE == true
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <string.h>
+#include "Hal.h"
+#include "Logger.h"
+#include "Actions.h"
+#include "MqttHandler.h"
+#include "MqttOutbox.h"
+#include "BinaryCommand.h"
+#include "ColorPipeline.h"
+#include "LightOutput.h"
+#include "Metrics.h"
+#include "Scenes.h"
+#include "ClockSync.h"
+
+#define MQTT_CHANNEL_MAX 128
+// A message with its payload, or a batch of light commands each with its own payload
+#define MQTT_JSON_CAPACITY \
+    JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(8) \
+    + JSON_ARRAY_SIZE(LIGHT_BATCH_MAX) + LIGHT_BATCH_MAX * (JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(8))
+
+unsigned long restartRequested = 0;
+unsigned long resetRequested = 0;
+
+static MqttStats mqttStats;
+// Read by the metrics reply, between its measure and stream passes
+static MetricsSnapshot metricsSnapshot;
+// Same for the stats reply
+static MqttStats statsSnapshot;
+static CommandStats commandsSnapshot;
+static const char *publishChannel = "";
+// Config channels followed by BINARY_TOPIC_SUFFIX
+static char binarySubscribeChannel[MQTT_CHANNEL_MAX + sizeof(BINARY_TOPIC_SUFFIX)] = "";
+static char binaryPublishChannel[MQTT_CHANNEL_MAX + sizeof(BINARY_TOPIC_SUFFIX)] = "";
+// Batched changeColor acknowledgement
+static ActionReply pendingAck;
+static unsigned int pendingAckCount = 0;
+static unsigned long pendingAckSent = 0;
+static const unsigned long ackBatchDelay = 100;
+
+void mqttHandlerBegin(const char *publish, const char *subscribe) {
+    publishChannel = publish;
+    snprintf(binarySubscribeChannel, sizeof(binarySubscribeChannel), "%s%s", subscribe, BINARY_TOPIC_SUFFIX);
+    snprintf(binaryPublishChannel, sizeof(binaryPublishChannel), "%s%s", publish, BINARY_TOPIC_SUFFIX);
+}
+
+const MqttStats &mqttHandlerStats() {
+    return mqttStats;
+}
+
+const char *mqttHandlerBinaryTopic() {
+    return binarySubscribeChannel;
+}
+
+// From the requested state, which also covers a state restored from the journal at boot
+static bool lightIsOn() {
+    uint8_t color[LIGHT_CHANNELS];
+
+    for (uint8_t zone = 0 ; zone < lightOutputZoneCount() ; zone++) {
+        lightOutputTarget(zone, color);
+
+        if (color[0] != 0 || color[1] != 0 || color[2] != 0 || lightOutputEffect(zone) != EFFECT_NONE) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// "zone" (index) or "zones" (mask, bit n for zone n), every zone when neither is given.
+// 0 when no configured zone is left.
+static uint8_t payloadZones(JsonVariant payload) {
+    if (payload.containsKey("zone")) {
+        int zone = payload["zone"] | -1;
+
+        return zone >= 0 && zone < lightOutputZoneCount() ? 1 << zone : 0;
+    }
+
+    return (payload["zones"] | (unsigned int) LIGHT_ZONES_ALL) & lightOutputZoneMask();
+}
+
+// {"t", "rtt"} from a controller synchronizing the clocks, see ClockSync.h
+void actionPing(JsonVariant payload, ActionReply &reply) {
+    if (payload.containsKey("t")) {
+        clockSyncPing(payload["t"].as<uint64_t>(), payload["rtt"] | -1);
+    }
+
+    strlcpy(reply.message, "pong", sizeof(reply.message));
+}
+
+void actionStatus(JsonVariant payload, ActionReply &reply) {
+    if (restartRequested != 0) {
+        strlcpy(reply.message, "Restart in progress", sizeof(reply.message));
+    } else {
+        strlcpy(reply.message, true == lightIsOn() ? "1" : "0", sizeof(reply.message));
+    }
+}
+
+void actionConfigure(JsonVariant payload, ActionReply &reply) {
+    reply.manifest = true;
+}
+
+void actionRestart(JsonVariant payload, ActionReply &reply) {
+    strlcpy(reply.message, "Restart in progress", sizeof(reply.message));
+    restartRequested = halMillis();
+}
+
+void actionReset(JsonVariant payload, ActionReply &reply) {
+    strlcpy(reply.message, "Reset in progress", sizeof(reply.message));
+    resetRequested = halMillis();
+}
+
+static void replyQueueFull(ActionReply &reply) {
+    reply.code = 500;
+    strlcpy(reply.message, "Command queue full", sizeof(reply.message));
+}
+
+static void replyUnknownZone(ActionReply &reply) {
+    reply.code = 500;
+    strlcpy(reply.message, "Unknown zone", sizeof(reply.message));
+}
+
+// Light commands are parsed first and queued after, so a batch is only queued when all of
+// its commands are valid. A parser sets the error reply and returns false.
+typedef bool (*LightParser)(JsonVariant payload, LightCommand &command, ActionReply &reply);
+
+static bool parseZones(JsonVariant payload, LightCommand &command, ActionReply &reply) {
+    command.zones = payloadZones(payload);
+
+    if (0 == command.zones) {
+        replyUnknownZone(reply);
+        return false;
+    }
+
+    return true;
+}
+
+static bool parseLightOn(JsonVariant payload, LightCommand &command, ActionReply &reply) {
+    memset(command.color, 255, sizeof(command.color));
+    command.durationMs = payload["transition"] | 0u;
+
+    return parseZones(payload, command, reply);
+}
+
+static bool parseLightOff(JsonVariant payload, LightCommand &command, ActionReply &reply) {
+    command.durationMs = payload["transition"] | 0u;
+
+    return parseZones(payload, command, reply);
+}
+
+// An integer of min to max, fallback when missing. A value out of range is refused, it would
+// wrap in the narrower type it goes to.
+static bool parseInteger(JsonVariant payload, const char *key, int32_t min, int32_t max, int32_t fallback, int32_t &result, ActionReply &reply) {
+    JsonVariant value = payload[key];
+
+    if (value.isNull()) {
+        result = fallback;
+        return true;
+    }
+
+    if (false == value.is<int32_t>() || value.as<int32_t>() < min || value.as<int32_t>() > max) {
+        reply.code = 500;
+        snprintf(reply.message, sizeof(reply.message), "%s must be an integer from %d to %d", key, (int) min, (int) max);
+        return false;
+    }
+
+    result = value.as<int32_t>();
+
+    return true;
+}
+
+static bool parseLevel(JsonVariant payload, const char *key, uint8_t fallback, uint8_t &level, ActionReply &reply) {
+    int32_t value;
+
+    if (false == parseInteger(payload, key, 0, 255, fallback, value, reply)) {
+        return false;
+    }
+
+    level = (uint8_t) value;
+
+    return true;
+}
+
+static bool parseColor(JsonVariant payload, const uint8_t fallback[LIGHT_CHANNELS], uint8_t color[LIGHT_CHANNELS], ActionReply &reply) {
+    return parseLevel(payload, "red", fallback[0], color[0], reply)
+        && parseLevel(payload, "green", fallback[1], color[1], reply)
+        && parseLevel(payload, "blue", fallback[2], color[2], reply);
+}
+
+// Red, green and blue, or a color temperature, or a hue and saturation. The last two are
+// scaled by the brightness.
+static bool parseChangeColor(JsonVariant payload, LightCommand &command, ActionReply &reply) {
+    const uint8_t black[LIGHT_CHANNELS] = { 0, 0, 0 };
+    uint8_t brightness;
+    uint8_t saturation;
+    int32_t value;
+
+    if (false == parseLevel(payload, "brightness", 255, brightness, reply)) {
+        return false;
+    }
+
+    if (payload.containsKey("kelvin")) {
+        if (false == parseInteger(payload, "kelvin", COLOR_KELVIN_MIN, COLOR_KELVIN_MAX, 0, value, reply)) {
+            return false;
+        }
+
+        colorFromKelvin(value, brightness, command.color);
+    } else if (payload.containsKey("hue")) {
+        if (
+            false == parseInteger(payload, "hue", 0, COLOR_HUE_MAX, 0, value, reply)
+            || false == parseLevel(payload, "saturation", 255, saturation, reply)
+        ) {
+            return false;
+        }
+
+        colorFromHsv(value, saturation, brightness, command.color);
+    } else if (false == parseColor(payload, black, command.color, reply)) {
+        return false;
+    }
+
+    command.durationMs = payload["transition"] | 0u;
+
+    return parseZones(payload, command, reply);
+}
+
+static bool parseStartEffect(JsonVariant payload, LightCommand &command, ActionReply &reply) {
+    uint8_t firstZone = 0;
+
+    command.type = LIGHT_COMMAND_EFFECT_START;
+    command.effect = effectFind(payload["effect"].as<const char *>());
+
+    if (command.effect == EFFECT_NONE || command.effect == EFFECT_COUNT) {
+        reply.code = 500;
+        strlcpy(reply.message, "Unknown effect", sizeof(reply.message));
+        return false;
+    }
+
+    if (false == parseZones(payload, command, reply)) {
+        return false;
+    }
+
+    // Effects use the current color of the first zone unless one is given
+    while ((command.zones & (1 << firstZone)) == 0) {
+        firstZone++;
+    }
+
+    lightOutputTarget(firstZone, command.color);
+
+    if (command.color[0] == 0 && command.color[1] == 0 && command.color[2] == 0) {
+        memset(command.color, 255, sizeof(command.color));
+    }
+
+    uint8_t current[LIGHT_CHANNELS];
+
+    memcpy(current, command.color, LIGHT_CHANNELS);
+
+    if (false == parseColor(payload, current, command.color, reply)) {
+        return false;
+    }
+
+    command.durationMs = payload["period"] | EFFECT_PERIOD_DEFAULT_MS;
+
+    return true;
+}
+
+static bool parseStopEffect(JsonVariant payload, LightCommand &command, ActionReply &reply) {
+    command.type = LIGHT_COMMAND_EFFECT_STOP;
+    command.durationMs = payload["transition"] | 0u;
+
+    return parseZones(payload, command, reply);
+}
+
+// Actions allowed in a batch or a scene
+struct LightAction {
+    const char *name;
+    LightParser parse;
+};
+
+static const LightAction lightActions[] = {
+    { "lightOn", parseLightOn },
+    { "lightOff", parseLightOff },
+    { "changeColor", parseChangeColor },
+    { "startEffect", parseStartEffect },
+    { "stopEffect", parseStopEffect }
+};
+
+// "applyAt" : controller time in ms (see ClockSync.h), the command waits for it in the render task
+static bool parseApplyAt(JsonVariant payload, LightCommand &command, ActionReply &reply) {
+    int64_t localUs = 0;
+
+    if (!payload.containsKey("applyAt")) {
+        return true;
+    }
+
+    reply.code = 500;
+
+    if (false == clockSyncToLocal(payload["applyAt"].as<uint64_t>(), localUs)) {
+        strlcpy(reply.message, "Clock not synchronized, ping with t first", sizeof(reply.message));
+        return false;
+    }
+
+    if (localUs - halMicros() > (int64_t) CLOCK_SYNC_AHEAD_MAX_MS * 1000) {
+        snprintf(reply.message, sizeof(reply.message), "applyAt more than %u ms ahead", CLOCK_SYNC_AHEAD_MAX_MS);
+        return false;
+    }
+
+    // A command just late stays scheduled, the render task applies it at once and counts it late
+    if (localUs - halMicros() < -(int64_t) CLOCK_SYNC_BEHIND_MAX_MS * 1000) {
+        snprintf(reply.message, sizeof(reply.message), "applyAt more than %u ms behind", CLOCK_SYNC_BEHIND_MAX_MS);
+        return false;
+    }
+
+    reply.code = 200;
+    command.scheduled = true;
+    command.applyAtUs = (uint32_t) localUs;
+
+    return true;
+}
+
+static bool queueLight(LightParser parse, JsonVariant payload, LightCommand &command, ActionReply &reply) {
+    if (false == parse(payload, command, reply) || false == parseApplyAt(payload, command, reply)) {
+        return false;
+    }
+
+    if (false == lightOutputQueue(command)) {
+        replyQueueFull(reply);
+        return false;
+    }
+
+    return true;
+}
+
+void actionLightOn(JsonVariant payload, ActionReply &reply) {
+    LightCommand command;
+
+    if (true == queueLight(parseLightOn, payload, command, reply)) {
+        strlcpy(reply.message, "Light on", sizeof(reply.message));
+    }
+}
+
+void actionLightOff(JsonVariant payload, ActionReply &reply) {
+    LightCommand command;
+
+    if (true == queueLight(parseLightOff, payload, command, reply)) {
+        strlcpy(reply.message, "Light off", sizeof(reply.message));
+    }
+}
+
+void actionChangeColor(JsonVariant payload, ActionReply &reply) {
+    LightCommand command;
+
+    if (false == queueLight(parseChangeColor, payload, command, reply)) {
+        return;
+    }
+
+    // Sliders send bursts, one ack is published per batch (see mqttHandlerLoop)
+    reply.deferred = true;
+    pendingAckCount++;
+    snprintf(
+        pendingAck.message,
+        sizeof(pendingAck.message),
+        "Change color to %d,%d,%d",
+        command.color[0],
+        command.color[1],
+        command.color[2]
+    );
+}
+
+void actionStartEffect(JsonVariant payload, ActionReply &reply) {
+    LightCommand command;
+
+    if (true == queueLight(parseStartEffect, payload, command, reply)) {
+        snprintf(reply.message, sizeof(reply.message), "Effect %s started", effectName(command.effect));
+    }
+}
+
+void actionStopEffect(JsonVariant payload, ActionReply &reply) {
+    LightCommand command;
+
+    if (false == queueLight(parseStopEffect, payload, command, reply)) {
+        return;
+    }
+
+    // Stats of the effect, kept when the stop was refused
+    RenderStats stats = lightOutputStats(true);
+    uint32_t jitterAvg = stats.jitterSamples > 0 ? stats.jitterTotalUs / stats.jitterSamples : 0;
+
+    snprintf(
+        reply.message,
+        sizeof(reply.message),
+        "Effect stopped (jitter max %u us, avg %u us, render max %u us, overruns %u)",
+        stats.jitterMaxUs,
+        jitterAvg,
+        stats.renderMaxUs,
+        stats.overruns
+    );
+}
+
+// "commands" : array of { "action", "payload" } like the messages, light actions only
+static uint8_t parseCommands(JsonVariant list, LightCommand commands[LIGHT_BATCH_MAX], ActionReply &reply) {
+    if (false == list.is<JsonArray>() || list.size() == 0 || list.size() > LIGHT_BATCH_MAX) {
+        reply.code = 500;
+        snprintf(reply.message, sizeof(reply.message), "Commands must be an array of 1 to %d commands", LIGHT_BATCH_MAX);
+        return 0;
+    }
+
+    for (size_t i = 0 ; i < list.size() ; i++) {
+        const char *name = list[i]["action"] | "";
+        const LightAction *action = nullptr;
+
+        for (size_t j = 0 ; j < sizeof(lightActions) / sizeof(lightActions[0]) && nullptr == action ; j++) {
+            if (strcmp(lightActions[j].name, name) == 0) {
+                action = &lightActions[j];
+            }
+        }
+
+        if (nullptr == action) {
+            reply.code = 500;
+            snprintf(reply.message, sizeof(reply.message), "Action %s not allowed in commands", name);
+            return 0;
+        }
+
+        if (false == action->parse(list[i]["payload"], commands[i], reply)) {
+            return 0;
+        }
+
+        if (false == parseApplyAt(list[i]["payload"], commands[i], reply)) {
+            return 0;
+        }
+    }
+
+    return list.size();
+}
+
+// An "applyAt" of the batch applies to the commands without their own
+void actionBatch(JsonVariant payload, ActionReply &reply) {
+    LightCommand commands[LIGHT_BATCH_MAX];
+    LightCommand timing;
+    uint8_t count = parseCommands(payload["commands"], commands, reply);
+
+    if (0 == count || false == parseApplyAt(payload, timing, reply)) {
+        return;
+    }
+
+    lightOutputBatchBegin();
+
+    for (uint8_t i = 0 ; i < count ; i++) {
+        if (false == commands[i].scheduled) {
+            commands[i].scheduled = timing.scheduled;
+            commands[i].applyAtUs = timing.applyAtUs;
+        }
+
+        lightOutputQueue(commands[i]);
+    }
+
+    if (false == lightOutputBatchEnd()) {
+        return replyQueueFull(reply);
+    }
+
+    snprintf(reply.message, sizeof(reply.message), "Batch of %u commands applied", count);
+}
+
+static const char *sceneName(JsonVariant payload, ActionReply &reply) {
+    const char *name = payload["name"] | "";
+
+    if (name[0] == '\0' || strlen(name) >= SCENE_NAME_MAX) {
+        reply.code = 500;
+        snprintf(reply.message, sizeof(reply.message), "Scene name must have 1 to %d characters", SCENE_NAME_MAX - 1);
+        return nullptr;
+    }
+
+    return name;
+}
+
+static void replyScene(SceneStatus status, const char *name, const char *done, ActionReply &reply) {
+    switch (status) {
+        case SCENE_OK:
+            snprintf(reply.message, sizeof(reply.message), "Scene %s %s", name, done);
+            return;
+        case SCENE_NOT_FOUND:
+            snprintf(reply.message, sizeof(reply.message), "Scene %s not found", name);
+            break;
+        case SCENE_STORE_FULL:
+            snprintf(reply.message, sizeof(reply.message), "No room for scene %s (%d scenes max)", name, SCENES_MAX);
+            break;
+        case SCENE_STORE_FAILED:
+            strlcpy(reply.message, "Scene store write failed", sizeof(reply.message));
+            break;
+        case SCENE_QUEUE_FULL:
+            strlcpy(reply.message, "Command queue full", sizeof(reply.message));
+            break;
+    }
+
+    reply.code = 500;
+}
+
+void actionSaveScene(JsonVariant payload, ActionReply &reply) {
+    LightCommand commands[LIGHT_BATCH_MAX];
+    const char *name = sceneName(payload, reply);
+    uint8_t count = nullptr != name ? parseCommands(payload["commands"], commands, reply) : 0;
+
+    if (0 == count) {
+        return;
+    }
+
+    replyScene(sceneSave(name, commands, count), name, "saved", reply);
+}
+
+void actionScene(JsonVariant payload, ActionReply &reply) {
+    LightCommand timing;
+    const char *name = sceneName(payload, reply);
+
+    if (nullptr != name && true == parseApplyAt(payload, timing, reply)) {
+        replyScene(sceneRecall(name, timing.scheduled, timing.applyAtUs), name, "applied", reply);
+    }
+}
+
+void actionDeleteScene(JsonVariant payload, ActionReply &reply) {
+    const char *name = sceneName(payload, reply);
+
+    if (nullptr != name) {
+        replyScene(sceneDelete(name), name, "deleted", reply);
+    }
+}
+
+static uint32_t averageCycles(const MqttPathStats &stats) {
+    return stats.messages > 0 ? stats.totalCycles / stats.messages : 0;
+}
+
+// Longer than a reply message
+static void writeStats(ReplyOutput &out) {
+    out.printf(
+        "json %u avg %u max %u, binary %u avg %u max %u, stack %u, queued %u coalesced %u dropped %u",
+        statsSnapshot.json.messages,
+        averageCycles(statsSnapshot.json),
+        statsSnapshot.json.maxCycles,
+        statsSnapshot.binary.messages,
+        averageCycles(statsSnapshot.binary),
+        statsSnapshot.binary.maxCycles,
+        statsSnapshot.stackFree,
+        commandsSnapshot.enqueued,
+        commandsSnapshot.coalesced,
+        commandsSnapshot.dropped
+    );
+}
+
+void actionStats(JsonVariant payload, ActionReply &reply) {
+    statsSnapshot = mqttStats;
+    commandsSnapshot = lightOutputCommandStats();
+    reply.body = writeStats;
+}
+
+static void writeMetrics(ReplyOutput &out) {
+    metricsWrite(out, metricsSnapshot);
+}
+
+void actionMetrics(JsonVariant payload, ActionReply &reply) {
+    metricsCapture(metricsSnapshot);
+    reply.body = writeMetrics;
+}
+
+static void publishReply(const char *actionName, const ActionReply &reply) {
+    mqttOutboxPushReply(publishChannel, actionName, reply);
+}
+
+uint32_t mqttHandlerLoop() {
+    uint32_t sinceMs = halMillis() - pendingAckSent;
+
+    if (pendingAckCount == 0) {
+        return UINT32_MAX;
+    }
+
+    if (sinceMs < ackBatchDelay) {
+        return ackBatchDelay - sinceMs;
+    }
+
+    if (pendingAckCount > 1) {
+        size_t length = strlen(pendingAck.message);
+        snprintf(pendingAck.message + length, sizeof(pendingAck.message) - length, " (%u commands)", pendingAckCount);
+    }
+
+    publishReply("changeColor", pendingAck);
+    pendingAckCount = 0;
+    pendingAckSent = halMillis();
+
+    return UINT32_MAX;
+}
+
+static void updateMqttStats(MqttPathStats &stats, uint32_t startCycles) {
+    uint32_t cycles = halCycles() - startCycles;
+
+    stats.messages++;
+    stats.lastCycles = cycles;
+    stats.totalCycles += cycles;
+    mqttStats.stackFree = halStackFree();
+
+    if (cycles > stats.maxCycles) {
+        stats.maxCycles = cycles;
+    }
+}
+
+// Fast path : no parsing, no lookup, and no reply unless the sender asked for one
+static void handleBinary(uint8_t *payload, unsigned int length) {
+    uint32_t startCycles = halCycles();
+    BinaryColor command;
+    LightCommand light;
+    BinaryStatus status = BINARY_STATUS_OK;
+
+    if (false == binaryColorDecode(payload, length, command)) {
+        status = BINARY_STATUS_MALFORMED;
+        // Only a well formed flags byte tells if a reply is expected
+        command.flags = length > 0 && (payload[0] & ~BINARY_FLAGS_MASK) == 0 ? payload[0] : 0;
+    } else if (0 == (command.zones & lightOutputZoneMask())) {
+        status = BINARY_STATUS_MALFORMED;
+    } else {
+        binaryColorCommand(command, light);
+
+        if (false == lightOutputQueue(light)) {
+            status = BINARY_STATUS_QUEUE_FULL;
+        }
+    }
+
+    if ((command.flags & BINARY_FLAG_REPLY) != 0) {
+        uint8_t ack[BINARY_ACK_LENGTH];
+
+        mqttOutboxPush(binaryPublishChannel, ack, binaryAckEncode(status, command.sequence, ack), false, OUTBOX_DROP_NEWEST);
+    }
+
+    updateMqttStats(mqttStats.binary, startCycles);
+}
+
+void mqttHandleMessage(char *topic, uint8_t *payload, unsigned int length) {
+    if (0 == strcmp(topic, binarySubscribeChannel)) {
+        handleBinary(payload, length);
+        return;
+    }
+
+    uint32_t startCycles = halCycles();
+    int64_t start = halMicros();
+    // Zero-copy : strings of the document point into the client buffer (mutable char*)
+    StaticJsonDocument<MQTT_JSON_CAPACITY> json;
+
+    if (deserializeJson(json, (char *) payload, length) != DeserializationError::Ok || !json.containsKey("action")) {
+        return;
+    }
+
+    int64_t parsed = halMicros();
+
+    metricsObserve(METRIC_MQTT_PARSE, parsed - start);
+
+    const char *name = json["action"] | "";
+    const Action *action = actionFind(name);
+    ActionReply reply;
+
+    if (nullptr == action) {
+        reply.code = 404;
+        snprintf(reply.message, sizeof(reply.message), "Action %s not found !", name);
+    } else {
+        action->handler(json["payload"], reply);
+    }
+
+    metricsObserve(METRIC_MQTT_DISPATCH, halMicros() - parsed);
+
+    if (false == reply.deferred) {
+        publishReply(nullptr != action ? action->name : nullptr, reply);
+    }
+
+    updateMqttStats(mqttStats.json, startCycles);
+
+    LOG_DEBUG("Message handled in %u cycles (stack free : %u)", mqttStats.json.lastCycles, mqttStats.stackFree);
+}
+#endif
@@ -0,0 +1,290 @@
+#include "Settings.h"
+
+#if MQTT_ENABLE == true
+#include <string.h>
+#include "Hal.h"
+#include "MqttOutbox.h"
+#include "MqttReply.h"
+#include "Metrics.h"
+
+struct OutboxEntry {
+    const char *topic = "";
+    uint32_t queuedUs = 0;
+    unsigned long retryAt = 0;
+    uint16_t length = 0;
+    uint8_t attempts = 0;
+    bool retained = false;
+    OutboxPolicy policy = OUTBOX_DROP_NEWEST;
+    // Slot of a streamed reply, -1 when the payload is in the entry
+    int8_t streamed = -1;
+    // Writes the payload when it did not fit in the entry
+    ReplyWriter body = nullptr;
+    uint8_t payload[MQTT_OUTBOX_PAYLOAD_MAX];
+};
+
+struct StreamedReply {
+    bool used = false;
+    const char *actionName = nullptr;
+    ActionReply reply;
+};
+
+// Writes a reply in the payload of an entry, measured first so it always fits
+class EntryOutput : public ReplyOutput {
+  public:
+    explicit EntryOutput(OutboxEntry &entry) : entry(entry) {}
+
+    size_t write(const uint8_t *buffer, size_t size) override {
+        memcpy(entry.payload + entry.length, buffer, size);
+        entry.length += size;
+
+        return size;
+    }
+
+  private:
+    OutboxEntry &entry;
+};
+
+// Loop task only, oldest first from head
+static OutboxEntry entries[MQTT_OUTBOX_SIZE];
+static uint8_t head = 0;
+static uint8_t count = 0;
+static StreamedReply streamedReplies[MQTT_OUTBOX_STREAMED_MAX];
+static MqttOutboxStats stats;
+
+static OutboxEntry &entryAt(uint8_t index) {
+    return entries[(head + index) % MQTT_OUTBOX_SIZE];
+}
+
+static void pop() {
+    OutboxEntry &entry = entries[head];
+
+    if (entry.streamed >= 0) {
+        streamedReplies[entry.streamed].used = false;
+    }
+
+    head = (head + 1) % MQTT_OUTBOX_SIZE;
+    count--;
+}
+
+// A free entry at the tail, or the queued entry a latest message replaces
+static OutboxEntry *reserve(const char *topic, OutboxPolicy policy) {
+    OutboxEntry *entry = nullptr;
+
+    for (uint8_t i = 0 ; i < count && policy == OUTBOX_LATEST && nullptr == entry ; i++) {
+        if (entryAt(i).policy == OUTBOX_LATEST && strcmp(entryAt(i).topic, topic) == 0) {
+            entry = &entryAt(i);
+            stats.replaced++;
+
+            if (entry->streamed >= 0) {
+                streamedReplies[entry->streamed].used = false;
+            }
+        }
+    }
+
+    if (nullptr == entry && count == MQTT_OUTBOX_SIZE) {
+        stats.dropped++;
+
+        if (policy != OUTBOX_LATEST) {
+            return nullptr;
+        }
+
+        pop();
+    }
+
+    if (nullptr == entry) {
+        entry = &entryAt(count++);
+    }
+
+    // A replaced message is a new one, it gets its own retries
+    entry->attempts = 0;
+    entry->retryAt = 0;
+    entry->topic = topic;
+    entry->queuedUs = (uint32_t) halMicros();
+    entry->length = 0;
+    entry->retained = false;
+    entry->policy = policy;
+    entry->streamed = -1;
+    entry->body = nullptr;
+
+    stats.queued++;
+    stats.depthMax = count > stats.depthMax ? count : stats.depthMax;
+
+    return entry;
+}
+
+bool mqttOutboxPush(const char *topic, const uint8_t *payload, size_t length, bool retained, OutboxPolicy policy) {
+    if (length > MQTT_OUTBOX_PAYLOAD_MAX) {
+        stats.dropped++;
+        return false;
+    }
+
+    OutboxEntry *entry = reserve(topic, policy);
+
+    if (nullptr == entry) {
+        return false;
+    }
+
+    memcpy(entry->payload, payload, length);
+    entry->length = length;
+    entry->retained = retained;
+
+    return true;
+}
+
+bool mqttOutboxPushReply(const char *topic, const char *actionName, const ActionReply &reply) {
+    CountingOutput counter;
+    int8_t slot = -1;
+
+    mqttWriteReply(counter, actionName, reply);
+
+    if (counter.count > MQTT_OUTBOX_PAYLOAD_MAX) {
+        for (int8_t i = 0 ; i < MQTT_OUTBOX_STREAMED_MAX && slot < 0 ; i++) {
+            slot = false == streamedReplies[i].used ? i : -1;
+        }
+
+        if (slot < 0) {
+            stats.dropped++;
+            return false;
+        }
+    }
+
+    OutboxEntry *entry = reserve(topic, OUTBOX_DROP_NEWEST);
+
+    if (nullptr == entry) {
+        return false;
+    }
+
+    if (slot >= 0) {
+        streamedReplies[slot].used = true;
+        streamedReplies[slot].actionName = actionName;
+        streamedReplies[slot].reply = reply;
+        entry->streamed = slot;
+    } else {
+        EntryOutput out(*entry);
+
+        mqttWriteReply(out, actionName, reply);
+    }
+
+    return true;
+}
+
+bool mqttOutboxPushWriter(const char *topic, ReplyWriter body, bool retained, OutboxPolicy policy) {
+    CountingOutput counter;
+
+    body(counter);
+
+    OutboxEntry *entry = reserve(topic, policy);
+
+    if (nullptr == entry) {
+        return false;
+    }
+
+    entry->retained = retained;
+
+    if (counter.count > MQTT_OUTBOX_PAYLOAD_MAX) {
+        entry->body = body;
+    } else {
+        EntryOutput out(*entry);
+
+        body(out);
+    }
+
+    return true;
+}
+
+bool mqttOutboxBusy() {
+    return count >= MQTT_OUTBOX_HIGH_WATER;
+}
+
+static bool send(const OutboxEntry &entry) {
+    int64_t start = halMicros();
+    bool sent;
+
+    if (entry.streamed >= 0) {
+        const StreamedReply &streamed = streamedReplies[entry.streamed];
+
+        sent = mqttPublishReply(entry.topic, streamed.actionName, streamed.reply);
+    } else if (nullptr != entry.body) {
+        sent = mqttPublishWriter(entry.topic, entry.body, entry.retained);
+    } else {
+        sent = halMqttPublish(entry.topic, entry.payload, entry.length, entry.retained);
+    }
+
+    metricsObserve(METRIC_MQTT_PUBLISH, halMicros() - start);
+
+    if (true == sent) {
+        stats.published++;
+        metricsObserve(METRIC_MQTT_OUTBOX, (uint32_t) halMicros() - entry.queuedUs);
+    }
+
+    return sent;
+}
+
+uint32_t mqttOutboxLoop() {
+    unsigned long now = halMillis();
+    uint8_t sent = 0;
+    uint32_t waitMs = UINT32_MAX;
+
+    while (count > 0 && sent < MQTT_OUTBOX_BATCH_MAX) {
+        OutboxEntry &entry = entries[head];
+
+        if ((uint32_t) halMicros() - entry.queuedUs >= MQTT_OUTBOX_EXPIRE_MS * 1000u) {
+            stats.expired++;
+            pop();
+            continue;
+        }
+
+        if (entry.attempts > 0 && (long) (entry.retryAt - now) > 0) {
+            waitMs = entry.retryAt - now;
+            break;
+        }
+
+        if (true == send(entry)) {
+            pop();
+            sent++;
+            continue;
+        }
+
+        // A full TCP window empties within a few round trips
+        if (entry.attempts == MQTT_OUTBOX_RETRIES) {
+            stats.failed++;
+            pop();
+            continue;
+        }
+
+        waitMs = MQTT_OUTBOX_RETRY_MS << entry.attempts;
+        entry.attempts++;
+        entry.retryAt = now + waitMs;
+        stats.retries++;
+        break;
+    }
+
+    if (sent > 0) {
+        stats.batches++;
+    }
+
+    if (count > 0 && sent == MQTT_OUTBOX_BATCH_MAX) {
+        return 0;
+    }
+
+    return waitMs;
+}
+
+void mqttOutboxFlush() {
+    while (count > 0) {
+        if (false == send(entries[head])) {
+            stats.failed++;
+        }
+
+        pop();
+    }
+}
+
+MqttOutboxStats mqttOutboxStats() {
+    MqttOutboxStats copy = stats;
+
+    copy.depth = count;
+
+    return copy;
+}
+#endif
@@ -0,0 +1,143 @@
+#include "Settings.h"
+
+#if MQTT_ENABLE == true
+#include <stdio.h>
+#include <string.h>
+#include "Hal.h"
+#include "MqttReply.h"
+
+bool MqttReplyWriter::begin(const char *topic, size_t length, bool retained) {
+    used = 0;
+    failed = !halMqttBeginPublish(topic, length, retained);
+
+    return !failed;
+}
+
+bool MqttReplyWriter::end() {
+    flushChunk();
+
+    return halMqttEndPublish() && !failed;
+}
+
+void MqttReplyWriter::flushChunk() {
+    if (used > 0 && !failed) {
+        failed = halMqttWrite(chunk, used) != used;
+    }
+
+    used = 0;
+}
+
+size_t MqttReplyWriter::write(const uint8_t *buffer, size_t size) {
+    // Large blocks (the manifest) skip the chunk
+    if (size > sizeof(chunk)) {
+        flushChunk();
+
+        if (!failed) {
+            failed = halMqttWrite(buffer, size) != size;
+        }
+
+        return size;
+    }
+
+    if (used + size > sizeof(chunk)) {
+        flushChunk();
+    }
+
+    memcpy(chunk + used, buffer, size);
+    used += size;
+
+    return size;
+}
+
+static void writeJsonString(ReplyOutput &out, const char *value) {
+    out.put('"');
+
+    for (const char *c = value ; *c != '\0' ; c++) {
+        if (*c == '"' || *c == '\\') {
+            out.put('\\');
+        }
+
+        out.put(*c);
+    }
+
+    out.put('"');
+}
+
+static void writeManifest(ReplyOutput &out, const char *actionName) {
+    char ip[16];
+    char macAddress[18];
+
+    halNetworkAddress(ip, macAddress);
+
+    out.print("{\"code\":\"200\",\"actionCalled\":");
+    writeJsonString(out, actionName);
+    out.print(",\"payload\":{\"ip\":\"");
+    out.print(ip);
+    out.print("\",\"Mac address\":\"");
+    out.print(macAddress);
+    out.print("\",\"protocol\":\"mqtt\",\"port\":\"\",\"actions\":[");
+    out.write((const uint8_t *) actionManifest, actionManifestLength);
+    out.print("}}");
+}
+
+void mqttWriteReply(ReplyOutput &out, const char *actionName, const ActionReply &reply) {
+    if (true == reply.manifest) {
+        writeManifest(out, actionName);
+        return;
+    }
+
+    out.print("{\"code\": \"");
+    out.print(reply.code);
+
+    if (nullptr != actionName) {
+        out.print("\", \"actionCalled\": ");
+        writeJsonString(out, actionName);
+    } else {
+        out.put('"');
+    }
+
+    out.print(", \"payload\": ");
+
+    if (nullptr != reply.body) {
+        JsonStringOutput content(out);
+
+        out.put('"');
+        reply.body(content);
+        out.put('"');
+    } else {
+        writeJsonString(out, reply.message);
+    }
+
+    out.put('}');
+}
+
+bool mqttPublishReply(const char *topic, const char *actionName, const ActionReply &reply) {
+    CountingOutput counter;
+    MqttReplyWriter writer;
+
+    mqttWriteReply(counter, actionName, reply);
+
+    if (!writer.begin(topic, counter.count)) {
+        return false;
+    }
+
+    mqttWriteReply(writer, actionName, reply);
+
+    return writer.end();
+}
+
+bool mqttPublishWriter(const char *topic, ReplyWriter body, bool retained) {
+    CountingOutput counter;
+    MqttReplyWriter writer;
+
+    body(counter);
+
+    if (!writer.begin(topic, counter.count, retained)) {
+        return false;
+    }
+
+    body(writer);
+
+    return writer.end();
+}
+#endif
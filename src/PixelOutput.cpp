@@ -0,0 +1,79 @@
+#include <string.h>
+#include "Hal.h"
+#include "PixelOutput.h"
+
+// Position of red, green, blue and white in a pixel on the wire
+static const uint8_t wireOrder[LIGHT_ZONE_PINS_MAX] = { 1, 0, 2, 3 };
+
+// One frame is clocked out while the other is filled, they are swapped when a frame is sent.
+// A frame is always filled whole, so the one coming back needs no copy.
+static uint8_t frames[2][PIXELS_MAX * LIGHT_ZONE_PINS_MAX];
+static uint8_t filling = 0;
+static size_t frameLength = 0;
+static uint8_t pixelChannels = 0;
+static bool pending = false;
+static int64_t sentUs = 0;
+static PixelStats stats;
+
+uint32_t pixelFrameUs(uint16_t count, uint8_t channels) {
+    return (uint32_t) count * channels * PIXEL_BYTE_NS / 1000 + PIXEL_LATCH_US;
+}
+
+bool pixelOutputBegin(const PixelStripConfig &config) {
+    if (config.pin < 0 || 0 == config.count || config.count > PIXELS_MAX) {
+        return false;
+    }
+
+    if (false == halPixelsSetup(config.pin)) {
+        return false;
+    }
+
+    pixelChannels = config.channels;
+    frameLength = (size_t) config.count * config.channels;
+    stats.count = config.count;
+    stats.frameUs = pixelFrameUs(config.count, config.channels);
+    stats.maxFps = 1000000 / stats.frameUs;
+
+    return true;
+}
+
+void pixelOutputFill(const uint8_t color[LIGHT_ZONE_PINS_MAX]) {
+    uint8_t *frame = frames[filling];
+    uint8_t pixel[LIGHT_ZONE_PINS_MAX];
+
+    for (int i = 0 ; i < LIGHT_ZONE_PINS_MAX ; i++) {
+        pixel[wireOrder[i]] = color[i];
+    }
+
+    for (size_t i = 0 ; i < frameLength ; i += pixelChannels) {
+        memcpy(frame + i, pixel, pixelChannels);
+    }
+
+    if (true == pending) {
+        stats.dropped++;
+    }
+
+    pending = true;
+}
+
+bool pixelOutputPresent() {
+    if (false == pending) {
+        return false;
+    }
+
+    // The previous frame is on the wire or latching, this one waits for a later render frame
+    if (halMicros() - sentUs < stats.frameUs || false == halPixelsSend(frames[filling], frameLength)) {
+        return true;
+    }
+
+    sentUs = halMicros();
+    filling ^= 1;
+    pending = false;
+    stats.frames++;
+
+    return false;
+}
+
+PixelStats pixelOutputStats() {
+    return stats;
+}
@@ -0,0 +1,154 @@
+#include <Arduino.h>
+#include <esp_timer.h>
+#include "LightOutput.h"
+#include "EventLoop.h"
+
+#define FRAME_TIMER_BIT 0x01
+#define FRAME_DIRECT_BIT 0x02
+#define FRAME_DUE_BIT 0x04
+
+static TaskHandle_t renderTaskHandle = nullptr;
+static esp_timer_handle_t frameTimer = nullptr;
+// One shot, at the time of the earliest scheduled command
+static esp_timer_handle_t dueTimer = nullptr;
+static bool frameTimerRunning = false;
+static int64_t lastTimerFrame = 0;
+
+// Written by the render task, read by the others
+static RenderStats stats;
+static portMUX_TYPE renderMux = portMUX_INITIALIZER_UNLOCKED;
+
+// esp_timer task, only wakes the render task up
+static void onFrameTimer(void *arg) {
+    xTaskNotify(renderTaskHandle, FRAME_TIMER_BIT, eSetBits);
+}
+
+static void onDueTimer(void *arg) {
+    xTaskNotify(renderTaskHandle, FRAME_DUE_BIT, eSetBits);
+}
+
+static void armDueTimer() {
+    uint32_t atUs = 0;
+
+    esp_timer_stop(dueTimer);
+
+    if (true == lightOutputNextDue(atUs)) {
+        int32_t dueInUs = (int32_t) (atUs - (uint32_t) esp_timer_get_time());
+
+        esp_timer_start_once(dueTimer, dueInUs > 0 ? dueInUs : 0);
+    }
+}
+
+static void renderTask(void *arg) {
+    uint32_t bits = 0;
+
+    for (;;) {
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+
+        // Scheduled commands due before the next frame, the running frames keep their pace
+        if (bits == FRAME_DUE_BIT && true == frameTimerRunning) {
+            lightOutputRenderDue();
+            armDueTimer();
+            continue;
+        }
+
+        // While frames run, queued commands wait for the next one so a burst is coalesced
+        if ((bits & (FRAME_TIMER_BIT | FRAME_DUE_BIT)) == 0 && true == frameTimerRunning) {
+            continue;
+        }
+
+        int64_t start = esp_timer_get_time();
+        uint32_t jitter = 0;
+        bool jitterSampled = false;
+
+        if ((bits & FRAME_TIMER_BIT) != 0) {
+            if (lastTimerFrame != 0) {
+                jitter = abs((int32_t) (start - lastTimerFrame) - LIGHT_FRAME_US);
+                jitterSampled = true;
+            }
+
+            lastTimerFrame = start;
+        }
+
+        bool changed = lightOutputRender();
+
+        armDueTimer();
+
+        if (true == changed && false == frameTimerRunning) {
+            esp_timer_start_periodic(frameTimer, LIGHT_FRAME_US);
+            frameTimerRunning = true;
+            lastTimerFrame = 0;
+        } else if (false == changed && true == frameTimerRunning) {
+            esp_timer_stop(frameTimer);
+            frameTimerRunning = false;
+        }
+
+        eventLoopKeepAwake(true == frameTimerRunning || true == lightOutputLit());
+
+        uint32_t renderUs = (uint32_t) (esp_timer_get_time() - start);
+
+        portENTER_CRITICAL(&renderMux);
+
+        if (true == jitterSampled) {
+            stats.jitterTotalUs += jitter;
+            stats.jitterSamples++;
+
+            if (jitter > stats.jitterMaxUs) {
+                stats.jitterMaxUs = jitter;
+            }
+        }
+
+        if (true == changed) {
+            stats.frames++;
+        }
+
+        if (renderUs > stats.renderMaxUs) {
+            stats.renderMaxUs = renderUs;
+        }
+
+        if (renderUs > LIGHT_FRAME_US) {
+            stats.overruns++;
+        }
+
+        portEXIT_CRITICAL(&renderMux);
+    }
+}
+
+void lightOutputBegin(const LightZoneConfig zones[LIGHT_ZONES_MAX], const PixelStripConfig &pixels) {
+    lightOutputSetup(zones, pixels);
+
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onFrameTimer;
+    timerArgs.name = "lightFrame";
+    esp_timer_create(&timerArgs, &frameTimer);
+
+    timerArgs.callback = onDueTimer;
+    timerArgs.name = "lightDue";
+    esp_timer_create(&timerArgs, &dueTimer);
+
+    // Above the loop task, so mqtt traffic handled in loop() can not delay a frame
+    xTaskCreatePinnedToCore(renderTask, "render", 3072, nullptr, RENDER_TASK_PRIORITY, &renderTaskHandle, RENDER_TASK_CORE);
+}
+
+void lightOutputWake() {
+    xTaskNotify(renderTaskHandle, FRAME_DIRECT_BIT, eSetBits);
+}
+
+RenderStats lightOutputStats(bool reset) {
+    RenderStats copy;
+
+    portENTER_CRITICAL(&renderMux);
+    copy = stats;
+
+    if (true == reset) {
+        stats.jitterMaxUs = 0;
+        stats.jitterTotalUs = 0;
+        stats.jitterSamples = 0;
+        stats.renderMaxUs = 0;
+        stats.overruns = 0;
+    }
+
+    portEXIT_CRITICAL(&renderMux);
+
+    return copy;
+}
@@ -0,0 +1,61 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "ReplyOutput.h"
+
+size_t ReplyOutput::put(char c) {
+    return write((const uint8_t *) &c, 1);
+}
+
+size_t ReplyOutput::print(const char *text) {
+    return write((const uint8_t *) text, strlen(text));
+}
+
+size_t ReplyOutput::print(int value) {
+    char buffer[12];
+
+    return write((const uint8_t *) buffer, snprintf(buffer, sizeof(buffer), "%d", value));
+}
+
+size_t ReplyOutput::printf(const char *format, ...) {
+    char buffer[128];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if (length < 0) {
+        return 0;
+    }
+
+    return write((const uint8_t *) buffer, (size_t) length < sizeof(buffer) ? length : sizeof(buffer) - 1);
+}
+
+size_t CountingOutput::write(const uint8_t *buffer, size_t size) {
+    count += size;
+    return size;
+}
+
+JsonStringOutput::JsonStringOutput(ReplyOutput &out) : out(out) {
+}
+
+size_t JsonStringOutput::write(const uint8_t *buffer, size_t size) {
+    for (size_t i = 0 ; i < size ; i++) {
+        switch (buffer[i]) {
+            case '"':
+            case '\\':
+                out.put('\\');
+                out.put(buffer[i]);
+                break;
+            case '\n':
+                out.print("\\n");
+                break;
+            default:
+                out.put(buffer[i]);
+                break;
+        }
+    }
+
+    return size;
+}
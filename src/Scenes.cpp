@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <string.h>
+#include "Hal.h"
+#include "LightOutput.h"
+#include "Logger.h"
+#include "Scenes.h"
+
+static SceneRecord scenes[SCENES_MAX];
+
+static void storeKey(int index, char key[8]) {
+    snprintf(key, 8, "scene%d", index);
+}
+
+static int sceneFind(const char *name) {
+    for (int i = 0 ; i < SCENES_MAX ; i++) {
+        if (scenes[i].name[0] != '\0' && strcmp(scenes[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Also checks a record read from the store
+static bool sceneValid(const SceneRecord &scene) {
+    if (memchr(scene.name, '\0', SCENE_NAME_MAX) == nullptr || scene.count > SCENE_STEPS_MAX) {
+        return false;
+    }
+
+    for (uint8_t i = 0 ; i < scene.count ; i++) {
+        if (scene.steps[i].type > LIGHT_COMMAND_EFFECT_STOP || scene.steps[i].effect >= EFFECT_COUNT) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void scenesBegin() {
+    char key[8];
+
+    for (int i = 0 ; i < SCENES_MAX ; i++) {
+        storeKey(i, key);
+
+        if (false == halStoreRead(key, &scenes[i], sizeof(scenes[i])) || false == sceneValid(scenes[i])) {
+            scenes[i] = SceneRecord();
+        }
+    }
+
+    LOG_INFO("%u scenes loaded", scenesCount());
+}
+
+uint8_t scenesCount() {
+    uint8_t count = 0;
+
+    for (int i = 0 ; i < SCENES_MAX ; i++) {
+        if (scenes[i].name[0] != '\0') {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+SceneStatus sceneSave(const char *name, const LightCommand commands[], uint8_t count) {
+    SceneRecord scene;
+    char key[8];
+    int index = sceneFind(name);
+
+    for (int i = 0 ; i < SCENES_MAX && index < 0 ; i++) {
+        if (scenes[i].name[0] == '\0') {
+            index = i;
+        }
+    }
+
+    if (index < 0) {
+        return SCENE_STORE_FULL;
+    }
+
+    strlcpy(scene.name, name, sizeof(scene.name));
+    scene.count = count < SCENE_STEPS_MAX ? count : SCENE_STEPS_MAX;
+
+    for (uint8_t i = 0 ; i < scene.count ; i++) {
+        SceneStep &step = scene.steps[i];
+
+        step.type = commands[i].type;
+        step.zones = commands[i].zones;
+        step.effect = commands[i].effect;
+        memcpy(step.color, commands[i].color, LIGHT_CHANNELS);
+        step.durationMs = commands[i].durationMs;
+    }
+
+    storeKey(index, key);
+
+    if (false == halStoreWrite(key, &scene, sizeof(scene))) {
+        return SCENE_STORE_FAILED;
+    }
+
+    scenes[index] = scene;
+
+    return SCENE_OK;
+}
+
+SceneStatus sceneRecall(const char *name, bool scheduled, uint32_t applyAtUs) {
+    int index = sceneFind(name);
+
+    if (index < 0) {
+        return SCENE_NOT_FOUND;
+    }
+
+    const SceneRecord &scene = scenes[index];
+
+    lightOutputBatchBegin();
+
+    for (uint8_t i = 0 ; i < scene.count ; i++) {
+        LightCommand command;
+
+        command.type = (LightCommandType) scene.steps[i].type;
+        command.zones = scene.steps[i].zones;
+        command.effect = (EffectType) scene.steps[i].effect;
+        memcpy(command.color, scene.steps[i].color, LIGHT_CHANNELS);
+        command.durationMs = scene.steps[i].durationMs;
+        command.scheduled = scheduled;
+        command.applyAtUs = applyAtUs;
+
+        lightOutputQueue(command);
+    }
+
+    return true == lightOutputBatchEnd() ? SCENE_OK : SCENE_QUEUE_FULL;
+}
+
+SceneStatus sceneDelete(const char *name) {
+    char key[8];
+    int index = sceneFind(name);
+
+    if (index < 0) {
+        return SCENE_NOT_FOUND;
+    }
+
+    SceneRecord empty;
+
+    storeKey(index, key);
+
+    // The hal store has no erase, the record is written back empty
+    if (false == halStoreWrite(key, &empty, sizeof(empty))) {
+        return SCENE_STORE_FAILED;
+    }
+
+    scenes[index] = empty;
+
+    return SCENE_OK;
+}
@@ -0,0 +1,244 @@
+#include <stddef.h>
+#include <string.h>
+#include "Crc32.h"
+#include "Hal.h"
+#include "Logger.h"
+#include "StateJournal.h"
+
+// Records never straddle two sectors
+#define JOURNAL_SECTOR_SLOTS (HAL_JOURNAL_SECTOR_SIZE / sizeof(JournalRecord))
+
+static_assert(sizeof(JournalRecord) <= HAL_JOURNAL_SECTOR_SIZE, "Journal record larger than a sector");
+// 56 bytes with the 6 zones (5 PWM and the strip), 73 records per sector
+static_assert(sizeof(JournalRecord) == 8 + LIGHT_ZONES_MAX * sizeof(JournalZone) && sizeof(JournalZone) == 8, "Journal record not packed as expected");
+
+static JournalStats stats;
+// Slots of the whole sectors of the partition, 0 without one
+static uint32_t journalSlots = 0;
+// Next slot to write, the slots after it in its sector are erased
+static uint32_t writeSlot = 0;
+static uint32_t sequence = 0;
+static LightState written;
+// Light commands already counted and the changes not written yet
+static uint32_t seenCommands = 0;
+static uint32_t pendingUpdates = 0;
+static unsigned long lastChange = 0;
+
+static uint32_t recordCrc(const JournalRecord &record) {
+    return crc32(0, &record, offsetof(JournalRecord, crc));
+}
+
+static bool recordValid(const JournalRecord &record) {
+    if (record.crc != recordCrc(record)) {
+        return false;
+    }
+
+    for (int i = 0 ; i < LIGHT_ZONES_MAX ; i++) {
+        if (record.zones[i].effect >= EFFECT_COUNT) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool recordErased(const JournalRecord &record) {
+    const uint8_t *bytes = (const uint8_t *) &record;
+
+    for (size_t i = 0 ; i < sizeof(record) ; i++) {
+        if (bytes[i] != 0xFF) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Sequence distance, so the order survives the wrap around
+static bool newer(uint32_t sequence, uint32_t than) {
+    return (int32_t) (sequence - than) > 0;
+}
+
+static uint32_t slotOffset(uint32_t slot) {
+    return slot / JOURNAL_SECTOR_SLOTS * HAL_JOURNAL_SECTOR_SIZE + slot % JOURNAL_SECTOR_SLOTS * sizeof(JournalRecord);
+}
+
+static bool sameState(const LightState &a, const LightState &b) {
+    for (int i = 0 ; i < LIGHT_ZONES_MAX ; i++) {
+        const LightZoneState &zoneA = a.zones[i];
+        const LightZoneState &zoneB = b.zones[i];
+
+        if (memcmp(zoneA.color, zoneB.color, LIGHT_CHANNELS) != 0 || zoneA.effect != zoneB.effect || zoneA.periodMs != zoneB.periodMs) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Zones missing from the current config are skipped
+static void apply(const JournalRecord &record) {
+    for (int i = 0 ; i < lightOutputZoneCount() ; i++) {
+        const JournalZone &zone = record.zones[i];
+
+        if (zone.effect != EFFECT_NONE) {
+            lightOutputStartEffect(1 << i, (EffectType) zone.effect, zone.color, zone.periodMs);
+        } else {
+            lightOutputSet(1 << i, zone.color[0], zone.color[1], zone.color[2], 0);
+        }
+    }
+}
+
+// Sector erased when the ring enters it, a failed write still moves on so a slot is never written twice
+static bool append(const LightState &state) {
+    JournalRecord record;
+    uint32_t slot = writeSlot;
+    uint32_t offset = slotOffset(slot);
+
+    record.sequence = sequence + 1;
+
+    for (int i = 0 ; i < LIGHT_ZONES_MAX ; i++) {
+        memcpy(record.zones[i].color, state.zones[i].color, LIGHT_CHANNELS);
+        record.zones[i].effect = state.zones[i].effect;
+        record.zones[i].periodMs = state.zones[i].periodMs;
+    }
+
+    record.crc = recordCrc(record);
+
+    writeSlot = (writeSlot + 1) % journalSlots;
+
+    if (slot % JOURNAL_SECTOR_SLOTS == 0) {
+        if (false == halJournalErase(offset)) {
+            LOG_ERROR("Journal sector erase failed");
+            return false;
+        }
+
+        stats.erases++;
+    }
+
+    if (false == halJournalWrite(offset, &record, sizeof(record))) {
+        LOG_ERROR("Journal write failed");
+        return false;
+    }
+
+    sequence = record.sequence;
+    stats.writes++;
+
+    return true;
+}
+
+static void collectUpdates() {
+    uint32_t enqueued = lightOutputCommandStats().enqueued;
+
+    if (enqueued != seenCommands) {
+        stats.updates += enqueued - seenCommands;
+        pendingUpdates += enqueued - seenCommands;
+        seenCommands = enqueued;
+        lastChange = halMillis();
+    }
+}
+
+bool stateJournalBegin() {
+    int64_t start = halMicros();
+    JournalRecord record;
+    JournalRecord newest;
+    uint32_t newestSlot = 0;
+    bool found = false;
+
+    journalSlots = halJournalSize() / HAL_JOURNAL_SECTOR_SIZE * JOURNAL_SECTOR_SLOTS;
+    writeSlot = 0;
+    sequence = 0;
+    written = LightState();
+    pendingUpdates = 0;
+
+    if (0 == journalSlots) {
+        seenCommands = lightOutputCommandStats().enqueued;
+        LOG_WARN("No journal partition, the light state is not kept");
+        return false;
+    }
+
+    // Records are written in order, the newest sector is the one starting with the newest record
+    for (uint32_t slot = 0 ; slot < journalSlots ; slot += JOURNAL_SECTOR_SLOTS) {
+        if (
+            halJournalRead(slotOffset(slot), &record, sizeof(record))
+            && recordValid(record)
+            && (false == found || newer(record.sequence, newest.sequence))
+        ) {
+            found = true;
+            newestSlot = slot;
+            newest = record;
+        }
+    }
+
+    if (true == found) {
+        // Up to the first erased slot, a torn record is skipped but its slot is not reused
+        for (uint32_t slot = newestSlot ; slot < newestSlot + JOURNAL_SECTOR_SLOTS ; slot++) {
+            if (false == halJournalRead(slotOffset(slot), &record, sizeof(record)) || true == recordErased(record)) {
+                break;
+            }
+
+            writeSlot = (slot + 1) % journalSlots;
+
+            if (true == recordValid(record) && true == newer(record.sequence, newest.sequence)) {
+                newest = record;
+            }
+        }
+
+        sequence = newest.sequence;
+        apply(newest);
+        lightOutputState(written);
+    }
+
+    seenCommands = lightOutputCommandStats().enqueued;
+    stats.restoreUs = (uint32_t) (halMicros() - start);
+
+    return found;
+}
+
+uint32_t stateJournalLoop() {
+    collectUpdates();
+
+    if (0 == pendingUpdates) {
+        return UINT32_MAX;
+    }
+
+    uint32_t quietMs = halMillis() - lastChange;
+
+    if (quietMs < STATE_JOURNAL_QUIET_MS) {
+        return STATE_JOURNAL_QUIET_MS - quietMs;
+    }
+
+    stateJournalFlush();
+
+    return UINT32_MAX;
+}
+
+void stateJournalFlush() {
+    LightState state;
+
+    collectUpdates();
+
+    if (0 == pendingUpdates || 0 == journalSlots) {
+        pendingUpdates = 0;
+        return;
+    }
+
+    lightOutputState(state);
+
+    // A slider going back and forth often ends where it started
+    if (true == sameState(state, written)) {
+        stats.writesAvoided += pendingUpdates;
+    } else {
+        stats.writesAvoided += pendingUpdates - 1;
+
+        if (true == append(state)) {
+            written = state;
+        }
+    }
+
+    pendingUpdates = 0;
+}
+
+const JournalStats &stateJournalStats() {
+    return stats;
+}
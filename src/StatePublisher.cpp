@@ -0,0 +1,164 @@
+#include "Settings.h"
+
+#if MQTT_ENABLE == true
+#include <stdio.h>
+#include <string.h>
+#include "Hal.h"
+#include "LightOutput.h"
+#include "MqttOutbox.h"
+#include "ReplyOutput.h"
+#include "StatePublisher.h"
+
+#define STATE_CHANNEL_MAX 128
+
+static char stateTopic[STATE_CHANNEL_MAX + sizeof(STATE_TOPIC_SUFFIX)] = "";
+static char availabilityTopic[STATE_CHANNEL_MAX + sizeof(STATE_AVAILABILITY_SUFFIX)] = "";
+// Last state seen by the loop, and last one given to the outbox, which writes it when its turn
+// comes when it is too large for an entry (several zones)
+static LightState seen;
+static LightState published;
+static bool pending = false;
+static unsigned long firstChange = 0;
+static unsigned long lastChange = 0;
+static StatePublisherStats stats;
+
+void statePublisherBegin(const char *publishChannel) {
+    snprintf(stateTopic, sizeof(stateTopic), "%s%s", publishChannel, STATE_TOPIC_SUFFIX);
+    snprintf(availabilityTopic, sizeof(availabilityTopic), "%s%s", publishChannel, STATE_AVAILABILITY_SUFFIX);
+}
+
+const char *statePublisherAvailabilityTopic() {
+    return availabilityTopic;
+}
+
+const StatePublisherStats &statePublisherStats() {
+    return stats;
+}
+
+// Zones of the config only, the others never change
+static bool sameState(const LightState &a, const LightState &b) {
+    for (uint8_t i = 0 ; i < lightOutputZoneCount() ; i++) {
+        const LightZoneState &zoneA = a.zones[i];
+        const LightZoneState &zoneB = b.zones[i];
+
+        if (
+            memcmp(zoneA.color, zoneB.color, LIGHT_CHANNELS) != 0
+            || zoneA.effect != zoneB.effect
+            || zoneA.periodMs != zoneB.periodMs
+            || zoneA.transitionMs != zoneB.transitionMs
+        ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// A zone is at most 112 bytes, within the printf buffer of the output :
+// ,{"red":255,"green":255,"blue":255,"effect":"breathe","period":4294967295,"transition":4294967295}
+static void writeState(ReplyOutput &out) {
+    const LightState &state = published;
+    bool on = false;
+
+    for (uint8_t i = 0 ; i < lightOutputZoneCount() ; i++) {
+        const LightZoneState &zone = state.zones[i];
+
+        on = true == on || zone.color[0] != 0 || zone.color[1] != 0 || zone.color[2] != 0 || zone.effect != EFFECT_NONE;
+    }
+
+    out.printf("{\"on\":%s,\"zones\":[", true == on ? "true" : "false");
+
+    for (uint8_t i = 0 ; i < lightOutputZoneCount() ; i++) {
+        const LightZoneState &zone = state.zones[i];
+
+        out.printf(
+            "%s{\"red\":%u,\"green\":%u,\"blue\":%u,\"effect\":\"%s\",\"period\":%u,\"transition\":%u}",
+            i > 0 ? "," : "",
+            zone.color[0],
+            zone.color[1],
+            zone.color[2],
+            effectName(zone.effect),
+            zone.periodMs,
+            zone.transitionMs
+        );
+    }
+
+    out.print("]}");
+}
+
+static bool publish(const LightState &state) {
+    LightState previous = published;
+
+    published = state;
+
+    // Only the latest state is kept while the outbox waits, it is written even when it is full
+    if (false == mqttOutboxPushWriter(stateTopic, writeState, true, OUTBOX_LATEST)) {
+        published = previous;
+        stats.failed++;
+        return false;
+    }
+
+    stats.published++;
+
+    return true;
+}
+
+static void publishAvailability(const char *availability) {
+    mqttOutboxPush(availabilityTopic, (const uint8_t *) availability, strlen(availability), true, OUTBOX_LATEST);
+}
+
+void statePublisherOnline() {
+    publishAvailability(STATE_ONLINE);
+    lightOutputState(seen);
+    pending = false;
+    publish(seen);
+}
+
+void statePublisherOffline() {
+    publishAvailability(STATE_OFFLINE);
+}
+
+uint32_t statePublisherLoop() {
+    LightState state;
+    unsigned long now = halMillis();
+
+    lightOutputState(state);
+
+    if (false == sameState(state, seen)) {
+        stats.changes++;
+
+        if (false == pending) {
+            pending = true;
+            firstChange = now;
+        }
+
+        lastChange = now;
+        seen = state;
+    }
+
+    if (false == pending) {
+        return UINT32_MAX;
+    }
+
+    uint32_t quietMs = now - lastChange;
+    uint32_t pendingMs = now - firstChange;
+
+    if (quietMs < STATE_DEBOUNCE_MS && pendingMs < STATE_DEBOUNCE_MAX_MS) {
+        uint32_t leftMs = STATE_DEBOUNCE_MS - quietMs;
+
+        return leftMs < STATE_DEBOUNCE_MAX_MS - pendingMs ? leftMs : STATE_DEBOUNCE_MAX_MS - pendingMs;
+    }
+
+    pending = false;
+
+    // A slider going back and forth often ends where it started
+    if (true == sameState(seen, published)) {
+        stats.unchanged++;
+        return UINT32_MAX;
+    }
+
+    publish(seen);
+
+    return UINT32_MAX;
+}
+#endif
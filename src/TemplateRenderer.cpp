@@ -0,0 +1,97 @@
+#include <string.h>
+#include "TemplateRenderer.h"
+
+static const char *htmlEscape(char c) {
+    switch (c) {
+        case '&': return "&amp;";
+        case '<': return "&lt;";
+        case '>': return "&gt;";
+        case '"': return "&quot;";
+        case '\'': return "&#39;";
+        default: return nullptr;
+    }
+}
+
+size_t templateCopy(char *buffer, size_t size, const char *value) {
+    size_t length = strlen(value);
+
+    if (size == 0) {
+        return 0;
+    }
+
+    if (length >= size) {
+        length = size - 1;
+    }
+
+    memcpy(buffer, value, length);
+    buffer[length] = '\0';
+
+    return length;
+}
+
+size_t templateRender(const Template &page, TemplateValueFn value, size_t index, uint8_t *buffer, size_t maxLen) {
+    char raw[TPL_VALUE_MAX + 1];
+    size_t position = 0;
+    size_t written = 0;
+
+    for (size_t i = 0 ; i < page.count && written < maxLen ; i++) {
+        const TemplateSegment &segment = page.segments[i];
+
+        if (segment.var == TPL_VAR_NONE) {
+            if (position + segment.length > index) {
+                size_t offset = index > position ? index - position : 0;
+                size_t length = segment.length - offset;
+
+                if (length > maxLen - written) {
+                    length = maxLen - written;
+                }
+
+                memcpy(buffer + written, segment.text + offset, length);
+                written += length;
+                index += length;
+            }
+
+            position += segment.length;
+            continue;
+        }
+
+        size_t rawLength = value(segment.var, raw, sizeof(raw));
+
+        for (size_t c = 0 ; c < rawLength && written < maxLen ; c++) {
+            const char *escaped = htmlEscape(raw[c]);
+            size_t length = escaped != nullptr ? strlen(escaped) : 1;
+
+            for (size_t e = 0 ; e < length && written < maxLen ; e++, position++) {
+                if (position >= index) {
+                    buffer[written++] = escaped != nullptr ? escaped[e] : raw[c];
+                    index++;
+                }
+            }
+        }
+    }
+
+    return written;
+}
+
+size_t templateLength(const Template &page, TemplateValueFn value) {
+    char raw[TPL_VALUE_MAX + 1];
+    size_t length = 0;
+
+    for (size_t i = 0 ; i < page.count ; i++) {
+        const TemplateSegment &segment = page.segments[i];
+
+        if (segment.var == TPL_VAR_NONE) {
+            length += segment.length;
+            continue;
+        }
+
+        size_t rawLength = value(segment.var, raw, sizeof(raw));
+
+        for (size_t c = 0 ; c < rawLength ; c++) {
+            const char *escaped = htmlEscape(raw[c]);
+            length += escaped != nullptr ? strlen(escaped) : 1;
+        }
+    }
+
+    return length;
+}
@@ -0,0 +1,204 @@
+#include "WebAssets.h"
+#include "Logger.h"
+
+static const char *manifestPath = "/assets.idx";
+static const char *assetCacheControl = "public, max-age=604800";
+
+static fs::FS *assetsFs = nullptr;
+static WebAsset assets[WEB_ASSETS_MAX];
+static size_t assetsCount = 0;
+static WebRouteStats routes[WEB_ROUTES_MAX];
+static size_t routesCount = 0;
+
+// Writes to the Print of an Arduino stream
+class PrintOutput : public ReplyOutput {
+  public:
+    explicit PrintOutput(Print &print) : print(print) {
+    }
+
+    size_t count = 0;
+
+    size_t write(const uint8_t *buffer, size_t size) override {
+        count += size;
+        return print.write(buffer, size);
+    }
+
+  private:
+    Print &print;
+};
+
+static const WebAsset *findAsset(const char *path) {
+    for (size_t i = 0 ; i < assetsCount ; i++) {
+        if (strcmp(assets[i].path, path) == 0) {
+            return &assets[i];
+        }
+    }
+
+    return nullptr;
+}
+
+bool webAssetsBegin(fs::FS &fs) {
+    File manifest = fs.open(manifestPath, FILE_READ);
+    char line[96];
+
+    assetsFs = &fs;
+    assetsCount = 0;
+
+    if (!manifest) {
+        LOG_WARN("No assets manifest, static files are sent uncompressed");
+        return false;
+    }
+
+    while (manifest.available() && assetsCount < WEB_ASSETS_MAX) {
+        size_t length = manifest.readBytesUntil('\n', line, sizeof(line) - 1);
+        unsigned int size = 0;
+        WebAsset &asset = assets[assetsCount];
+
+        line[length] = '\0';
+
+        if (sscanf(line, "%31s %19s %u", asset.path, asset.etag, &size) == 3) {
+            asset.size = size;
+            assetsCount++;
+        }
+    }
+
+    manifest.close();
+
+    LOG_INFO("Assets manifest loaded (%u entries)", (unsigned) assetsCount);
+
+    return true;
+}
+
+int webRouteRegister(const char *path) {
+    if (routesCount >= WEB_ROUTES_MAX) {
+        return -1;
+    }
+
+    routes[routesCount].path = path;
+
+    return routesCount++;
+}
+
+void webRouteTrack(AsyncWebServerRequest *request, int routeId, size_t bytes) {
+    if (routeId < 0 || routeId >= (int) routesCount) {
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+
+    routes[routeId].requests++;
+    routes[routeId].bytes += bytes;
+
+    request->onDisconnect([routeId, start]() {
+        WebRouteStats &route = routes[routeId];
+        uint32_t ttlb = (uint32_t) (esp_timer_get_time() - start);
+
+        route.ttlbLastUs = ttlb;
+        route.ttlbTotalUs += ttlb;
+
+        if (ttlb > route.ttlbMaxUs) {
+            route.ttlbMaxUs = ttlb;
+        }
+    });
+}
+
+// Outside the manifest, the size is read from the file opened. Like request->send(fs, path),
+// "<path>.gz" is sent when there is no plain file and the response adds the encoding for it.
+static void sendFile(AsyncWebServerRequest *request, int routeId, const char *path, const char *contentType) {
+    File file = assetsFs->exists(path) ? assetsFs->open(path, FILE_READ) : assetsFs->open(String(path) + ".gz", FILE_READ);
+
+    if (!file) {
+        webRouteTrack(request, routeId, 0);
+        request->send(404);
+        return;
+    }
+
+    webRouteTrack(request, routeId, file.size());
+    request->send(request->beginResponse(file, path, contentType));
+}
+
+void webSendAsset(AsyncWebServerRequest *request, int routeId, const char *path, const char *contentType) {
+    const WebAsset *asset = findAsset(path);
+
+    if (nullptr == asset) {
+        sendFile(request, routeId, path, contentType);
+        return;
+    }
+
+    if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == asset->etag) {
+        AsyncWebServerResponse *response = request->beginResponse(304);
+
+        response->addHeader("ETag", asset->etag);
+        response->addHeader("Cache-Control", assetCacheControl);
+        webRouteTrack(request, routeId, 0);
+
+        if (routeId >= 0) {
+            routes[routeId].notModified++;
+        }
+
+        request->send(response);
+        return;
+    }
+
+    // The file response picks "<path>.gz" and adds "Content-Encoding: gzip" by itself
+    AsyncWebServerResponse *response = request->beginResponse(*assetsFs, path, contentType);
+
+    response->addHeader("ETag", asset->etag);
+    response->addHeader("Cache-Control", assetCacheControl);
+    webRouteTrack(request, routeId, asset->size);
+    request->send(response);
+}
+
+void webSendTemplate(AsyncWebServerRequest *request, const WebTemplate *webTemplate) {
+    webRouteTrack(request, webTemplate->routeId, 0);
+
+    // Only the descriptor pointer is captured so the callback stays in std::function inline storage
+    AsyncWebServerResponse *response = request->beginChunkedResponse("text/html", [webTemplate](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        size_t length = templateRender(*webTemplate->page, webTemplate->value, index, buffer, maxLen);
+
+        if (webTemplate->routeId >= 0) {
+            routes[webTemplate->routeId].bytes += length;
+        }
+
+        return length;
+    });
+
+    response->addHeader("Cache-Control", "no-store");
+    request->send(response);
+}
+
+void webSendStats(AsyncWebServerRequest *request) {
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+
+    response->print("{\"routes\":[");
+
+    for (size_t i = 0 ; i < routesCount ; i++) {
+        const WebRouteStats &route = routes[i];
+        uint32_t completed = route.requests > 0 ? route.requests : 1;
+
+        response->printf(
+            "%s{\"path\":\"%s\",\"requests\":%u,\"notModified\":%u,\"bytes\":%llu,\"ttlbLastUs\":%u,\"ttlbMaxUs\":%u,\"ttlbAvgUs\":%llu}",
+            i == 0 ? "" : ",",
+            route.path,
+            route.requests,
+            route.notModified,
+            route.bytes,
+            route.ttlbLastUs,
+            route.ttlbMaxUs,
+            route.ttlbTotalUs / completed
+        );
+    }
+
+    response->print("]}");
+    request->send(response);
+}
+
+void webSendWriter(AsyncWebServerRequest *request, int routeId, const char *contentType, ReplyWriter body) {
+    AsyncResponseStream *response = request->beginResponseStream(contentType);
+    PrintOutput out(*response);
+
+    body(out);
+    response->addHeader("Cache-Control", "no-store");
+    webRouteTrack(request, routeId, out.count);
+    request->send(response);
+}
@@ -0,0 +1,317 @@
+#include <atomic>
+#include "Hal.h"
+#include "WebControl.h"
+#include "LightOutput.h"
+#include "Metrics.h"
+
+// A frame costs one token, counted in millionths so the refill is exact at any rate
+#define TOKEN 1000000u
+
+enum SlotState : uint8_t {
+    SLOT_FREE,
+    SLOT_OPEN,
+    // The client went away, the loop task frees the slot
+    SLOT_CLOSED
+};
+
+struct WebFrame {
+    uint32_t receivedUs = 0;
+    uint8_t slot = 0;
+    BinaryColor color;
+};
+
+struct WebAck {
+    uint16_t sequence = 0;
+    BinaryStatus status = BINARY_STATUS_OK;
+};
+
+// Claimed by the websocket task, which then owns id and refused, freed by the loop task which
+// owns the rest. state hands the slot over from one task to the other.
+struct WebClient {
+    std::atomic<uint8_t> state { SLOT_FREE };
+    uint32_t id = 0;
+    SpscRing<WebAck, WEB_CONTROL_REFUSED_MAX> refused;
+    uint32_t tokens = WEB_CONTROL_BURST * TOKEN;
+    uint32_t refilledUs = 0;
+    // Over the rate, oldest first
+    WebFrame held[WEB_CONTROL_HELD_MAX];
+    uint8_t heldCount = 0;
+};
+
+static SpscRing<WebFrame, WEB_CONTROL_QUEUE_SIZE> frames;
+static void (*wakeLoop)() = nullptr;
+static WebControlReply replyClient = nullptr;
+static WebControlStats stats;
+static WebClient clients[WEB_CONTROL_CLIENTS_MAX];
+
+void webControlBegin(void (*wake)(), WebControlReply reply) {
+    wakeLoop = wake;
+    replyClient = reply;
+}
+
+static void wake() {
+    if (nullptr != wakeLoop) {
+        wakeLoop();
+    }
+}
+
+// Loop task
+static void sendAck(uint32_t client, uint16_t sequence, BinaryStatus status) {
+    uint8_t frame[BINARY_ACK_LENGTH];
+
+    if (nullptr != replyClient) {
+        replyClient(client, frame, binaryAckEncode(status, sequence, frame));
+    }
+}
+
+// Loop task
+static void ack(uint32_t client, const BinaryColor &color, BinaryStatus status) {
+    if ((color.flags & BINARY_FLAG_REPLY) != 0) {
+        sendAck(client, color.sequence, status);
+    }
+}
+
+// Websocket task, the ack waits for the loop task
+static void refuse(WebClient *client, const BinaryColor &color, BinaryStatus status) {
+    WebAck ack;
+
+    if ((color.flags & BINARY_FLAG_REPLY) == 0 || nullptr == client) {
+        return;
+    }
+
+    ack.sequence = color.sequence;
+    ack.status = status;
+
+    if (true == client->refused.push(ack)) {
+        wake();
+    }
+}
+
+// Websocket task, the slot of the client or a free one
+static WebClient *claimClient(uint32_t id) {
+    WebClient *empty = nullptr;
+
+    for (int i = 0 ; i < WEB_CONTROL_CLIENTS_MAX ; i++) {
+        uint8_t state = clients[i].state.load(std::memory_order_acquire);
+
+        if (SLOT_OPEN == state && clients[i].id == id) {
+            return &clients[i];
+        }
+
+        if (SLOT_FREE == state && nullptr == empty) {
+            empty = &clients[i];
+        }
+    }
+
+    if (nullptr != empty) {
+        empty->id = id;
+        empty->state.store(SLOT_OPEN, std::memory_order_release);
+    }
+
+    return empty;
+}
+
+void webControlReceive(uint32_t client, const uint8_t *data, size_t length) {
+    WebFrame frame;
+    WebClient *slot = claimClient(client);
+
+    stats.frames++;
+    frame.receivedUs = (uint32_t) halMicros();
+
+    if (false == binaryColorDecode(data, length, frame.color)) {
+        stats.malformed++;
+        // Only a well formed flags byte tells if a reply is expected
+        frame.color.flags = length > 0 && (data[0] & ~BINARY_FLAGS_MASK) == 0 ? data[0] : 0;
+        refuse(slot, frame.color, BINARY_STATUS_MALFORMED);
+        return;
+    }
+
+    if (nullptr == slot) {
+        stats.overflow++;
+        return;
+    }
+
+    frame.slot = slot - clients;
+
+    if (false == frames.push(frame)) {
+        stats.overflow++;
+        refuse(slot, frame.color, BINARY_STATUS_QUEUE_FULL);
+        return;
+    }
+
+    wake();
+}
+
+// The frames of the client are queued before its slot is closed
+void webControlDisconnect(uint32_t client) {
+    for (int i = 0 ; i < WEB_CONTROL_CLIENTS_MAX ; i++) {
+        if (SLOT_OPEN == clients[i].state.load(std::memory_order_relaxed) && clients[i].id == client) {
+            clients[i].state.store(SLOT_CLOSED, std::memory_order_release);
+            wake();
+            return;
+        }
+    }
+}
+
+// Loop task, the websocket task may claim the slot again once it is free
+static void freeClient(WebClient &client, uint32_t now) {
+    WebAck ack;
+
+    while (true == client.refused.pop(ack)) {
+    }
+
+    client.tokens = WEB_CONTROL_BURST * TOKEN;
+    client.refilledUs = now;
+    client.heldCount = 0;
+    client.state.store(SLOT_FREE, std::memory_order_release);
+}
+
+// Loop task
+static void sendRefused(WebClient &client) {
+    WebAck ack;
+
+    while (true == client.refused.pop(ack)) {
+        sendAck(client.id, ack.sequence, ack.status);
+    }
+}
+
+static void refill(WebClient &client, uint32_t now) {
+    // Bounded first, so the product does not overflow after a long pause
+    uint32_t elapsedUs = now - client.refilledUs;
+    uint32_t fullUs = WEB_CONTROL_BURST * (TOKEN / WEB_CONTROL_RATE);
+
+    client.refilledUs = now;
+    client.tokens += (elapsedUs < fullUs ? elapsedUs : fullUs) * WEB_CONTROL_RATE;
+
+    if (client.tokens > WEB_CONTROL_BURST * TOKEN) {
+        client.tokens = WEB_CONTROL_BURST * TOKEN;
+    }
+}
+
+static void apply(uint32_t client, const WebFrame &frame) {
+    LightCommand command;
+    BinaryStatus status = BINARY_STATUS_OK;
+
+    binaryColorCommand(frame.color, command);
+
+    if (0 == (command.zones & lightOutputZoneMask())) {
+        status = BINARY_STATUS_MALFORMED;
+    } else if (false == lightOutputQueue(command)) {
+        stats.dropped++;
+        status = BINARY_STATUS_QUEUE_FULL;
+    } else {
+        stats.applied++;
+        metricsObserve(METRIC_WEB_CONTROL, (uint32_t) halMicros() - frame.receivedUs);
+    }
+
+    ack(client, frame.color, status);
+}
+
+// Same rule as the light queue : a newer frame replaces a held one when it covers its zones,
+// an effect stop depends on the frame before it and replaces none
+static void hold(WebClient &client, const WebFrame &frame) {
+    bool stop = (frame.color.flags & BINARY_FLAG_EFFECT) != 0 && frame.color.effect == EFFECT_NONE;
+    uint8_t kept = 0;
+
+    for (uint8_t i = 0 ; i < client.heldCount ; i++) {
+        if (false == stop && (client.held[i].color.zones & ~frame.color.zones) == 0) {
+            stats.coalesced++;
+            ack(client.id, client.held[i].color, BINARY_STATUS_OK);
+            continue;
+        }
+
+        client.held[kept++] = client.held[i];
+    }
+
+    client.heldCount = kept;
+
+    if (client.heldCount == WEB_CONTROL_HELD_MAX) {
+        stats.dropped++;
+        ack(client.id, frame.color, BINARY_STATUS_QUEUE_FULL);
+        return;
+    }
+
+    client.held[client.heldCount++] = frame;
+    stats.limited++;
+}
+
+// Held frames in order while the client has tokens
+static void release(WebClient &client) {
+    uint8_t sent = 0;
+
+    while (sent < client.heldCount && client.tokens >= TOKEN) {
+        client.tokens -= TOKEN;
+        apply(client.id, client.held[sent++]);
+    }
+
+    for (uint8_t i = sent ; i < client.heldCount ; i++) {
+        client.held[i - sent] = client.held[i];
+    }
+
+    client.heldCount -= sent;
+}
+
+uint32_t webControlLoop() {
+    WebFrame frame;
+    uint32_t now = (uint32_t) halMicros();
+    uint32_t waitMs = UINT32_MAX;
+    bool closed[WEB_CONTROL_CLIENTS_MAX];
+
+    // Read before the queue, the last frames of a closed client are in it then
+    for (int i = 0 ; i < WEB_CONTROL_CLIENTS_MAX ; i++) {
+        closed[i] = SLOT_CLOSED == clients[i].state.load(std::memory_order_acquire);
+    }
+
+    while (frames.pop(frame)) {
+        WebClient &client = clients[frame.slot];
+
+        // Nobody left to see it
+        if (true == closed[frame.slot]) {
+            continue;
+        }
+
+        refill(client, now);
+
+        // Behind held frames the order is kept even with a token
+        if (0 == client.heldCount && client.tokens >= TOKEN) {
+            client.tokens -= TOKEN;
+            apply(client.id, frame);
+        } else {
+            hold(client, frame);
+        }
+    }
+
+    for (int i = 0 ; i < WEB_CONTROL_CLIENTS_MAX ; i++) {
+        WebClient &client = clients[i];
+
+        if (true == closed[i]) {
+            freeClient(client, now);
+            continue;
+        }
+
+        if (SLOT_FREE == client.state.load(std::memory_order_acquire)) {
+            continue;
+        }
+
+        sendRefused(client);
+
+        if (0 == client.heldCount) {
+            continue;
+        }
+
+        refill(client, now);
+        release(client);
+
+        if (client.heldCount > 0) {
+            uint32_t leftMs = ((TOKEN - client.tokens) / WEB_CONTROL_RATE + 999) / 1000;
+
+            waitMs = leftMs < waitMs ? leftMs : waitMs;
+        }
+    }
+
+    return waitMs;
+}
+
+WebControlStats webControlStats() {
+    return stats;
+}
@@ -2,54 +2,52 @@
 #include <SPIFFS.h>
 #include <WiFi.h>
 #include <WiFiClient.h>
-#include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
-
-#define MQTT_ENABLE true
-#define OTA_ENABLE false
+#include "Settings.h"
+#include "Logger.h"
+#include "HalEsp32.h"
+#include "Config.h"
+#include "ConfigStore.h"
+#include "ConfigPage.h"
+#include "WebAssets.h"
+#include "ConnectionManager.h"
+#include "LightOutput.h"
+#include "PixelOutput.h"
+#include "Metrics.h"
+#include "StateJournal.h"
+#include "Scenes.h"
+#include "EventLoop.h"
+#include "Buttons.h"
+#include "WebControl.h"
+#include "generated/Templates.h"
 
 #if MQTT_ENABLE == true
-// @todo See large message method in exemple
-#define MQTT_MAX_PACKET_SIZE 2048
-
 #include <PubSubClient.h>
+#include "MqttHandler.h"
+#include "StatePublisher.h"
+#include "MqttOutbox.h"
 #endif
 
 #if OTA_ENABLE == true
 #include <ArduinoOTA.h>
 #endif
 
-void logger(String message, bool endLine = true);
-
-struct Config {
-  char wifiSsid[32] = "";
-  char wifiPassword[64] = "";
-  #if MQTT_ENABLE == true
-  bool mqttEnable = true;
-  char mqttHost[128] = "";
-  int  mqttPort = 1883;
-  char mqttUsername[32] = "";
-  char mqttPassword[64] = "";
-  char mqttPublishChannel[128] = "device/to/marvin";
-  char mqttSubscribeChannel[128] = "marvin/to/device";
-  #endif
-  char uuid[64] = "";
-};
-
 WiFiClient wifiClient;
 #if MQTT_ENABLE == true
 PubSubClient mqttClient;
 #endif
 Config config;
 AsyncWebServer server(80);
+// Light control of a local UI, binary color frames (see include/WebControl.h)
+AsyncWebSocket webSocket("/ws");
 
 /* ***** pin component ***** */
 const int ledStatusPin = 4;
-const int ledStripRedPin = 19;
-const int ledStripGreenPin = 18;
-const int ledStripBluePin = 5;
 const int restartBtnPin = 16;
 const int resetBtnPin = 17;
+// Indexes of the button events
+const int buttonPins[] = { restartBtnPin, resetBtnPin };
+enum { RESTART_BUTTON, RESET_BUTTON };
 
 #if MQTT_ENABLE == true
 const char *configFilePath = "/config.json";
@@ -57,320 +55,244 @@ const char *mqttName = "StripLedWifi";
 #else
 const char *configFilePath = "/config_cc.json";
 #endif
-const bool debug = true;
 const char *wifiApSsid = "strip-led-wifi-ssid";
 const char *wifiApPassw = "strip-led-wifi-passw";
 const char *appName = "Marvin led strip wifi";
+// Before falling back to the configuration AP
+const unsigned long bootWifiTimeout = 10000;
+const unsigned long bootMqttTimeout = 60000;
+// Delay of the restart and reset actions, the reply goes out first
+const unsigned long actionDelay = 5000;
+// Longest sleep of the loop, well inside the mqtt keep alive. OTA polls its socket.
+#if OTA_ENABLE == true
+const uint32_t loopWaitMax = 250;
+#else
+const uint32_t loopWaitMax = 5000;
+#endif
 #if OTA_ENABLE == true
 const char *otaPasswordHash = "***** MD5 password *****";
 #endif
 
-bool wifiConnected = false;
 bool startApp = false;
-bool lightOn = false;
+bool booting = false;
+unsigned long bootStarted = 0;
 int ledStatusState = LOW;
-String errorMessage = "";
+char errorMessage[128] = "";
 
-#if MQTT_ENABLE == true
-bool mqttConnected = false;
-unsigned long restartRequested = 0;
-unsigned long resetRequested = 0;
-#endif
-unsigned long resetBtnPressed = 0;
 unsigned long previousBlinkLed = 0;
 
-void logger(String message, bool endLine) {
-    if (true == debug) {
-        if (true == endLine) {
-            Serial.println(message);
-        } else {
-            Serial.print(message);
-        }
-    }
-}
+// Time left before delay has passed since start, 0 once it has
+uint32_t msLeft(unsigned long start, unsigned long delay) {
+    unsigned long elapsed = halMillis() - start;
 
-unsigned long getMillis() {
-    return esp_timer_get_time() / 1000;
+    return elapsed < delay ? delay - elapsed : 0;
 }
 
+// From the binary store, the json file is only imported when the store holds no valid config
 bool getConfig() {
-    File configFile = SPIFFS.open(configFilePath, FILE_READ);
+    int64_t start = halMicros();
+    bool imported = false;
 
-    if (!configFile) {
-        logger("Failed to open config file \"" + String(configFilePath) + "\".");
-        return false;
-    }
-
-    size_t size = configFile.size();
-
-    if (size == 0) {
-        logger(F("Config file is empty !"));
-        return false;
-    }
-
-    if (size > 1024) {
-        logger(F("Config file size is too large"));
-        return false;
-    }
-
-    StaticJsonDocument<512> json;
-    DeserializationError err = deserializeJson(json, configFile);
-
-    switch (err.code()) {
-        case DeserializationError::Ok:
-            logger(F("Deserialization succeeded"));
-            break;
-        case DeserializationError::InvalidInput:
-            logger(F("Invalid input!"));
-            return false;
-            break;
-        case DeserializationError::NoMemory:
-            logger(F("Not enough memory"));
-            return false;
-            break;
-        default:
-            logger(F("Deserialization failed"));
+    if (false == configStoreLoad(config)) {
+        if (!SPIFFS.begin(true) || false == configImport(configFilePath, config)) {
             return false;
-            break;
-    }
+        }
 
-    // Copy values from the JsonObject to the Config
-    if (
-        !json.containsKey("wifiSsid") ||
-        !json.containsKey("wifiPassword") ||
-        #if MQTT_ENABLE == true
-        !json.containsKey("mqttEnable") ||    
-        !json.containsKey("mqttHost") ||
-        !json.containsKey("mqttPort") ||
-        !json.containsKey("mqttUsername") ||
-        !json.containsKey("mqttPassword") ||
-        !json.containsKey("mqttPublishChannel") ||
-        !json.containsKey("mqttSubscribeChannel") ||
-        #endif
-        !json.containsKey("uuid")
-    ) {
-        logger(F("getConfig"));
-        serializeJson(json, Serial);
-        logger(F(""));
-        logger(F("Key not found in json fille"));
-        return false;
+        configStoreSave(config);
+        imported = true;
     }
 
-    strlcpy(config.wifiSsid, json["wifiSsid"], sizeof(config.wifiSsid));
-    strlcpy(config.wifiPassword, json["wifiPassword"], sizeof(config.wifiPassword));
-    #if MQTT_ENABLE == true
-    config.mqttEnable = json["mqttEnable"] | true;
-    strlcpy(config.mqttHost, json["mqttHost"], sizeof(config.mqttHost));
-    config.mqttPort = json["mqttPort"] | 1883;
-    strlcpy(config.mqttUsername, json["mqttUsername"], sizeof(config.mqttUsername));
-    strlcpy(config.mqttPassword, json["mqttPassword"], sizeof(config.mqttPassword));
-    strlcpy(config.mqttPublishChannel, json["mqttPublishChannel"], sizeof(config.mqttPublishChannel));
-    strlcpy(config.mqttSubscribeChannel, json["mqttSubscribeChannel"], sizeof(config.mqttSubscribeChannel));
-    #endif
-    strlcpy(config.uuid, json["uuid"], sizeof(config.uuid));
-
-    configFile.close();
+    int64_t ready = halMicros();
 
-    logger(F("wifiSsid : "), false);
-    logger(String(config.wifiSsid));
-    logger(F("wifiPassword : "), false);
-    logger(String(config.wifiPassword));
+    LOG_INFO(
+        "%s in %u us (%u us after boot)",
+        true == imported ? "Config imported" : "Config loaded",
+        (uint32_t) (ready - start),
+        (uint32_t) ready
+    );
+    LOG_INFO("wifiSsid : %s", config.wifiSsid);
     #if MQTT_ENABLE == true
-    logger(F("mqttHost : "), false);
-    logger(String(config.mqttHost));
-    logger(F("mqttPort : "), false);
-    logger(String(config.mqttPort));
-    logger(F("mqttUsername : "), false);
-    logger(String(config.mqttUsername));
-    logger(F("mqttPassword : "), false);
-    logger(String(config.mqttPassword));
-    logger(F("mqttPublishChannel : "), false);
-    logger(String(config.mqttPublishChannel));
-    logger(F("mqttSubscribeChannel : "), false);
-    logger(String(config.mqttSubscribeChannel));
-    logger(F("uuid : "), false);
+    LOG_INFO("mqttHost : %s:%d", config.mqttHost, config.mqttPort);
+    LOG_INFO("mqttUsername : %s", config.mqttUsername);
+    LOG_INFO("mqttPublishChannel : %s", config.mqttPublishChannel);
+    LOG_INFO("mqttSubscribeChannel : %s", config.mqttSubscribeChannel);
     #endif
-    logger(F("uuid : "), false);
-    logger(String(config.uuid));
+    LOG_INFO("uuid : %s", config.uuid);
 
     return true;
 }
 
 bool setConfig(Config newConfig) {
-    StaticJsonDocument<512> json;
+    return configStoreSave(newConfig);
+}
 
-    json["wifiSsid"] = String(newConfig.wifiSsid);
-    json["wifiPassword"] = String(newConfig.wifiPassword);
-    #if MQTT_ENABLE == true
-    json["mqttEnable"] = newConfig.mqttEnable;
-    json["mqttHost"] = String(newConfig.mqttHost);
-    json["mqttPort"] = newConfig.mqttPort;
-    json["mqttUsername"] = String(newConfig.mqttUsername);
-    json["mqttPassword"] = String(newConfig.mqttPassword);
-    json["mqttPublishChannel"] = String(newConfig.mqttPublishChannel);
-    json["mqttSubscribeChannel"] = String(newConfig.mqttSubscribeChannel);
-    #endif
+bool checkWifiConfigValues() {
+    LOG_DEBUG("config.wifiSsid length : %u", (unsigned) strlen(config.wifiSsid));
+    LOG_DEBUG("config.wifiPassword length : %u", (unsigned) strlen(config.wifiPassword));
 
-    if (strlen(newConfig.uuid) == 0) {
-        uint32_t tmpUuid = esp_random();
-        String(tmpUuid).toCharArray(newConfig.uuid, 64);
+    if ( strlen(config.wifiSsid) > 1 && strlen(config.wifiPassword) > 1 ) {
+        return true;
     }
 
-    json["uuid"] = String(newConfig.uuid);
+    LOG_WARN("Ssid and passw not present in the config");
+    return false;
+}
 
-    File configFile = SPIFFS.open(configFilePath, FILE_WRITE);
+#if MQTT_ENABLE == true
+bool mqttConnect() {
+    uint32_t brokerIp = connectionBrokerIp();
 
-    if (!configFile) {
-        logger(F("Failed to open config file for writing"));
-        return false;
+    // The cached address skips the DNS lookup, the host name is resolved again when it fails
+    if (0 != brokerIp) {
+        mqttClient.setServer(IPAddress(brokerIp), config.mqttPort);
+    } else {
+        mqttClient.setServer(config.mqttHost, config.mqttPort);
     }
 
-    serializeJson(json, configFile);
+    LOG_INFO("Attempting MQTT connection (host: %s)...", config.mqttHost);
 
-    configFile.close();
+    // The broker marks the device offline on its own when the connection is lost
+    if (mqttClient.connect(mqttName, config.mqttUsername, config.mqttPassword, statePublisherAvailabilityTopic(), 0, true, STATE_OFFLINE)) {
+        LOG_INFO("Mqtt connected !");
+        connectionBrokerResolved((uint32_t) wifiClient.remoteIP());
 
-    return true;
-}
+        if (strlen(config.mqttSubscribeChannel) > 1) {
+            mqttClient.subscribe(config.mqttSubscribeChannel);
+            mqttClient.subscribe(mqttHandlerBinaryTopic());
+        }
 
-bool wifiConnect() {
-    unsigned int count = 0;
-    WiFi.begin(config.wifiSsid, config.wifiPassword);
-    Serial.print(F("Try to connect to "));
-    logger(config.wifiSsid);
+        statePublisherOnline();
 
-    while (count < 20) {
-        if (WiFi.status() == WL_CONNECTED) {
-            logger("");
-            Serial.print(F("WiFi connected (IP : "));  
-            Serial.print(WiFi.localIP());
-            logger(F(")"));
+        return true;
+    }
 
-            return true;
-        } else {
-            delay(500);
-            Serial.print(F("."));  
-        }
+    LOG_WARN("Mqtt connection failed, rc=%d", mqttClient.state());
 
-        count++;
+    if (0 != brokerIp) {
+        connectionBrokerResolved(0);
     }
 
-    Serial.print(F("Error connection to "));
-    logger(String(config.wifiSsid));
     return false;
 }
 
-bool checkWifiConfigValues() {
-    logger(F("config.wifiSsid length : "), false);
-    logger(String(strlen(config.wifiSsid)));
+bool mqttIsConnected() {
+    return mqttClient.connected();
+}
+#endif
 
-    logger(F("config.wifiPassword length : "), false);
-    logger(String(strlen(config.wifiPassword)));
+void restart() {
+    LOG_INFO("Restart ESP");
 
-    if ( strlen(config.wifiSsid) > 1 && strlen(config.wifiPassword) > 1 ) {
-        return true;
+    #if MQTT_ENABLE == true
+    // The will is only sent when the connection is lost, not on a clean disconnect
+    if (true == mqttClient.connected()) {
+        statePublisherOffline();
+        mqttOutboxFlush();
+        mqttClient.disconnect();
     }
+    #endif
 
-    logger(F("Ssid and passw not present in SPIFFS"));
-    return false;
+    // The quiet delay of the journal would lose the last change
+    stateJournalFlush();
+    ESP.restart();
 }
 
-#if MQTT_ENABLE == true
-bool mqttConnect() {
-    int count = 0;
+void resetConfig() {
+    LOG_INFO("Reset ESP");
+    Config resetConfig;
+    // The zones and the strip follow the wiring of the board, they survive a reset
+    memcpy(resetConfig.zones, config.zones, sizeof(resetConfig.zones));
+    resetConfig.pixels = config.pixels;
+    setConfig(resetConfig);
+    restart();
+}
 
-    while (!mqttClient.connected()) {
-        logger("Attempting MQTT connection (host: " + String(config.mqttHost) + ")...");
+void writeConfig(ReplyOutput &out) {
+    char buffer[CONFIG_FILE_MAX];
+    size_t length = configSerialize(config, buffer, sizeof(buffer));
 
-        if (mqttClient.connect(mqttName, config.mqttUsername, config.mqttPassword)) {
-            logger(F("connected !"));
+    if (length < sizeof(buffer)) {
+        out.write((const uint8_t *) buffer, length);
+    }
+}
 
-            if (strlen(config.mqttSubscribeChannel) > 1) {
-                mqttClient.subscribe(config.mqttSubscribeChannel);
-            }
-            
-            return true;
-        } else {
-            logger(F("failed, rc="), false);
-            logger(String(mqttClient.state()));
-            logger(F("try again in 5 seconds"));
-            // Wait 5 seconds before retrying
-            delay(5000);
-
-            if (count == 10) {
-              return false;
-            }
-        }
+void writeMetrics(ReplyOutput &out) {
+    MetricsSnapshot snapshot;
 
-        count++;
-    }
+    metricsCapture(snapshot);
+    metricsWrite(out, snapshot);
+}
 
-    return false;
+// Tail of the log history, the lines still queued show up on the next request
+void writeLog(ReplyOutput &out) {
+    static char tail[LOG_HISTORY_SIZE];
+
+    out.write((const uint8_t *) tail, logTail(tail, sizeof(tail)));
 }
-#endif
 
-String processor(const String& var){
-    Serial.println(var);
-
-    if (var == "TITLE" || var == "MODULE_NAME"){
-        return String(appName);
-    } else if (var == "WIFI_SSID") {
-        return String(config.wifiSsid);
-    } else if (var == "WIFI_PASSWD") {
-        return String(config.wifiPassword);
-    } 
-    #if MQTT_ENABLE == true 
-    else if(var == "MQTT_ENABLE") {
-        if (true == config.mqttEnable) {
-            return String("checked");
-        }
-    } else if (var == "MQTT_HOST") {
-        return String(config.mqttHost);
-    } else if (var == "MQTT_PORT") {
-        return String(config.mqttPort);
-    } else if (var == "MQTT_USERNAME") {
-        return String(config.mqttUsername);
-    } else if (var == "MQTT_PASSWD") {
-        return String(config.mqttPassword);
-    } else if (var == "MQTT_PUB_CHAN") {
-        return String(config.mqttPublishChannel);
-    } else if (var == "MQTT_SUB_CHAN") {
-        return String(config.mqttSubscribeChannel);
-    } 
-    #endif
-    else if (var == "ERROR_MESSAGE") {
-        return errorMessage;
-    } else if (var == "ERROR_HIDDEN") {
-        if (errorMessage.length() == 0) {
-        return String("d-none");
+// Async task. Only whole binary frames are commands, a color frame is at most 10 bytes.
+void onWebSocketEvent(AsyncWebSocket *socket, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t length) {
+    if (type == WS_EVT_CONNECT) {
+        // The acks are a few bytes, they must not wait for more
+        client->client()->setNoDelay(true);
+    } else if (type == WS_EVT_DISCONNECT) {
+        webControlDisconnect(client->id());
+    } else if (type == WS_EVT_DATA) {
+        AwsFrameInfo *info = (AwsFrameInfo *) arg;
+
+        if (true == info->final && info->index == 0 && info->len == length && info->opcode == WS_BINARY) {
+            webControlReceive(client->id(), data, length);
         }
     }
-
-    return String();
 }
 
-void restart() {
-    logger("Restart ESP");
-    ESP.restart();
+// Loop task only, see WebControl.h
+void webSocketReply(uint32_t client, const uint8_t *frame, size_t length) {
+    webSocket.binary(client, (uint8_t *) frame, length);
 }
 
-void resetConfig() {
-    logger(F("Reset ESP"));
-    Config resetConfig;
-    setConfig(resetConfig);
-    logger(F("Restart ESP"));
-    restart();
-}
+// The configuration routes are only served on the AP, the station serves the stats and metrics
+void serverConfig(bool provisioning) {
+    static int cssRoute = webRouteRegister("/bootstrap.min.css");
+    static int metricsRoute = webRouteRegister("/metrics");
+    static int logRoute = webRouteRegister("/log");
+    #if MQTT_ENABLE == true
+    static const WebTemplate indexPage = { &templateIndex, configPageValue, webRouteRegister("/") };
+    #else
+    static const WebTemplate indexPage = { &templateIndexCc, configPageValue, webRouteRegister("/") };
+    #endif
+    static const WebTemplate restartPage = { &templateRestart, configPageValue, webRouteRegister("/save") };
+    static const WebTemplate notFoundPage = { &template404, configPageValue, webRouteRegister("404") };
+
+    configPageBind(&config, appName, errorMessage);
+    webAssetsBegin(SPIFFS);
+
+    server.on("/stats", HTTP_GET, [] (AsyncWebServerRequest *request) {
+        webSendStats(request);
+    });
+    server.on("/metrics", HTTP_GET, [] (AsyncWebServerRequest *request) {
+        webSendWriter(request, metricsRoute, "text/plain; version=0.0.4", writeMetrics);
+    });
+    server.on("/log", HTTP_GET, [] (AsyncWebServerRequest *request) {
+        webSendWriter(request, logRoute, "text/plain", writeLog);
+    });
+    server.onNotFound([](AsyncWebServerRequest *request){
+        webSendTemplate(request, &notFoundPage);
+    });
+    webSocket.onEvent(onWebSocketEvent);
+    server.addHandler(&webSocket);
+
+    if (false == provisioning) {
+        server.begin();
+        LOG_INFO("HTTP server started");
+        return;
+    }
 
-void serverConfig() {
     server.on("/", HTTP_GET, [] (AsyncWebServerRequest *request) {
-        #if MQTT_ENABLE == true
-        request->send(SPIFFS, "/index.html", "text/html", false, processor);
-        #else
-        request->send(SPIFFS, "/index_cc.html", "text/html", false, processor);
-        #endif
+        webSendTemplate(request, &indexPage);
     });
     server.on("/bootstrap.min.css", HTTP_GET, [] (AsyncWebServerRequest *request) {
-        request->send(SPIFFS, "/bootstrap.min.css", "text/css");
+        webSendAsset(request, cssRoute, "/bootstrap.min.css", "text/css");
     });
     server.on("/save", HTTP_POST, [] (AsyncWebServerRequest *request) {
         int params = request->params();
@@ -410,101 +332,20 @@ void serverConfig() {
         // save config
         setConfig(config);
 
-        request->send(SPIFFS, "/restart.html", "text/html", false, processor);
+        webSendTemplate(request, &restartPage);
     });
     server.on("/restart", HTTP_GET, [] (AsyncWebServerRequest *request) {
         restart();
     });
-    server.onNotFound([](AsyncWebServerRequest *request){
-        request->send(SPIFFS, "/404.html", "text/html", false, processor);
+    // Export, the same file is imported at boot when the config store is empty
+    server.on("/config.json", HTTP_GET, [] (AsyncWebServerRequest *request) {
+        webSendWriter(request, -1, "application/json", writeConfig);
     });
 
     server.begin();
-    logger("HTTP server started");
-}
-
-void setLightColor(unsigned int red, unsigned int green, unsigned int blue) {
-    ledcWrite(1, red);
-    ledcWrite(2, green);
-    ledcWrite(3, blue);
-
-    if(
-        red == 0 &&
-        green == 0 &&
-        blue == 0
-    ) {
-        lightOn = false;
-    } else {
-        lightOn = true;
-    }
+    LOG_INFO("HTTP server started");
 }
 
-#if MQTT_ENABLE == true
-void callback(char* topic, byte* payload, unsigned int length) {
-    StaticJsonDocument<256> json;
-    deserializeJson(json, payload, length);
-    
-    char response[1280];
-    
-    if (json.containsKey("action")) {
-        JsonVariant action = json["action"];
-
-        if (json["action"] == "ping") {
-          sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\" \"payload\": \"pong\"}", action.as<char *>());
-        } 
-        else if (json["action"] == "status") {
-          int status = 0;
-
-          if(lightOn == true) {
-              status = 1;
-          }
-
-          if (restartRequested != 0) {
-              sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"Restart in progress\"}", action.as<char *>());
-          } else {
-              sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"%d\"}", action.as<char *>(), status);
-          }
-        }
-        else if (json["action"] == "configure") {
-            String message  = "{\"code\":\"200\",\"actionCalled\":\"\",\"payload\":{\"ip\":\"\",\"Mac address\":\"\",\"protocol\":\"mqtt\",\"port\":\"\",\"actions\":[{\"action\":\"ping\",\"payload\":null,\"response\":{\"code\":{\"type\":\"integer\",\"value\":\"[200, 500]\",\"definition\":{\"200\":\"ok\",\"500\":\"error\"}},\"actionCalled\":{\"type\":\"string\"},\"payload\":{\"type\":\"string\"}}},{\"action\":\"status\",\"payload\":null,\"response\":{\"code\":{\"type\":\"integer\",\"value\":\"[200, 500]\",\"definition\":{\"200\":\"ok\",\"500\":\"error\"}},\"actionCalled\":{\"type\":\"string\"},\"payload\":{\"type\":\"string\"}}},{\"action\":\"lightOn\",\"payload\":null,\"response\":{\"code\":{\"type\":\"integer\",\"value\":\"[200,500]\",\"definition\":{\"200\":\"ok\",\"500\":\"error\"}},\"actionCalled\":{\"type\":\"string\"},\"payload\":{\"type\":\"string\"}}},{\"action\":\"lightOff\",\"payload\":null,\"response\":{\"code\":{\"type\":\"integer\",\"value\":\"[200,500]\",\"definition\":{\"200\":\"ok\",\"500\":\"error\"}},\"actionCalled\":{\"type\":\"string\"},\"payload\":{\"type\":\"string\"}}},{\"action\":\"changeColor\",\"payload\":{\"red\":{\"type\":\"integer\",\"value\":\"[0,255]\"},\"green\":{\"type\":\"integer\",\"value\":\"[0,255]\"},\"blue\":{\"type\":\"integer\",\"value\":\"[0,255]\"}},\"response\":{\"code\":{\"type\":\"integer\",\"value\":\"[200,500]\",\"definition\":{\"200\":\"ok\",\"500\":\"error\"}},\"actionCalled\":{\"type\":\"string\"},\"payload\":{\"type\":\"string\"}}}]}}";
-            message.toCharArray(response, 1280);
-        }
-        else if (json["action"] == "restart") {
-            sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"Restart in progress\"}", action.as<char *>());
-            restartRequested = getMillis();
-        }
-        else if (json["action"] == "reset") {
-            sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"Reset in progress\"}", action.as<char *>());
-            resetRequested = getMillis();
-        }
-        else if (json["action"] == "lightOn") {
-            setLightColor(255, 255, 255);
-            sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"Light on\"}", action.as<char *>());
-        }
-        else if (json["action"] == "lightOff") {
-            setLightColor(0, 0, 0);
-            sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"Light off\"}", action.as<char *>());
-        }
-        else if (json["action"] == "changeColor") {
-            // @todo check payload contain key red, green, blue and is interger value
-            JsonVariant red = json["payload"]["red"];
-            JsonVariant green = json["payload"]["green"];
-            JsonVariant blue = json["payload"]["blue"];
-
-            setLightColor(red.as<unsigned int>(), green.as<unsigned int>(), blue.as<unsigned int>());
-            sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"Change color to %d,%d,%d\"}", action.as<char *>(), red.as<unsigned int>(), green.as<unsigned int>(), blue.as<unsigned int>());
-        }
-        else {
-            sprintf(response, "{\"code\": \"404\", \"payload\": \"Action %s not found !\"}", action.as<char *>());
-        }
-
-        mqttClient.publish(config.mqttPublishChannel, response);
-    }
-
-    memset(response, 0, sizeof(response));
-}
-#endif
-
 void blinkLed() {
     digitalWrite(ledStatusPin, HIGH);
     delay(300);
@@ -513,8 +354,9 @@ void blinkLed() {
     digitalWrite(ledStatusPin, HIGH);
 }
 
-void blinkLedNoDelay() {
-    unsigned long currentBlinkLed = getMillis();
+// Returns the time before the next toggle
+uint32_t blinkLedNoDelay() {
+    unsigned long currentBlinkLed = halMillis();
 
     if (currentBlinkLed - previousBlinkLed >= 1000) {
         previousBlinkLed = currentBlinkLed;
@@ -529,80 +371,127 @@ void blinkLedNoDelay() {
         // set the LED with the ledState of the variable:
         digitalWrite(ledStatusPin, ledStatusState);
     }
+
+    return msLeft(previousBlinkLed, 1000);
 }
 
-void setup() {
-    Serial.begin(115200);
-    logger(F("Start program !"));
+// Connection changes are handled in loop()
+void onWifiEvent(WiFiEvent_t event) {
+    eventLoopWake();
+}
 
-    if (!SPIFFS.begin(true)) {
-        logger(F("An Error has occurred while mounting SPIFFS"));
-        return;
-    }
+void startAccessPoint() {
+    booting = false;
+    startApp = false;
+    connectionStop();
 
-    logger(F("SPIFFS mounted"));
+    WiFi.mode(WIFI_AP);
+    WiFi.softAP(wifiApSsid, wifiApPassw);
+    LOG_INFO("WiFi AP is ready (IP : %s)", WiFi.softAPIP().toString().c_str());
+    serverConfig(true);
+}
 
-    pinMode(ledStatusPin, OUTPUT);
-    pinMode(restartBtnPin, OUTPUT);
-    pinMode(resetBtnPin, OUTPUT);
+void startApplication() {
+    char bootSummary[96];
 
-    digitalWrite(ledStatusPin, LOW);
+    booting = false;
+    startApp = true;
 
-    // Get wifi SSID and PASSW from SPIFFS
-    if (true == getConfig()) {
-        if (true == checkWifiConfigValues()) {
-            wifiConnected = wifiConnect();
+    metricsBootSummary(bootSummary, sizeof(bootSummary));
+    LOG_INFO("Boot phases : %s", bootSummary);
 
-            #if MQTT_ENABLE == true
-            if (true == wifiConnected && true == config.mqttEnable) {
-                mqttClient.setClient(wifiClient);
-                mqttClient.setServer(config.mqttHost, config.mqttPort);
-                mqttClient.setCallback(callback);
-                mqttConnected = mqttConnect();
-            }
-            #endif
-        }
-    } // endif true == getConfig()
+    serverConfig(false);
+
+    digitalWrite(ledStatusPin, HIGH);
+    LOG_INFO("App started !");
+}
+
+// First connection after boot, falls back to the AP when the config does not work
+void bootLoop() {
+    ConnectionState state = connectionLoop();
+    unsigned long elapsed = halMillis() - bootStarted;
 
-    if (false == wifiConnected) {
-        errorMessage = "Wifi connection error to " + String(config.wifiSsid);
-        startApp = false;
-    } 
+    if (state == CONNECTION_READY) {
+        startApplication();
+    } else if (false == connectionWifiUp() && elapsed >= bootWifiTimeout) {
+        snprintf(errorMessage, sizeof(errorMessage), "Wifi connection error to %s", config.wifiSsid);
+        startAccessPoint();
+    }
     #if MQTT_ENABLE == true
-    else if (
-        true == wifiConnected &&
-        true == config.mqttEnable && 
-        false == mqttConnected
-    ) {
-        errorMessage = "Mqtt connection error to " + String(config.mqttHost);
-        startApp = false;
+    else if (elapsed >= bootMqttTimeout) {
+        snprintf(errorMessage, sizeof(errorMessage), "Mqtt connection error to %s", config.mqttHost);
+        startAccessPoint();
     }
     #endif
-    else {
-        startApp = true;
+}
+
+void setup() {
+    Serial.begin(115200);
+    logBegin();
+    LOG_INFO("Start program !");
+
+    pinMode(ledStatusPin, OUTPUT);
+    digitalWrite(ledStatusPin, LOW);
+
+    eventLoopBegin();
+    buttonsBegin(buttonPins, sizeof(buttonPins) / sizeof(buttonPins[0]), eventLoopWake);
+    WiFi.onEvent(onWifiEvent);
+
+    // Before mounting SPIFFS, which is only needed by the web server once the config is in the store
+    bool configured = getConfig() && checkWifiConfigValues();
+
+    metricsBootPhase(BOOT_PHASE_CONFIG);
+
+    // The strips come back as they were before the power cut, without waiting for the network
+    lightOutputBegin(config.zones, config.pixels);
+    LOG_INFO("%u light zones", lightOutputZoneCount());
+
+    if (config.pixels.pin >= 0) {
+        PixelStats pixels = pixelOutputStats();
+
+        LOG_INFO("%u pixels, %u us per frame, up to %u fps", pixels.count, pixels.frameUs, pixels.maxFps);
+    }
+
+    if (true == stateJournalBegin()) {
+        LOG_INFO("Light state restored in %u us", stateJournalStats().restoreUs);
+    }
+
+    scenesBegin();
+    webControlBegin(eventLoopWake, webSocketReply);
+
+    if (!SPIFFS.begin(true)) {
+        LOG_ERROR("An Error has occurred while mounting SPIFFS");
+        return;
     }
 
-    if (false == startApp) {
-        WiFi.mode(WIFI_AP);
-        WiFi.softAP(wifiApSsid, wifiApPassw);
-        logger(F("WiFi AP is ready (IP : "), false);  
-        logger(WiFi.softAPIP().toString(), false);
-        logger(F(")"));
-        serverConfig();
+    metricsBootPhase(BOOT_PHASE_SPIFFS);
+    LOG_INFO("SPIFFS mounted");
+
+    if (true == configured) {
+        ConnectionHandlers handlers = { nullptr, nullptr };
+        const char *brokerHost = "";
+
+        #if MQTT_ENABLE == true
+        if (true == config.mqttEnable) {
+            mqttClient.setClient(wifiClient);
+            mqttClient.setCallback(mqttHandleMessage);
+            halMqttAttach(mqttClient);
+            mqttHandlerBegin(config.mqttPublishChannel, config.mqttSubscribeChannel);
+            statePublisherBegin(config.mqttPublishChannel);
+            handlers.mqttConnect = mqttConnect;
+            handlers.mqttConnected = mqttIsConnected;
+            brokerHost = config.mqttHost;
+        }
+        #endif
+
+        metricsBegin(&connectionStats(), eventLoopStats);
+        // The connection goes on in loop(), the app or the AP is started from there
+        connectionBegin(config.wifiSsid, config.wifiPassword, brokerHost, handlers);
+        booting = true;
+        bootStarted = halMillis();
     } else {
-        ledcAttachPin(ledStripRedPin, 1); // assign RGB led pins to channels
-        ledcAttachPin(ledStripGreenPin, 2);
-        ledcAttachPin(ledStripBluePin, 3);
-
-        // Initialize channels 
-        // channels 0-15, resolution 1-16 bits, freq limits depend on resolution
-        // ledcSetup(uint8_t channel, uint32_t freq, uint8_t resolution_bits);
-        ledcSetup(1, 12000, 8); // 12 kHz PWM, 8-bit resolution
-        ledcSetup(2, 12000, 8);
-        ledcSetup(3, 12000, 8);
-
-        digitalWrite(ledStatusPin, HIGH);
-        logger(F("App started !"));
+        snprintf(errorMessage, sizeof(errorMessage), "Wifi connection error to %s", config.wifiSsid);
+        startAccessPoint();
     }
 
     #if OTA_ENABLE == true
@@ -620,7 +509,7 @@ void setup() {
     ArduinoOTA.setPasswordHash(otaPasswordHash);
 
     ArduinoOTA.onStart([]() {
-        String type;
+        const char *type;
         if (ArduinoOTA.getCommand() == U_FLASH) {
             type = "sketch";
         } else { // U_SPIFFS
@@ -628,66 +517,114 @@ void setup() {
         }
 
         SPIFFS.end();
-        logger("Start updating " + type);
+        LOG_INFO("Start updating %s", type);
     }).onEnd([]() {
-        logger(F("\nEnd"));
+        LOG_INFO("End");
     }).onProgress([](unsigned int progress, unsigned int total) {
-        Serial.printf("Progress: %u%%\r", (progress / (total / 100)));
+        LOG_DEBUG("Progress: %u%%", (progress / (total / 100)));
     }).onError([](ota_error_t error) {
-        Serial.printf("Error[%u]: ", error);
-        if (error == OTA_AUTH_ERROR) logger(F("Auth Failed"));
-        else if (error == OTA_BEGIN_ERROR) logger(F("Begin Failed"));
-        else if (error == OTA_CONNECT_ERROR) logger(F("Connect Failed"));
-        else if (error == OTA_RECEIVE_ERROR) logger(F("Receive Failed"));
-        else if (error == OTA_END_ERROR) logger(F("End Failed"));
+        if (error == OTA_AUTH_ERROR) LOG_ERROR("Error[%u]: Auth Failed", (unsigned) error);
+        else if (error == OTA_BEGIN_ERROR) LOG_ERROR("Error[%u]: Begin Failed", (unsigned) error);
+        else if (error == OTA_CONNECT_ERROR) LOG_ERROR("Error[%u]: Connect Failed", (unsigned) error);
+        else if (error == OTA_RECEIVE_ERROR) LOG_ERROR("Error[%u]: Receive Failed", (unsigned) error);
+        else if (error == OTA_END_ERROR) LOG_ERROR("Error[%u]: End Failed", (unsigned) error);
     });
 
     ArduinoOTA.begin();
     #endif
 }
 
-void loop() {
-    if (true == startApp) {
-        #if MQTT_ENABLE == true
-        if (true == config.mqttEnable) {
-            if (!mqttClient.connected()) {
-                mqttConnect();
-            }
+// Restart on a press of the restart button, the reset one must be held
+void handleButtons() {
+    ButtonEvent event;
 
-            mqttClient.loop();
+    while (true == buttonsPoll(event)) {
+        if (event.button == RESTART_BUTTON && event.type == BUTTON_RELEASED) {
+            restart();
+        } else if (event.button == RESET_BUTTON && event.type == BUTTON_LONG_PRESS) {
+            resetConfig();
         }
+    }
+}
 
-        if (digitalRead(restartBtnPin) == HIGH) {
-            restartRequested = getMillis();
-        }
+// Each pass handles what is pending then sleeps until the next event or deadline
+void loop() {
+    uint32_t waitMs = loopWaitMax;
+    int mqttSocket = -1;
+    #if MQTT_ENABLE == true
+    bool mqttReady = false;
+    #endif
+
+    handleButtons();
 
-        if (digitalRead(resetBtnPin) == HIGH) {
-            if (resetBtnPressed != 0) {
-                if (getMillis() - resetBtnPressed >= 5000) {
-                    resetConfig();
+    if (true == booting) {
+        bootLoop();
+        waitMs = min(waitMs, blinkLedNoDelay());
+        waitMs = min(waitMs, connectionIdleMs());
+    } else if (true == startApp) {
+        ConnectionState state = connectionLoop();
+
+        waitMs = min(waitMs, connectionIdleMs());
+
+        #if MQTT_ENABLE == true
+        if (state == CONNECTION_READY && true == config.mqttEnable) {
+            mqttReady = true;
+
+            // While the outbox is over its high water mark the messages wait in the socket
+            if (false == mqttOutboxBusy()) {
+                mqttClient.loop();
+                mqttSocket = wifiClient.fd();
+
+                // The client reads one packet per loop, the next one may already be buffered
+                if (wifiClient.available() > 0) {
+                    waitMs = 0;
                 }
-            } else {
-                resetBtnPressed = getMillis();
             }
+
+            waitMs = min(waitMs, mqttHandlerLoop());
         }
 
         if (restartRequested != 0) {
-            if (getMillis() - restartRequested >= 5000 ) {
+            if (halMillis() - restartRequested >= actionDelay) {
                 restart();
             }
+
+            waitMs = min(waitMs, msLeft(restartRequested, actionDelay));
         }
 
         if (resetRequested != 0) {
-            if (getMillis() - resetRequested >= 5000) {
+            if (halMillis() - resetRequested >= actionDelay) {
                 resetConfig();
             }
+
+            waitMs = min(waitMs, msLeft(resetRequested, actionDelay));
         }
         #endif
     } else {
-        blinkLedNoDelay();
+        waitMs = min(waitMs, blinkLedNoDelay());
+    }
+
+    waitMs = min(waitMs, webControlLoop());
+
+    #if MQTT_ENABLE == true
+    // After every source of light commands, so a change is seen on the pass that made it
+    if (true == startApp && true == config.mqttEnable) {
+        waitMs = min(waitMs, statePublisherLoop());
     }
 
+    // Replies, acks and state of the pass are written together
+    if (true == mqttReady) {
+        waitMs = min(waitMs, mqttOutboxLoop());
+    }
+    #endif
+
+    waitMs = min(waitMs, stateJournalLoop());
+    // Frees the clients that went away
+    webSocket.cleanupClients();
+
     #if OTA_ENABLE == true
     ArduinoOTA.handle();
     #endif
-}
\ No newline at end of file
+
+    eventLoopWait(mqttSocket, waitMs);
+}
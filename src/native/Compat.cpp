@@ -0,0 +1,16 @@
+#include "Compat.h"
+
+#if defined(__GLIBC__) && !(__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 38))
+extern "C" size_t strlcpy(char *destination, const char *source, size_t size) {
+    size_t length = strlen(source);
+
+    if (size > 0) {
+        size_t copied = length < size - 1 ? length : size - 1;
+
+        memcpy(destination, source, copied);
+        destination[copied] = '\0';
+    }
+
+    return length;
+}
+#endif
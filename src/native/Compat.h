@@ -0,0 +1,21 @@
+#ifndef NATIVE_COMPAT_H
+#define NATIVE_COMPAT_H
+
+// Forced into every host translation unit (-include), provides what newlib has and glibc lacks
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__GLIBC__) && !(__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 38))
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+size_t strlcpy(char *destination, const char *source, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+#endif
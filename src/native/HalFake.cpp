@@ -0,0 +1,377 @@
+#include <chrono>
+#include <map>
+#include <random>
+#include <string.h>
+#include <vector>
+#include "HalFake.h"
+#include "Logger.h"
+
+static int64_t nowUs = 0;
+static uint32_t pwm[HAL_FAKE_PWM_CHANNELS];
+static uint32_t pwmPending[HAL_FAKE_PWM_CHANNELS];
+static std::vector<uint8_t> pixels;
+static int64_t pixelsBusyUntilUs = 0;
+static std::map<std::string, std::string> files;
+static std::map<std::string, std::string> store;
+static std::mt19937 generator(1);
+static std::vector<uint8_t> journal(HAL_FAKE_JOURNAL_SIZE, 0xFF);
+
+static FakeMqttStats mqttStats;
+static void (*mqttListener)(const char *topic, const uint8_t *payload, size_t length, bool retained) = nullptr;
+static uint32_t mqttFailures = 0;
+static std::string streamTopic;
+static std::string streamPayload;
+static size_t streamLength = 0;
+static bool streamRetained = false;
+static bool streaming = false;
+
+static const uint8_t fakeBssid[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0xA1 };
+static uint8_t wifiChannel = 6;
+static bool wifiJoining = false;
+static int64_t wifiUpUs = 0;
+static bool wifiStatic = false;
+static uint8_t retained[HAL_RETAINED_SIZE];
+// Time of the restarts since the last power loss
+static int64_t retainedUs = 0;
+
+void halFakeAdvance(uint32_t us) {
+    nowUs += us;
+}
+
+void halFakeReboot(bool powerLoss) {
+    retainedUs = true == powerLoss ? 0 : retainedUs + nowUs;
+    nowUs = 0;
+    wifiJoining = false;
+
+    if (true == powerLoss) {
+        for (size_t i = 0 ; i < HAL_RETAINED_SIZE ; i++) {
+            retained[i] = (uint8_t) generator();
+        }
+    }
+}
+
+void halFakeWifiMove(uint8_t channel) {
+    wifiChannel = channel;
+}
+
+uint32_t halMillis() {
+    return nowUs / 1000;
+}
+
+int64_t halMicros() {
+    return nowUs;
+}
+
+uint32_t halCycles() {
+    return (uint32_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+uint32_t halRandom() {
+    return generator();
+}
+
+uint32_t halStackFree() {
+    return 0;
+}
+
+uint32_t halHeapFree() {
+    return 0;
+}
+
+uint32_t halHeapMinFree() {
+    return 0;
+}
+
+void halPwmSetup(uint8_t channel, int pin, uint32_t frequency, uint8_t resolution) {
+    if (channel < HAL_FAKE_PWM_CHANNELS) {
+        pwm[channel] = 0;
+        pwmPending[channel] = 0;
+    }
+}
+
+void halPwmWrite(uint8_t channel, uint32_t duty) {
+    if (channel < HAL_FAKE_PWM_CHANNELS) {
+        pwmPending[channel] = duty;
+    }
+}
+
+void halPwmCommit() {
+    memcpy(pwm, pwmPending, sizeof(pwm));
+}
+
+void halPwmSync() {
+}
+
+bool halPixelsSetup(int pin) {
+    pixels.clear();
+    pixelsBusyUntilUs = 0;
+
+    return true;
+}
+
+// 10 us per byte on the wire, as a WS2812 strip
+bool halPixelsSend(const uint8_t *frame, size_t length) {
+    if (nowUs < pixelsBusyUntilUs) {
+        return false;
+    }
+
+    pixels.assign(frame, frame + length);
+    pixelsBusyUntilUs = nowUs + (int64_t) length * 10;
+
+    return true;
+}
+
+const std::vector<uint8_t> &halFakePixels() {
+    return pixels;
+}
+
+uint32_t halFakePwm(uint8_t channel) {
+    return channel < HAL_FAKE_PWM_CHANNELS ? pwm[channel] : 0;
+}
+
+void halFakeFilePut(const char *path, const char *data, size_t length) {
+    files[path] = std::string(data, length);
+}
+
+bool halFakeFileGet(const char *path, std::string &data) {
+    std::map<std::string, std::string>::const_iterator file = files.find(path);
+
+    if (file == files.end()) {
+        return false;
+    }
+
+    data = file->second;
+
+    return true;
+}
+
+int32_t halFileRead(const char *path, char *buffer, size_t size) {
+    std::map<std::string, std::string>::const_iterator file = files.find(path);
+
+    if (file == files.end()) {
+        return -1;
+    }
+
+    memcpy(buffer, file->second.data(), file->second.size() < size ? file->second.size() : size);
+
+    return file->second.size();
+}
+
+bool halFileWrite(const char *path, const char *data, size_t length) {
+    halFakeFilePut(path, data, length);
+
+    return true;
+}
+
+bool halStoreRead(const char *key, void *data, size_t size) {
+    std::map<std::string, std::string>::const_iterator record = store.find(key);
+
+    if (record == store.end() || record->second.size() != size) {
+        return false;
+    }
+
+    memcpy(data, record->second.data(), size);
+
+    return true;
+}
+
+bool halStoreWrite(const char *key, const void *data, size_t size) {
+    store[key] = std::string((const char *) data, size);
+
+    return true;
+}
+
+void halFakeStoreCorrupt(const char *key, size_t offset) {
+    std::map<std::string, std::string>::iterator record = store.find(key);
+
+    if (record != store.end() && offset < record->second.size()) {
+        record->second[offset] ^= 0xFF;
+    }
+}
+
+uint32_t halJournalSize() {
+    return journal.size();
+}
+
+bool halJournalRead(uint32_t offset, void *data, size_t size) {
+    if (offset + size > journal.size()) {
+        return false;
+    }
+
+    memcpy(data, &journal[offset], size);
+
+    return true;
+}
+
+// Like NOR flash, bits can only be cleared until the sector is erased
+bool halJournalWrite(uint32_t offset, const void *data, size_t size) {
+    if (offset + size > journal.size()) {
+        return false;
+    }
+
+    for (size_t i = 0 ; i < size ; i++) {
+        journal[offset + i] &= ((const uint8_t *) data)[i];
+    }
+
+    return true;
+}
+
+bool halJournalErase(uint32_t offset) {
+    if (offset % HAL_JOURNAL_SECTOR_SIZE != 0 || offset >= journal.size()) {
+        return false;
+    }
+
+    memset(&journal[offset], 0xFF, HAL_JOURNAL_SECTOR_SIZE);
+
+    return true;
+}
+
+void halFakeJournalCorrupt(uint32_t offset) {
+    if (offset < journal.size()) {
+        journal[offset] ^= 0xFF;
+    }
+}
+
+void halFakeMqttListen(void (*listener)(const char *topic, const uint8_t *payload, size_t length, bool retained)) {
+    mqttListener = listener;
+}
+
+const FakeMqttStats &halFakeMqttStats() {
+    return mqttStats;
+}
+
+void halFakeMqttFail(uint32_t count) {
+    mqttFailures = count;
+}
+
+void halFakeMqttReset() {
+    mqttStats = FakeMqttStats();
+}
+
+static void delivered(const char *topic, const uint8_t *payload, size_t length, bool retained) {
+    mqttStats.published++;
+    mqttStats.retained += true == retained ? 1 : 0;
+    mqttStats.bytes += length;
+    mqttStats.lastTopic = topic;
+    mqttStats.lastPayload.assign((const char *) payload, length);
+
+    if (nullptr != mqttListener) {
+        mqttListener(topic, payload, length, retained);
+    }
+}
+
+bool halMqttPublish(const char *topic, const uint8_t *payload, size_t length, bool retained) {
+    if (mqttFailures > 0) {
+        mqttFailures--;
+        mqttStats.failed++;
+        return false;
+    }
+
+    delivered(topic, payload, length, retained);
+
+    return true;
+}
+
+bool halMqttBeginPublish(const char *topic, size_t length, bool retained) {
+    if (mqttFailures > 0) {
+        mqttFailures--;
+        mqttStats.failed++;
+        return false;
+    }
+
+    streamTopic = topic;
+    streamPayload.clear();
+    streamLength = length;
+    streamRetained = retained;
+    streaming = true;
+
+    return true;
+}
+
+size_t halMqttWrite(const uint8_t *buffer, size_t size) {
+    if (false == streaming) {
+        return 0;
+    }
+
+    streamPayload.append((const char *) buffer, size);
+
+    return size;
+}
+
+bool halMqttEndPublish() {
+    // Like the broker, a payload shorter or longer than announced is a broken packet
+    if (false == streaming || streamPayload.size() != streamLength) {
+        mqttStats.failed++;
+        streaming = false;
+        return false;
+    }
+
+    streaming = false;
+    delivered(streamTopic.c_str(), (const uint8_t *) streamPayload.data(), streamPayload.size(), streamRetained);
+
+    return true;
+}
+
+void halNetworkAddress(char ip[16], char mac[18]) {
+    strlcpy(ip, "127.0.0.1", 16);
+    strlcpy(mac, "02:00:00:00:00:01", 18);
+}
+
+void halWifiBegin(const char *ssid, const char *password, const WifiLink *link) {
+    wifiJoining = true;
+    wifiStatic = nullptr != link && 0 != link->ip;
+
+    if (nullptr == link) {
+        wifiUpUs = nowUs + HAL_FAKE_WIFI_SCAN_US + HAL_FAKE_WIFI_JOIN_US + HAL_FAKE_WIFI_DHCP_US;
+    } else if (link->channel != wifiChannel || memcmp(link->bssid, fakeBssid, sizeof(fakeBssid)) != 0) {
+        wifiUpUs = INT64_MAX;
+    } else {
+        wifiUpUs = nowUs + HAL_FAKE_WIFI_JOIN_US + (0 != link->ip ? 0 : HAL_FAKE_WIFI_DHCP_US);
+    }
+}
+
+void halWifiDhcp() {
+    wifiStatic = false;
+    wifiUpUs = nowUs + HAL_FAKE_WIFI_DHCP_US;
+}
+
+bool halFakeWifiStatic() {
+    return true == wifiJoining && true == wifiStatic;
+}
+
+void halWifiDisconnect() {
+    wifiJoining = false;
+}
+
+bool halWifiUp() {
+    return true == wifiJoining && nowUs >= wifiUpUs;
+}
+
+// 192.168.1.50/24
+void halWifiLink(WifiLink &link) {
+    memcpy(link.bssid, fakeBssid, sizeof(fakeBssid));
+    link.channel = wifiChannel;
+    link.ip = 0x3201A8C0;
+    link.gateway = 0x0101A8C0;
+    link.subnet = 0x00FFFFFF;
+    link.dns = 0x0101A8C0;
+    link.leaseS = true == wifiStatic ? 0 : HAL_FAKE_WIFI_LEASE_S;
+}
+
+void halRetainedRead(void *data, size_t size) {
+    memcpy(data, retained, size < HAL_RETAINED_SIZE ? size : HAL_RETAINED_SIZE);
+}
+
+void halRetainedWrite(const void *data, size_t size) {
+    memcpy(retained, data, size < HAL_RETAINED_SIZE ? size : HAL_RETAINED_SIZE);
+}
+
+uint32_t halRetainedSeconds() {
+    return (retainedUs + nowUs) / 1000000;
+}
+
+// No log task on the host, the simulator and the tests drain the lines themselves
+void logWake() {
+}
@@ -0,0 +1,70 @@
+#ifndef HAL_FAKE_H
+#define HAL_FAKE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Hal.h"
+
+// In-memory fakes of the HAL used by the host build.
+// The clock only moves when told to, the cycle counter reads the host clock in nanoseconds.
+
+#define HAL_FAKE_PWM_CHANNELS 16
+
+// Simulated WiFi, a full scan listens on every channel before joining, a directed association
+// only joins, and a reused address skips DHCP
+#define HAL_FAKE_WIFI_SCAN_US 2300000
+#define HAL_FAKE_WIFI_JOIN_US 250000
+#define HAL_FAKE_WIFI_DHCP_US 900000
+// Lease granted by the DHCP server
+#define HAL_FAKE_WIFI_LEASE_S 3600
+
+// Sixteen sectors, as partitions.csv
+#define HAL_FAKE_JOURNAL_SIZE (16 * HAL_JOURNAL_SECTOR_SIZE)
+
+struct FakeMqttStats {
+    uint32_t published = 0;
+    uint32_t failed = 0;
+    uint32_t retained = 0;
+    uint64_t bytes = 0;
+    std::string lastTopic;
+    std::string lastPayload;
+};
+
+void halFakeAdvance(uint32_t us);
+// Clock back to 0 and WiFi down, the retained memory is lost too on a power loss
+void halFakeReboot(bool powerLoss);
+
+// The access point moves to another channel, a directed association to the old one never ends
+void halFakeWifiMove(uint8_t channel);
+// Joined with the cached address applied as a static one
+bool halFakeWifiStatic();
+
+// Duty as written, HAL_PWM_FRACTION_BITS under the steps of the resolution
+uint32_t halFakePwm(uint8_t channel);
+// Last frame sent to the addressable strip, in wire order
+const std::vector<uint8_t> &halFakePixels();
+
+void halFakeFilePut(const char *path, const char *data, size_t length);
+bool halFakeFileGet(const char *path, std::string &data);
+
+// Flip the bits of one byte of a stored record, as a torn write would
+void halFakeStoreCorrupt(const char *key, size_t offset);
+
+// Flip the bits of one byte of the journal, as a write cut by a power loss would
+void halFakeJournalCorrupt(uint32_t offset);
+
+// Called with every published packet, nullptr to stop
+void halFakeMqttListen(void (*listener)(const char *topic, const uint8_t *payload, size_t length, bool retained));
+const FakeMqttStats &halFakeMqttStats();
+void halFakeMqttReset();
+// The next count publishes fail, like a full TCP window
+void halFakeMqttFail(uint32_t count);
+
+// Native scheduler of the render (src/native/RenderLoop.cpp), one call is one frame period
+void renderLoopTick();
+// Called more often than the frames, for the commands that do not wait for the next one
+void renderLoopPoll();
+
+#endif
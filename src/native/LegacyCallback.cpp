@@ -0,0 +1,73 @@
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include "Hal.h"
+#include "LegacyCallback.h"
+#include "LegacyString.h"
+
+static bool lightOn = false;
+static unsigned long restartRequested = 0;
+static unsigned long resetRequested = 0;
+
+// The PWM channels of the board were 1 to 3 on the LEDC
+static void setLightColor(unsigned int red, unsigned int green, unsigned int blue) {
+    halPwmWrite(0, red);
+    halPwmWrite(1, green);
+    halPwmWrite(2, blue);
+    lightOn = red != 0 || green != 0 || blue != 0;
+}
+
+// As it was, apart from the HAL calls and the const of the action names
+void legacyCallback(const char *publishTopic, char *topic, uint8_t *payload, unsigned int length) {
+    StaticJsonDocument<256> json;
+    deserializeJson(json, (char *) payload, length);
+
+    char response[1280];
+
+    if (json.containsKey("action")) {
+        JsonVariant action = json["action"];
+
+        if (json["action"] == "ping") {
+            sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\" \"payload\": \"pong\"}", action.as<const char *>());
+        } else if (json["action"] == "status") {
+            int status = 0;
+
+            if (lightOn == true) {
+                status = 1;
+            }
+
+            if (restartRequested != 0) {
+                sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"Restart in progress\"}", action.as<const char *>());
+            } else {
+                sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"%d\"}", action.as<const char *>(), status);
+            }
+        } else if (json["action"] == "configure") {
+            String message = "{\"code\":\"200\",\"actionCalled\":\"\",\"payload\":{\"ip\":\"\",\"Mac address\":\"\",\"protocol\":\"mqtt\",\"port\":\"\",\"actions\":[{\"action\":\"ping\",\"payload\":null,\"response\":{\"code\":{\"type\":\"integer\",\"value\":\"[200, 500]\",\"definition\":{\"200\":\"ok\",\"500\":\"error\"}},\"actionCalled\":{\"type\":\"string\"},\"payload\":{\"type\":\"string\"}}},{\"action\":\"status\",\"payload\":null,\"response\":{\"code\":{\"type\":\"integer\",\"value\":\"[200, 500]\",\"definition\":{\"200\":\"ok\",\"500\":\"error\"}},\"actionCalled\":{\"type\":\"string\"},\"payload\":{\"type\":\"string\"}}},{\"action\":\"lightOn\",\"payload\":null,\"response\":{\"code\":{\"type\":\"integer\",\"value\":\"[200,500]\",\"definition\":{\"200\":\"ok\",\"500\":\"error\"}},\"actionCalled\":{\"type\":\"string\"},\"payload\":{\"type\":\"string\"}}},{\"action\":\"lightOff\",\"payload\":null,\"response\":{\"code\":{\"type\":\"integer\",\"value\":\"[200,500]\",\"definition\":{\"200\":\"ok\",\"500\":\"error\"}},\"actionCalled\":{\"type\":\"string\"},\"payload\":{\"type\":\"string\"}}},{\"action\":\"changeColor\",\"payload\":{\"red\":{\"type\":\"integer\",\"value\":\"[0,255]\"},\"green\":{\"type\":\"integer\",\"value\":\"[0,255]\"},\"blue\":{\"type\":\"integer\",\"value\":\"[0,255]\"}},\"response\":{\"code\":{\"type\":\"integer\",\"value\":\"[200,500]\",\"definition\":{\"200\":\"ok\",\"500\":\"error\"}},\"actionCalled\":{\"type\":\"string\"},\"payload\":{\"type\":\"string\"}}}]}}";
+            message.toCharArray(response, 1280);
+        } else if (json["action"] == "restart") {
+            sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"Restart in progress\"}", action.as<const char *>());
+            restartRequested = halMillis();
+        } else if (json["action"] == "reset") {
+            sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"Reset in progress\"}", action.as<const char *>());
+            resetRequested = halMillis();
+        } else if (json["action"] == "lightOn") {
+            setLightColor(255, 255, 255);
+            sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"Light on\"}", action.as<const char *>());
+        } else if (json["action"] == "lightOff") {
+            setLightColor(0, 0, 0);
+            sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"Light off\"}", action.as<const char *>());
+        } else if (json["action"] == "changeColor") {
+            JsonVariant red = json["payload"]["red"];
+            JsonVariant green = json["payload"]["green"];
+            JsonVariant blue = json["payload"]["blue"];
+
+            setLightColor(red.as<unsigned int>(), green.as<unsigned int>(), blue.as<unsigned int>());
+            sprintf(response, "{\"code\": \"200\", \"actionCalled\": \"%s\", \"payload\": \"Change color to %d,%d,%d\"}", action.as<const char *>(), red.as<unsigned int>(), green.as<unsigned int>(), blue.as<unsigned int>());
+        } else {
+            sprintf(response, "{\"code\": \"404\", \"payload\": \"Action %s not found !\"}", action.as<const char *>());
+        }
+
+        halMqttPublish(publishTopic, (const uint8_t *) response, strlen(response));
+    }
+
+    memset(response, 0, sizeof(response));
+}
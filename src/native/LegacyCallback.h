@@ -0,0 +1,12 @@
+#ifndef NATIVE_LEGACY_CALLBACK_H
+#define NATIVE_LEGACY_CALLBACK_H
+
+#include <stdint.h>
+
+// The mqtt callback of the firmware before the action registry, the baseline of the callback
+// bench : a StaticJsonDocument<256> copy of the message, a zero filled 1280 byte response
+// formatted by sprintf and the configure manifest built in a String. The reply is published
+// to topic, the light goes to the PWM channels 0 to 2 as setLightColor() did.
+void legacyCallback(const char *publishTopic, char *topic, uint8_t *payload, unsigned int length);
+
+#endif
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "LegacyPage.h"
+#include "LegacyString.h"
+#include "generated/Templates.h"
+
+// Longest placeholder name AsyncWebServer looks for
+#define LEGACY_PARAM_NAME_LENGTH 32
+
+struct PlaceholderName {
+    uint8_t var;
+    const char *name;
+};
+
+static const PlaceholderName placeholderNames[] = {
+    { TPL_VAR_ERROR_HIDDEN, "ERROR_HIDDEN" },
+    { TPL_VAR_ERROR_MESSAGE, "ERROR_MESSAGE" },
+    { TPL_VAR_MODULE_NAME, "MODULE_NAME" },
+    { TPL_VAR_MQTT_ENABLE, "MQTT_ENABLE" },
+    { TPL_VAR_MQTT_HOST, "MQTT_HOST" },
+    { TPL_VAR_MQTT_PASSWD, "MQTT_PASSWD" },
+    { TPL_VAR_MQTT_PORT, "MQTT_PORT" },
+    { TPL_VAR_MQTT_PUB_CHAN, "MQTT_PUB_CHAN" },
+    { TPL_VAR_MQTT_SUB_CHAN, "MQTT_SUB_CHAN" },
+    { TPL_VAR_MQTT_USERNAME, "MQTT_USERNAME" },
+    { TPL_VAR_TITLE, "TITLE" },
+    { TPL_VAR_WIFI_PASSWD, "WIFI_PASSWD" },
+    { TPL_VAR_WIFI_SSID, "WIFI_SSID" }
+};
+
+static_assert(sizeof(placeholderNames) / sizeof(placeholderNames[0]) == TPL_VAR_COUNT, "A placeholder has no name");
+
+static const char *placeholderName(uint8_t var) {
+    for (const PlaceholderName &entry : placeholderNames) {
+        if (entry.var == var) {
+            return entry.name;
+        }
+    }
+
+    return "";
+}
+
+size_t legacyPageSource(const Template &page, char *buffer, size_t size) {
+    size_t length = 0;
+
+    for (size_t i = 0 ; i < page.count && length < size ; i++) {
+        const TemplateSegment &segment = page.segments[i];
+
+        if (segment.var == TPL_VAR_NONE) {
+            length += snprintf(buffer + length, size - length, "%.*s", (int) segment.length, segment.text);
+        } else {
+            length += snprintf(buffer + length, size - length, "%%%s%%", placeholderName(segment.var));
+        }
+    }
+
+    return length < size ? length : 0;
+}
+
+static const Config *legacyConfig = nullptr;
+static const char *legacyAppName = "";
+static LegacyPageStats *legacyStats = nullptr;
+static String errorMessage;
+
+// processor() of the firmware before the template compiler, Serial.println included
+static String processor(const String &var) {
+    const Config &config = *legacyConfig;
+
+    legacyStats->serialBytes += var.length() + 2;
+
+    if (var == "TITLE" || var == "MODULE_NAME") {
+        return String(legacyAppName);
+    } else if (var == "WIFI_SSID") {
+        return String(config.wifiSsid);
+    } else if (var == "WIFI_PASSWD") {
+        return String(config.wifiPassword);
+    }
+    #if MQTT_ENABLE == true
+    else if (var == "MQTT_ENABLE") {
+        if (true == config.mqttEnable) {
+            return String("checked");
+        }
+    } else if (var == "MQTT_HOST") {
+        return String(config.mqttHost);
+    } else if (var == "MQTT_PORT") {
+        return String(config.mqttPort);
+    } else if (var == "MQTT_USERNAME") {
+        return String(config.mqttUsername);
+    } else if (var == "MQTT_PASSWD") {
+        return String(config.mqttPassword);
+    } else if (var == "MQTT_PUB_CHAN") {
+        return String(config.mqttPublishChannel);
+    } else if (var == "MQTT_SUB_CHAN") {
+        return String(config.mqttSubscribeChannel);
+    }
+    #endif
+    else if (var == "ERROR_MESSAGE") {
+        return errorMessage;
+    } else if (var == "ERROR_HIDDEN") {
+        if (errorMessage.length() == 0) {
+            return String("d-none");
+        }
+    }
+
+    return String();
+}
+
+// Same steps as AsyncAbstractResponse::_fillBufferAndProcessTemplates : the name between two
+// percents is copied into a String, the value String returned by the processor is copied into
+// the chunk, and the chunk is sent once full
+size_t legacyPageRender(const char *html, size_t length, const Config &config, const char *appName, uint8_t *buffer, size_t size, LegacyPageStats &stats) {
+    size_t used = 0;
+    size_t total = 0;
+
+    legacyConfig = &config;
+    legacyAppName = appName;
+    legacyStats = &stats;
+
+    for (size_t i = 0 ; i < length ; ) {
+        const char *end = html[i] == '%' ? (const char *) memchr(html + i + 1, '%', length - i - 1) : nullptr;
+        size_t nameLength = nullptr != end ? end - (html + i + 1) : 0;
+        char name[LEGACY_PARAM_NAME_LENGTH + 1];
+
+        if (nullptr == end || nameLength > LEGACY_PARAM_NAME_LENGTH) {
+            buffer[used] = html[i++];
+            used = (used + 1) % size;
+            total++;
+            continue;
+        }
+
+        memcpy(name, html + i + 1, nameLength);
+        name[nameLength] = '\0';
+
+        const String paramName(name);
+        const String paramValue(processor(paramName));
+
+        for (size_t c = 0 ; c < paramValue.length() ; c++) {
+            buffer[used] = paramValue.c_str()[c];
+            used = (used + 1) % size;
+        }
+
+        total += paramValue.length();
+        stats.placeholders++;
+        i += nameLength + 2;
+    }
+
+    return total;
+}
@@ -0,0 +1,26 @@
+#ifndef NATIVE_LEGACY_PAGE_H
+#define NATIVE_LEGACY_PAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Config.h"
+#include "TemplateRenderer.h"
+
+// The config page as it was served before the template compiler, the baseline of the page
+// render bench : AsyncWebServer scanned the html for %VAR% and processor() returned a heap
+// String for each placeholder, after a Serial.println of its name.
+
+// The html source of a compiled page, placeholders written back as %VAR%
+size_t legacyPageSource(const Template &page, char *buffer, size_t size);
+
+struct LegacyPageStats {
+    // Bytes written to Serial by processor(), 115200 baud on the device
+    size_t serialBytes = 0;
+    size_t placeholders = 0;
+};
+
+// Render the page in chunks of size bytes like the response of the web server, returns the
+// length of the page
+size_t legacyPageRender(const char *html, size_t length, const Config &config, const char *appName, uint8_t *buffer, size_t size, LegacyPageStats &stats);
+
+#endif
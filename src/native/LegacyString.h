@@ -0,0 +1,66 @@
+#ifndef NATIVE_LEGACY_STRING_H
+#define NATIVE_LEGACY_STRING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Arduino String of the esp32 core 1.0 : every non empty string is a heap buffer, there is
+// no small string buffer
+class String {
+  public:
+    String() {}
+
+    String(const char *text) {
+        copy(text, strlen(text));
+    }
+
+    explicit String(int value) {
+        char text[12];
+
+        copy(text, snprintf(text, sizeof(text), "%d", value));
+    }
+
+    String(const String &other) {
+        copy(other.c_str(), other.length());
+    }
+
+    ~String() {
+        free(buffer);
+    }
+
+    String &operator=(const String &other) = delete;
+
+    bool operator==(const char *text) const {
+        return strcmp(c_str(), text) == 0;
+    }
+
+    size_t length() const {
+        return size;
+    }
+
+    const char *c_str() const {
+        return nullptr != buffer ? buffer : "";
+    }
+
+    void toCharArray(char *destination, unsigned int size) const {
+        strlcpy(destination, c_str(), size);
+    }
+
+  private:
+    char *buffer = nullptr;
+    size_t size = 0;
+
+    void copy(const char *text, size_t length) {
+        if (0 == length) {
+            return;
+        }
+
+        buffer = (char *) realloc(buffer, length + 1);
+        memcpy(buffer, text, length);
+        buffer[length] = '\0';
+        size = length;
+    }
+};
+
+#endif
@@ -0,0 +1,289 @@
+#include <chrono>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "MqttSocket.h"
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_SUBSCRIBE 0x82
+#define MQTT_SUBACK 0x90
+#define MQTT_PINGREQ 0xC0
+#define MQTT_DISCONNECT 0xE0
+
+static int socketFd = -1;
+static uint16_t packetId = 0;
+static std::string received;
+static int64_t lastSentMs = 0;
+
+static int64_t nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+static void appendString(std::string &packet, const char *text) {
+    size_t length = strlen(text);
+
+    packet += (char) (length >> 8);
+    packet += (char) (length & 0xFF);
+    packet.append(text, length);
+}
+
+// Fixed header : type and flags, then the remaining length, 7 bits per byte
+static bool sendPacket(uint8_t header, const std::string &body) {
+    std::string packet(1, (char) header);
+    size_t length = body.size();
+
+    do {
+        uint8_t digit = length & 0x7F;
+
+        length >>= 7;
+        packet += (char) (0 != length ? digit | 0x80 : digit);
+    } while (0 != length);
+
+    packet += body;
+
+    for (size_t sent = 0 ; sent < packet.size() ; ) {
+        ssize_t written = send(socketFd, packet.data() + sent, packet.size() - sent, MSG_NOSIGNAL);
+
+        if (written <= 0) {
+            mqttSocketClose();
+            return false;
+        }
+
+        sent += written;
+    }
+
+    lastSentMs = nowMs();
+
+    return true;
+}
+
+// One whole packet from the received bytes, false until it has fully arrived
+static bool nextPacket(uint8_t &header, std::string &body) {
+    size_t length = 0;
+    size_t position = 1;
+    int shift = 0;
+
+    for (;;) {
+        if (position >= received.size() || position > 4) {
+            return false;
+        }
+
+        uint8_t digit = received[position++];
+
+        length |= (size_t) (digit & 0x7F) << shift;
+        shift += 7;
+
+        if ((digit & 0x80) == 0) {
+            break;
+        }
+    }
+
+    if (received.size() < position + length) {
+        return false;
+    }
+
+    header = received[0];
+    body = received.substr(position, length);
+    received.erase(0, position + length);
+
+    return true;
+}
+
+static bool receive(uint32_t timeoutMs) {
+    struct pollfd descriptor = { socketFd, POLLIN, 0 };
+    char buffer[2048];
+
+    if (poll(&descriptor, 1, timeoutMs) <= 0) {
+        return true;
+    }
+
+    ssize_t length = recv(socketFd, buffer, sizeof(buffer), 0);
+
+    if (length <= 0) {
+        mqttSocketClose();
+        return false;
+    }
+
+    received.append(buffer, length);
+
+    return true;
+}
+
+// Blocking wait for an acknowledgement during connect and subscribe
+static bool expect(uint8_t type, std::string &body) {
+    uint8_t header = 0;
+    int64_t deadline = nowMs() + 5000;
+
+    while (nowMs() < deadline) {
+        if (true == nextPacket(header, body)) {
+            if ((header & 0xF0) == type) {
+                return true;
+            }
+
+            continue;
+        }
+
+        if (false == receive(100)) {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+bool mqttSocketConnect(
+    const char *host,
+    uint16_t port,
+    const char *clientId,
+    const char *username,
+    const char *password,
+    const char *willTopic,
+    const char *willMessage
+) {
+    struct addrinfo hints = {};
+    struct addrinfo *addresses = nullptr;
+    char service[8];
+    std::string body;
+
+    mqttSocketClose();
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%u", port);
+
+    if (getaddrinfo(host, service, &hints, &addresses) != 0) {
+        return false;
+    }
+
+    for (struct addrinfo *address = addresses ; nullptr != address && socketFd < 0 ; address = address->ai_next) {
+        socketFd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+
+        if (socketFd >= 0 && connect(socketFd, address->ai_addr, address->ai_addrlen) != 0) {
+            close(socketFd);
+            socketFd = -1;
+        }
+    }
+
+    freeaddrinfo(addresses);
+
+    if (socketFd < 0) {
+        return false;
+    }
+
+    uint8_t flags = 0x02;
+
+    body = std::string("\0\4MQTT\4", 7);
+
+    if (username[0] != '\0') {
+        flags |= 0x80 | (password[0] != '\0' ? 0x40 : 0);
+    }
+
+    // Will flag and will retain, QoS 0
+    if (nullptr != willTopic) {
+        flags |= 0x04 | 0x20;
+    }
+
+    body += (char) flags;
+    body += (char) 0;
+    body += (char) MQTT_SOCKET_KEEP_ALIVE_S;
+    appendString(body, clientId);
+
+    if (nullptr != willTopic) {
+        appendString(body, willTopic);
+        appendString(body, willMessage);
+    }
+
+    if (username[0] != '\0') {
+        appendString(body, username);
+
+        if (password[0] != '\0') {
+            appendString(body, password);
+        }
+    }
+
+    if (false == sendPacket(MQTT_CONNECT, body) || false == expect(MQTT_CONNACK, body)) {
+        mqttSocketClose();
+        return false;
+    }
+
+    if (body.size() < 2 || body[1] != 0) {
+        mqttSocketClose();
+        return false;
+    }
+
+    return true;
+}
+
+bool mqttSocketSubscribe(const char *topic) {
+    std::string body;
+
+    packetId++;
+    body += (char) (packetId >> 8);
+    body += (char) (packetId & 0xFF);
+    appendString(body, topic);
+    body += (char) 0;
+
+    return sendPacket(MQTT_SUBSCRIBE, body) && expect(MQTT_SUBACK, body);
+}
+
+bool mqttSocketPublish(const char *topic, const uint8_t *payload, size_t length, bool retained) {
+    std::string body;
+
+    if (socketFd < 0) {
+        return false;
+    }
+
+    appendString(body, topic);
+    body.append((const char *) payload, length);
+
+    return sendPacket(true == retained ? MQTT_PUBLISH | 0x01 : MQTT_PUBLISH, body);
+}
+
+bool mqttSocketLoop(MqttSocketCallback callback, uint32_t timeoutMs) {
+    uint8_t header = 0;
+    std::string body;
+
+    if (socketFd < 0 || false == receive(timeoutMs)) {
+        return false;
+    }
+
+    while (true == nextPacket(header, body)) {
+        if ((header & 0xF0) != MQTT_PUBLISH || body.size() < 2) {
+            continue;
+        }
+
+        size_t topicLength = ((uint8_t) body[0] << 8) | (uint8_t) body[1];
+        // QoS 1 and 2 carry a packet identifier after the topic
+        size_t payloadStart = 2 + topicLength + ((header & 0x06) != 0 ? 2 : 0);
+
+        if (payloadStart > body.size() || body.size() + 5 > MQTT_SOCKET_PACKET_MAX) {
+            continue;
+        }
+
+        std::string topic = body.substr(2, topicLength);
+
+        callback(&topic[0], (uint8_t *) &body[payloadStart], body.size() - payloadStart);
+    }
+
+    if (nowMs() - lastSentMs >= MQTT_SOCKET_KEEP_ALIVE_S * 1000 / 2) {
+        return sendPacket(MQTT_PINGREQ, std::string());
+    }
+
+    return socketFd >= 0;
+}
+
+void mqttSocketClose() {
+    if (socketFd >= 0) {
+        close(socketFd);
+    }
+
+    socketFd = -1;
+    received.clear();
+}
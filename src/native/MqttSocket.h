@@ -0,0 +1,36 @@
+#ifndef MQTT_SOCKET_H
+#define MQTT_SOCKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal MQTT 3.1.1 client over a TCP socket for the host build, so the firmware modules
+// can be driven through a real broker : QoS 0 publish and subscribe, keep alive.
+// Inbound packets larger than the device accepts (MQTT_MAX_PACKET_SIZE) are dropped like
+// PubSubClient does.
+#define MQTT_SOCKET_PACKET_MAX 1024
+#define MQTT_SOCKET_KEEP_ALIVE_S 15
+
+typedef void (*MqttSocketCallback)(char *topic, uint8_t *payload, unsigned int length);
+
+// Blocks until CONNACK, username and password may be empty. The will, when given, is
+// published retained by the broker once the connection is lost.
+bool mqttSocketConnect(
+    const char *host,
+    uint16_t port,
+    const char *clientId,
+    const char *username,
+    const char *password,
+    const char *willTopic = nullptr,
+    const char *willMessage = nullptr
+);
+bool mqttSocketSubscribe(const char *topic);
+bool mqttSocketPublish(const char *topic, const uint8_t *payload, size_t length, bool retained = false);
+
+// Wait up to timeoutMs for data, callback for each PUBLISH received, false once the
+// connection is lost
+bool mqttSocketLoop(MqttSocketCallback callback, uint32_t timeoutMs);
+
+void mqttSocketClose();
+
+#endif
@@ -0,0 +1,63 @@
+#include "HalFake.h"
+#include "LightOutput.h"
+
+static bool woken = false;
+static bool running = false;
+static RenderStats stats;
+
+void lightOutputBegin(const LightZoneConfig zones[LIGHT_ZONES_MAX], const PixelStripConfig &pixels) {
+    lightOutputSetup(zones, pixels);
+}
+
+void lightOutputWake() {
+    woken = true;
+}
+
+// Same rule as the render task : frames run at the frame rate while the output changes,
+// a queued command wakes an idle output up. Timing stats are left to the device.
+void renderLoopTick() {
+    if (false == running && false == woken) {
+        return;
+    }
+
+    woken = false;
+    running = lightOutputRender();
+
+    if (true == running) {
+        stats.frames++;
+    }
+}
+
+// Between two frames, what wakes the render task up on the device : a command queued while
+// the output is idle, or the timer of a scheduled command
+void renderLoopPoll() {
+    uint32_t atUs = 0;
+
+    if (false == running && true == woken) {
+        renderLoopTick();
+    }
+
+    if (false == lightOutputNextDue(atUs) || (int32_t) (atUs - (uint32_t) halMicros()) > 0) {
+        return;
+    }
+
+    if (true == running) {
+        lightOutputRenderDue();
+    } else {
+        running = lightOutputRender();
+    }
+}
+
+RenderStats lightOutputStats(bool reset) {
+    RenderStats copy = stats;
+
+    if (true == reset) {
+        stats.jitterMaxUs = 0;
+        stats.jitterTotalUs = 0;
+        stats.jitterSamples = 0;
+        stats.renderMaxUs = 0;
+        stats.overruns = 0;
+    }
+
+    return copy;
+}
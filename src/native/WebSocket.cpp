@@ -0,0 +1,334 @@
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "WebSocket.h"
+
+#define WS_OPCODE_TEXT 0x1
+#define WS_OPCODE_BINARY 0x2
+#define WS_OPCODE_CLOSE 0x8
+#define WS_OPCODE_PING 0x9
+#define WS_OPCODE_PONG 0xA
+
+static const char *handshakeGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+struct Client {
+    int fd = -1;
+    uint32_t id = 0;
+    bool upgraded = false;
+    std::string received;
+};
+
+static int listenFd = -1;
+static Client clients[WEB_SOCKET_CLIENTS_MAX];
+static uint32_t nextId = 1;
+
+static uint32_t rotate(uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+// SHA-1 of the handshake key, the only hash the protocol needs
+static void sha1(const std::string &message, uint8_t digest[20]) {
+    uint32_t state[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    std::string data = message;
+    uint64_t bits = (uint64_t) message.size() * 8;
+
+    data += (char) 0x80;
+
+    while (data.size() % 64 != 56) {
+        data += (char) 0;
+    }
+
+    for (int i = 7 ; i >= 0 ; i--) {
+        data += (char) (bits >> (i * 8));
+    }
+
+    for (size_t block = 0 ; block < data.size() ; block += 64) {
+        uint32_t words[80];
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+        for (int i = 0 ; i < 16 ; i++) {
+            const uint8_t *bytes = (const uint8_t *) data.data() + block + i * 4;
+
+            words[i] = (uint32_t) bytes[0] << 24 | (uint32_t) bytes[1] << 16 | (uint32_t) bytes[2] << 8 | bytes[3];
+        }
+
+        for (int i = 16 ; i < 80 ; i++) {
+            words[i] = rotate(words[i - 3] ^ words[i - 8] ^ words[i - 14] ^ words[i - 16], 1);
+        }
+
+        for (int i = 0 ; i < 80 ; i++) {
+            uint32_t f;
+            uint32_t k;
+
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+
+            uint32_t next = rotate(a, 5) + f + e + k + words[i];
+
+            e = d;
+            d = c;
+            c = rotate(b, 30);
+            b = a;
+            a = next;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+
+    for (int i = 0 ; i < 20 ; i++) {
+        digest[i] = state[i / 4] >> (24 - (i % 4) * 8);
+    }
+}
+
+static std::string base64(const uint8_t *data, size_t length) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string encoded;
+
+    for (size_t i = 0 ; i < length ; i += 3) {
+        uint32_t group = (uint32_t) data[i] << 16
+            | (i + 1 < length ? (uint32_t) data[i + 1] << 8 : 0)
+            | (i + 2 < length ? data[i + 2] : 0);
+
+        encoded += alphabet[(group >> 18) & 0x3F];
+        encoded += alphabet[(group >> 12) & 0x3F];
+        encoded += i + 1 < length ? alphabet[(group >> 6) & 0x3F] : '=';
+        encoded += i + 2 < length ? alphabet[group & 0x3F] : '=';
+    }
+
+    return encoded;
+}
+
+static bool sendAll(int fd, const std::string &data) {
+    for (size_t sent = 0 ; sent < data.size() ; ) {
+        ssize_t written = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+
+        if (written <= 0) {
+            return false;
+        }
+
+        sent += written;
+    }
+
+    return true;
+}
+
+static bool sendFrame(Client &client, uint8_t opcode, const uint8_t *data, size_t length) {
+    std::string frame;
+
+    frame += (char) (0x80 | opcode);
+    frame += (char) length;
+    frame.append((const char *) data, length);
+
+    return sendAll(client.fd, frame);
+}
+
+static void drop(Client &client, WebSocketClosed closed) {
+    if (true == client.upgraded) {
+        closed(client.id);
+    }
+
+    close(client.fd);
+    client = Client();
+}
+
+bool webSocketListen(uint16_t port) {
+    struct sockaddr_in address;
+    int reuse = 1;
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(listenFd, 4) != 0) {
+        if (listenFd >= 0) {
+            close(listenFd);
+        }
+
+        listenFd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+// Upgrade reply once the request headers are in, false on a request that is not a websocket one
+static bool handshake(Client &client) {
+    size_t end = client.received.find("\r\n\r\n");
+
+    if (std::string::npos == end) {
+        return client.received.size() < 4096;
+    }
+
+    std::string request = client.received.substr(0, end + 2);
+    size_t keyStart = request.find("Sec-WebSocket-Key:");
+
+    if (std::string::npos == keyStart) {
+        return false;
+    }
+
+    keyStart += strlen("Sec-WebSocket-Key:");
+
+    size_t keyEnd = request.find("\r\n", keyStart);
+    std::string key = request.substr(keyStart, keyEnd - keyStart);
+    uint8_t digest[20];
+
+    key.erase(0, key.find_first_not_of(' '));
+    key.erase(key.find_last_not_of(' ') + 1);
+    sha1(key + handshakeGuid, digest);
+
+    client.received.erase(0, end + 4);
+    client.upgraded = true;
+
+    return sendAll(
+        client.fd,
+        "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: "
+            + base64(digest, sizeof(digest)) + "\r\n\r\n"
+    );
+}
+
+// Whole frames of the received bytes, false when the client must be dropped
+static bool readFrames(Client &client, WebSocketFrame frame) {
+    for (;;) {
+        const uint8_t *bytes = (const uint8_t *) client.received.data();
+        size_t available = client.received.size();
+
+        if (available < 2) {
+            return true;
+        }
+
+        uint8_t opcode = bytes[0] & 0x0F;
+        size_t length = bytes[1] & 0x7F;
+        size_t position = 2;
+
+        // Clients mask their frames, control frames are never longer than 125 bytes
+        if ((bytes[1] & 0x80) == 0 || (bytes[0] & 0x80) == 0 || length > WEB_SOCKET_FRAME_MAX) {
+            return false;
+        }
+
+        if (available < position + 4 + length) {
+            return true;
+        }
+
+        uint8_t payload[WEB_SOCKET_FRAME_MAX];
+        const uint8_t *mask = bytes + position;
+
+        for (size_t i = 0 ; i < length ; i++) {
+            payload[i] = bytes[position + 4 + i] ^ mask[i % 4];
+        }
+
+        client.received.erase(0, position + 4 + length);
+
+        if (opcode == WS_OPCODE_CLOSE) {
+            sendFrame(client, WS_OPCODE_CLOSE, payload, length < 2 ? length : 2);
+            return false;
+        }
+
+        if (opcode == WS_OPCODE_PING) {
+            sendFrame(client, WS_OPCODE_PONG, payload, length);
+        } else if (opcode == WS_OPCODE_BINARY) {
+            frame(client.id, payload, length);
+        }
+    }
+}
+
+void webSocketPoll(WebSocketFrame frame, WebSocketClosed closed, uint32_t timeoutMs) {
+    struct pollfd descriptors[WEB_SOCKET_CLIENTS_MAX + 1];
+    int count = 0;
+
+    if (listenFd < 0) {
+        return;
+    }
+
+    descriptors[count++] = { listenFd, POLLIN, 0 };
+
+    for (int i = 0 ; i < WEB_SOCKET_CLIENTS_MAX ; i++) {
+        if (clients[i].fd >= 0) {
+            descriptors[count++] = { clients[i].fd, POLLIN, 0 };
+        }
+    }
+
+    if (poll(descriptors, count, timeoutMs) <= 0) {
+        return;
+    }
+
+    for (int i = 0 ; i < WEB_SOCKET_CLIENTS_MAX ; i++) {
+        Client &client = clients[i];
+        char buffer[2048];
+
+        if (client.fd < 0) {
+            continue;
+        }
+
+        ssize_t length = recv(client.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+        if (length < 0) {
+            continue;
+        }
+
+        if (length == 0) {
+            drop(client, closed);
+            continue;
+        }
+
+        client.received.append(buffer, length);
+
+        if (
+            (false == client.upgraded && false == handshake(client))
+            || (true == client.upgraded && false == readFrames(client, frame))
+        ) {
+            drop(client, closed);
+        }
+    }
+
+    if ((descriptors[0].revents & POLLIN) != 0) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        int noDelay = 1;
+
+        for (int i = 0 ; fd >= 0 && i < WEB_SOCKET_CLIENTS_MAX ; i++) {
+            if (clients[i].fd < 0) {
+                // The acks are a few bytes, they must not wait for more
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+                clients[i].fd = fd;
+                clients[i].id = nextId++;
+                fd = -1;
+            }
+        }
+
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+bool webSocketSend(uint32_t client, const uint8_t *data, size_t length) {
+    for (int i = 0 ; i < WEB_SOCKET_CLIENTS_MAX ; i++) {
+        if (clients[i].fd >= 0 && clients[i].id == client && true == clients[i].upgraded) {
+            return length <= WEB_SOCKET_FRAME_MAX && sendFrame(clients[i], WS_OPCODE_BINARY, data, length);
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,23 @@
+#ifndef WEB_SOCKET_H
+#define WEB_SOCKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal websocket listener (RFC 6455) for the host build, standing for the /ws endpoint of
+// the device : any path is upgraded, binary frames in and out, no fragmented messages.
+// Text frames are ignored, like the device does.
+#define WEB_SOCKET_CLIENTS_MAX 8
+#define WEB_SOCKET_FRAME_MAX 125
+
+typedef void (*WebSocketFrame)(uint32_t client, const uint8_t *data, size_t length);
+typedef void (*WebSocketClosed)(uint32_t client);
+
+bool webSocketListen(uint16_t port);
+
+// Accept the clients and read their frames, waits at most timeoutMs
+void webSocketPoll(WebSocketFrame frame, WebSocketClosed closed, uint32_t timeoutMs);
+
+bool webSocketSend(uint32_t client, const uint8_t *data, size_t length);
+
+#endif
@@ -0,0 +1,1085 @@
+// Host simulator of the firmware, the portable modules run against the HAL fakes.
+//
+//   program bench      messages/sec and allocations per message of each mqtt path, time and
+//                      stack of a message against the callback before the action registry,
+//                      config json parse, config store load, page render time against the
+//                      processor() it replaced, the color pipeline of a frame and the frame
+//                      rate of the addressable strip against its pixel count
+//   program sim        read "<topic> <payload>" lines on stdin (hex payload on the binary topic,
+//                      "wait <ms>" lets the time go, "fail <n>" fails the next n publishes), print
+//                      what is published and the PWM output
+//   program boot       time to wifi and mqtt of a cold boot, restarts, a power cycle, a moved
+//                      access point and a restart past the lease of the cached address, against the
+//                      simulated WiFi of the HAL fakes and a simulated broker
+//   program mqtt [host] [port] [ws port]
+//                      the firmware on a real broker (default 127.0.0.1 1883), in real time, with
+//                      the topics of the sample config, for scripts/mqtt_load.py, and the websocket
+//                      control channel (default 8080) for scripts/ws_latency.py
+//   program skew [n]   n devices (one process each, own boot time, clock drift and network delays)
+//                      behind a simulated broker : clock sync by ping, then the spread of the time
+//                      a fanned out changeColor is applied, without and with applyAt
+//
+// pio run -e native && .pio/build/native/program bench
+//
+// pio test -e native builds src/ with the suites of test/, which bring their own main
+
+#ifndef PIO_UNIT_TESTING
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "HalFake.h"
+#include "LegacyCallback.h"
+#include "LegacyPage.h"
+#include "Logger.h"
+#include "Config.h"
+#include "ConfigStore.h"
+#include "ConfigPage.h"
+#include "ConnectionManager.h"
+#include "Metrics.h"
+#include "StateJournal.h"
+#include "ClockSync.h"
+#include "Scenes.h"
+#include "LightOutput.h"
+#include "PixelOutput.h"
+#include "MqttHandler.h"
+#include "StatePublisher.h"
+#include "MqttOutbox.h"
+#include "BinaryCommand.h"
+#include "ColorPipeline.h"
+#include "MqttSocket.h"
+#include "WebControl.h"
+#include "WebSocket.h"
+#include "TemplateRenderer.h"
+#include "generated/Templates.h"
+
+static const char *configFilePath = "/config.json";
+static const char *appName = "Marvin led strip wifi";
+static const char *mqttName = "StripLedWifi";
+static const char *sampleConfig =
+    "{\"wifiSsid\":\"home\",\"wifiPassword\":\"secret-password\",\"mqttEnable\":true,"
+    "\"mqttHost\":\"192.168.1.10\",\"mqttPort\":1883,\"mqttUsername\":\"marvin\",\"mqttPassword\":\"mqtt-password\","
+    "\"mqttPublishChannel\":\"marvin/device/action\",\"mqttSubscribeChannel\":\"marvin/device/listen\",\"uuid\":\"1234567890\","
+    "\"zones\":[[19,18,5],[21,22,23,25]],\"pixels\":{\"pin\":13,\"count\":300,\"white\":false}}";
+
+// Simulated broker, its host name lookup is skipped once the address is cached
+#define SIM_BROKER_DNS_US 120000
+#define SIM_BROKER_CONNECT_US 80000
+static const uint32_t simBrokerIp = 0x0A01A8C0; // 192.168.1.10
+
+static bool verbose = false;
+static uint64_t allocations = 0;
+static Config config;
+
+#ifdef __GLIBC__
+// Every heap allocation of the process goes through these, operator new included
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pointer, size_t size);
+extern "C" void __libc_free(void *pointer);
+
+extern "C" void *malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size) {
+    allocations++;
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void free(void *pointer) {
+    __libc_free(pointer);
+}
+#endif
+
+// The log task of the device, lines are drained once per frame
+static void logSink(const char *text, size_t length) {
+    if (true == verbose) {
+        fwrite(text, 1, length, stderr);
+    }
+}
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+// One frame period of the device : time, render and batched acks
+static void step() {
+    halFakeAdvance(LIGHT_FRAME_US);
+    renderLoopTick();
+    renderLoopPoll();
+    mqttHandlerLoop();
+    statePublisherLoop();
+    mqttOutboxLoop();
+    stateJournalLoop();
+    logDrain(logSink);
+}
+
+// Same order as the device : the store, then the json file when the store is empty
+static void begin() {
+    halFakeFilePut(configFilePath, sampleConfig, strlen(sampleConfig));
+
+    if (false == configStoreLoad(config)) {
+        if (false == configImport(configFilePath, config)) {
+            fprintf(stderr, "Sample config not loaded\n");
+            exit(1);
+        }
+
+        configStoreSave(config);
+    }
+
+    configPageBind(&config, appName, "");
+    lightOutputBegin(config.zones, config.pixels);
+    stateJournalBegin();
+    scenesBegin();
+    mqttHandlerBegin(config.mqttPublishChannel, config.mqttSubscribeChannel);
+    statePublisherBegin(config.mqttPublishChannel);
+}
+
+static void report(const char *name, uint32_t iterations, int64_t elapsedNs, uint64_t allocated) {
+    printf(
+        "%-24s %9u ops %10.0f ops/s %8.1f ns/op %6.2f allocs/op\n",
+        name,
+        iterations,
+        iterations * 1e9 / elapsedNs,
+        (double) elapsedNs / iterations,
+        (double) allocated / iterations
+    );
+}
+
+// Each message is copied to a client-like buffer first, as it is parsed in place
+static void benchMessages(const char *name, const char *topic, const uint8_t *payload, size_t length, uint32_t iterations) {
+    uint8_t buffer[512];
+    char topicBuffer[160];
+
+    strlcpy(topicBuffer, topic, sizeof(topicBuffer));
+    halFakeMqttReset();
+
+    uint64_t allocated = allocations;
+    int64_t start = nowNs();
+
+    for (uint32_t i = 0 ; i < iterations ; i++) {
+        memcpy(buffer, payload, length);
+        mqttHandleMessage(topicBuffer, buffer, length);
+
+        // Ten messages per frame, about a fast slider
+        if (i % 10 == 9) {
+            step();
+        }
+    }
+
+    int64_t elapsed = nowNs() - start;
+
+    report(name, iterations, elapsed, allocations - allocated);
+}
+
+// Painted under the measuring frame, deeper than the largest callback
+#define STACK_PROBE_BYTES 16384
+#define STACK_PROBE_PATTERN 0xA5
+// Left unpainted under the measuring frame, the least stack a call shows
+#define STACK_PROBE_GAP 256
+
+typedef void (*MessageHandler)(char *topic, uint8_t *payload, unsigned int length);
+
+// Deepest stack use of one call : the stack under this frame is painted, then scanned back
+// from the bottom to the first byte the call has written
+static size_t __attribute__((noinline)) stackUse(MessageHandler handler, char *topic, uint8_t *payload, unsigned int length) {
+    volatile uint8_t *bottom = (volatile uint8_t *) __builtin_frame_address(0) - STACK_PROBE_BYTES;
+    size_t untouched = 0;
+
+    for (size_t i = 0 ; i < STACK_PROBE_BYTES - STACK_PROBE_GAP ; i++) {
+        bottom[i] = STACK_PROBE_PATTERN;
+    }
+
+    handler(topic, payload, length);
+
+    while (untouched < STACK_PROBE_BYTES && bottom[untouched] == STACK_PROBE_PATTERN) {
+        untouched++;
+    }
+
+    return STACK_PROBE_BYTES - untouched;
+}
+
+static void legacyHandler(char *topic, uint8_t *payload, unsigned int length) {
+    legacyCallback(config.mqttPublishChannel, topic, payload, length);
+}
+
+// The reply leaves from the loop after the callback, its stack counts as well
+static void currentHandler(char *topic, uint8_t *payload, unsigned int length) {
+    mqttHandleMessage(topic, payload, length);
+    mqttHandlerLoop();
+    mqttOutboxLoop();
+}
+
+// A message through the callback before the action registry (src/native/LegacyCallback.cpp)
+// and through the current one, with the stack each one takes
+static void benchCallback(const char *name, const char *message, uint32_t iterations) {
+    const MessageHandler handlers[] = { legacyHandler, currentHandler };
+    const char *paths[] = { "before", "after" };
+    size_t length = strlen(message);
+    uint8_t buffer[512];
+    char topic[160];
+    char label[32];
+
+    strlcpy(topic, config.mqttSubscribeChannel, sizeof(topic));
+
+    for (int path = 0 ; path < 2 ; path++) {
+        halFakeMqttReset();
+        memcpy(buffer, message, length);
+
+        size_t stack = stackUse(handlers[path], topic, buffer, length);
+
+        step();
+
+        uint64_t allocated = allocations;
+        int64_t start = nowNs();
+
+        for (uint32_t i = 0 ; i < iterations ; i++) {
+            memcpy(buffer, message, length);
+
+            if (0 == path) {
+                legacyHandler(topic, buffer, length);
+            } else {
+                mqttHandleMessage(topic, buffer, length);
+            }
+
+            if (i % 10 == 9) {
+                step();
+            }
+        }
+
+        int64_t elapsed = nowNs() - start;
+
+        snprintf(label, sizeof(label), "%s %s", paths[path], name);
+        report(label, iterations, elapsed, allocations - allocated);
+        printf("%-24s stack %zu bytes\n", "", stack);
+    }
+}
+
+// The frames of a websocket client at the pace of a fast slider, over its rate : most are held
+// and replaced by the next one
+static void benchWebControl(const uint8_t *frame, size_t length, uint32_t iterations) {
+    uint64_t allocated = allocations;
+    int64_t start = nowNs();
+
+    for (uint32_t i = 0 ; i < iterations ; i++) {
+        webControlReceive(1, frame, length);
+        webControlLoop();
+
+        if (i % 10 == 9) {
+            step();
+        }
+    }
+
+    int64_t elapsed = nowNs() - start;
+
+    webControlDisconnect(1);
+    webControlLoop();
+    report("websocket color", iterations, elapsed, allocations - allocated);
+}
+
+static void benchConfigParse(uint32_t iterations) {
+    char buffer[CONFIG_FILE_MAX];
+    size_t length = strlen(sampleConfig);
+    Config parsed;
+
+    uint64_t allocated = allocations;
+    int64_t start = nowNs();
+
+    for (uint32_t i = 0 ; i < iterations ; i++) {
+        memcpy(buffer, sampleConfig, length);
+        configParse(buffer, length, parsed);
+    }
+
+    report("config json parse", iterations, nowNs() - start, allocations - allocated);
+}
+
+static void benchConfigStore(uint32_t iterations) {
+    Config loaded;
+
+    uint64_t allocated = allocations;
+    int64_t start = nowNs();
+
+    for (uint32_t i = 0 ; i < iterations ; i++) {
+        configStoreLoad(loaded);
+    }
+
+    report("config store load", iterations, nowNs() - start, allocations - allocated);
+}
+
+// A formatted line queued for the log task, drained as often as the queue needs
+static void benchLog(uint32_t iterations) {
+    uint64_t allocated = allocations;
+    int64_t start = nowNs();
+
+    for (uint32_t i = 0 ; i < iterations ; i++) {
+        LOG_INFO("Message handled in %u cycles (stack free : %u)", i, 2048u);
+
+        if (i % (LOG_QUEUE_SLOTS / 2) == 0) {
+            logDrain(nullptr);
+        }
+    }
+
+    report("log line", iterations, nowNs() - start, allocations - allocated);
+}
+
+// Frames of the addressable strip filled at the render rate, and the rate its wire time allows
+static void benchPixels(uint16_t count, uint32_t iterations) {
+    PixelStripConfig strip = { 13, count, 3 };
+    uint8_t color[LIGHT_ZONE_PINS_MAX] = { 12, 200, 64, 0 };
+    char name[32];
+
+    pixelOutputBegin(strip);
+
+    PixelStats before = pixelOutputStats();
+    uint64_t allocated = allocations;
+    int64_t start = nowNs();
+
+    for (uint32_t i = 0 ; i < iterations ; i++) {
+        color[0] = (uint8_t) i;
+        pixelOutputFill(color);
+        halFakeAdvance(LIGHT_FRAME_US);
+        pixelOutputPresent();
+    }
+
+    int64_t elapsed = nowNs() - start;
+    PixelStats stats = pixelOutputStats();
+
+    snprintf(name, sizeof(name), "pixels %u frame", count);
+    report(name, iterations, elapsed, allocations - allocated);
+    printf(
+        "%-24s wire %u us, up to %u fps : %u of %u frames sent at %u fps\n",
+        "",
+        stats.frameUs,
+        stats.maxFps,
+        stats.frames - before.frames,
+        iterations,
+        LIGHT_FRAME_RATE
+    );
+}
+
+// The color pipeline of one frame on every PWM channel : an hsv or kelvin input, the CIE
+// table, the white balance and the duty, at a low level where the fraction of the duty matters
+static void benchColorFrame(bool kelvin, uint32_t iterations) {
+    uint8_t color[LIGHT_CHANNELS];
+    uint32_t fractions = 0;
+
+    uint64_t allocated = allocations;
+    int64_t start = nowNs();
+
+    for (uint32_t i = 0 ; i < iterations ; i++) {
+        if (true == kelvin) {
+            colorFromKelvin(COLOR_KELVIN_MIN + i % (COLOR_KELVIN_MAX - COLOR_KELVIN_MIN), 40, color);
+        } else {
+            colorFromHsv(i % (COLOR_HUE_MAX + 1), 200, 40, color);
+        }
+
+        for (int channel = 0 ; channel < LIGHT_PWM_CHANNELS ; channel++) {
+            uint32_t duty = colorDuty(colorBalance(colorLinear(color[channel % LIGHT_CHANNELS]), 230));
+
+            fractions += (duty & ((1 << HAL_PWM_FRACTION_BITS) - 1)) != 0 ? 1 : 0;
+            halPwmWrite(channel, duty);
+        }
+
+        halPwmCommit();
+    }
+
+    int64_t elapsed = nowNs() - start;
+
+    report(true == kelvin ? "color frame kelvin" : "color frame hsv", iterations, elapsed, allocations - allocated);
+    printf(
+        "%-24s %u channels, %.1f%% with a fraction, %.3f%% of a %u us frame\n",
+        "",
+        LIGHT_PWM_CHANNELS,
+        fractions * 100.0 / ((double) iterations * LIGHT_PWM_CHANNELS),
+        elapsed / 10.0 / iterations / LIGHT_FRAME_US,
+        LIGHT_FRAME_US
+    );
+}
+
+// The compiled template against the baseline it replaced (src/native/LegacyPage.cpp), the
+// AsyncWebServer template scan with a String processor, both in chunks of the same size
+static void benchPageRender(uint32_t iterations) {
+    static char html[8192];
+    char buffer[512];
+    size_t bytes = 0;
+    size_t htmlLength = legacyPageSource(templateIndex, html, sizeof(html));
+
+    uint64_t allocated = allocations;
+    int64_t start = nowNs();
+
+    for (uint32_t i = 0 ; i < iterations ; i++) {
+        size_t index = 0;
+        size_t length;
+
+        while ((length = templateRender(templateIndex, configPageValue, index, (uint8_t *) buffer, sizeof(buffer))) > 0) {
+            index += length;
+        }
+
+        bytes += index;
+    }
+
+    int64_t elapsed = nowNs() - start;
+
+    report("index page render", iterations, elapsed, allocations - allocated);
+    printf("%-24s %9.1f MB/s\n", "", bytes * 1e3 / elapsed);
+
+    LegacyPageStats stats;
+
+    bytes = 0;
+    allocated = allocations;
+    start = nowNs();
+
+    for (uint32_t i = 0 ; i < iterations ; i++) {
+        bytes += legacyPageRender(html, htmlLength, config, appName, (uint8_t *) buffer, sizeof(buffer), stats);
+    }
+
+    elapsed = nowNs() - start;
+
+    report("index page processor", iterations, elapsed, allocations - allocated);
+    // 10 bits per byte on the wire
+    printf(
+        "%-24s %9.1f MB/s, %zu placeholders and %zu bytes of Serial.println (%zu us at 115200 baud) per page\n",
+        "",
+        bytes * 1e3 / elapsed,
+        stats.placeholders / iterations,
+        stats.serialBytes / iterations,
+        stats.serialBytes / iterations * 10 * 1000000 / 115200
+    );
+}
+
+static int bench() {
+    uint8_t binary[BINARY_COLOR_MAX_LENGTH];
+    BinaryColor color;
+    const char *changeColor = "{\"action\":\"changeColor\",\"payload\":{\"red\":12,\"green\":200,\"blue\":64,\"transition\":250}}";
+    const char *ping = "{\"action\":\"ping\"}";
+    const char *configure = "{\"action\":\"configure\"}";
+    const uint32_t iterations = 200000;
+
+    begin();
+
+    color.flags = BINARY_FLAG_TRANSITION;
+    color.color[0] = 12;
+    color.color[1] = 200;
+    color.color[2] = 64;
+    color.transitionMs = 250;
+
+    size_t binaryLength = binaryColorEncode(color, binary);
+
+    benchConfigParse(iterations);
+    benchConfigStore(iterations);
+    benchPageRender(iterations / 10);
+    benchColorFrame(false, iterations);
+    benchColorFrame(true, iterations);
+    benchLog(iterations);
+    benchMessages("json changeColor", config.mqttSubscribeChannel, (const uint8_t *) changeColor, strlen(changeColor), iterations);
+    benchMessages("json ping (replied)", config.mqttSubscribeChannel, (const uint8_t *) ping, strlen(ping), iterations);
+    benchMessages("binary color", mqttHandlerBinaryTopic(), binary, binaryLength, iterations);
+    benchWebControl(binary, binaryLength, iterations);
+    benchCallback("changeColor", changeColor, iterations);
+    benchCallback("ping", ping, iterations);
+    benchCallback("configure", configure, iterations / 10);
+
+    color.flags |= BINARY_FLAG_SEQUENCE | BINARY_FLAG_REPLY;
+    binaryLength = binaryColorEncode(color, binary);
+    benchMessages("binary color (acked)", mqttHandlerBinaryTopic(), binary, binaryLength, iterations);
+
+    // Last, they set the strip up again
+    benchPixels(300, iterations / 100);
+    benchPixels(600, iterations / 100);
+    benchPixels(1000, iterations / 100);
+
+    return 0;
+}
+
+// Blocking like the device handler, the clock moves by the time the connection takes
+static bool simMqttConnect() {
+    if (0 == connectionBrokerIp()) {
+        halFakeAdvance(SIM_BROKER_DNS_US);
+    }
+
+    halFakeAdvance(SIM_BROKER_CONNECT_US);
+    connectionBrokerResolved(simBrokerIp);
+
+    return true;
+}
+
+static bool simMqttConnected() {
+    return true;
+}
+
+// From reset to the first mqtt connection, in simulated time
+static void bootOnce(const char *name, bool powerLoss) {
+    ConnectionHandlers handlers = { simMqttConnect, simMqttConnected };
+    char summary[96];
+
+    halFakeReboot(powerLoss);
+    metricsBootReset();
+    configStoreLoad(config);
+    metricsBootPhase(BOOT_PHASE_CONFIG);
+    connectionBegin(config.wifiSsid, config.wifiPassword, config.mqttHost, handlers);
+
+    while (connectionLoop() != CONNECTION_READY && halMillis() < 60000) {
+        halFakeAdvance(10000);
+        logDrain(logSink);
+    }
+
+    metricsBootSummary(summary, sizeof(summary));
+    printf("%-20s %s\n", name, summary);
+}
+
+static int boot() {
+    begin();
+    metricsBegin(&connectionStats());
+
+    bootOnce("cold boot", true);
+    bootOnce("restart", false);
+    bootOnce("power cycle", true);
+    halFakeWifiMove(11);
+    bootOnce("access point moved", false);
+    bootOnce("restart", false);
+    // Up for half the lease, the address is not reused after it
+    halFakeAdvance(HAL_FAKE_WIFI_LEASE_S / 2 * 1000000u);
+    bootOnce("restart past T1", false);
+
+    printf(
+        "%u wifi attempts, %u to the cached access point, %u of them failed\n",
+        connectionStats().wifiAttempts,
+        connectionStats().directedAttempts,
+        connectionStats().directedFailures
+    );
+
+    return 0;
+}
+
+static void printPublished(const char *topic, const uint8_t *payload, size_t length, bool retained) {
+    printf("> %s%s ", topic, true == retained ? " (retained)" : "");
+
+    if (strcmp(topic + strlen(topic) - strlen(BINARY_TOPIC_SUFFIX), BINARY_TOPIC_SUFFIX) == 0) {
+        for (size_t i = 0 ; i < length ; i++) {
+            printf("%02x", payload[i]);
+        }
+    } else {
+        fwrite(payload, 1, length, stdout);
+    }
+
+    printf("\n");
+}
+
+static bool parseHex(const std::string &hex, uint8_t *buffer, size_t size, size_t &length) {
+    length = 0;
+
+    for (size_t i = 0 ; i + 1 < hex.size() && length < size ; i += 2) {
+        buffer[length++] = (uint8_t) strtoul(hex.substr(i, 2).c_str(), nullptr, 16);
+    }
+
+    return hex.size() % 2 == 0 && length * 2 == hex.size();
+}
+
+// Zones separated by a bar, in the order of their channels
+static void printOutput() {
+    static uint32_t last[LIGHT_PWM_CHANNELS] = {};
+    static std::vector<uint8_t> lastPixels;
+    bool changed = lastPixels != halFakePixels();
+
+    lastPixels = halFakePixels();
+
+    for (int i = 0 ; i < LIGHT_PWM_CHANNELS ; i++) {
+        changed |= last[i] != halFakePwm(i);
+        last[i] = halFakePwm(i);
+    }
+
+    if (false == changed) {
+        return;
+    }
+
+    int channel = 0;
+
+    printf("%8u ms  pwm", halMillis());
+
+    for (int zone = 0 ; zone < LIGHT_ZONES_MAX && config.zones[zone].channels != 0 ; zone++) {
+        if (zone > 0) {
+            printf(" |");
+        }
+
+        for (int i = 0 ; i < config.zones[zone].channels ; i++) {
+            printf(" %7.2f", (double) last[channel++] / (1 << HAL_PWM_FRACTION_BITS));
+        }
+    }
+
+    // Wire order GRB, the whole strip has the color of its first pixel
+    if (lastPixels.size() >= 3) {
+        printf(" | px %3u %3u %3u", lastPixels[1], lastPixels[0], lastPixels[2]);
+    }
+
+    printf("\n");
+}
+
+static int sim() {
+    std::string line;
+    uint8_t buffer[1024];
+
+    begin();
+    halFakeMqttListen(printPublished);
+
+    while (std::getline(std::cin, line)) {
+        size_t space = line.find(' ');
+        std::string topic = line.substr(0, space);
+        std::string payload = space == std::string::npos ? "" : line.substr(space + 1);
+
+        if (topic.empty() || topic[0] == '#') {
+            continue;
+        }
+
+        if (topic == "wait") {
+            for (uint32_t waited = 0 ; waited < strtoul(payload.c_str(), nullptr, 10) ; waited += LIGHT_FRAME_US / 1000) {
+                step();
+                printOutput();
+            }
+
+            continue;
+        }
+
+        if (topic == "fail") {
+            halFakeMqttFail(strtoul(payload.c_str(), nullptr, 10));
+            continue;
+        }
+
+        size_t length = 0;
+
+        if (topic == mqttHandlerBinaryTopic()) {
+            if (false == parseHex(payload, buffer, sizeof(buffer), length)) {
+                fprintf(stderr, "Invalid hex payload : %s\n", payload.c_str());
+                continue;
+            }
+        } else {
+            length = payload.size() < sizeof(buffer) ? payload.size() : sizeof(buffer);
+            memcpy(buffer, payload.data(), length);
+        }
+
+        mqttHandleMessage(&topic[0], buffer, length);
+        step();
+        printOutput();
+    }
+
+    return 0;
+}
+
+static void mqttForward(const char *topic, const uint8_t *payload, size_t length, bool retained) {
+    mqttSocketPublish(topic, payload, length, retained);
+}
+
+static void webSocketReply(uint32_t client, const uint8_t *frame, size_t length) {
+    webSocketSend(client, frame, length);
+}
+
+// The fake clock follows the host clock, frames run as on the device
+static int mqtt(const char *host, uint16_t port, uint16_t wsPort) {
+    Backoff backoff(1000, 30000);
+    int64_t lastUs = nowNs() / 1000;
+    int64_t frameUs = 0;
+    bool connected = false;
+    uint32_t connections = 0;
+
+    begin();
+    halFakeMqttListen(mqttForward);
+    // Same task here, no wake needed
+    webControlBegin(nullptr, webSocketReply);
+
+    if (false == webSocketListen(wsPort)) {
+        fprintf(stderr, "Websocket port %u not available\n", wsPort);
+        return 1;
+    }
+
+    for (;;) {
+        if (false == connected) {
+            connected = mqttSocketConnect(
+                    host,
+                    port,
+                    mqttName,
+                    config.mqttUsername,
+                    config.mqttPassword,
+                    statePublisherAvailabilityTopic(),
+                    STATE_OFFLINE
+                )
+                && mqttSocketSubscribe(config.mqttSubscribeChannel)
+                && mqttSocketSubscribe(mqttHandlerBinaryTopic());
+
+            if (false == connected) {
+                uint32_t delayMs = backoff.next();
+
+                printf("Mqtt connection to %s:%u failed, retry in %u ms\n", host, port, delayMs);
+                fflush(stdout);
+                usleep(delayMs * 1000);
+                lastUs = nowNs() / 1000;
+                continue;
+            }
+
+            backoff.reset();
+            statePublisherOnline();
+            connections++;
+            printf("Mqtt connected to %s:%u (%u), listening on %s\n", host, port, connections, config.mqttSubscribeChannel);
+            fflush(stdout);
+        }
+
+        connected = mqttSocketLoop(mqttHandleMessage, 1);
+        webSocketPoll(webControlReceive, webControlDisconnect, 0);
+
+        int64_t currentUs = nowNs() / 1000;
+
+        halFakeAdvance((uint32_t) (currentUs - lastUs));
+        frameUs += currentUs - lastUs;
+        lastUs = currentUs;
+
+        if (frameUs >= LIGHT_FRAME_US) {
+            frameUs = frameUs < 2 * LIGHT_FRAME_US ? frameUs - LIGHT_FRAME_US : 0;
+            renderLoopTick();
+            mqttHandlerLoop();
+            stateJournalLoop();
+            logDrain(logSink);
+        }
+
+        webControlLoop();
+        statePublisherLoop();
+        mqttOutboxLoop();
+        renderLoopPoll();
+    }
+
+    return 0;
+}
+
+// Skew harness. The broker and the controller run in the parent, each device in a child
+// process talking to it on pipes : "<sent us> <payload>" to the device, one line back.
+// The times are of the controller clock, from the start of the run.
+#define SKEW_DEVICES_DEFAULT 8
+#define SKEW_DEVICES_MAX 64
+#define SKEW_BOOT_SPREAD_US 5000000
+#define SKEW_DRIFT_PPM 30
+#define SKEW_DELAY_BASE_US 1500
+#define SKEW_DELAY_MEAN_US 4000
+// A retransmitted WiFi frame, per cent of the messages
+#define SKEW_RETRY_PERCENT 3
+#define SKEW_RETRY_US 40000
+#define SKEW_STEP_US 100
+#define SKEW_PINGS 10
+#define SKEW_APPLY_AHEAD_MS 250
+// Controller clock in ms at the start of the run, an epoch time like a real controller
+static const uint64_t skewEpochMs = 1760000000000ull;
+
+static uint32_t skewRandomState = 1;
+
+// xorshift32, the devices draw their own sequence
+static uint32_t skewRandom() {
+    skewRandomState ^= skewRandomState << 13;
+    skewRandomState ^= skewRandomState >> 17;
+    skewRandomState ^= skewRandomState << 5;
+
+    return skewRandomState;
+}
+
+static int64_t skewDelayUs() {
+    double uniform = (skewRandom() % 1000000 + 1) / 1000001.0;
+    int64_t delay = SKEW_DELAY_BASE_US - (int64_t) (SKEW_DELAY_MEAN_US * log(uniform));
+
+    return skewRandom() % 100 < SKEW_RETRY_PERCENT ? delay + SKEW_RETRY_US : delay;
+}
+
+struct SkewDevice {
+    int64_t bootUs = 0;
+    int32_t driftPpm = 0;
+    // Controller time the device clock has been moved to
+    int64_t nowUs = 0;
+    int64_t localUs = 0;
+    int64_t nextFrameUs = 0;
+};
+
+static int64_t skewLocalUs(const SkewDevice &device, int64_t controllerUs) {
+    return (controllerUs + device.bootUs) + (controllerUs + device.bootUs) * device.driftPpm / 1000000;
+}
+
+// The device runs its frames and its scheduled commands on its own clock
+static void skewAdvance(SkewDevice &device, int64_t untilUs) {
+    while (device.nowUs < untilUs) {
+        device.nowUs += SKEW_STEP_US < untilUs - device.nowUs ? SKEW_STEP_US : untilUs - device.nowUs;
+
+        int64_t localUs = skewLocalUs(device, device.nowUs);
+
+        halFakeAdvance((uint32_t) (localUs - device.localUs));
+        device.localUs = localUs;
+
+        if (device.localUs >= device.nextFrameUs) {
+            device.nextFrameUs += LIGHT_FRAME_US;
+            renderLoopTick();
+            mqttHandlerLoop();
+            mqttOutboxLoop();
+            logDrain(logSink);
+        }
+
+        renderLoopPoll();
+    }
+}
+
+static bool skewOutputChanged(const uint32_t before[LIGHT_CHANNELS]) {
+    for (int i = 0 ; i < LIGHT_CHANNELS ; i++) {
+        if (halFakePwm(i) != before[i]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void skewDeviceRun(int index, FILE *in, FILE *out) {
+    SkewDevice device;
+    char line[1024];
+
+    skewRandomState = 2654435761u * (index + 1);
+    device.bootUs = skewRandom() % SKEW_BOOT_SPREAD_US;
+    device.driftPpm = (int32_t) (skewRandom() % (2 * SKEW_DRIFT_PPM + 1)) - SKEW_DRIFT_PPM;
+
+    begin();
+    device.localUs = skewLocalUs(device, 0);
+    device.nextFrameUs = device.localUs;
+    halFakeAdvance((uint32_t) device.localUs);
+
+    while (nullptr != fgets(line, sizeof(line), in)) {
+        char *payload = nullptr;
+        int64_t sentUs = strtoll(line, &payload, 10);
+        uint32_t before[LIGHT_CHANNELS];
+
+        if (strncmp(payload, " offset", 7) == 0) {
+            int64_t controllerUs = (int64_t) skewEpochMs * 1000 + device.nowUs;
+
+            fprintf(out, "%lld\n", (long long) (clockSyncStats().offsetUs - (controllerUs - halMicros())));
+            fflush(out);
+            continue;
+        }
+
+        payload++;
+        payload[strcspn(payload, "\n")] = '\0';
+
+        skewAdvance(device, sentUs + skewDelayUs());
+
+        for (int i = 0 ; i < LIGHT_CHANNELS ; i++) {
+            before[i] = halFakePwm(i);
+        }
+
+        mqttHandleMessage(config.mqttSubscribeChannel, (uint8_t *) payload, strlen(payload));
+
+        // A ping is answered at once, the pong comes back with its own delay
+        if (strstr(payload, "\"ping\"") != nullptr) {
+            fprintf(out, "%lld\n", (long long) (device.nowUs + skewDelayUs()));
+            fflush(out);
+            continue;
+        }
+
+        int64_t deadlineUs = device.nowUs + 2000000;
+
+        while (false == skewOutputChanged(before) && device.nowUs < deadlineUs) {
+            skewAdvance(device, device.nowUs + SKEW_STEP_US);
+        }
+
+        fprintf(out, "%lld\n", (long long) (true == skewOutputChanged(before) ? device.nowUs : -1));
+        fflush(out);
+    }
+}
+
+struct SkewLink {
+    pid_t pid;
+    FILE *in;
+    FILE *out;
+};
+
+static int64_t skewExchange(SkewLink &link, int64_t sentUs, const char *payload) {
+    char line[64];
+
+    fprintf(link.out, "%lld %s\n", (long long) sentUs, payload);
+    fflush(link.out);
+
+    return nullptr != fgets(line, sizeof(line), link.in) ? strtoll(line, nullptr, 10) : -1;
+}
+
+// Every device gets the same message, prints the spread of the time they applied it
+static void skewFanOut(SkewLink links[], int devices, int64_t sentUs, const char *payload, int64_t targetUs, const char *name) {
+    int64_t first = INT64_MAX;
+    int64_t last = INT64_MIN;
+    int missed = 0;
+
+    for (int i = 0 ; i < devices ; i++) {
+        int64_t applied = skewExchange(links[i], sentUs, payload);
+
+        if (applied < 0) {
+            missed++;
+            continue;
+        }
+
+        first = applied < first ? applied : first;
+        last = applied > last ? applied : last;
+    }
+
+    if (missed == devices) {
+        printf("%-36s not applied\n", name);
+        return;
+    }
+
+    printf(
+        "%-36s skew %6lld us, applied %+lld..%+lld us from %s%s\n",
+        name,
+        (long long) (last - first),
+        (long long) (first - targetUs),
+        (long long) (last - targetUs),
+        targetUs == sentUs ? "send" : "applyAt",
+        missed > 0 ? " (some devices missed it)" : ""
+    );
+}
+
+static int skew(int devices) {
+    SkewLink links[SKEW_DEVICES_MAX];
+    uint32_t rttMs[SKEW_DEVICES_MAX];
+    char payload[256];
+    int64_t nowUs = 1000000;
+
+    for (int i = 0 ; i < devices ; i++) {
+        int toDevice[2];
+        int fromDevice[2];
+
+        if (pipe(toDevice) != 0 || pipe(fromDevice) != 0) {
+            return 1;
+        }
+
+        links[i].pid = fork();
+
+        if (links[i].pid == 0) {
+            // Or the devices forked before would never see the end of their input
+            for (int j = 0 ; j < i ; j++) {
+                fclose(links[j].out);
+                fclose(links[j].in);
+            }
+
+            close(toDevice[1]);
+            close(fromDevice[0]);
+            skewDeviceRun(i, fdopen(toDevice[0], "r"), fdopen(fromDevice[1], "w"));
+            exit(0);
+        }
+
+        close(toDevice[0]);
+        close(fromDevice[1]);
+        links[i].in = fdopen(fromDevice[0], "r");
+        links[i].out = fdopen(toDevice[1], "w");
+        rttMs[i] = 0;
+    }
+
+    printf(
+        "%d devices, booted up to %u ms apart, drift up to %d ppm, one-way delay %u us + exponential %u us, %d%% retried +%u ms\n",
+        devices,
+        SKEW_BOOT_SPREAD_US / 1000,
+        SKEW_DRIFT_PPM,
+        SKEW_DELAY_BASE_US,
+        SKEW_DELAY_MEAN_US,
+        SKEW_RETRY_PERCENT,
+        SKEW_RETRY_US / 1000
+    );
+
+    // Each ping carries the round trip of the previous one, none on the first
+    for (int ping = 0 ; ping < SKEW_PINGS ; ping++, nowUs += 1000000) {
+        for (int i = 0 ; i < devices ; i++) {
+            uint64_t sentMs = skewEpochMs + nowUs / 1000;
+
+            if (0 == ping) {
+                snprintf(payload, sizeof(payload), "{\"action\":\"ping\",\"payload\":{\"t\":%llu}}", (unsigned long long) sentMs);
+            } else {
+                snprintf(payload, sizeof(payload), "{\"action\":\"ping\",\"payload\":{\"t\":%llu,\"rtt\":%u}}", (unsigned long long) sentMs, rttMs[i]);
+            }
+
+            rttMs[i] = (uint32_t) ((skewExchange(links[i], nowUs, payload) - nowUs + 500) / 1000);
+        }
+    }
+
+    int64_t errorMax = 0;
+
+    for (int i = 0 ; i < devices ; i++) {
+        int64_t error = skewExchange(links[i], nowUs, "offset");
+
+        errorMax = llabs(error) > errorMax ? llabs(error) : errorMax;
+    }
+
+    printf("%-36s max %lld us after %d pings\n", "clock offset error", (long long) errorMax, SKEW_PINGS);
+
+    skewFanOut(
+        links, devices, nowUs,
+        "{\"action\":\"changeColor\",\"payload\":{\"zone\":0,\"red\":255,\"green\":0,\"blue\":0}}",
+        nowUs, "changeColor on arrival"
+    );
+
+    int64_t stepsUs[] = { 5000000, 60000000 };
+    const char *names[] = { "changeColor with applyAt", "same, 60 s after the last ping" };
+
+    for (int i = 0 ; i < 2 ; i++) {
+        nowUs += stepsUs[i];
+
+        // Aligned on the ms of the controller clock, which applyAt carries
+        int64_t targetUs = (nowUs / 1000 + SKEW_APPLY_AHEAD_MS) * 1000;
+
+        snprintf(
+            payload,
+            sizeof(payload),
+            "{\"action\":\"changeColor\",\"payload\":{\"zone\":0,\"red\":0,\"green\":%d,\"blue\":255,\"applyAt\":%llu}}",
+            100 + i,
+            (unsigned long long) (skewEpochMs + targetUs / 1000)
+        );
+        skewFanOut(links, devices, nowUs, payload, targetUs, names[i]);
+    }
+
+    for (int i = 0 ; i < devices ; i++) {
+        fclose(links[i].out);
+        fclose(links[i].in);
+        waitpid(links[i].pid, nullptr, 0);
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *mode = argc > 1 ? argv[1] : "bench";
+    int result = 1;
+
+    verbose = strcmp(argv[argc - 1], "-v") == 0;
+
+    if (strcmp(mode, "bench") == 0) {
+        result = bench();
+    } else if (strcmp(mode, "sim") == 0) {
+        result = sim();
+    } else if (strcmp(mode, "boot") == 0) {
+        result = boot();
+    } else if (strcmp(mode, "mqtt") == 0) {
+        const char *host = argc > 2 && argv[2][0] != '-' ? argv[2] : "127.0.0.1";
+        int port = argc > 3 && argv[3][0] != '-' ? atoi(argv[3]) : 1883;
+        int wsPort = argc > 4 && argv[4][0] != '-' ? atoi(argv[4]) : 8080;
+
+        result = mqtt(host, port, wsPort);
+    } else if (strcmp(mode, "skew") == 0) {
+        int devices = argc > 2 && argv[2][0] != '-' ? atoi(argv[2]) : SKEW_DEVICES_DEFAULT;
+
+        result = devices > 0 && devices <= SKEW_DEVICES_MAX ? skew(devices) : 1;
+    } else {
+        fprintf(stderr, "Usage : %s [bench|sim|boot|mqtt [host] [port] [ws port]|skew [devices]] [-v]\n", argv[0]);
+    }
+
+    logDrain(logSink);
+
+    return result;
+}
+#endif
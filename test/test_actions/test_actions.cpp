@@ -0,0 +1,56 @@
+#include <string>
+#include <unity.h>
+#include "Actions.h"
+
+#define ACTION_EXPECTED(name, handler, schema) { #name, handler },
+
+static const Action expected[] = { MQTT_ACTIONS(ACTION_EXPECTED) };
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+static void test_every_action_is_found_with_its_handler() {
+    for (const Action &action : expected) {
+        const Action *found = actionFind(action.name);
+
+        TEST_ASSERT_NOT_NULL(found);
+        TEST_ASSERT_EQUAL_STRING(action.name, found->name);
+        TEST_ASSERT_EQUAL_PTR(action.handler, found->handler);
+    }
+}
+
+// Names sharing a slot with an action still go through the string compare
+static void test_unknown_names_are_not_found() {
+    const char *unknown[] = { "", "pin", "pings", "Ping", "PING", "changecolor", "changeColor ", "metricsX", "x" };
+
+    for (const char *name : unknown) {
+        TEST_ASSERT_NULL(actionFind(name));
+    }
+
+    TEST_ASSERT_NULL(actionFind(nullptr));
+}
+
+static void test_the_manifest_lists_every_action() {
+    std::string manifest(actionManifest, actionManifestLength);
+
+    // Without its opening bracket
+    TEST_ASSERT_EQUAL('{', manifest[0]);
+    TEST_ASSERT_EQUAL(']', manifest[manifest.size() - 1]);
+
+    for (const Action &action : expected) {
+        std::string entry = std::string("\"action\":\"") + action.name + "\"";
+
+        TEST_ASSERT_TRUE(manifest.find(entry) != std::string::npos);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_every_action_is_found_with_its_handler);
+    RUN_TEST(test_unknown_names_are_not_found);
+    RUN_TEST(test_the_manifest_lists_every_action);
+    return UNITY_END();
+}
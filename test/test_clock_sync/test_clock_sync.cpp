@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "Actions.h"
+#include "ClockSync.h"
+#include "HalFake.h"
+#include "LightOutput.h"
+
+static const LightZoneConfig zones[LIGHT_ZONES_MAX] = {
+    { 3, { 1, 2, 3, -1 }, { 255, 255, 255, 255 } }
+};
+
+static const PixelStripConfig pixels = { -1, 0, 3 };
+
+// The controller runs an hour ahead of the device
+static const uint64_t controllerStartMs = 3600000;
+
+static uint64_t controllerNowMs() {
+    return (halMicros() + clockSyncStats().offsetUs) / 1000;
+}
+
+// The payload of a message
+static ActionReply send(ActionHandler handler, const char *json) {
+    StaticJsonDocument<256> document;
+    char message[128];
+    ActionReply reply;
+
+    snprintf(message, sizeof(message), "{\"payload\":%s}", json);
+    deserializeJson(document, message);
+    handler(document["payload"], reply);
+
+    return reply;
+}
+
+// lightOn at a controller time relative to now
+static ActionReply lightOnAt(int64_t fromNowMs) {
+    char json[64];
+
+    snprintf(json, sizeof(json), "{\"applyAt\":%llu}", (unsigned long long) (controllerNowMs() + fromNowMs));
+
+    return send(actionLightOn, json);
+}
+
+// As written to the LEDC, the target changes when queued
+static bool isOn() {
+    for (uint8_t channel = 0 ; channel < HAL_FAKE_PWM_CHANNELS ; channel++) {
+        if (halFakePwm(channel) != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Two pings 10 ms apart, the second completes the round trip of the first
+static void synchronize() {
+    char json[64];
+
+    snprintf(json, sizeof(json), "{\"t\":%llu}", (unsigned long long) controllerStartMs);
+    send(actionPing, json);
+    halFakeAdvance(10000);
+    snprintf(json, sizeof(json), "{\"t\":%llu,\"rtt\":10}", (unsigned long long) (controllerStartMs + 10));
+    send(actionPing, json);
+}
+
+void setUp() {
+    renderLoopTick();
+}
+
+void tearDown() {
+    send(actionLightOff, "{}");
+    halFakeAdvance(1000000);
+    renderLoopTick();
+}
+
+static void test_a_command_before_the_first_sample_is_refused() {
+    ActionReply reply = send(actionLightOn, "{\"applyAt\":1000}");
+
+    TEST_ASSERT_EQUAL_INT(500, reply.code);
+}
+
+static void test_the_offset_is_the_controller_time_at_arrival() {
+    synchronize();
+
+    TEST_ASSERT_TRUE(clockSyncStats().synced);
+    TEST_ASSERT_EQUAL_UINT32(10, clockSyncStats().rttMs);
+    // Half the round trip after the first ping was sent
+    TEST_ASSERT_TRUE(controllerStartMs + 15 == controllerNowMs());
+}
+
+static void test_a_command_ahead_waits_for_its_time() {
+    CommandStats before = lightOutputCommandStats();
+
+    TEST_ASSERT_EQUAL_INT(200, lightOnAt(500).code);
+    renderLoopTick();
+    TEST_ASSERT_FALSE(isOn());
+
+    halFakeAdvance(500000);
+    renderLoopPoll();
+    TEST_ASSERT_TRUE(isOn());
+    TEST_ASSERT_EQUAL_UINT32(before.scheduled + 1, lightOutputCommandStats().scheduled);
+    TEST_ASSERT_EQUAL_UINT32(before.late, lightOutputCommandStats().late);
+}
+
+static void test_a_command_too_far_ahead_is_refused() {
+    ActionReply reply = lightOnAt(CLOCK_SYNC_AHEAD_MAX_MS + 1000);
+
+    TEST_ASSERT_EQUAL_INT(500, reply.code);
+    TEST_ASSERT_NOT_NULL(strstr(reply.message, "ahead"));
+}
+
+static void test_a_command_just_late_is_applied_at_once() {
+    CommandStats before = lightOutputCommandStats();
+
+    TEST_ASSERT_EQUAL_INT(200, lightOnAt(-1000).code);
+    renderLoopTick();
+    TEST_ASSERT_TRUE(isOn());
+    TEST_ASSERT_EQUAL_UINT32(before.late + 1, lightOutputCommandStats().late);
+}
+
+static void test_a_command_too_far_behind_is_refused() {
+    ActionReply reply = lightOnAt(-(int64_t) CLOCK_SYNC_BEHIND_MAX_MS - 1000);
+
+    TEST_ASSERT_EQUAL_INT(500, reply.code);
+    TEST_ASSERT_NOT_NULL(strstr(reply.message, "behind"));
+}
+
+// Past half the range of the 32 bits clock of the render task, it would read as far ahead
+static void test_a_command_from_long_ago_is_refused() {
+    CommandStats before = lightOutputCommandStats();
+
+    TEST_ASSERT_EQUAL_INT(500, lightOnAt(-3000000).code);
+    TEST_ASSERT_EQUAL_INT(500, send(actionLightOn, "{\"applyAt\":0}").code);
+    renderLoopTick();
+    TEST_ASSERT_FALSE(isOn());
+    TEST_ASSERT_EQUAL_UINT32(before.enqueued, lightOutputCommandStats().enqueued);
+}
+
+int main() {
+    lightOutputBegin(zones, pixels);
+    halFakeAdvance(1000000);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_a_command_before_the_first_sample_is_refused);
+    RUN_TEST(test_the_offset_is_the_controller_time_at_arrival);
+    RUN_TEST(test_a_command_ahead_waits_for_its_time);
+    RUN_TEST(test_a_command_too_far_ahead_is_refused);
+    RUN_TEST(test_a_command_just_late_is_applied_at_once);
+    RUN_TEST(test_a_command_too_far_behind_is_refused);
+    RUN_TEST(test_a_command_from_long_ago_is_refused);
+    return UNITY_END();
+}
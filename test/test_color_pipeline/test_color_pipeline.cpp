@@ -0,0 +1,126 @@
+#include <unity.h>
+#include "ColorPipeline.h"
+
+static void assertColor(uint8_t red, uint8_t green, uint8_t blue, const uint8_t color[LIGHT_CHANNELS]) {
+    TEST_ASSERT_EQUAL_UINT8(red, color[0]);
+    TEST_ASSERT_EQUAL_UINT8(green, color[1]);
+    TEST_ASSERT_EQUAL_UINT8(blue, color[2]);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+static void test_the_levels_span_the_linear_range_in_order() {
+    TEST_ASSERT_EQUAL_UINT16(0, colorLinear(0));
+    TEST_ASSERT_EQUAL_UINT16(65535, colorLinear(255));
+
+    for (int level = 1 ; level < COLOR_LEVELS ; level++) {
+        TEST_ASSERT_TRUE(colorLinear(level) > colorLinear(level - 1));
+    }
+}
+
+static void test_the_balance_scales_the_linear_light() {
+    TEST_ASSERT_EQUAL_UINT16(40000, colorBalance(40000, LIGHT_BALANCE_NONE));
+    TEST_ASSERT_EQUAL_UINT16(20000, colorBalance(40000, 127));
+    TEST_ASSERT_EQUAL_UINT16(156, colorBalance(40000, 0));
+}
+
+static void test_the_duty_goes_from_off_to_full_on() {
+    TEST_ASSERT_EQUAL_UINT32(0, colorDuty(0));
+    TEST_ASSERT_EQUAL_UINT32(COLOR_DUTY_MAX, colorDuty(65535));
+
+    for (uint32_t linear = 1 ; linear <= 65535 ; linear++) {
+        TEST_ASSERT_TRUE(colorDuty(linear) >= colorDuty(linear - 1));
+    }
+}
+
+static void test_a_table_temperature_is_its_entry() {
+    uint8_t color[LIGHT_CHANNELS];
+
+    colorFromKelvin(1000, 255, color);
+    assertColor(255, 56, 0, color);
+    colorFromKelvin(6500, 255, color);
+    assertColor(255, 249, 253, color);
+    colorFromKelvin(10000, 255, color);
+    assertColor(204, 219, 255, color);
+}
+
+static void test_a_temperature_between_entries_is_interpolated() {
+    uint8_t color[LIGHT_CHANNELS];
+
+    // Halfway between 56 and 109
+    colorFromKelvin(1250, 255, color);
+    assertColor(255, 82, 0, color);
+}
+
+static void test_a_temperature_out_of_the_table_is_clamped() {
+    uint8_t low[LIGHT_CHANNELS];
+    uint8_t high[LIGHT_CHANNELS];
+    uint8_t color[LIGHT_CHANNELS];
+
+    colorFromKelvin(COLOR_KELVIN_MIN, 255, low);
+    colorFromKelvin(COLOR_KELVIN_MAX, 255, high);
+
+    colorFromKelvin(0, 255, color);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(low, color, LIGHT_CHANNELS);
+    colorFromKelvin(65535, 255, color);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(high, color, LIGHT_CHANNELS);
+}
+
+static void test_the_brightness_scales_the_temperature() {
+    uint8_t color[LIGHT_CHANNELS];
+
+    colorFromKelvin(6500, 127, color);
+    assertColor(127, 124, 126, color);
+    colorFromKelvin(6500, 0, color);
+    assertColor(0, 0, 0, color);
+}
+
+static void test_the_primary_hues() {
+    uint8_t color[LIGHT_CHANNELS];
+
+    colorFromHsv(0, 255, 255, color);
+    assertColor(255, 0, 0, color);
+    colorFromHsv(120, 255, 255, color);
+    assertColor(0, 255, 0, color);
+    colorFromHsv(240, 255, 255, color);
+    assertColor(0, 0, 255, color);
+    colorFromHsv(60, 255, 255, color);
+    assertColor(255, 255, 0, color);
+}
+
+static void test_a_hue_wraps_around_the_circle() {
+    uint8_t first[LIGHT_CHANNELS];
+    uint8_t color[LIGHT_CHANNELS];
+
+    colorFromHsv(30, 255, 255, first);
+    colorFromHsv(390, 255, 255, color);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(first, color, LIGHT_CHANNELS);
+}
+
+static void test_no_saturation_is_a_gray_of_the_value() {
+    uint8_t color[LIGHT_CHANNELS];
+
+    for (uint16_t hue = 0 ; hue <= COLOR_HUE_MAX ; hue += 45) {
+        colorFromHsv(hue, 0, 100, color);
+        assertColor(100, 100, 100, color);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_the_levels_span_the_linear_range_in_order);
+    RUN_TEST(test_the_balance_scales_the_linear_light);
+    RUN_TEST(test_the_duty_goes_from_off_to_full_on);
+    RUN_TEST(test_a_table_temperature_is_its_entry);
+    RUN_TEST(test_a_temperature_between_entries_is_interpolated);
+    RUN_TEST(test_a_temperature_out_of_the_table_is_clamped);
+    RUN_TEST(test_the_brightness_scales_the_temperature);
+    RUN_TEST(test_the_primary_hues);
+    RUN_TEST(test_a_hue_wraps_around_the_circle);
+    RUN_TEST(test_no_saturation_is_a_gray_of_the_value);
+    return UNITY_END();
+}
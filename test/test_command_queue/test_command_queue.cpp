@@ -0,0 +1,130 @@
+#include <unity.h>
+#include "CommandQueue.h"
+
+#define RING_SIZE 4
+
+static SpscRing<uint32_t, RING_SIZE> ring;
+
+static void drain() {
+    uint32_t item;
+
+    while (true == ring.pop(item)) {
+    }
+}
+
+void setUp() {
+    ring.discard();
+    drain();
+}
+
+void tearDown() {
+}
+
+static void test_pushed_items_pop_in_order() {
+    uint32_t item = 0;
+
+    TEST_ASSERT_FALSE(ring.pop(item));
+    TEST_ASSERT_TRUE(ring.push(1));
+    TEST_ASSERT_TRUE(ring.push(2));
+    TEST_ASSERT_EQUAL_UINT32(2, ring.size());
+
+    TEST_ASSERT_TRUE(ring.pop(item));
+    TEST_ASSERT_EQUAL_UINT32(1, item);
+    TEST_ASSERT_TRUE(ring.pop(item));
+    TEST_ASSERT_EQUAL_UINT32(2, item);
+    TEST_ASSERT_FALSE(ring.pop(item));
+}
+
+static void test_a_full_ring_refuses_until_popped() {
+    uint32_t item;
+
+    for (uint32_t i = 0 ; i < RING_SIZE ; i++) {
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+
+    TEST_ASSERT_FALSE(ring.push(RING_SIZE));
+    TEST_ASSERT_EQUAL_UINT32(RING_SIZE, ring.size());
+
+    TEST_ASSERT_TRUE(ring.pop(item));
+    TEST_ASSERT_EQUAL_UINT32(0, item);
+    TEST_ASSERT_TRUE(ring.push(RING_SIZE));
+}
+
+// The indexes keep counting past the size, the slots wrap around
+static void test_the_ring_wraps_around() {
+    uint32_t item;
+
+    for (uint32_t i = 0 ; i < RING_SIZE * 3 ; i++) {
+        TEST_ASSERT_TRUE(ring.push(i));
+        TEST_ASSERT_TRUE(ring.pop(item));
+        TEST_ASSERT_EQUAL_UINT32(i, item);
+    }
+}
+
+static void test_staged_items_are_seen_once_published() {
+    uint32_t item;
+
+    TEST_ASSERT_TRUE(ring.stage(1));
+    TEST_ASSERT_TRUE(ring.stage(2));
+    TEST_ASSERT_EQUAL_UINT32(0, ring.size());
+    TEST_ASSERT_FALSE(ring.pop(item));
+
+    ring.publish();
+
+    TEST_ASSERT_EQUAL_UINT32(2, ring.size());
+    TEST_ASSERT_TRUE(ring.pop(item));
+    TEST_ASSERT_EQUAL_UINT32(1, item);
+    TEST_ASSERT_TRUE(ring.pop(item));
+    TEST_ASSERT_EQUAL_UINT32(2, item);
+}
+
+// A batch that does not fit is rolled back whole, the items before it stay
+static void test_a_discarded_batch_leaves_no_item() {
+    uint32_t item;
+
+    TEST_ASSERT_TRUE(ring.push(1));
+
+    for (uint32_t i = 0 ; i < RING_SIZE - 1 ; i++) {
+        TEST_ASSERT_TRUE(ring.stage(10 + i));
+    }
+
+    TEST_ASSERT_FALSE(ring.stage(20));
+    ring.discard();
+
+    TEST_ASSERT_EQUAL_UINT32(1, ring.size());
+    TEST_ASSERT_TRUE(ring.push(2));
+    TEST_ASSERT_TRUE(ring.pop(item));
+    TEST_ASSERT_EQUAL_UINT32(1, item);
+    TEST_ASSERT_TRUE(ring.pop(item));
+    TEST_ASSERT_EQUAL_UINT32(2, item);
+    TEST_ASSERT_FALSE(ring.pop(item));
+}
+
+static void test_the_mpsc_ring_keeps_the_order_of_one_producer() {
+    MpscRing<uint32_t, RING_SIZE> mpsc;
+    uint32_t item;
+
+    for (uint32_t i = 0 ; i < RING_SIZE ; i++) {
+        TEST_ASSERT_TRUE(mpsc.push(i));
+    }
+
+    TEST_ASSERT_FALSE(mpsc.push(RING_SIZE));
+
+    for (uint32_t i = 0 ; i < RING_SIZE ; i++) {
+        TEST_ASSERT_TRUE(mpsc.pop(item));
+        TEST_ASSERT_EQUAL_UINT32(i, item);
+    }
+
+    TEST_ASSERT_FALSE(mpsc.pop(item));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_pushed_items_pop_in_order);
+    RUN_TEST(test_a_full_ring_refuses_until_popped);
+    RUN_TEST(test_the_ring_wraps_around);
+    RUN_TEST(test_staged_items_are_seen_once_published);
+    RUN_TEST(test_a_discarded_batch_leaves_no_item);
+    RUN_TEST(test_the_mpsc_ring_keeps_the_order_of_one_producer);
+    return UNITY_END();
+}
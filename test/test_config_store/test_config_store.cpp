@@ -0,0 +1,94 @@
+#include <stddef.h>
+#include <unity.h>
+#include "ConfigStore.h"
+#include "HalFake.h"
+
+// Slots are written in turn from configA, see src/ConfigStore.cpp
+#define SLOT_A "configA"
+#define SLOT_B "configB"
+
+static Config named(const char *ssid) {
+    Config config;
+
+    strlcpy(config.wifiSsid, ssid, sizeof(config.wifiSsid));
+    strlcpy(config.uuid, "1234", sizeof(config.uuid));
+
+    return config;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+static void test_an_empty_store_loads_nothing() {
+    Config config;
+
+    TEST_ASSERT_FALSE(configStoreLoad(config));
+}
+
+static void test_saves_alternate_slots_and_the_newest_is_loaded() {
+    Config first = named("first");
+    Config second = named("second");
+    Config loaded;
+
+    TEST_ASSERT_TRUE(configStoreSave(first));
+    TEST_ASSERT_TRUE(configStoreSave(second));
+    TEST_ASSERT_TRUE(configStoreLoad(loaded));
+    TEST_ASSERT_EQUAL_STRING("second", loaded.wifiSsid);
+    TEST_ASSERT_EQUAL_MEMORY(&second, &loaded, sizeof(Config));
+}
+
+// The newest record is in configB, a torn write of it falls back to configA
+static void test_a_corrupted_newest_slot_falls_back_to_the_other_one() {
+    Config loaded;
+
+    halFakeStoreCorrupt(SLOT_B, offsetof(ConfigRecord, config) + 3);
+
+    TEST_ASSERT_TRUE(configStoreLoad(loaded));
+    TEST_ASSERT_EQUAL_STRING("first", loaded.wifiSsid);
+}
+
+// The next save goes to the slot not holding the loaded record, and wins by its sequence
+static void test_a_save_after_the_fallback_overwrites_the_bad_slot() {
+    Config third = named("third");
+    Config loaded;
+
+    TEST_ASSERT_TRUE(configStoreSave(third));
+    TEST_ASSERT_TRUE(configStoreLoad(loaded));
+    TEST_ASSERT_EQUAL_STRING("third", loaded.wifiSsid);
+
+    halFakeStoreCorrupt(SLOT_A, offsetof(ConfigRecord, sequence));
+    TEST_ASSERT_TRUE(configStoreLoad(loaded));
+    TEST_ASSERT_EQUAL_STRING("third", loaded.wifiSsid);
+}
+
+static void test_both_slots_corrupted_load_nothing() {
+    Config loaded;
+
+    halFakeStoreCorrupt(SLOT_B, offsetof(ConfigRecord, crc));
+
+    TEST_ASSERT_FALSE(configStoreLoad(loaded));
+}
+
+static void test_a_save_without_uuid_gets_one() {
+    Config config;
+    Config loaded;
+
+    TEST_ASSERT_TRUE(configStoreSave(config));
+    TEST_ASSERT_TRUE(strlen(config.uuid) > 0);
+    TEST_ASSERT_TRUE(configStoreLoad(loaded));
+    TEST_ASSERT_EQUAL_STRING(config.uuid, loaded.uuid);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_an_empty_store_loads_nothing);
+    RUN_TEST(test_saves_alternate_slots_and_the_newest_is_loaded);
+    RUN_TEST(test_a_corrupted_newest_slot_falls_back_to_the_other_one);
+    RUN_TEST(test_a_save_after_the_fallback_overwrites_the_bad_slot);
+    RUN_TEST(test_both_slots_corrupted_load_nothing);
+    RUN_TEST(test_a_save_without_uuid_gets_one);
+    return UNITY_END();
+}
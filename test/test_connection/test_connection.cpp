@@ -0,0 +1,104 @@
+#include <unity.h>
+#include "ConnectionManager.h"
+#include "HalFake.h"
+
+static bool mqttConnect() {
+    return true;
+}
+
+static bool mqttConnected() {
+    return true;
+}
+
+static const ConnectionHandlers handlers = { mqttConnect, mqttConnected };
+
+// Until both connections are up, false past a minute
+static bool connect() {
+    uint32_t start = halMillis();
+
+    while (connectionLoop() != CONNECTION_READY) {
+        if (halMillis() - start > 60000) {
+            return false;
+        }
+
+        halFakeAdvance(10000);
+    }
+
+    return true;
+}
+
+static void boot(bool powerLoss) {
+    halFakeReboot(powerLoss);
+    connectionBegin("ssid", "password", "broker", handlers);
+    TEST_ASSERT_TRUE(connect());
+}
+
+// Up for a while, the loop only runs when it asked to
+static void run(uint32_t seconds) {
+    for (uint32_t i = 0 ; i < seconds ; i++) {
+        halFakeAdvance(1000000);
+
+        if (connectionIdleMs() <= 1000) {
+            connectionLoop();
+        }
+    }
+}
+
+void setUp() {
+    boot(true);
+}
+
+void tearDown() {
+    connectionStop();
+}
+
+static void test_a_cold_boot_asks_dhcp() {
+    TEST_ASSERT_FALSE(halFakeWifiStatic());
+}
+
+static void test_a_restart_reuses_the_address_of_a_valid_lease() {
+    run(60);
+    boot(false);
+
+    TEST_ASSERT_TRUE(halFakeWifiStatic());
+    TEST_ASSERT_TRUE(connectionIdleMs() <= (HAL_FAKE_WIFI_LEASE_S / 2 - 60) * 1000u);
+}
+
+static void test_a_restart_past_half_the_lease_asks_dhcp() {
+    run(HAL_FAKE_WIFI_LEASE_S / 2);
+    boot(false);
+
+    TEST_ASSERT_FALSE(halFakeWifiStatic());
+}
+
+static void test_a_reused_address_goes_back_to_dhcp_at_half_its_lease() {
+    run(60);
+    boot(false);
+    TEST_ASSERT_TRUE(halFakeWifiStatic());
+
+    run(HAL_FAKE_WIFI_LEASE_S / 2 - 60);
+    TEST_ASSERT_FALSE(halFakeWifiStatic());
+    TEST_ASSERT_TRUE(connect());
+
+    // The lease of its own is reused by the next restart
+    boot(false);
+    TEST_ASSERT_TRUE(halFakeWifiStatic());
+}
+
+static void test_a_power_loss_forgets_the_address() {
+    boot(false);
+    TEST_ASSERT_TRUE(halFakeWifiStatic());
+
+    boot(true);
+    TEST_ASSERT_FALSE(halFakeWifiStatic());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_a_cold_boot_asks_dhcp);
+    RUN_TEST(test_a_restart_reuses_the_address_of_a_valid_lease);
+    RUN_TEST(test_a_restart_past_half_the_lease_asks_dhcp);
+    RUN_TEST(test_a_reused_address_goes_back_to_dhcp_at_half_its_lease);
+    RUN_TEST(test_a_power_loss_forgets_the_address);
+    return UNITY_END();
+}
@@ -0,0 +1,177 @@
+#include <string.h>
+#include <unity.h>
+#include "HalFake.h"
+#include "MqttOutbox.h"
+
+static const char *replyTopic = "strip/reply";
+static const char *stateTopic = "strip/state";
+
+static MqttOutboxStats before;
+
+static bool push(const char *topic, const char *payload, OutboxPolicy policy) {
+    return mqttOutboxPush(topic, (const uint8_t *) payload, strlen(payload), OUTBOX_LATEST == policy, policy);
+}
+
+// Loop passes until the queue is empty or waits for a retry
+static uint32_t drain() {
+    uint32_t waitMs;
+
+    while ((waitMs = mqttOutboxLoop()) == 0) {
+    }
+
+    return waitMs;
+}
+
+static void advanceMs(uint32_t ms) {
+    halFakeAdvance(ms * 1000);
+}
+
+void setUp() {
+    halFakeMqttFail(0);
+    drain();
+    halFakeMqttReset();
+    before = mqttOutboxStats();
+}
+
+void tearDown() {
+}
+
+static void test_messages_are_written_in_order() {
+    TEST_ASSERT_TRUE(push(replyTopic, "one", OUTBOX_DROP_NEWEST));
+    TEST_ASSERT_TRUE(push(replyTopic, "two", OUTBOX_DROP_NEWEST));
+    TEST_ASSERT_EQUAL_UINT32(0, halFakeMqttStats().published);
+
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, mqttOutboxLoop());
+    TEST_ASSERT_EQUAL_UINT32(2, halFakeMqttStats().published);
+    TEST_ASSERT_EQUAL_STRING("two", halFakeMqttStats().lastPayload.c_str());
+    TEST_ASSERT_EQUAL_UINT32(before.batches + 1, mqttOutboxStats().batches);
+}
+
+// A full batch leaves the rest for the next pass
+static void test_a_full_batch_asks_for_another_pass() {
+    for (int i = 0 ; i < MQTT_OUTBOX_BATCH_MAX + 1 ; i++) {
+        TEST_ASSERT_TRUE(push(replyTopic, "reply", OUTBOX_DROP_NEWEST));
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(0, mqttOutboxLoop());
+    TEST_ASSERT_EQUAL_UINT32(1, mqttOutboxStats().depth);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, mqttOutboxLoop());
+}
+
+// The retry delay doubles, the messages behind the failed one wait for it
+static void test_a_failed_publish_is_retried_later() {
+    halFakeMqttFail(2);
+
+    TEST_ASSERT_TRUE(push(replyTopic, "first", OUTBOX_DROP_NEWEST));
+    TEST_ASSERT_TRUE(push(replyTopic, "second", OUTBOX_DROP_NEWEST));
+
+    TEST_ASSERT_EQUAL_UINT32(MQTT_OUTBOX_RETRY_MS, mqttOutboxLoop());
+    advanceMs(MQTT_OUTBOX_RETRY_MS - 1);
+    TEST_ASSERT_EQUAL_UINT32(1, mqttOutboxLoop());
+    advanceMs(1);
+    TEST_ASSERT_EQUAL_UINT32(MQTT_OUTBOX_RETRY_MS * 2, mqttOutboxLoop());
+    advanceMs(MQTT_OUTBOX_RETRY_MS * 2);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, mqttOutboxLoop());
+
+    TEST_ASSERT_EQUAL_UINT32(2, halFakeMqttStats().published);
+    TEST_ASSERT_EQUAL_STRING("second", halFakeMqttStats().lastPayload.c_str());
+    TEST_ASSERT_EQUAL_UINT32(before.retries + 2, mqttOutboxStats().retries);
+}
+
+static void test_a_message_still_failing_is_dropped() {
+    halFakeMqttFail(MQTT_OUTBOX_RETRIES + 1);
+
+    TEST_ASSERT_TRUE(push(replyTopic, "lost", OUTBOX_DROP_NEWEST));
+    TEST_ASSERT_TRUE(push(replyTopic, "next", OUTBOX_DROP_NEWEST));
+
+    for (int i = 0 ; i < MQTT_OUTBOX_RETRIES ; i++) {
+        advanceMs(drain());
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, drain());
+    TEST_ASSERT_EQUAL_UINT32(before.failed + 1, mqttOutboxStats().failed);
+    TEST_ASSERT_EQUAL_UINT32(1, halFakeMqttStats().published);
+    TEST_ASSERT_EQUAL_STRING("next", halFakeMqttStats().lastPayload.c_str());
+}
+
+static void test_a_message_queued_too_long_expires() {
+    TEST_ASSERT_TRUE(push(replyTopic, "stale", OUTBOX_DROP_NEWEST));
+    advanceMs(MQTT_OUTBOX_EXPIRE_MS);
+    TEST_ASSERT_TRUE(push(replyTopic, "fresh", OUTBOX_DROP_NEWEST));
+
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, mqttOutboxLoop());
+    TEST_ASSERT_EQUAL_UINT32(before.expired + 1, mqttOutboxStats().expired);
+    TEST_ASSERT_EQUAL_UINT32(1, halFakeMqttStats().published);
+    TEST_ASSERT_EQUAL_STRING("fresh", halFakeMqttStats().lastPayload.c_str());
+}
+
+// The state replaces the queued one in place, the replies around it keep their order
+static void test_a_latest_message_replaces_the_queued_one() {
+    TEST_ASSERT_TRUE(push(stateTopic, "off", OUTBOX_LATEST));
+    TEST_ASSERT_TRUE(push(replyTopic, "reply", OUTBOX_DROP_NEWEST));
+    TEST_ASSERT_TRUE(push(stateTopic, "on", OUTBOX_LATEST));
+
+    TEST_ASSERT_EQUAL_UINT32(2, mqttOutboxStats().depth);
+    TEST_ASSERT_EQUAL_UINT32(before.replaced + 1, mqttOutboxStats().replaced);
+
+    mqttOutboxLoop();
+
+    TEST_ASSERT_EQUAL_UINT32(2, halFakeMqttStats().published);
+    TEST_ASSERT_EQUAL_UINT32(1, halFakeMqttStats().retained);
+    TEST_ASSERT_EQUAL_STRING("reply", halFakeMqttStats().lastPayload.c_str());
+}
+
+// The replacement is written at once, without the retries left by the message it replaces
+static void test_a_replaced_message_starts_its_retries_over() {
+    halFakeMqttFail(MQTT_OUTBOX_RETRIES);
+
+    TEST_ASSERT_TRUE(push(stateTopic, "off", OUTBOX_LATEST));
+
+    for (int i = 0 ; i < MQTT_OUTBOX_RETRIES ; i++) {
+        advanceMs(mqttOutboxLoop());
+    }
+
+    TEST_ASSERT_TRUE(push(stateTopic, "on", OUTBOX_LATEST));
+    halFakeMqttFail(1);
+
+    TEST_ASSERT_EQUAL_UINT32(MQTT_OUTBOX_RETRY_MS, mqttOutboxLoop());
+    advanceMs(MQTT_OUTBOX_RETRY_MS);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, mqttOutboxLoop());
+
+    TEST_ASSERT_EQUAL_UINT32(before.failed, mqttOutboxStats().failed);
+    TEST_ASSERT_EQUAL_UINT32(1, halFakeMqttStats().published);
+    TEST_ASSERT_EQUAL_STRING("on", halFakeMqttStats().lastPayload.c_str());
+}
+
+// A full queue drops a reply but makes room for the state
+static void test_a_full_queue_drops_replies_and_keeps_the_state() {
+    for (int i = 0 ; i < MQTT_OUTBOX_SIZE ; i++) {
+        TEST_ASSERT_TRUE(push(replyTopic, "reply", OUTBOX_DROP_NEWEST));
+    }
+
+    TEST_ASSERT_TRUE(mqttOutboxBusy());
+    TEST_ASSERT_FALSE(push(replyTopic, "dropped", OUTBOX_DROP_NEWEST));
+    TEST_ASSERT_TRUE(push(stateTopic, "on", OUTBOX_LATEST));
+
+    TEST_ASSERT_EQUAL_UINT32(MQTT_OUTBOX_SIZE, mqttOutboxStats().depth);
+    TEST_ASSERT_EQUAL_UINT32(before.dropped + 2, mqttOutboxStats().dropped);
+
+    drain();
+
+    TEST_ASSERT_EQUAL_UINT32(MQTT_OUTBOX_SIZE, halFakeMqttStats().published);
+    TEST_ASSERT_EQUAL_STRING(stateTopic, halFakeMqttStats().lastTopic.c_str());
+    TEST_ASSERT_FALSE(mqttOutboxBusy());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_messages_are_written_in_order);
+    RUN_TEST(test_a_full_batch_asks_for_another_pass);
+    RUN_TEST(test_a_failed_publish_is_retried_later);
+    RUN_TEST(test_a_message_still_failing_is_dropped);
+    RUN_TEST(test_a_message_queued_too_long_expires);
+    RUN_TEST(test_a_latest_message_replaces_the_queued_one);
+    RUN_TEST(test_a_replaced_message_starts_its_retries_over);
+    RUN_TEST(test_a_full_queue_drops_replies_and_keeps_the_state);
+    return UNITY_END();
+}
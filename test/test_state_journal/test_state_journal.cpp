@@ -0,0 +1,103 @@
+#include <stddef.h>
+#include <unity.h>
+#include "Config.h"
+#include "HalFake.h"
+#include "StateJournal.h"
+
+static Config config;
+
+static void assertColor(uint8_t red, uint8_t green, uint8_t blue) {
+    uint8_t color[LIGHT_CHANNELS];
+
+    lightOutputTarget(0, color);
+    TEST_ASSERT_EQUAL_UINT8(red, color[0]);
+    TEST_ASSERT_EQUAL_UINT8(green, color[1]);
+    TEST_ASSERT_EQUAL_UINT8(blue, color[2]);
+}
+
+// Power cut and boot, the light output comes back dark before the journal is read
+static bool restore() {
+    halFakeReboot(true);
+    lightOutputBegin(config.zones, config.pixels);
+    lightOutputSet(lightOutputZoneMask(), 0, 0, 0, 0);
+    renderLoopTick();
+
+    return stateJournalBegin();
+}
+
+static void setColor(uint8_t red, uint8_t green, uint8_t blue) {
+    TEST_ASSERT_TRUE(lightOutputSet(1, red, green, blue, 0));
+    renderLoopTick();
+    stateJournalFlush();
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+static void test_an_empty_journal_restores_nothing() {
+    TEST_ASSERT_FALSE(restore());
+    assertColor(0, 0, 0);
+}
+
+static void test_the_newest_record_is_restored() {
+    setColor(10, 20, 30);
+    setColor(40, 50, 60);
+
+    TEST_ASSERT_TRUE(restore());
+    assertColor(40, 50, 60);
+}
+
+static void test_a_quiet_change_is_written_by_the_loop() {
+    TEST_ASSERT_TRUE(lightOutputSet(1, 1, 2, 3, 0));
+    renderLoopTick();
+
+    TEST_ASSERT_EQUAL_UINT32(STATE_JOURNAL_QUIET_MS, stateJournalLoop());
+    halFakeAdvance(STATE_JOURNAL_QUIET_MS * 1000);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, stateJournalLoop());
+
+    TEST_ASSERT_TRUE(restore());
+    assertColor(1, 2, 3);
+}
+
+// Three records after the restores above : (10 20 30), (40 50 60), (1 2 3), then this one
+static void test_a_torn_record_falls_back_to_the_one_before() {
+    uint32_t writes = stateJournalStats().writes;
+
+    setColor(70, 80, 90);
+    TEST_ASSERT_EQUAL_UINT32(writes + 1, stateJournalStats().writes);
+
+    halFakeJournalCorrupt(3 * sizeof(JournalRecord) + offsetof(JournalRecord, zones) + 1);
+
+    TEST_ASSERT_TRUE(restore());
+    assertColor(1, 2, 3);
+}
+
+// The torn slot is not written again, the next record goes after it and wins
+static void test_a_write_after_a_torn_record_is_restored() {
+    setColor(5, 6, 7);
+
+    TEST_ASSERT_TRUE(restore());
+    assertColor(5, 6, 7);
+}
+
+static void test_an_unchanged_state_is_not_written() {
+    uint32_t writes = stateJournalStats().writes;
+
+    setColor(5, 6, 7);
+
+    TEST_ASSERT_EQUAL_UINT32(writes, stateJournalStats().writes);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_an_empty_journal_restores_nothing);
+    RUN_TEST(test_the_newest_record_is_restored);
+    RUN_TEST(test_a_quiet_change_is_written_by_the_loop);
+    RUN_TEST(test_a_torn_record_falls_back_to_the_one_before);
+    RUN_TEST(test_a_write_after_a_torn_record_is_restored);
+    RUN_TEST(test_an_unchanged_state_is_not_written);
+    return UNITY_END();
+}
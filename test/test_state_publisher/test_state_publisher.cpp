@@ -0,0 +1,114 @@
+#include <string.h>
+#include <string>
+#include <unity.h>
+#include "HalFake.h"
+#include "LightOutput.h"
+#include "MqttOutbox.h"
+#include "StatePublisher.h"
+
+// Five RGB zones and the strip, the state of every zone running an effect is over 600 bytes
+static const LightZoneConfig zones[LIGHT_ZONES_MAX] = {
+    { 3, { 1, 2, 3, -1 }, { 255, 255, 255, 255 } },
+    { 3, { 4, 5, 6, -1 }, { 255, 255, 255, 255 } },
+    { 3, { 7, 8, 9, -1 }, { 255, 255, 255, 255 } },
+    { 3, { 10, 11, 12, -1 }, { 255, 255, 255, 255 } },
+    { 3, { 13, 14, 15, -1 }, { 255, 255, 255, 255 } }
+};
+
+static const PixelStripConfig pixels = { 16, 30, 3 };
+
+static const char *stateTopic = "strip/state";
+
+static size_t count(const std::string &text, const char *pattern) {
+    size_t found = 0;
+
+    for (size_t at = text.find(pattern) ; at != std::string::npos ; at = text.find(pattern, at + 1)) {
+        found++;
+    }
+
+    return found;
+}
+
+// Past the debounce, then the outbox writes what was queued
+static void settle() {
+    renderLoopTick();
+    statePublisherLoop();
+    halFakeAdvance(STATE_DEBOUNCE_MS * 1000);
+    statePublisherLoop();
+    mqttOutboxLoop();
+}
+
+void setUp() {
+    halFakeMqttFail(0);
+    halFakeMqttReset();
+}
+
+void tearDown() {
+}
+
+static void test_every_zone_is_in_the_state() {
+    const uint8_t color[LIGHT_CHANNELS] = { 255, 10, 0 };
+    uint32_t published = statePublisherStats().published;
+
+    TEST_ASSERT_EQUAL_UINT8(LIGHT_ZONES_MAX, lightOutputZoneCount());
+    TEST_ASSERT_TRUE(lightOutputStartEffect(lightOutputZoneMask(), EFFECT_BREATHE, color, 4000));
+
+    settle();
+
+    const std::string &payload = halFakeMqttStats().lastPayload;
+
+    TEST_ASSERT_EQUAL_UINT32(published + 1, statePublisherStats().published);
+    TEST_ASSERT_EQUAL_STRING(stateTopic, halFakeMqttStats().lastTopic.c_str());
+    TEST_ASSERT_EQUAL_UINT32(1, halFakeMqttStats().retained);
+    TEST_ASSERT_TRUE(payload.size() > MQTT_OUTBOX_PAYLOAD_MAX);
+    TEST_ASSERT_EQUAL_UINT32(LIGHT_ZONES_MAX, count(payload, "\"effect\":\"breathe\""));
+    TEST_ASSERT_EQUAL_STRING("]}", payload.substr(payload.size() - 2).c_str());
+    TEST_ASSERT_EQUAL_UINT32(0, mqttOutboxStats().dropped);
+}
+
+// A large state waiting for a retry is replaced by the next one, the broker gets the latest
+static void test_a_waiting_large_state_is_replaced_by_the_latest() {
+    halFakeMqttFail(1);
+
+    TEST_ASSERT_TRUE(lightOutputStopEffect(lightOutputZoneMask(), 0));
+    settle();
+    TEST_ASSERT_EQUAL_UINT32(0, halFakeMqttStats().published);
+
+    TEST_ASSERT_TRUE(lightOutputSet(1, 1, 2, 3, 0));
+    settle();
+    halFakeAdvance(MQTT_OUTBOX_RETRY_MS * 1000);
+    mqttOutboxLoop();
+
+    const std::string &payload = halFakeMqttStats().lastPayload;
+    const char *first = "{\"on\":true,\"zones\":[{\"red\":1,\"green\":2,\"blue\":3,";
+
+    TEST_ASSERT_EQUAL_UINT32(1, halFakeMqttStats().published);
+    TEST_ASSERT_EQUAL_UINT32(0, count(payload, "breathe"));
+    TEST_ASSERT_EQUAL_STRING(first, payload.substr(0, strlen(first)).c_str());
+}
+
+// One zone fits in an outbox entry, it is copied there
+static void test_a_small_state_is_queued_whole() {
+    const LightZoneConfig single[LIGHT_ZONES_MAX] = { { 3, { 1, 2, 3, -1 }, { 255, 255, 255, 255 } } };
+    const PixelStripConfig none = { -1, 0, 3 };
+
+    lightOutputBegin(single, none);
+    TEST_ASSERT_TRUE(lightOutputSet(1, 9, 9, 9, 0));
+    settle();
+
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"on\":true,\"zones\":[{\"red\":9,\"green\":9,\"blue\":9,\"effect\":\"none\",\"period\":0,\"transition\":0}]}",
+        halFakeMqttStats().lastPayload.c_str()
+    );
+}
+
+int main() {
+    lightOutputBegin(zones, pixels);
+    statePublisherBegin("strip");
+
+    UNITY_BEGIN();
+    RUN_TEST(test_every_zone_is_in_the_state);
+    RUN_TEST(test_a_waiting_large_state_is_replaced_by_the_latest);
+    RUN_TEST(test_a_small_state_is_queued_whole);
+    return UNITY_END();
+}
@@ -0,0 +1,103 @@
+#include <string.h>
+#include <string>
+#include <unity.h>
+#include "TemplateRenderer.h"
+
+#define VAR_NAME 0
+#define VAR_EMPTY 1
+
+static const TemplateSegment segments[] = {
+    { "<p>", 3, TPL_VAR_NONE },
+    { nullptr, 0, VAR_NAME },
+    { "</p><i>", 7, TPL_VAR_NONE },
+    { nullptr, 0, VAR_EMPTY },
+    { "</i>", 4, TPL_VAR_NONE }
+};
+
+static const Template page = { segments, sizeof(segments) / sizeof(segments[0]) };
+
+static const char *name = "";
+
+static size_t value(uint8_t var, char *buffer, size_t size) {
+    return templateCopy(buffer, size, VAR_NAME == var ? name : "");
+}
+
+// The page as the web server sends it, chunk after chunk from the index reached
+static std::string render(size_t chunk) {
+    std::string html;
+    uint8_t buffer[64];
+    size_t length;
+
+    while ((length = templateRender(page, value, html.size(), buffer, chunk)) > 0) {
+        html.append((const char *) buffer, length);
+    }
+
+    return html;
+}
+
+void setUp() {
+    name = "strip";
+}
+
+void tearDown() {
+}
+
+static void test_placeholders_are_replaced() {
+    TEST_ASSERT_EQUAL_STRING("<p>strip</p><i></i>", render(64).c_str());
+    TEST_ASSERT_EQUAL_UINT32(strlen("<p>strip</p><i></i>"), templateLength(page, value));
+}
+
+// Chunks end inside text segments and inside values, every split gives the same page
+static void test_every_chunk_size_renders_the_same_page() {
+    std::string whole = render(64);
+
+    for (size_t chunk = 1 ; chunk < whole.size() ; chunk++) {
+        TEST_ASSERT_EQUAL_STRING(whole.c_str(), render(chunk).c_str());
+    }
+}
+
+static void test_a_render_past_the_end_is_empty() {
+    uint8_t buffer[8];
+
+    TEST_ASSERT_EQUAL_UINT32(0, templateRender(page, value, templateLength(page, value), buffer, sizeof(buffer)));
+}
+
+static void test_values_are_html_escaped() {
+    const char *expected = "<p>&lt;b a=&quot;1&quot; b=&#39;2&#39;&gt;&amp;</p><i></i>";
+
+    name = "<b a=\"1\" b='2'>&";
+
+    TEST_ASSERT_EQUAL_STRING(expected, render(64).c_str());
+    TEST_ASSERT_EQUAL_UINT32(strlen(expected), templateLength(page, value));
+}
+
+// An entity is never cut in two by the end of a chunk
+static void test_escaped_values_split_over_chunks() {
+    std::string whole;
+
+    name = "&&&<>";
+    whole = render(64);
+
+    for (size_t chunk = 1 ; chunk < whole.size() ; chunk++) {
+        TEST_ASSERT_EQUAL_STRING(whole.c_str(), render(chunk).c_str());
+    }
+}
+
+static void test_long_values_are_clamped() {
+    char buffer[TPL_VALUE_MAX + 1];
+    std::string longName(TPL_VALUE_MAX * 2, 'x');
+
+    TEST_ASSERT_EQUAL_UINT32(TPL_VALUE_MAX, templateCopy(buffer, sizeof(buffer), longName.c_str()));
+    TEST_ASSERT_EQUAL_UINT32(TPL_VALUE_MAX, strlen(buffer));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_placeholders_are_replaced);
+    RUN_TEST(test_every_chunk_size_renders_the_same_page);
+    RUN_TEST(test_a_render_past_the_end_is_empty);
+    RUN_TEST(test_values_are_html_escaped);
+    RUN_TEST(test_escaped_values_split_over_chunks);
+    RUN_TEST(test_long_values_are_clamped);
+    return UNITY_END();
+}
@@ -0,0 +1,167 @@
+#include <vector>
+#include <unity.h>
+#include "Config.h"
+#include "HalFake.h"
+#include "LightOutput.h"
+#include "WebControl.h"
+
+struct Ack {
+    uint32_t client;
+    uint8_t status;
+    uint16_t sequence;
+};
+
+static std::vector<Ack> acks;
+// Acks sent outside webControlLoop, from the websocket task on the device
+static uint32_t acksOutsideLoop = 0;
+static bool inLoop = false;
+
+static void reply(uint32_t client, const uint8_t *frame, size_t length) {
+    TEST_ASSERT_EQUAL_UINT32(BINARY_ACK_LENGTH, length);
+    acks.push_back({ client, frame[0], (uint16_t) (frame[1] << 8 | frame[2]) });
+    acksOutsideLoop += true == inLoop ? 0 : 1;
+}
+
+static void loop() {
+    inLoop = true;
+    webControlLoop();
+    inLoop = false;
+    renderLoopTick();
+}
+
+// A color asking for an ack
+static void send(uint32_t client, uint16_t sequence) {
+    BinaryColor color;
+    uint8_t frame[BINARY_COLOR_MAX_LENGTH];
+
+    color.flags = BINARY_FLAG_SEQUENCE | BINARY_FLAG_REPLY;
+    color.color[0] = 255;
+    color.sequence = sequence;
+
+    webControlReceive(client, frame, binaryColorEncode(color, frame));
+}
+
+static const Ack *findAck(uint32_t client, uint16_t sequence) {
+    for (const Ack &ack : acks) {
+        if (ack.client == client && ack.sequence == sequence) {
+            return &ack;
+        }
+    }
+
+    return nullptr;
+}
+
+void setUp() {
+    acks.clear();
+    acksOutsideLoop = 0;
+}
+
+// Past the rate of every client, and their slots freed
+void tearDown() {
+    for (uint32_t client = 1 ; client <= 20 ; client++) {
+        webControlDisconnect(client);
+    }
+
+    halFakeAdvance(1000000);
+    loop();
+}
+
+static void test_a_frame_is_applied_and_acknowledged() {
+    send(1, 7);
+    TEST_ASSERT_EQUAL_UINT32(0, acks.size());
+
+    loop();
+
+    TEST_ASSERT_EQUAL_UINT32(1, acks.size());
+    TEST_ASSERT_EQUAL_UINT8(BINARY_STATUS_OK, acks[0].status);
+    TEST_ASSERT_EQUAL_UINT16(7, acks[0].sequence);
+    TEST_ASSERT_EQUAL_UINT32(0, acksOutsideLoop);
+}
+
+static void test_a_malformed_frame_is_acknowledged_by_the_loop() {
+    const uint8_t frame[] = { BINARY_FLAG_REPLY, 1, 2 };
+
+    webControlReceive(1, frame, sizeof(frame));
+    TEST_ASSERT_EQUAL_UINT32(0, acks.size());
+
+    loop();
+
+    TEST_ASSERT_EQUAL_UINT32(1, acks.size());
+    TEST_ASSERT_EQUAL_UINT8(BINARY_STATUS_MALFORMED, acks[0].status);
+    TEST_ASSERT_EQUAL_UINT32(0, acksOutsideLoop);
+}
+
+static void test_a_frame_over_a_full_queue_is_refused_by_the_loop() {
+    uint32_t overflow = webControlStats().overflow;
+
+    for (uint16_t i = 1 ; i <= WEB_CONTROL_QUEUE_SIZE + 1 ; i++) {
+        send(1, i);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(overflow + 1, webControlStats().overflow);
+    TEST_ASSERT_EQUAL_UINT32(0, acks.size());
+
+    loop();
+
+    const Ack *refused = findAck(1, WEB_CONTROL_QUEUE_SIZE + 1);
+
+    TEST_ASSERT_NOT_NULL(refused);
+    TEST_ASSERT_EQUAL_UINT8(BINARY_STATUS_QUEUE_FULL, refused->status);
+    TEST_ASSERT_EQUAL_UINT32(0, acksOutsideLoop);
+}
+
+// The disconnect does not go through the full queue, the slot is free again for a new client
+static void test_a_disconnect_behind_a_full_queue_frees_the_slot() {
+    for (uint32_t client = 1 ; client <= WEB_CONTROL_CLIENTS_MAX ; client++) {
+        send(client, 1);
+    }
+
+    loop();
+
+    for (uint16_t i = 2 ; i <= WEB_CONTROL_QUEUE_SIZE + 2 ; i++) {
+        send(1, i);
+    }
+
+    webControlDisconnect(1);
+    loop();
+    acks.clear();
+
+    send(WEB_CONTROL_CLIENTS_MAX + 1, 1);
+    loop();
+
+    const Ack *ack = findAck(WEB_CONTROL_CLIENTS_MAX + 1, 1);
+
+    TEST_ASSERT_NOT_NULL(ack);
+    TEST_ASSERT_EQUAL_UINT8(BINARY_STATUS_OK, ack->status);
+    // Nothing left of the client that went away
+    TEST_ASSERT_NULL(findAck(1, WEB_CONTROL_QUEUE_SIZE + 2));
+}
+
+static void test_more_clients_than_slots_are_not_served() {
+    uint32_t overflow = webControlStats().overflow;
+
+    for (uint32_t client = 1 ; client <= WEB_CONTROL_CLIENTS_MAX + 1 ; client++) {
+        send(client, 1);
+    }
+
+    loop();
+
+    TEST_ASSERT_EQUAL_UINT32(WEB_CONTROL_CLIENTS_MAX, acks.size());
+    TEST_ASSERT_NULL(findAck(WEB_CONTROL_CLIENTS_MAX + 1, 1));
+    TEST_ASSERT_EQUAL_UINT32(overflow + 1, webControlStats().overflow);
+}
+
+int main() {
+    Config config;
+
+    lightOutputBegin(config.zones, config.pixels);
+    webControlBegin(nullptr, reply);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_a_frame_is_applied_and_acknowledged);
+    RUN_TEST(test_a_malformed_frame_is_acknowledged_by_the_loop);
+    RUN_TEST(test_a_frame_over_a_full_queue_is_refused_by_the_loop);
+    RUN_TEST(test_a_disconnect_behind_a_full_queue_frees_the_slot);
+    RUN_TEST(test_more_clients_than_slots_are_not_served);
+    return UNITY_END();
+}